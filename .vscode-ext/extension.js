@@ -0,0 +1,24 @@
+const vscode = require('vscode');
+const { LanguageClient } = require('vscode-languageclient/node');
+
+let client;
+
+function activate(context) {
+    const command = vscode.workspace.getConfiguration('ocn').get('serverPath', 'app');
+
+    client = new LanguageClient(
+        'ocn',
+        'OCN Language Server',
+        { command, args: ['--lsp'] },
+        { documentSelector: [{ scheme: 'file', language: 'ocn' }] }
+    );
+
+    context.subscriptions.push(client);
+    client.start();
+}
+
+function deactivate() {
+    return client ? client.stop() : undefined;
+}
+
+module.exports = { activate, deactivate };
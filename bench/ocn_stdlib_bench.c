@@ -0,0 +1,304 @@
+// Microbenchmarks for the reference counting runtime in ocn_stdlib.c.
+//
+// Build together with the runtime (the CMake target `runtime_bench` does this):
+//
+//   cc -O2 bench/ocn_stdlib_bench.c ocn_stdlib.c -o runtime_bench
+//
+// To measure a different allocator, link an object that defines __ocn_alloc and __ocn_free.
+// Compiling this file with -DOCN_BENCH_POOL_ALLOCATOR links in the size-class freelist
+// allocator below instead of calloc/free, which doubles as an example of that interface.
+//
+// Every workload reports its throughput (operations per second, measured without timers in the
+// hot loop) and the latency percentiles of single operations (measured in a separate pass).
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void *__sp_create(size_t size, void (*dtor)(void *));
+void *__sp_copy(void *ptr);
+void __sp_drop(void *ptr);
+void *__arr_create(size_t elementSize, size_t arraySize, void (*dtor)(void *));
+void *__arr_copy(void *ptr);
+void __arr_drop(void *ptr);
+
+#ifdef OCN_BENCH_POOL_ALLOCATOR
+// Size-class freelists carved out of large chunks that are never returned to the system.
+#define CLASS_GRANULARITY 16
+#define CLASS_COUNT		  512
+#define CHUNK_SIZE		  (1 << 20)
+
+typedef struct FreeCell {
+	struct FreeCell *next;
+} FreeCell;
+
+static FreeCell *s_FreeLists[CLASS_COUNT];
+static char *s_ChunkCursor;
+static char *s_ChunkEnd;
+
+void *__ocn_alloc(size_t size) {
+	size_t total = size + CLASS_GRANULARITY;
+	size_t sizeClass = (total + CLASS_GRANULARITY - 1) / CLASS_GRANULARITY;
+	if (sizeClass >= CLASS_COUNT) {
+		size_t *big = calloc(1, total);
+		if (!big)
+			return NULL;
+		big[0] = 0;
+		return (char *) big + CLASS_GRANULARITY;
+	}
+
+	size_t cellSize = sizeClass * CLASS_GRANULARITY;
+	char *cell;
+	if (s_FreeLists[sizeClass]) {
+		cell = (char *) s_FreeLists[sizeClass];
+		s_FreeLists[sizeClass] = s_FreeLists[sizeClass]->next;
+	} else {
+		if (!s_ChunkCursor || s_ChunkCursor + cellSize > s_ChunkEnd) {
+			s_ChunkCursor = malloc(CHUNK_SIZE);
+			if (!s_ChunkCursor)
+				return NULL;
+			s_ChunkEnd = s_ChunkCursor + CHUNK_SIZE;
+		}
+		cell = s_ChunkCursor;
+		s_ChunkCursor += cellSize;
+	}
+
+	memset(cell, 0, cellSize);
+	*(size_t *) cell = sizeClass;
+	return cell + CLASS_GRANULARITY;
+}
+
+void __ocn_free(void *ptr) {
+	char *cell = (char *) ptr - CLASS_GRANULARITY;
+	size_t sizeClass = *(size_t *) cell;
+	if (sizeClass == 0) {
+		free(cell);
+		return;
+	}
+
+	FreeCell *freeCell = (FreeCell *) cell;
+	freeCell->next = s_FreeLists[sizeClass];
+	s_FreeLists[sizeClass] = freeCell;
+}
+#endif
+
+static uint64_t nowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t s_RngState = 0x9E3779B97F4A7C15u;
+
+static uint64_t nextRandom(void) {
+	s_RngState ^= s_RngState << 13;
+	s_RngState ^= s_RngState >> 7;
+	s_RngState ^= s_RngState << 17;
+	return s_RngState;
+}
+
+static void noopDtor(void *ptr) {
+	(void) ptr;
+}
+
+// Keeps the optimizer from discarding the results of the measured operations.
+static volatile uintptr_t s_Sink;
+
+typedef struct {
+	const char *name;
+	size_t size;
+	size_t batch;
+	// Runs `rounds` rounds of the workload. When `samples` is not NULL, every single runtime
+	// call is timed and written to it; the function returns the number of runtime calls made.
+	size_t (*run)(size_t size, size_t batch, size_t rounds, uint32_t *samples);
+} Workload;
+
+#define TIMED(samples, count, stmt)                                                                \
+	do {                                                                                           \
+		if (samples) {                                                                             \
+			uint64_t start_ = nowNs();                                                             \
+			stmt;                                                                                  \
+			(samples)[(count)] = (uint32_t) (nowNs() - start_);                                    \
+		} else {                                                                                   \
+			stmt;                                                                                  \
+		}                                                                                          \
+		(count)++;                                                                                 \
+	} while (0)
+
+// Allocates and immediately releases a single object: the common case for temporaries.
+static size_t runCreateDrop(size_t size, size_t batch, size_t rounds, uint32_t *samples) {
+	size_t ops = 0;
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < batch; i++) {
+			void *ptr;
+			TIMED(samples, ops, ptr = __sp_create(size, NULL));
+			s_Sink = (uintptr_t) ptr;
+			TIMED(samples, ops, __sp_drop(ptr));
+		}
+	}
+	return ops;
+}
+
+static void **s_Slots;
+
+// Allocates a whole batch and releases it in reverse order: nested scopes and recursion.
+static size_t runBatchLifo(size_t size, size_t batch, size_t rounds, uint32_t *samples) {
+	size_t ops = 0;
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < batch; i++)
+			TIMED(samples, ops, s_Slots[i] = __sp_create(size, NULL));
+		for (size_t i = batch; i-- > 0;)
+			TIMED(samples, ops, __sp_drop(s_Slots[i]));
+	}
+	return ops;
+}
+
+// Allocates a whole batch and releases it in allocation order: queues and linked lists.
+static size_t runBatchFifo(size_t size, size_t batch, size_t rounds, uint32_t *samples) {
+	size_t ops = 0;
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < batch; i++)
+			TIMED(samples, ops, s_Slots[i] = __sp_create(size, NULL));
+		for (size_t i = 0; i < batch; i++)
+			TIMED(samples, ops, __sp_drop(s_Slots[i]));
+	}
+	return ops;
+}
+
+// Keeps `batch` objects alive and replaces a random one per step: long lived, fragmented heaps.
+static size_t runRandomReplace(size_t size, size_t batch, size_t rounds, uint32_t *samples) {
+	size_t ops = 0;
+	for (size_t i = 0; i < batch; i++)
+		s_Slots[i] = __sp_create(size, NULL);
+
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < batch; i++) {
+			size_t slot = nextRandom() % batch;
+			TIMED(samples, ops, __sp_drop(s_Slots[slot]));
+			TIMED(samples, ops, s_Slots[slot] = __sp_create(size, NULL));
+		}
+	}
+
+	for (size_t i = 0; i < batch; i++)
+		__sp_drop(s_Slots[i]);
+	return ops;
+}
+
+// Copies and drops a shared object without ever freeing it: pure reference count traffic.
+static size_t runCopyDrop(size_t size, size_t batch, size_t rounds, uint32_t *samples) {
+	size_t ops = 0;
+	void *ptr = __sp_create(size, NULL);
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < batch; i++) {
+			TIMED(samples, ops, s_Sink = (uintptr_t) __sp_copy(ptr));
+			TIMED(samples, ops, __sp_drop(ptr));
+		}
+	}
+	__sp_drop(ptr);
+	return ops;
+}
+
+// Allocates and releases arrays of `batch` elements of `size` bytes with a per-element destructor.
+static size_t runArrayCreateDrop(size_t size, size_t batch, size_t rounds, uint32_t *samples) {
+	size_t ops = 0;
+	for (size_t r = 0; r < rounds; r++) {
+		void *arr;
+		TIMED(samples, ops, arr = __arr_create(size, batch, noopDtor));
+		s_Sink = (uintptr_t) arr;
+		TIMED(samples, ops, __arr_drop(arr));
+	}
+	return ops;
+}
+
+// Copies and drops a shared array without ever freeing it.
+static size_t runArrayCopyDrop(size_t size, size_t batch, size_t rounds, uint32_t *samples) {
+	size_t ops = 0;
+	void *arr = __arr_create(size, batch, NULL);
+	for (size_t r = 0; r < rounds; r++) {
+		TIMED(samples, ops, s_Sink = (uintptr_t) __arr_copy(arr));
+		TIMED(samples, ops, __arr_drop(arr));
+	}
+	__arr_drop(arr);
+	return ops;
+}
+
+static int compareSamples(const void *lhs, const void *rhs) {
+	uint32_t a = *(const uint32_t *) lhs;
+	uint32_t b = *(const uint32_t *) rhs;
+	return (a > b) - (a < b);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t count, double p) {
+	size_t index = (size_t) (p * (double) (count - 1));
+	return sorted[index];
+}
+
+#define MAX_BATCH 4096
+
+int main(int argc, char **argv) {
+	// The number of rounds scales every workload; pass a smaller value for a quick smoke run.
+	size_t scale = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+	if (scale == 0)
+		scale = 1;
+
+	static const Workload workloads[] = {
+		{"sp create+drop", 16, 1024, runCreateDrop},
+		{"sp create+drop", 64, 1024, runCreateDrop},
+		{"sp create+drop", 256, 1024, runCreateDrop},
+		{"sp create+drop", 4096, 1024, runCreateDrop},
+		{"sp batch lifo", 16, MAX_BATCH, runBatchLifo},
+		{"sp batch lifo", 256, MAX_BATCH, runBatchLifo},
+		{"sp batch fifo", 16, MAX_BATCH, runBatchFifo},
+		{"sp batch fifo", 256, MAX_BATCH, runBatchFifo},
+		{"sp random replace", 16, MAX_BATCH, runRandomReplace},
+		{"sp random replace", 256, MAX_BATCH, runRandomReplace},
+		{"sp copy+drop", 16, 1024, runCopyDrop},
+		{"arr create+drop", 4, 16, runArrayCreateDrop},
+		{"arr create+drop", 4, 1024, runArrayCreateDrop},
+		{"arr create+drop", 16, MAX_BATCH, runArrayCreateDrop},
+		{"arr copy+drop", 4, 1024, runArrayCopyDrop},
+	};
+
+	s_Slots = calloc(MAX_BATCH, sizeof(void *));
+	if (!s_Slots)
+		return 1;
+
+	printf("%-18s %6s %6s %12s %8s %8s %8s %8s %8s\n", "workload", "size", "batch", "Mops/s",
+		   "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns");
+
+	for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+		const Workload *workload = &workloads[w];
+		// Array workloads do one create per round, so give them more rounds to be comparable.
+		size_t rounds = workload->run == runArrayCreateDrop || workload->run == runArrayCopyDrop
+								? scale * 1024
+								: scale;
+
+		// Warm up the allocator and caches, then measure throughput without timers.
+		workload->run(workload->size, workload->batch, rounds / 10 + 1, NULL);
+		uint64_t start = nowNs();
+		size_t ops = workload->run(workload->size, workload->batch, rounds, NULL);
+		uint64_t elapsed = nowNs() - start;
+
+		// Measure the latency distribution of single calls in a second pass.
+		size_t sampleRounds = rounds / 4 + 1;
+		uint32_t *samples = malloc(sizeof(uint32_t) * (ops / 4 + 4 * workload->batch + 4));
+		if (!samples)
+			return 1;
+		size_t sampleCount = workload->run(workload->size, workload->batch, sampleRounds, samples);
+		qsort(samples, sampleCount, sizeof(uint32_t), compareSamples);
+
+		printf("%-18s %6zu %6zu %12.2f %8u %8u %8u %8u %8u\n", workload->name, workload->size,
+			   workload->batch, (double) ops / ((double) elapsed / 1e3),
+			   percentile(samples, sampleCount, 0.50), percentile(samples, sampleCount, 0.90),
+			   percentile(samples, sampleCount, 0.99), percentile(samples, sampleCount, 0.999),
+			   samples[sampleCount - 1]);
+		free(samples);
+	}
+
+	free(s_Slots);
+	return 0;
+}
@@ -123,13 +123,29 @@ OCN_CHAR read_char() {
 	return res;
 }
 
+// Every heap cell of the runtime is obtained from and returned to this allocator interface.
+// The default implementations are weak symbols, so a custom allocator can be swapped in at link
+// time by linking an object that provides strong definitions of both functions:
+//
+//   void *__ocn_alloc(size_t size); // returns zeroed memory of at least size bytes, or NULL
+//   void __ocn_free(void *ptr);     // releases memory returned by __ocn_alloc
+__attribute__((weak)) void *__ocn_alloc(size_t size) {
+	return calloc(1, size);
+}
+
+__attribute__((weak)) void __ocn_free(void *ptr) {
+	free(ptr);
+}
+
+// Generated code drops values whose destructor it knows without calling into the runtime, so it
+// relies on the layout of both control blocks.
 typedef struct {
 	size_t refCount;
 	void (*dtor)(void *);
 } ControlBlock;
 
 void *__sp_create(size_t size, void (*dtor)(void *)) {
-	void *ptr = calloc(1, size + sizeof(ControlBlock));
+	void *ptr = __ocn_alloc(size + sizeof(ControlBlock));
 	ControlBlock *cbptr = (ControlBlock *) ptr;
 	cbptr->refCount = 1;
 	cbptr->dtor = dtor;
@@ -154,7 +170,7 @@ void __sp_drop(void *ptr) {
 	if (cbptr->refCount == 0) {
 		if (cbptr->dtor)
 			cbptr->dtor(ptr);
-		free(cbptr);
+		__ocn_free(cbptr);
 	}
 }
 
@@ -166,7 +182,7 @@ typedef struct {
 } ArrayControlBlock;
 
 void *__arr_create(size_t elementSize, size_t arraySize, void (*dtor)(void *)) {
-	void *ptr = calloc(1, sizeof(ArrayControlBlock) + (elementSize * arraySize));
+	void *ptr = __ocn_alloc(sizeof(ArrayControlBlock) + (elementSize * arraySize));
 	if (!ptr)
 		return NULL;
 
@@ -203,6 +219,6 @@ void __arr_drop(void *ptr) {
 			}
 		}
 
-		free(cbptr);
+		__ocn_free(cbptr);
 	}
 }
\ No newline at end of file
@@ -59,9 +59,17 @@ protected:
 	explicit Stmt(NodeKind kind);
 };
 
+/// The value of an expression that is known at compile time. Integers, characters, booleans and
+/// unit are stored as their scalar, structs as the values of their fields.
+struct ConstValue {
+	i32 scalar = 0;
+	Vec<ConstValue> fields;
+};
+
 struct Expr : Stmt {
 	Opt<Type> inferredType;
 	Opt<ValueCategory> valueCategory;
+	Opt<ConstValue> constValue;
 
 	void infer(Type type, ValueCategory category);
 	[[nodiscard]] bool isInferred() const;
@@ -213,11 +221,33 @@ struct VarDef : Stmt {
 using Param = Pair<U8String, Type>;
 using StructField = Pair<U8String, Type>;
 
+/// What a call of a function may do besides computing its result. The defaults assume that it
+/// may do anything, until the EffectAnalysisPass infers more.
+struct FuncEffects {
+	/// Reads memory the caller can see, e.g. through a pointer.
+	bool readsMemory = true;
+	/// Writes memory the caller can see or performs input or output.
+	bool writesMemory = true;
+	/// Allocates or copies and drops reference counted values, which may free memory.
+	bool touchesHeap = true;
+	bool mayPanic = true;
+	/// May loop or recurse forever.
+	bool mayDiverge = true;
+	bool neverReturns = false;
+	/// Always returns a new allocation that nothing else refers to.
+	bool returnsFresh = false;
+	/// Whether the function may keep a parameter beyond the call, all of them if empty.
+	Vec<bool> capturedParams;
+
+	bool operator==(const FuncEffects &) const = default;
+};
+
 struct FuncDecl : Node {
 	const U8String ident;
 	const Vec<Param> params;
 	const Type returnType;
 	const Box<BlockStmt> body;
+	FuncEffects effects;
 
 	FuncDecl(U8String ident, Vec<Param> params, Type returnType, Box<BlockStmt> body);
 };
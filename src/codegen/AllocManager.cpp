@@ -1,21 +1,51 @@
 #include "AllocManager.h"
 
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+
 #include <ranges>
 
 namespace gen {
+namespace {
+/// Whether the local keeps its stack slot. Only fields of structs are accessed through the address
+/// of a local, all other locals are promoted to registers right after lowering, which removes
+/// their lifetime markers again.
+bool staysInMemory(Type type) {
+	return type->isTypeKind(TypeKind::Struct);
+}
+}
+
 AllocManager::AllocManager(CodeGenContext &ctx)
 	: m_Context(ctx) {}
 
 Opt<TrackedValue> AllocManager::getAlloca(const U8String &ident) const {
 	for (const auto &scope : std::ranges::reverse_view(m_Allocs)) {
-		if (auto it = scope.find(ident); it != scope.end()) {
-			return it->second;
+		if (auto it = scope.locals.find(ident); it != scope.locals.end()) {
+			return it->second.tracked;
 		}
 	}
 	return {};
 }
 
-llvm::AllocaInst *AllocManager::createAlloca(Type type, const U8String &ident) {
+const Local *AllocManager::getLocal(const U8String &ident) const {
+	for (const auto &scope : std::ranges::reverse_view(m_Allocs)) {
+		if (auto it = scope.locals.find(ident); it != scope.locals.end()) {
+			return &it->second;
+		}
+	}
+	return nullptr;
+}
+
+bool AllocManager::isBorrowed(const U8String &ident) const {
+	for (const auto &scope : std::ranges::reverse_view(m_Allocs)) {
+		if (auto it = scope.locals.find(ident); it != scope.locals.end()) {
+			return it->second.isBorrowed;
+		}
+	}
+	return false;
+}
+
+llvm::AllocaInst *AllocManager::createAlloca(Type type, const U8String &ident,
+											 const LocalKey key, const bool isBorrowed) {
 	auto *func = m_Context.irBuilder.GetInsertBlock()->getParent();
 	VERIFY(func);
 
@@ -24,37 +54,144 @@ llvm::AllocaInst *AllocManager::createAlloca(Type type, const U8String &ident) {
 	auto *llvmType = m_Context.typeConverter.convert(type);
 	auto *alloca = entryBuilder.CreateAlloca(llvmType, nullptr, ident.asAscii());
 
-	m_Allocs.back().emplace(ident, TrackedValue{alloca, type});
+	// Locals of nested scopes only live from their declaration to the end of their scope, which
+	// lets LLVM put locals of scopes that are never entered at the same time into one slot.
+	if (m_Allocs.size() > 1 && staysInMemory(type)) {
+		m_Context.irBuilder.CreateLifetimeStart(alloca);
+	}
+
+	m_Allocs.back().locals.emplace(ident, Local{.tracked = {alloca, type},
+												.key = key,
+												.isBorrowed = isBorrowed});
 
 	return alloca;
 }
 
 void AllocManager::clearAllocas() {
 	m_Allocs.clear();
+	m_Return.reset();
+	m_ExitBlocks.clear();
 }
 
 void AllocManager::openScope() {
-	m_Allocs.emplace_back(Map<U8String, TrackedValue>{});
+	m_Allocs.emplace_back(Scope{});
 }
 
 void AllocManager::closeScope() {
+	// Exits that leave the scope early drop its locals on the way to the return, where the
+	// lifetimes end with the function.
+	auto *block = m_Context.irBuilder.GetInsertBlock();
+	if (m_Allocs.size() > 1 && block && !block->getTerminator()) {
+		for (const auto &[_, local] : m_Allocs.back().locals) {
+			if (staysInMemory(local.tracked.type)) {
+				m_Context.irBuilder.CreateLifetimeEnd(local.tracked.value);
+			}
+		}
+	}
+
 	m_Allocs.pop_back();
 }
 
-void AllocManager::emitCurrentScopeCleanup() {
-	emitScopeCleanup(m_Allocs.back());
+void AllocManager::emitCurrentScopeCleanup(const LocalSet &moved) {
+	emitScopeCleanup(m_Allocs.back(), moved);
 }
 
-void AllocManager::emitFullScopeCleanup() {
+void AllocManager::emitReturn(llvm::Value *value, const LocalSet &moved) {
+	const auto &exit = getScopeExit(m_Allocs.size(), moved);
+
+	exit.result->addIncoming(value, m_Context.irBuilder.GetInsertBlock());
+	m_Context.irBuilder.CreateBr(exit.block);
+}
+
+void AllocManager::emitTailCallCleanup(const LocalSet &moved) {
 	for (const auto &scope : std::ranges::reverse_view(m_Allocs)) {
-		emitScopeCleanup(scope);
+		emitScopeCleanup(scope, moved);
+	}
+}
+
+void AllocManager::finishFunction() {
+	// Merging only ever removes the merged block, so the remaining ones stay valid.
+	for (auto *block : m_ExitBlocks) {
+		llvm::MergeBlockIntoPredecessor(block);
 	}
 }
 
-void AllocManager::emitScopeCleanup(const Scope &scope) {
+const ScopeExit &AllocManager::getScopeExit(const size_t depth, const LocalSet &moved) {
+	auto &builder = m_Context.irBuilder;
+	auto *func = builder.GetInsertBlock()->getParent();
+
+	if (depth == 0) {
+		if (!m_Return) {
+			const auto oldIP = builder.saveIP();
+			auto *block = llvm::BasicBlock::Create(m_Context.llvmContext, "return", func);
+			builder.SetInsertPoint(block);
+
+			auto *result = builder.CreatePHI(func->getReturnType(), 0, "result");
+			builder.CreateRet(result);
+			builder.restoreIP(oldIP);
+
+			m_Return = ScopeExit{.localCount = 0, .moved = {}, .block = block, .result = result};
+			m_ExitBlocks.push_back(block);
+		}
+
+		return *m_Return;
+	}
+
+	auto &scope = m_Allocs[depth - 1];
+
+	LocalSet scopeMoved;
+	bool hasDrops = false;
+	for (const auto &[_, local] : scope.locals) {
+		if (moved.contains(local.key)) {
+			scopeMoved.insert(local.key);
+		} else if (!local.isBorrowed && isRefCounted(local.tracked.type)) {
+			hasDrops = true;
+		}
+	}
+
+	if (!hasDrops) {
+		return getScopeExit(depth - 1, moved);
+	}
+
+	// Locals are only ever added to a scope, their count tells which ones are declared.
+	for (const auto &exit : scope.exits) {
+		if (exit.localCount == scope.locals.size() && exit.moved == scopeMoved) {
+			return exit;
+		}
+	}
+
+	const auto oldIP = builder.saveIP();
+	auto *block = llvm::BasicBlock::Create(m_Context.llvmContext, "cleanup", func);
+	builder.SetInsertPoint(block);
+
+	auto *result = builder.CreatePHI(func->getReturnType(), 0, "result");
+	emitScopeCleanup(scope, moved);
+
+	const auto &next = getScopeExit(depth - 1, moved);
+	next.result->addIncoming(result, builder.GetInsertBlock());
+	builder.CreateBr(next.block);
+	builder.restoreIP(oldIP);
+
+	m_ExitBlocks.push_back(block);
+	return scope.exits.emplace_back(ScopeExit{.localCount = scope.locals.size(),
+											  .moved = std::move(scopeMoved),
+											  .block = block,
+											  .result = result});
+}
+
+void AllocManager::emitScopeCleanup(const Scope &scope, const LocalSet &moved) {
 	// All allocations store a pointer to the value that needs to be dropped
 	// so we need to load the value first and then emit the actual cleanup.
-	for (const auto &[_, tracked] : scope) {
+	for (const auto &[_, local] : scope.locals) {
+		const auto &tracked = local.tracked;
+
+		if (local.isBorrowed || moved.contains(local.key)) {
+			if (isRefCounted(tracked.type))
+				++m_Context.rcStats.elidedDrops;
+
+			continue;
+		}
+
 		auto *llvmType = m_Context.typeConverter.convert(tracked.type);
 		auto *value = m_Context.irBuilder.CreateLoad(llvmType, tracked.value);
 
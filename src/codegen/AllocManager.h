@@ -1,27 +1,65 @@
 #pragma once
 #include "CodeGenContext.h"
+#include "OwnershipAnalysis.h"
 
 namespace gen {
-using Scope = Map<U8String, TrackedValue>;
+struct Local {
+	TrackedValue tracked;
+	LocalKey key;
+	/// Borrowed locals are kept alive by someone else and are not dropped at scope exit.
+	bool isBorrowed;
+};
+
+/// Cleanup block shared by all exits that leave a scope with the same locals declared and moved
+/// out. It drops the locals and branches on to the cleanup of the enclosing scope.
+struct ScopeExit {
+	size_t localCount;
+	LocalSet moved;
+	llvm::BasicBlock *block;
+	/// The value the function returns, passed on along the chain of cleanup blocks.
+	llvm::PHINode *result;
+};
+
+struct Scope {
+	Map<U8String, Local> locals;
+	Vec<ScopeExit> exits;
+};
 
 struct AllocManager {
 private:
 	CodeGenContext &m_Context;
 	Vec<Scope> m_Allocs;
+	Opt<ScopeExit> m_Return;
+	Vec<llvm::BasicBlock *> m_ExitBlocks;
 
 public:
 	explicit AllocManager(CodeGenContext &ctx);
 
 public:
 	Opt<TrackedValue> getAlloca(const U8String &ident) const;
-	llvm::AllocaInst *createAlloca(Type type, const U8String &ident);
+	/// Returns the innermost local or parameter with the name, nullptr if there is none.
+	const Local *getLocal(const U8String &ident) const;
+	bool isBorrowed(const U8String &ident) const;
+	llvm::AllocaInst *createAlloca(Type type, const U8String &ident, LocalKey key,
+								   bool isBorrowed = false);
 	void clearAllocas();
 	void openScope();
 	void closeScope();
-	void emitCurrentScopeCleanup();
-	void emitFullScopeCleanup();
+	/// Drops the locals of the innermost scope, except for the ones that are moved out.
+	void emitCurrentScopeCleanup(const LocalSet &moved);
+	/// Drops the locals of all scopes, except for the ones that are moved out, and returns the
+	/// value. Instead of repeating the drops at every return, the exits branch into a chain of
+	/// cleanup blocks, one per scope, that ends in the single return of the function.
+	void emitReturn(llvm::Value *value, const LocalSet &moved);
+	/// Drops the locals of all scopes like a return does, but right away instead of on the way to
+	/// the return of the function, so that a tail call can follow the drops.
+	void emitTailCallCleanup(const LocalSet &moved);
+	/// Merges the cleanup blocks that only a single exit branches to back into it.
+	void finishFunction();
 
 private:
-	void emitScopeCleanup(const Scope &scope);
+	void emitScopeCleanup(const Scope &scope, const LocalSet &moved);
+	/// Returns the cleanup block for leaving the innermost `depth` scopes of the function.
+	const ScopeExit &getScopeExit(size_t depth, const LocalSet &moved);
 };
 }
\ No newline at end of file
@@ -0,0 +1,509 @@
+#include "CheckOptimizer.h"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/PatternMatch.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/Local.h>
+
+#include <algorithm>
+
+namespace gen {
+namespace {
+using namespace llvm::PatternMatch;
+
+/// Whether the block only calls the panic of the runtime, e.g. the one shared by the bounds
+/// checks of a function.
+bool isPanicBlock(const llvm::BasicBlock &block, const char *panic) {
+	return CodeGenContext::isCallTo(block.front(), panic);
+}
+
+/// Whether the instruction may change what a load from memory of the program returns. Creating
+/// and copying values only writes memory that loads of the program do not read.
+bool mayClobber(const llvm::Instruction &inst) {
+	return inst.mayWriteToMemory() &&
+		   !CodeGenContext::isCallTo(inst, CodeGenContext::sharedPtrCreate) &&
+		   !CodeGenContext::isCallTo(inst, CodeGenContext::arrayCreate) &&
+		   !CodeGenContext::isCopy(inst);
+}
+
+/// Whether the index is in bounds whenever the other index is, because both are the same value
+/// or both are constants and the index is the smaller one.
+bool covers(const llvm::Value *index, const llvm::Value *other) {
+	if (index == other) {
+		return true;
+	}
+
+	const auto *constIndex = llvm::dyn_cast<llvm::ConstantInt>(index);
+	const auto *constOther = llvm::dyn_cast<llvm::ConstantInt>(other);
+
+	return constIndex && constOther && !constOther->isNegative() &&
+		   constOther->getSExtValue() <= constIndex->getSExtValue();
+}
+}
+
+CheckOptimizer::CheckOptimizer(llvm::Function &func)
+	: m_Function(func)
+	, m_DomTree(func) {}
+
+void CheckOptimizer::optimize(CodeGenContext &ctx) {
+	for (auto &func : ctx.llvmModule) {
+		if (func.isDeclaration()) {
+			continue;
+		}
+
+		CheckOptimizer optimizer(func);
+		optimizer.collectChecks();
+		optimizer.removeRedundantChecks();
+		optimizer.versionLoops();
+	}
+}
+
+void CheckOptimizer::collectChecks() {
+	for (auto &block : m_Function) {
+		auto *branch = llvm::dyn_cast<llvm::BranchInst>(block.getTerminator());
+		if (!branch || !branch->isConditional()) {
+			continue;
+		}
+
+		auto *cond = branch->getCondition();
+		llvm::Value *pointer = nullptr;
+		llvm::CmpInst::Predicate pred;
+
+		// A null check: br (icmp eq pointer, null), panic, cont
+		// A condition like p != null, or p == null on its false edge, proves the same.
+		if (match(cond, m_c_ICmp(pred, m_Value(pointer), m_Zero())) &&
+			pointer->getType()->isPointerTy()) {
+			if (pred == llvm::CmpInst::ICMP_EQ &&
+				isPanicBlock(*branch->getSuccessor(0), CodeGenContext::panicNullDeref)) {
+				m_NullChecks.push_back(branch);
+			}
+
+			if (pred == llvm::CmpInst::ICMP_EQ || pred == llvm::CmpInst::ICMP_NE) {
+				const auto *nonNull = branch->getSuccessor(pred == llvm::CmpInst::ICMP_EQ ? 1 : 0);
+				m_NonNullFacts.push_back(
+						{{&block, nonNull}, CodeGenContext::stripCopies(pointer)});
+			}
+
+			continue;
+		}
+
+		llvm::Value *index = nullptr;
+		llvm::Value *array = nullptr;
+
+		// A bounds check: br (icmp uge (sext index), (extractvalue array, 1)), panic, cont
+		// Constant indices are already extended when they are lowered.
+		const auto sizeOf = m_ExtractValue<1>(m_Value(array));
+		if (isPanicBlock(*branch->getSuccessor(0), CodeGenContext::panicOutOfBounds) &&
+			(match(cond, m_ICmp(pred, m_SExt(m_Value(index)), sizeOf)) ||
+			 match(cond, m_ICmp(pred, m_CombineAnd(m_ConstantInt(), m_Value(index)), sizeOf))) &&
+			pred == llvm::CmpInst::ICMP_UGE) {
+			m_BoundsChecks.push_back({branch, index, array});
+			m_BoundsFacts.push_back({{&block, branch->getSuccessor(1)}, index, array});
+			continue;
+		}
+
+		// A condition like i < len(a): br (icmp slt index, (trunc (extractvalue array, 1))), ...
+		// The length is truncated to i32, which is at most the size if the index is not negative.
+		const auto lengthOf = m_Trunc(sizeOf);
+		if (match(cond, m_ICmp(pred, lengthOf, m_Value(index)))) {
+			pred = llvm::CmpInst::getSwappedPredicate(pred);
+		} else if (!match(cond, m_ICmp(pred, m_Value(index), lengthOf))) {
+			continue;
+		}
+
+		std::unordered_set<const llvm::Value *> phis;
+		if (pred == llvm::CmpInst::ICMP_SLT && isNonNegative(index, phis)) {
+			if (const auto *constIndex = llvm::dyn_cast<llvm::ConstantInt>(index)) {
+				index = llvm::ConstantInt::get(llvm::Type::getInt64Ty(block.getContext()),
+											   constIndex->getSExtValue());
+			}
+
+			m_BoundsFacts.push_back({{&block, branch->getSuccessor(0)}, index, array});
+		}
+	}
+}
+
+void CheckOptimizer::removeRedundantChecks() {
+	Vec<llvm::BranchInst *> redundant;
+
+	for (auto *check : m_NullChecks) {
+		auto *pointer = llvm::cast<llvm::ICmpInst>(check->getCondition())->getOperand(0);
+		std::unordered_set<const llvm::Value *> phis;
+
+		if (isNonNull(pointer, check->getParent(), phis)) {
+			redundant.push_back(check);
+		}
+
+		// A load that is never null tells LLVM more than the removed check does.
+		auto *load = llvm::dyn_cast<llvm::LoadInst>(CodeGenContext::stripCopies(pointer));
+		phis.clear();
+		if (load && isNonNull(load, load->getParent(), phis)) {
+			load->setMetadata(llvm::LLVMContext::MD_nonnull,
+							  llvm::MDNode::get(load->getContext(), {}));
+		}
+	}
+
+	for (const auto &check : m_BoundsChecks) {
+		const auto *block = check.branch->getParent();
+		const auto proven = std::ranges::any_of(m_BoundsFacts, [&](const BoundsFact &fact) {
+			return fact.array == check.array && covers(fact.index, check.index) &&
+				   fact.edge.getStart() != block && m_DomTree.dominates(fact.edge, block);
+		});
+
+		if (proven) {
+			redundant.push_back(check.branch);
+		}
+	}
+
+	removeChecks(redundant);
+}
+
+void CheckOptimizer::versionLoops() {
+	Vec<const llvm::BasicBlock *> headers;
+
+	m_DomTree.recalculate(m_Function);
+	const llvm::LoopInfo allLoops(m_DomTree);
+
+	for (const auto *loop : allLoops.getLoopsInPreorder()) {
+		if (loop->isInnermost()) {
+			headers.push_back(loop->getHeader());
+		}
+	}
+
+	// Versioning a loop changes the blocks and dominators of the function, the checks and loops
+	// are found again for every loop.
+	for (const auto *header : headers) {
+		m_DomTree.recalculate(m_Function);
+		m_NonNullFacts.clear();
+		m_NullChecks.clear();
+		m_BoundsFacts.clear();
+		m_BoundsChecks.clear();
+		collectChecks();
+
+		llvm::LoopInfo loops(m_DomTree);
+		if (auto *loop = loops.getLoopFor(header); loop && loop->getHeader() == header) {
+			versionLoop(*loop);
+		}
+	}
+}
+
+void CheckOptimizer::versionLoop(llvm::Loop &loop) {
+	auto *preheader = loop.getLoopPreheader();
+	auto *header = loop.getHeader();
+	auto *branch = llvm::dyn_cast<llvm::BranchInst>(header->getTerminator());
+
+	if (!preheader || !branch || !branch->isConditional()) {
+		return;
+	}
+
+	// The loop may only be left through its condition, or into a panic.
+	auto *exit = branch->getSuccessor(1);
+	llvm::SmallVector<llvm::Loop::Edge, 4> exits;
+	loop.getExitEdges(exits);
+
+	const auto leavesElsewhere = std::ranges::any_of(exits, [&](const llvm::Loop::Edge &edge) {
+		return edge != llvm::Loop::Edge{header, exit} &&
+			   !llvm::isa<llvm::UnreachableInst>(edge.second->getTerminator());
+	});
+
+	if (leavesElsewhere || loop.contains(exit) || exit->getSinglePredecessor() != header) {
+		return;
+	}
+
+	// The condition of the loop: br (icmp slt counter, bound), body, exit
+	llvm::Value *counter = nullptr;
+	llvm::Value *bound = nullptr;
+	llvm::CmpInst::Predicate pred;
+
+	if (!match(branch->getCondition(), m_ICmp(pred, m_Value(counter), m_Value(bound))) ||
+		pred != llvm::CmpInst::ICMP_SLT) {
+		return;
+	}
+
+	bool changed = false;
+	std::unordered_set<const llvm::Value *> phis;
+	const auto *phi = llvm::dyn_cast<llvm::PHINode>(counter);
+
+	if (!phi || phi->getParent() != header || !isNonNegative(phi, phis) ||
+		!loop.makeLoopInvariant(bound, changed)) {
+		return;
+	}
+
+	// The checks of the counter in the body, where it is known to be less than the bound.
+	const llvm::BasicBlockEdge body(header, branch->getSuccessor(0));
+	Vec<llvm::BranchInst *> checks;
+	Vec<llvm::Value *> arrays;
+
+	for (const auto &check : m_BoundsChecks) {
+		if (check.index != counter || !loop.contains(check.branch) ||
+			!m_DomTree.dominates(body, check.branch->getParent()) ||
+			!loop.makeLoopInvariant(check.array, changed)) {
+			continue;
+		}
+
+		checks.push_back(check.branch);
+		if (std::ranges::find(arrays, check.array) == arrays.end()) {
+			arrays.push_back(check.array);
+		}
+	}
+
+	if (checks.empty()) {
+		return;
+	}
+
+	// The counter starts at zero or above and stays below the bound, so all checks pass if the
+	// bound is at most the size of every array.
+	llvm::IRBuilder<> builder(preheader->getTerminator());
+	auto *limit = builder.CreateSExt(bound, builder.getInt64Ty());
+	llvm::Value *inBounds = nullptr;
+
+	for (auto *array : arrays) {
+		auto *fits = builder.CreateICmpSLE(limit, builder.CreateExtractValue(array, 1U));
+		inBounds = inBounds ? builder.CreateAnd(inBounds, fits) : fits;
+	}
+
+	llvm::ValueToValueMapTy valueMap;
+	llvm::SmallVector<llvm::BasicBlock *, 8> copies;
+
+	for (auto *block : loop.blocks()) {
+		auto *copy = llvm::CloneBasicBlock(block, valueMap, ".fast", &m_Function);
+		valueMap[block] = copy;
+		copies.push_back(copy);
+	}
+
+	llvm::remapInstructionsInBlocks(copies, valueMap);
+	auto *copyHeader = llvm::cast<llvm::BasicBlock>(valueMap[header]);
+
+	// After the loop, its values come from whichever version ran.
+	for (auto &exitPhi : exit->phis()) {
+		auto *incoming = exitPhi.getIncomingValueForBlock(header);
+		llvm::Value *copied = valueMap.lookup(incoming);
+		exitPhi.addIncoming(copied ? copied : incoming, copyHeader);
+	}
+
+	for (auto *block : loop.blocks()) {
+		for (auto &inst : *block) {
+			Vec<llvm::Use *> uses;
+			for (auto &use : inst.uses()) {
+				const auto *user = llvm::cast<llvm::Instruction>(use.getUser());
+				if (!loop.contains(user) && !(llvm::isa<llvm::PHINode>(user) &&
+											  user->getParent() == exit)) {
+					uses.push_back(&use);
+				}
+			}
+
+			if (uses.empty()) {
+				continue;
+			}
+
+			auto *merged = llvm::PHINode::Create(inst.getType(), 2, "", &exit->front());
+			merged->addIncoming(&inst, header);
+			merged->addIncoming(valueMap[&inst], copyHeader);
+
+			for (auto *use : uses) {
+				use->set(merged);
+			}
+		}
+	}
+
+	auto *entry = preheader->getTerminator();
+	llvm::BranchInst::Create(copyHeader, header, inBounds, entry);
+	entry->eraseFromParent();
+
+	Vec<llvm::BranchInst *> copiedChecks;
+	for (auto *check : checks) {
+		copiedChecks.push_back(llvm::cast<llvm::BranchInst>(valueMap[check]));
+	}
+
+	removeChecks(copiedChecks);
+}
+
+void CheckOptimizer::removeChecks(const Vec<llvm::BranchInst *> &branches) {
+	Vec<llvm::Value *> conditions;
+	Vec<llvm::BasicBlock *> removed;
+
+	for (auto *branch : branches) {
+		auto *panic = branch->getSuccessor(0);
+		auto *cont = branch->getSuccessor(1);
+
+		conditions.push_back(branch->getCondition());
+		llvm::BranchInst::Create(cont, branch);
+		branch->eraseFromParent();
+
+		if (llvm::pred_empty(panic)) {
+			panic->eraseFromParent();
+		}
+
+		removed.push_back(cont);
+	}
+
+	// Other checks may refer to the values the conditions were computed from, so delete them last.
+	for (auto *cond : conditions) {
+		llvm::RecursivelyDeleteTriviallyDeadInstructions(cond);
+	}
+
+	for (auto *cont : removed) {
+		llvm::MergeBlockIntoPredecessor(cont);
+	}
+}
+
+bool CheckOptimizer::isNonNull(const llvm::Value *pointer, const llvm::BasicBlock *block,
+							   std::unordered_set<const llvm::Value *> &phis) const {
+	pointer = CodeGenContext::stripCopies(pointer);
+
+	if (const auto *call = llvm::dyn_cast<llvm::CallBase>(pointer);
+		call && call->hasRetAttr(llvm::Attribute::NonNull)) {
+		return true;
+	}
+
+	if (const auto *arg = llvm::dyn_cast<llvm::Argument>(pointer); arg && arg->hasNonNullAttr()) {
+		return true;
+	}
+
+	const auto *load = llvm::dyn_cast<llvm::LoadInst>(pointer);
+	const auto proven = std::ranges::any_of(m_NonNullFacts, [&](const NonNullFact &fact) {
+		if (!m_DomTree.dominates(fact.edge, block)) {
+			return false;
+		}
+
+		const auto *factLoad = llvm::dyn_cast<llvm::LoadInst>(fact.pointer);
+		return fact.pointer == pointer || (load && factLoad && loadsSame(*factLoad, *load));
+	});
+
+	if (proven) {
+		return true;
+	}
+
+	// Assume the phis are not null while checking their incoming pointers at the end of the
+	// blocks they come from, if all of them are, no phi can ever become null.
+	if (const auto *phi = llvm::dyn_cast<llvm::PHINode>(pointer)) {
+		if (!phis.insert(phi).second) {
+			return true;
+		}
+
+		for (u32 i = 0; i < phi->getNumIncomingValues(); ++i) {
+			if (!isNonNull(phi->getIncomingValue(i), phi->getIncomingBlock(i), phis)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+bool CheckOptimizer::loadsSame(const llvm::LoadInst &first, const llvm::LoadInst &second) const {
+	const auto *firstAddress = llvm::dyn_cast<llvm::Instruction>(first.getPointerOperand());
+	const auto *secondAddress = llvm::dyn_cast<llvm::Instruction>(second.getPointerOperand());
+
+	const auto sameAddress = first.getPointerOperand() == second.getPointerOperand() ||
+							 (firstAddress && secondAddress &&
+							  firstAddress->isIdenticalTo(secondAddress));
+
+	if (&first == &second || !sameAddress || first.getType() != second.getType() ||
+		first.isVolatile() || second.isVolatile() || !m_DomTree.dominates(&first, &second)) {
+		return false;
+	}
+
+	const auto *firstBlock = first.getParent();
+	const auto *secondBlock = second.getParent();
+
+	const auto clobbers = [](auto begin, auto end) {
+		return std::any_of(begin, end, [](const auto &inst) { return mayClobber(inst); });
+	};
+
+	if (firstBlock == secondBlock) {
+		return !clobbers(std::next(first.getIterator()), second.getIterator());
+	}
+
+	if (clobbers(std::next(first.getIterator()), firstBlock->end()) ||
+		clobbers(secondBlock->begin(), second.getIterator())) {
+		return false;
+	}
+
+	// Every path to the second load passes the first one, as it dominates it. Walk back from the
+	// second load to the first one through all blocks in between.
+	Vec<const llvm::BasicBlock *> worklist(llvm::pred_begin(secondBlock),
+										   llvm::pred_end(secondBlock));
+	std::unordered_set<const llvm::BasicBlock *> visited;
+
+	while (!worklist.empty()) {
+		const auto *block = worklist.back();
+		worklist.pop_back();
+
+		if (block == firstBlock || !visited.insert(block).second) {
+			continue;
+		}
+
+		if (clobbers(block->begin(), block->end())) {
+			return false;
+		}
+
+		worklist.insert(worklist.end(), llvm::pred_begin(block), llvm::pred_end(block));
+	}
+
+	return true;
+}
+
+bool CheckOptimizer::isNonNegative(const llvm::Value *value,
+								   std::unordered_set<const llvm::Value *> &phis) const {
+	if (const auto *constant = llvm::dyn_cast<llvm::ConstantInt>(value)) {
+		return !constant->isNegative();
+	}
+
+	if (llvm::isa<llvm::ZExtInst>(value)) {
+		return true;
+	}
+
+	// Assume the phis of a loop are not negative while checking the values they are assigned. If
+	// all of them are, none of them can become negative in any iteration.
+	if (const auto *phi = llvm::dyn_cast<llvm::PHINode>(value)) {
+		if (!phis.insert(phi).second) {
+			return true;
+		}
+
+		return std::ranges::all_of(phi->incoming_values(), [&](const llvm::Use &incoming) {
+			return isNonNegative(incoming.get(), phis);
+		});
+	}
+
+	const llvm::Value *counter = nullptr;
+	const auto *inst = llvm::dyn_cast<llvm::Instruction>(value);
+	if (inst && match(value, m_c_Add(m_Value(counter), m_One()))) {
+		return isNonNegative(counter, phis) && isBoundedAbove(counter, inst->getParent());
+	}
+
+	return false;
+}
+
+bool CheckOptimizer::isBoundedAbove(const llvm::Value *value,
+									const llvm::BasicBlock *block) const {
+	for (const auto *user : value->users()) {
+		llvm::CmpInst::Predicate pred;
+		if (!match(user, m_c_ICmp(pred, m_Specific(value), m_Value()))) {
+			continue;
+		}
+
+		const auto *cmp = llvm::cast<llvm::ICmpInst>(user);
+		if (cmp->getOperand(0) != value) {
+			pred = llvm::CmpInst::getSwappedPredicate(pred);
+		}
+
+		if (pred != llvm::CmpInst::ICMP_SLT) {
+			continue;
+		}
+
+		for (const auto *cmpUser : cmp->users()) {
+			const auto *branch = llvm::dyn_cast<llvm::BranchInst>(cmpUser);
+			if (branch && branch->isConditional() &&
+				m_DomTree.dominates({branch->getParent(), branch->getSuccessor(0)}, block)) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+}
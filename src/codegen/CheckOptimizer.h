@@ -0,0 +1,103 @@
+#pragma once
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Instructions.h>
+
+#include <unordered_set>
+
+#include "CodeGenContext.h"
+
+namespace gen {
+///
+/// Removes the safety checks of a lowered module that checks before them already prove. Every
+/// dereference of a pointer is checked for null and every index into an array is checked against
+/// the size of the array, the program panics if a check fails. The optimizer runs after the
+/// locals are promoted to SSA values, so that the same pointer, array or index is the same value
+/// wherever it is used.
+///
+/// A branch establishes that a pointer is not null on one of its edges, if it is the null check
+/// of a dereference, or if it compares the pointer with null, like the condition of
+/// `if (p != null)`. Pointers created by `new` are never null. A later check of the same pointer
+/// that is only reached through such an edge can never fail and is removed. Loading the same
+/// field again without storing anything in between loads the same pointer, the load is marked as
+/// non-null for LLVM, if it is.
+///
+/// A branch establishes that an index is within the bounds of an array on one of its edges, if
+///
+/// - it is the bounds check of the index, which only continues if the index is in bounds, or
+/// - it compares a non-negative index to be less than the length of the array, like the
+///   condition of `while (i < len(a))` with `i` counting up from 0.
+///
+/// Every later check of the same index, or of a smaller constant index, into the same array that
+/// is only reached through such an edge can never fail and is removed.
+///
+/// The checks that remain in a counted loop like `while (i < n) { a[i] = b[i]; }` can all be
+/// decided before the loop: if `n` is at most the size of every array indexed by `i`, none of them
+/// fails. Such loops are versioned, a single range check in front of the loop enters a copy of it
+/// without these checks, and the original loop with all checks runs otherwise. Without the edges
+/// into the panic, LLVM is free to vectorize the copy.
+///
+struct CheckOptimizer {
+private:
+	/// An edge on which an index is known to be within the bounds of an array.
+	struct BoundsFact {
+		llvm::BasicBlockEdge edge;
+		const llvm::Value *index;
+		const llvm::Value *array;
+	};
+
+	/// An edge on which a pointer is known not to be null.
+	struct NonNullFact {
+		llvm::BasicBlockEdge edge;
+		const llvm::Value *pointer;
+	};
+
+	/// A bounds check of an index into an array, which branches to the panic if it fails.
+	struct BoundsCheck {
+		llvm::BranchInst *branch;
+		const llvm::Value *index;
+		llvm::Value *array;
+	};
+
+	llvm::Function &m_Function;
+	llvm::DominatorTree m_DomTree;
+	Vec<NonNullFact> m_NonNullFacts;
+	Vec<llvm::BranchInst *> m_NullChecks;
+	Vec<BoundsFact> m_BoundsFacts;
+	Vec<BoundsCheck> m_BoundsChecks;
+
+	explicit CheckOptimizer(llvm::Function &func);
+
+	void collectChecks();
+	void removeRedundantChecks();
+	void versionLoops();
+
+	/// Versions an innermost loop counting up to a bound that does not change in the loop, if
+	/// the bound can be checked against the arrays the loop indexes with its counter.
+	void versionLoop(llvm::Loop &loop);
+
+	/// Replaces the checks with branches to where they continue if they pass.
+	static void removeChecks(const Vec<llvm::BranchInst *> &branches);
+
+	/// Whether the pointer is never null in the block.
+	[[nodiscard]] bool isNonNull(const llvm::Value *pointer, const llvm::BasicBlock *block,
+								 std::unordered_set<const llvm::Value *> &phis) const;
+
+	/// Whether the second load always loads the same value as the first one, because it loads
+	/// from the same address and nothing may be stored in between.
+	[[nodiscard]] bool loadsSame(const llvm::LoadInst &first, const llvm::LoadInst &second) const;
+
+	/// Whether the value is never negative when interpreted as a signed integer.
+	[[nodiscard]] bool isNonNegative(const llvm::Value *value,
+									 std::unordered_set<const llvm::Value *> &phis) const;
+
+	/// Whether the value is known to be less than some other signed integer in the block, so that
+	/// adding one to it does not overflow.
+	[[nodiscard]] bool isBoundedAbove(const llvm::Value *value,
+									  const llvm::BasicBlock *block) const;
+
+public:
+	/// Optimizes every function defined in the module of the context.
+	static void optimize(CodeGenContext &ctx);
+};
+}
@@ -1,20 +1,175 @@
 #include "CodeGen.h"
 
+#include <algorithm>
 #include <fstream>
 
+#include "CheckOptimizer.h"
+#include "RcOptimizer.h"
+
 namespace gen {
-CodeGen::CodeGen(CodeGenContext &ctx)
+namespace {
+/// Collects the names the node refers to with a VarRef. Constant expressions are not lowered,
+/// so the functions they call are not needed at run time.
+void collectReferences(const ast::Node &n, std::unordered_set<U8String> &names) {
+	const auto collect = [&names](const auto &nodes) {
+		for (const auto &node : nodes) {
+			collectReferences(*node, names);
+		}
+	};
+
+	if (const auto *expr = dynamic_cast<const ast::Expr *>(&n); expr && expr->constValue) {
+		return;
+	}
+
+	switch (n.kind) {
+		case ast::NodeKind::VarRef: {
+			names.insert(static_cast<const ast::VarRef &>(n).ident);
+			break;
+		}
+
+		case ast::NodeKind::HeapAlloc: {
+			collectReferences(*static_cast<const ast::HeapAlloc &>(n).expr, names);
+			break;
+		}
+
+		case ast::NodeKind::ArrayHeapAlloc: {
+			collectReferences(*static_cast<const ast::ArrayHeapAlloc &>(n).size, names);
+			break;
+		}
+
+		case ast::NodeKind::StructInit: {
+			collect(static_cast<const ast::StructInit &>(n).args);
+			break;
+		}
+
+		case ast::NodeKind::UnaryExpr: {
+			collectReferences(*static_cast<const ast::UnaryExpr &>(n).operand, names);
+			break;
+		}
+
+		case ast::NodeKind::BinaryExpr: {
+			const auto &binaryExpr = static_cast<const ast::BinaryExpr &>(n);
+			collectReferences(*binaryExpr.left, names);
+			collectReferences(*binaryExpr.right, names);
+			break;
+		}
+
+		case ast::NodeKind::Assignment: {
+			const auto &assignment = static_cast<const ast::Assignment &>(n);
+			collectReferences(*assignment.left, names);
+			collectReferences(*assignment.right, names);
+			break;
+		}
+
+		case ast::NodeKind::FieldAccess: {
+			collectReferences(*static_cast<const ast::FieldAccess &>(n).base, names);
+			break;
+		}
+
+		case ast::NodeKind::IndexExpr: {
+			const auto &indexExpr = static_cast<const ast::IndexExpr &>(n);
+			collectReferences(*indexExpr.base, names);
+			collectReferences(*indexExpr.index, names);
+			break;
+		}
+
+		case ast::NodeKind::LenExpr: {
+			collectReferences(*static_cast<const ast::LenExpr &>(n).base, names);
+			break;
+		}
+
+		case ast::NodeKind::FuncCall: {
+			const auto &funcCall = static_cast<const ast::FuncCall &>(n);
+			collectReferences(*funcCall.expr, names);
+			collect(funcCall.args);
+			break;
+		}
+
+		case ast::NodeKind::BlockStmt: {
+			collect(static_cast<const ast::BlockStmt &>(n).stmts);
+			break;
+		}
+
+		case ast::NodeKind::IfStmt: {
+			const auto &ifStmt = static_cast<const ast::IfStmt &>(n);
+			collectReferences(*ifStmt.cond, names);
+			collectReferences(*ifStmt.then, names);
+			collectReferences(*ifStmt.else_, names);
+			break;
+		}
+
+		case ast::NodeKind::WhileStmt: {
+			const auto &whileStmt = static_cast<const ast::WhileStmt &>(n);
+			collectReferences(*whileStmt.cond, names);
+			collectReferences(*whileStmt.body, names);
+			break;
+		}
+
+		case ast::NodeKind::ReturnStmt: {
+			collectReferences(*static_cast<const ast::ReturnStmt &>(n).expr, names);
+			break;
+		}
+
+		case ast::NodeKind::VarDef: {
+			collectReferences(*static_cast<const ast::VarDef &>(n).value, names);
+			break;
+		}
+
+		default: break;
+	}
+}
+
+/// Returns the variable a value is part of or was loaded through, e.g. `p` for `*p.next[i]`, or
+/// the expression that produced it, if it is not part of a variable.
+const ast::Expr &getRoot(const ast::Expr &n, bool &isLoaded) {
+	switch (n.kind) {
+		case ast::NodeKind::FieldAccess: {
+			return getRoot(*static_cast<const ast::FieldAccess &>(n).base, isLoaded);
+		}
+
+		case ast::NodeKind::IndexExpr: {
+			isLoaded = true;
+			return getRoot(*static_cast<const ast::IndexExpr &>(n).base, isLoaded);
+		}
+
+		case ast::NodeKind::UnaryExpr: {
+			const auto &unary = static_cast<const ast::UnaryExpr &>(n);
+			if (unary.op != UnaryOpKind::Dereference) {
+				return n;
+			}
+
+			isLoaded = true;
+			return getRoot(*unary.operand, isLoaded);
+		}
+
+		default: return n;
+	}
+}
+}
+
+CodeGen::CodeGen(CodeGenContext &ctx, const ExternalDecls &externals,
+				 ErrorHandler *errorHandler)
 	: m_Context(ctx)
-	, m_AllocManager(ctx) {}
+	, m_AllocManager(ctx)
+	, m_Externals(externals)
+	, m_ErrorHandler(errorHandler) {}
 
-void CodeGen::generate(std::ofstream &out, const ast::Module &n) {
-	CodeGenContext ctx(n.name);
-	CodeGen lowerer(ctx);
+Box<CodeGenContext> CodeGen::lower(const ast::Module &n, const ExternalDecls &externals,
+								   ErrorHandler *errorHandler, const CodeGenOptions &options) {
+	auto ctx = std::make_unique<CodeGenContext>(n.name);
+	ctx->typeConverter.reorderFields = options.reorderFields;
+	CodeGen lowerer(*ctx, externals, errorHandler);
 
 	lowerer.visitNode(n);
+	RcOptimizer::optimize(*ctx);
+	CheckOptimizer::optimize(*ctx);
+	ctx->promoteDrops();
 
-	llvm::raw_os_ostream llvmOS(out);
-	ctx.llvmModule.print(llvmOS, nullptr);
+	if (lowerer.m_IsWholeProgram) {
+		removeUnusedFunctions(ctx->llvmModule);
+	}
+
+	return ctx;
 }
 
 void CodeGen::visitNode(const ast::Node &n) {
@@ -22,7 +177,7 @@ void CodeGen::visitNode(const ast::Node &n) {
 	// We would need a ExprStmt Node or smth like that in the future.
 
 	if (dynamic_cast<const ast::Expr *>(&n)) {
-		ExprLowerer exprLowerer(m_Context, m_AllocManager);
+		ExprLowerer exprLowerer(m_Context, m_AllocManager, m_Ownership);
 		exprLowerer.lowerExpr(static_cast<const ast::Expr &>(n));
 		exprLowerer.emitExprCleanup();
 
@@ -32,23 +187,291 @@ void CodeGen::visitNode(const ast::Node &n) {
 	dispatch(n);
 }
 
+void CodeGen::defineStruct(const U8String &name,
+						   const Map<U8String, const Vec<StructField> *> &structFields) {
+	auto *llvmType = llvm::StructType::getTypeByName(m_Context.llvmContext, name.asAscii());
+	if (!llvmType->isOpaque()) {
+		return;
+	}
+
+	const auto &fields = *structFields.at(name);
+	for (const auto &[_, fieldType] : fields) {
+		if (fieldType->isTypeKind(TypeKind::Struct)) {
+			defineStruct(static_cast<StructType *>(fieldType)->name, structFields);
+		}
+	}
+
+	m_Context.typeConverter.setStructBody(*llvmType, name, fields,
+										  m_Context.llvmModule.getDataLayout());
+}
+
+std::unordered_set<const ast::FuncDecl *> CodeGen::findReachableFunctions(const ast::Module &n) {
+	Map<U8String, const ast::FuncDecl *> funcs;
+	for (const auto &decl : n.funcs) {
+		funcs.emplace(decl->ident, decl.get());
+	}
+
+	// A local that shadows a function only makes the function reachable needlessly.
+	std::unordered_set<const ast::FuncDecl *> reachable = {funcs.at(u8"main")};
+	Vec<const ast::FuncDecl *> worklist(reachable.begin(), reachable.end());
+
+	while (!worklist.empty()) {
+		const auto *func = worklist.back();
+		worklist.pop_back();
+
+		std::unordered_set<U8String> names;
+		collectReferences(*func->body, names);
+
+		for (const auto &name : names) {
+			const auto callee = funcs.find(name);
+			if (callee != funcs.end() && reachable.insert(callee->second).second) {
+				worklist.push_back(callee->second);
+			}
+		}
+	}
+
+	return reachable;
+}
+
+void CodeGen::removeUnusedFunctions(llvm::Module &module) {
+	// Removing a function can leave the destructors or wrappers it used without uses.
+	for (bool changed = true; changed;) {
+		changed = false;
+
+		for (auto &func : llvm::make_early_inc_range(module)) {
+			if (!func.isDeclaration() && func.hasLocalLinkage() && func.use_empty()) {
+				func.eraseFromParent();
+				changed = true;
+			}
+		}
+	}
+}
+
+const ast::FuncCall *CodeGen::getTailCall(const ast::ReturnStmt &n) const {
+	if (n.expr->kind != ast::NodeKind::FuncCall || n.expr->constValue) {
+		return nullptr;
+	}
+
+	const auto &call = static_cast<const ast::FuncCall &>(*n.expr);
+	if (call.expr->kind != ast::NodeKind::VarRef) {
+		return nullptr;
+	}
+
+	const auto &ident = static_cast<const ast::VarRef &>(*call.expr).ident;
+	const auto callee = m_Funcs.find(ident);
+	if (callee == m_Funcs.end() || m_AllocManager.getAlloca(ident)) {
+		return nullptr;
+	}
+
+	const auto obstacle = findTailCallObstacle(call, *callee->second);
+	if (!obstacle) {
+		return &call;
+	}
+
+	if (m_ErrorHandler && isRecursiveCall(*callee->second)) {
+		m_ErrorHandler->addError(std::format("Recursive call of '{}' cannot be a tail call, {}.",
+											 ident, obstacle.value()),
+								 call.loc, ErrorLevel::WARNING);
+	}
+
+	return nullptr;
+}
+
+Opt<U8String> CodeGen::findTailCallObstacle(const ast::FuncCall &call,
+											const ast::FuncDecl &callee) const {
+	// A tail call reuses the frame of the caller, which only works if both take and return the
+	// same values.
+	const auto *borrowedParams = m_Ownership.getBorrowedParams(callee.ident);
+	const auto calleeName = borrowedParams ? OwnershipAnalysis::getBorrowingName(callee.ident)
+										   : callee.ident;
+	const auto *calleeFunc = m_Context.llvmModule.getFunction(calleeName.asAscii());
+	const auto *func = m_Context.irBuilder.GetInsertBlock()->getParent();
+
+	if (!calleeFunc || calleeFunc->getFunctionType() != func->getFunctionType()) {
+		return std::format("because its parameter or return types differ from the ones of '{}'",
+						   m_CurrentFunction->ident);
+	}
+
+	for (u32 i = 0; i < call.args.size(); ++i) {
+		const auto &arg = *call.args[i];
+		const auto isBorrowed = callee.params[i].second->isTypeKind(TypeKind::Reference) ||
+								(borrowedParams && (*borrowedParams)[i]);
+
+		// Owned parameters take over their arguments, the caller keeps nothing to drop.
+		if (!isBorrowed || arg.constValue || !isRefCounted(arg.inferredType.value())) {
+			continue;
+		}
+
+		bool isLoaded = false;
+		const auto &root = getRoot(arg, isLoaded);
+		if (root.kind != ast::NodeKind::VarRef) {
+			return std::format("because argument {} is a temporary that is dropped after the call",
+							   i + 1);
+		}
+
+		const auto &ident = static_cast<const ast::VarRef &>(root).ident;
+		const auto *local = m_AllocManager.getLocal(ident);
+		VERIFY(local);
+
+		const auto &params = m_CurrentFunction->params;
+		const auto isParam = std::ranges::any_of(params, [&](const auto &param) {
+			return local->key == &param;
+		});
+		const auto isDropped = !local->isBorrowed &&
+							   !local->tracked.type->isTypeKind(TypeKind::Reference);
+
+		if (!isParam || isDropped) {
+			return std::format("because argument {} needs '{}', which is dropped before the call",
+							   i + 1, ident);
+		}
+
+		if (isLoaded && callee.effects.writesMemory) {
+			return std::format("because argument {} is loaded from memory that '{}' may change",
+							   i + 1, callee.ident);
+		}
+	}
+
+	return {};
+}
+
+bool CodeGen::isRecursiveCall(const ast::FuncDecl &callee) const {
+	std::unordered_set<const ast::FuncDecl *> visited = {&callee};
+	Vec<const ast::FuncDecl *> worklist = {&callee};
+
+	while (!worklist.empty()) {
+		const auto *func = worklist.back();
+		worklist.pop_back();
+
+		std::unordered_set<U8String> names;
+		collectReferences(*func->body, names);
+
+		for (const auto &name : names) {
+			const auto next = m_Funcs.find(name);
+			if (next == m_Funcs.end()) {
+				continue;
+			}
+
+			if (next->second == m_CurrentFunction) {
+				return true;
+			}
+
+			if (visited.insert(next->second).second) {
+				worklist.push_back(next->second);
+			}
+		}
+	}
+
+	return false;
+}
+
+void CodeGen::emitTailCall(const ast::ReturnStmt &n, const ast::FuncCall &call) {
+	ExprLowerer exprLowerer(m_Context, m_AllocManager, m_Ownership);
+	const auto [type, callee, args] = exprLowerer.lowerCallOperands(call, true);
+
+	// The arguments are ready and none of them needs the temporaries or locals anymore.
+	exprLowerer.emitExprCleanup();
+	m_AllocManager.emitTailCallCleanup(m_Ownership.getMovedLocals(n));
+
+	auto *result = m_Context.irBuilder.CreateCall(type, callee, args);
+	result->setTailCallKind(llvm::CallInst::TCK_MustTail);
+	m_Context.irBuilder.CreateRet(result);
+}
+
+void CodeGen::addEffectAttributes(llvm::Function &func, const ast::FuncDecl &n,
+								  const bool isWrapper) const {
+	const auto &effects = n.effects;
+
+	// Nothing unwinds, a panic ends the program right away.
+	func.addFnAttr(llvm::Attribute::NoUnwind);
+
+	if (effects.neverReturns) {
+		func.addFnAttr(llvm::Attribute::NoReturn);
+	} else if (!effects.mayDiverge && !effects.mayPanic) {
+		func.addFnAttr(llvm::Attribute::WillReturn);
+	}
+
+	if (effects.returnsFresh) {
+		func.addRetAttr(llvm::Attribute::NoAlias);
+	}
+
+	if (isWrapper) {
+		return;
+	}
+
+	// Only drops free memory. Panics print and exit, which a call without effects must not do.
+	if (!effects.touchesHeap) {
+		func.addFnAttr(llvm::Attribute::NoFree);
+
+		if (!effects.writesMemory && !effects.mayPanic) {
+			if (effects.readsMemory) {
+				func.setOnlyReadsMemory();
+			} else {
+				func.setDoesNotAccessMemory();
+			}
+		}
+	}
+
+	// Parameters declared as &T are borrowed by every call, the others only by the variant.
+	const auto *borrowedParams = m_Ownership.getBorrowedParams(n.ident);
+	for (u32 i = 0; i < n.params.size(); ++i) {
+		const auto isBorrowed = n.params[i].second->isTypeKind(TypeKind::Reference) ||
+								(borrowedParams && (*borrowedParams)[i]);
+		const auto isCaptured = effects.capturedParams.empty() || effects.capturedParams[i];
+
+		if (isBorrowed && !isCaptured && func.getArg(i)->getType()->isPointerTy()) {
+			func.addParamAttr(i, llvm::Attribute::NoCapture);
+		}
+	}
+}
+
 void CodeGen::visit(const ast::Module &n) {
+	m_Ownership = OwnershipAnalysis::analyze(n);
+
+	for (const auto &decl : n.funcs) {
+		m_Funcs.emplace(decl->ident, decl.get());
+	}
+
+	// A whole program only emits main and the functions it uses, everything else is internal,
+	// which leaves LLVM free to inline it or remove it.
+	const auto isMain = [](const auto &decl) { return decl->ident == u8"main"; };
+	m_IsWholeProgram = !m_Externals.exportAll && std::ranges::any_of(n.funcs, isMain);
+
+	const auto reachable = m_IsWholeProgram ? findReachableFunctions(n)
+											: std::unordered_set<const ast::FuncDecl *>{};
+	const auto isEmitted = [&](const ast::FuncDecl &decl) {
+		return !m_IsWholeProgram || reachable.contains(&decl);
+	};
+	const auto linkage = m_IsWholeProgram ? llvm::Function::InternalLinkage
+										  : llvm::Function::ExternalLinkage;
+
+	// Declare structs of previously generated modules, their destructors are linked in
+	for (auto *structType : m_Externals.structs) {
+		llvm::StructType::create(m_Context.llvmContext, structType->name.asAscii());
+	}
+
+	for (auto *structType : m_Externals.structs) {
+		auto dtorName = getStructDtorName(structType->name);
+		llvm::Function::Create(m_Context.getDestructorType(), llvm::Function::ExternalLinkage,
+							   dtorName.asAscii(), m_Context.llvmModule);
+	}
+
 	// First pass: create opaque struct types
 	for (const auto &structDecl : n.structs) {
 		llvm::StructType::create(m_Context.llvmContext, structDecl->ident.asAscii());
 	}
 
 	// Second pass: set struct field types
-	for (const auto &structDecl : n.structs) {
-		auto *structType =
-				llvm::StructType::getTypeByName(m_Context.llvmContext, structDecl->ident.asAscii());
+	Map<U8String, const Vec<StructField> *> structFields;
+	for (auto *structType : m_Externals.structs) {
+		structFields.emplace(structType->name, &structType->orderedFields);
+	}
 
-		Vec<llvm::Type *> fieldTypes;
-		for (const auto &[fieldName, fieldType] : structDecl->fields) {
-			fieldTypes.push_back(m_Context.typeConverter.convert(fieldType));
-		}
+	for (const auto &structDecl : n.structs) {
+		structFields.emplace(structDecl->ident, &structDecl->fields);
+	}
 
-		structType->setBody(fieldTypes);
+	for (const auto &[name, _] : structFields) {
+		defineStruct(name, structFields);
 	}
 
 	// Forward declare default function decls
@@ -62,20 +485,23 @@ void CodeGen::visit(const ast::Module &n) {
 		auto *returnType = m_Context.typeConverter.convert(type->returnType);
 		auto *funcType = llvm::FunctionType::get(returnType, paramTypes, false);
 
-		llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, name.asAscii(),
-							   m_Context.llvmModule);
+		auto *func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
+											name.asAscii(), m_Context.llvmModule);
+		func->addFnAttr(llvm::Attribute::NoUnwind);
 
 		// Forward declare struct destructors
 		auto *structDtorType = m_Context.getDestructorType();
 		for (const auto &decl : n.structs) {
 			auto dtorName = getStructDtorName(decl->ident);
 			if (!m_Context.llvmModule.getFunction(dtorName.asAscii())) {
-				llvm::Function::Create(structDtorType, llvm::Function::ExternalLinkage,
-									   dtorName.asAscii(), m_Context.llvmModule);
+				llvm::Function::Create(structDtorType, linkage, dtorName.asAscii(),
+									   m_Context.llvmModule);
 			}
 		}
 	}
 
+	m_Context.emitPopcount(*m_Context.llvmModule.getFunction(CodeGenContext::builtinPopcount));
+
 	// Emit struct destructors
 	for (const auto &decl : n.structs) {
 		auto dtorName = getStructDtorName(decl->ident);
@@ -94,7 +520,9 @@ void CodeGen::visit(const ast::Module &n) {
 			auto dtor = m_Context.getDestructor(fieldType);
 
 			if (dtor.has_value()) {
-				auto *fieldPtr = m_Context.irBuilder.CreateStructGEP(llvmStructType, payload, i);
+				const auto index = m_Context.typeConverter.getFieldIndex(decl->ident, i);
+				auto *fieldPtr =
+						m_Context.irBuilder.CreateStructGEP(llvmStructType, payload, index);
 				auto *voidPtr =
 						m_Context.irBuilder.CreateBitCast(fieldPtr, m_Context.irBuilder.getPtrTy());
 				m_Context.irBuilder.CreateCall(m_Context.getDestructorType(), dtor.value(),
@@ -105,8 +533,26 @@ void CodeGen::visit(const ast::Module &n) {
 		m_Context.irBuilder.CreateRetVoid();
 	}
 
+	// Declare functions of previously generated modules
+	for (const auto &[name, type] : m_Externals.funcs) {
+		Vec<llvm::Type *> paramTypes;
+		for (auto *paramType : type->paramTypes) {
+			paramTypes.push_back(m_Context.typeConverter.convert(paramType));
+		}
+
+		auto *returnType = m_Context.typeConverter.convert(type->returnType);
+		auto *funcType = llvm::FunctionType::get(returnType, paramTypes, false);
+
+		llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, name.asAscii(),
+							   m_Context.llvmModule);
+	}
+
 	// Forward declare user defined functions decls
 	for (auto &decl : n.funcs) {
+		if (!isEmitted(*decl)) {
+			continue;
+		}
+
 		auto returnType = m_Context.typeConverter.convert(decl->returnType);
 
 		Vec<llvm::Type *> argTypes;
@@ -116,19 +562,36 @@ void CodeGen::visit(const ast::Module &n) {
 
 		auto funcType = llvm::FunctionType::get(returnType, argTypes, false);
 
-		llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, decl->ident.asAscii(),
-							   m_Context.llvmModule);
+		auto *func = llvm::Function::Create(
+				funcType, isMain(decl) ? llvm::Function::ExternalLinkage : linkage,
+				decl->ident.asAscii(), m_Context.llvmModule);
+
+		const auto hasBorrowingVariant = m_Ownership.getBorrowedParams(decl->ident) != nullptr;
+		addEffectAttributes(*func, *decl, hasBorrowingVariant);
+
+		if (hasBorrowingVariant) {
+			const auto borrowingName = OwnershipAnalysis::getBorrowingName(decl->ident);
+			auto *borrowing = llvm::Function::Create(funcType, llvm::Function::InternalLinkage,
+													 borrowingName.asAscii(), m_Context.llvmModule);
+			addEffectAttributes(*borrowing, *decl, false);
+		}
 	}
 
 	for (auto &d : n.funcs) {
-		visitNode(*d);
+		if (isEmitted(*d)) {
+			visitNode(*d);
+		}
 	}
 }
 
 void CodeGen::visit(const ast::FuncDecl &n) {
 	m_CurrentFunctionReturnType = n.returnType;
+	m_CurrentFunction = &n;
 
-	const auto func = m_Context.llvmModule.getFunction(n.ident.asAscii());
+	// Functions with borrowed parameters are generated into their borrowing variant.
+	const auto *borrowedParams = m_Ownership.getBorrowedParams(n.ident);
+	const auto funcName = borrowedParams ? OwnershipAnalysis::getBorrowingName(n.ident) : n.ident;
+	const auto func = m_Context.llvmModule.getFunction(funcName.asAscii());
 	VERIFY(func);
 	auto entry = llvm::BasicBlock::Create(m_Context.llvmContext, "entry", func);
 
@@ -140,7 +603,8 @@ void CodeGen::visit(const ast::FuncDecl &n) {
 	for (auto &arg : func->args()) {
 		const auto &name = n.params[i].first;
 		const auto &type = n.params[i].second;
-		auto alloca = m_AllocManager.createAlloca(type, name);
+		const auto isBorrowed = borrowedParams && (*borrowedParams)[i];
+		auto alloca = m_AllocManager.createAlloca(type, name, &n.params[i], isBorrowed);
 
 		arg.setName(name.asAscii());
 		m_Context.irBuilder.CreateStore(&arg, alloca);
@@ -151,13 +615,45 @@ void CodeGen::visit(const ast::FuncDecl &n) {
 	visitNode(*n.body);
 
 	if (!m_Context.irBuilder.GetInsertBlock()->getTerminator()) {
-		m_AllocManager.emitFullScopeCleanup();
-		m_Context.irBuilder.CreateRet(llvm::Constant::getNullValue(func->getReturnType()));
+		m_AllocManager.emitReturn(llvm::Constant::getNullValue(func->getReturnType()),
+								  m_Ownership.getMovedLocals(n));
 	}
 
 	m_AllocManager.closeScope();
+	m_AllocManager.finishFunction();
 	m_CurrentFunctionReturnType = std::nullopt;
-	llvm::verifyFunction(*func);
+	m_CurrentFunction = nullptr;
+	VERIFY(!llvm::verifyFunction(*func, &llvm::errs()));
+
+	if (borrowedParams) {
+		emitOwningWrapper(n, func);
+	}
+}
+
+void CodeGen::emitOwningWrapper(const ast::FuncDecl &n, llvm::Function *borrowing) {
+	const auto &borrowedParams = *m_Ownership.getBorrowedParams(n.ident);
+	const auto func = m_Context.llvmModule.getFunction(n.ident.asAscii());
+	VERIFY(func);
+
+	auto entry = llvm::BasicBlock::Create(m_Context.llvmContext, "entry", func);
+	m_Context.irBuilder.SetInsertPoint(entry);
+
+	Vec<llvm::Value *> args;
+	for (auto &arg : func->args()) {
+		arg.setName(n.params[args.size()].first.asAscii());
+		args.push_back(&arg);
+	}
+
+	auto *result = m_Context.irBuilder.CreateCall(borrowing, args);
+
+	for (u32 i = 0; i < args.size(); ++i) {
+		if (borrowedParams[i]) {
+			m_Context.dropValue(args[i], n.params[i].second);
+		}
+	}
+
+	m_Context.irBuilder.CreateRet(result);
+	VERIFY(!llvm::verifyFunction(*func, &llvm::errs()));
 }
 
 void CodeGen::visit(const ast::BlockStmt &n) {
@@ -172,14 +668,14 @@ void CodeGen::visit(const ast::BlockStmt &n) {
 	}
 
 	if (!m_Context.irBuilder.GetInsertBlock()->getTerminator()) {
-		m_AllocManager.emitCurrentScopeCleanup();
+		m_AllocManager.emitCurrentScopeCleanup(m_Ownership.getMovedLocals(n));
 	}
 
 	m_AllocManager.closeScope();
 }
 
 void CodeGen::visit(const ast::IfStmt &n) {
-	ExprLowerer exprLowerer(m_Context, m_AllocManager);
+	ExprLowerer exprLowerer(m_Context, m_AllocManager, m_Ownership);
 
 	const auto cond = exprLowerer.lowerExpr(*n.cond);
 	exprLowerer.emitExprCleanup();
@@ -223,7 +719,7 @@ void CodeGen::visit(const ast::WhileStmt &n) {
 	m_Context.irBuilder.SetInsertPoint(condBlock);
 
 	// Re-evaluate condition inside the condBlock!
-	ExprLowerer exprLowerer(m_Context, m_AllocManager);
+	ExprLowerer exprLowerer(m_Context, m_AllocManager, m_Ownership);
 	const auto cond = exprLowerer.lowerExpr(*n.cond);
 	exprLowerer.emitExprCleanup();
 
@@ -240,7 +736,12 @@ void CodeGen::visit(const ast::WhileStmt &n) {
 }
 
 void CodeGen::visit(const ast::ReturnStmt &n) {
-	ExprLowerer exprLowerer(m_Context, m_AllocManager);
+	if (const auto *call = getTailCall(n)) {
+		emitTailCall(n, *call);
+		return;
+	}
+
+	ExprLowerer exprLowerer(m_Context, m_AllocManager, m_Ownership);
 	const auto [value, type, isTemp] = exprLowerer.lowerExpr(*n.expr);
 	auto *retValue =
 			coerceNullToTarget(m_Context, value, type, m_CurrentFunctionReturnType.value());
@@ -251,12 +752,12 @@ void CodeGen::visit(const ast::ReturnStmt &n) {
 		m_Context.copyValue(retValue, m_CurrentFunctionReturnType.value());
 	}
 
-	m_AllocManager.emitFullScopeCleanup();
-	m_Context.irBuilder.CreateRet(retValue);
+	exprLowerer.emitExprCleanup();
+	m_AllocManager.emitReturn(retValue, m_Ownership.getMovedLocals(n));
 }
 
 void CodeGen::visit(const ast::VarDef &n) {
-	ExprLowerer exprLowerer(m_Context, m_AllocManager);
+	ExprLowerer exprLowerer(m_Context, m_AllocManager, m_Ownership);
 	// Handle default-initialized variables without calling lowerExpr on DefaultInit
 	llvm::Value *value = nullptr;
 	Type valueType = nullptr;
@@ -285,10 +786,13 @@ void CodeGen::visit(const ast::VarDef &n) {
 
 	value = coerceNullToTarget(m_Context, value, valueType, n.type);
 
-	auto alloca = m_AllocManager.createAlloca(n.type, n.ident);
+	const auto isBorrowed = m_Ownership.isBorrowed(n);
+	auto alloca = m_AllocManager.createAlloca(n.type, n.ident, &n, isBorrowed);
 
 	if (isTemp) {
 		exprLowerer.removeFromExprCleanup(value);
+	} else if (isBorrowed) {
+		++m_Context.rcStats.elidedCopies;
 	} else {
 		m_Context.copyValue(value, valueType);
 	}
@@ -2,20 +2,92 @@
 #include <llvm/IR/Verifier.h>
 #include <llvm/Support/raw_os_ostream.h>
 
+#include <unordered_set>
+
+#include "OwnershipAnalysis.h"
 #include "ExprCodeGen.h"
 #include "core/DefaultDecls.h"
+#include "core/ErrorHandler.h"
 
 namespace gen {
+/// Structs and functions defined by previously generated modules (e.g. earlier REPL inputs).
+/// They are only declared in the new module and get resolved when the modules are linked.
+struct ExternalDecls {
+	Vec<StructType *> structs;
+	Vec<Pair<U8String, FunctionType *>> funcs;
+	/// Whether later modules are linked against the new one, so that it has to export all of its
+	/// functions and destructors. Otherwise a module that defines main is a whole program.
+	bool exportAll = false;
+};
+
+/// Options that change how values are laid out or which code is emitted, but not what it does.
+struct CodeGenOptions {
+	/// Orders the fields of structs by alignment and size instead of declaration order.
+	bool reorderFields = false;
+
+	bool operator==(const CodeGenOptions &) const = default;
+};
+
 struct CodeGen : ast::ConstVisitor<void> {
 private:
 	CodeGenContext &m_Context;
 	AllocManager m_AllocManager;
 	Opt<Type> m_CurrentFunctionReturnType;
+	const ExternalDecls &m_Externals;
+	ErrorHandler *m_ErrorHandler;
+	OwnershipAnalysis m_Ownership;
+	bool m_IsWholeProgram = false;
+	Map<U8String, const ast::FuncDecl *> m_Funcs;
+	const ast::FuncDecl *m_CurrentFunction = nullptr;
+
+	/// Emits the function as a wrapper that calls its borrowing variant and drops the borrowed
+	/// parameters afterwards, as callers of the function hand them over.
+	void emitOwningWrapper(const ast::FuncDecl &n, llvm::Function *borrowing);
+
+	/// Tells LLVM about the inferred effects of the function, so that it can remove, merge and
+	/// move calls of it. The owning wrapper drops parameters, unlike the variant it calls.
+	void addEffectAttributes(llvm::Function &func, const ast::FuncDecl &n, bool isWrapper) const;
+
+	/// Sets the body of the LLVM struct of the struct, after the bodies of the structs it contains
+	/// by value, whose layouts its layout depends on.
+	void defineStruct(const U8String &name,
+					  const Map<U8String, const Vec<StructField> *> &structFields);
+
+	/// Returns the functions of a whole program that main uses directly or indirectly.
+	static std::unordered_set<const ast::FuncDecl *> findReachableFunctions(const ast::Module &n);
+
+	/// Removes the functions that are only visible in the module and never used, after the
+	/// functions using them were removed or optimized away.
+	static void removeUnusedFunctions(llvm::Module &module);
+
+	/// Returns the call of a function of the module a return statement returns the result of, if
+	/// it can be a guaranteed tail call. Recursive calls that cannot be one are reported as a
+	/// warning, because every level of the recursion then adds to the stack.
+	[[nodiscard]] const ast::FuncCall *getTailCall(const ast::ReturnStmt &n) const;
+
+	/// Returns why the call cannot be a tail call, nothing if it can. Nothing may run after a tail
+	/// call, so the caller drops its locals before it. Arguments for borrowed parameters must
+	/// not need any of them: they must be borrowed parameters of the caller, or loaded from
+	/// memory they refer to, which a callee that writes no memory cannot free.
+	[[nodiscard]] Opt<U8String> findTailCallObstacle(const ast::FuncCall &call,
+													 const ast::FuncDecl &callee) const;
+
+	/// Whether the callee calls the current function again, directly or indirectly.
+	[[nodiscard]] bool isRecursiveCall(const ast::FuncDecl &callee) const;
+
+	/// Lowers a return statement that returns the result of a tail call.
+	void emitTailCall(const ast::ReturnStmt &n, const ast::FuncCall &call);
 
 public:
-	explicit CodeGen(CodeGenContext &ctx);
+	CodeGen(CodeGenContext &ctx, const ExternalDecls &externals,
+			ErrorHandler *errorHandler = nullptr);
 
-	static void generate(std::ofstream &out, const ast::Module &module);
+	/// Lowers a type checked module into a fresh CodeGenContext that owns the LLVM module.
+	/// Warnings, e.g. about recursive calls that cannot be tail calls, go to the error handler.
+	static Box<CodeGenContext> lower(const ast::Module &module,
+									 const ExternalDecls &externals = {},
+									 ErrorHandler *errorHandler = nullptr,
+									 const CodeGenOptions &options = {});
 	void visitNode(const ast::Node &n);
 
 	void visit(const ast::Module &n) override;
@@ -1,7 +1,10 @@
 #include "CodeGenContext.h"
 
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/TargetParser/Host.h>
 
+#include <bit>
+#include <format>
 #include <ranges>
 
 #include "type/TypeFactory.h"
@@ -12,13 +15,21 @@ U8String getStructDtorName(const U8String &name) {
 }
 
 CodeGenContext::CodeGenContext(const U8String &moduleName)
-	: irBuilder(llvmContext)
-	, llvmModule(moduleName.asAscii(), llvmContext)
+	: m_OwnedContext(std::make_unique<llvm::LLVMContext>())
+	, m_OwnedModule(std::make_unique<llvm::Module>(moduleName.asAscii(), *m_OwnedContext))
+	, llvmContext(*m_OwnedContext)
+	, irBuilder(llvmContext)
+	, llvmModule(*m_OwnedModule)
 	, typeConverter(llvmContext) {
 	llvmModule.setTargetTriple(llvm::sys::getDefaultTargetTriple());
 	registerRuntimeFunctions();
 }
 
+Pair<Box<llvm::LLVMContext>, Box<llvm::Module>> CodeGenContext::releaseModule() {
+	VERIFY(m_OwnedContext && m_OwnedModule);
+	return {std::move(m_OwnedContext), std::move(m_OwnedModule)};
+}
+
 void CodeGenContext::registerRuntimeFunctions() {
 	const auto &dataLayout = llvmModule.getDataLayout();
 	auto *sizeTy = irBuilder.getIntPtrTy(dataLayout);
@@ -33,13 +44,34 @@ void CodeGenContext::registerRuntimeFunctions() {
 	llvm::FunctionType *arrayCopyTy = spCopyTy;
 	llvm::FunctionType *arrayDropTy = llvm::FunctionType::get(voidTy, {ptrTy}, false);
 
-	llvmModule.getOrInsertFunction(sharedPtrCreate, spCreateTy);
+	// The control block is allocated in front of the value, a shared pointer is never null.
+	// Like malloc, both allocations return memory nothing else refers to.
+	auto *spCreate = llvm::cast<llvm::Function>(
+			llvmModule.getOrInsertFunction(sharedPtrCreate, spCreateTy).getCallee());
+	spCreate->addRetAttr(llvm::Attribute::NonNull);
+	spCreate->addRetAttr(llvm::Attribute::NoAlias);
 	llvmModule.getOrInsertFunction(sharedPtrCopy, spCopyTy);
 	llvmModule.getOrInsertFunction(sharedPtrDrop, spDropTy);
 
-	llvmModule.getOrInsertFunction(arrayCreate, arrayCreateTy);
+	auto *arrayCreateFunc = llvm::cast<llvm::Function>(
+			llvmModule.getOrInsertFunction(arrayCreate, arrayCreateTy).getCallee());
+	arrayCreateFunc->addRetAttr(llvm::Attribute::NoAlias);
 	llvmModule.getOrInsertFunction(arrayCopy, arrayCopyTy);
 	llvmModule.getOrInsertFunction(arrayDrop, arrayDropTy);
+
+	// Direct drops free the control blocks themselves.
+	llvm::FunctionType *freeTy = llvm::FunctionType::get(voidTy, {ptrTy}, false);
+	llvmModule.getOrInsertFunction(runtimeFree, freeTy);
+
+	// Panics end the program, calls of them are never on a path that is worth optimizing.
+	llvm::FunctionType *panicTy = llvm::FunctionType::get(voidTy, false);
+	for (const auto *name : {panicNullDeref, panicOutOfBounds}) {
+		auto *panic = llvm::cast<llvm::Function>(
+				llvmModule.getOrInsertFunction(name, panicTy).getCallee());
+		panic->addFnAttr(llvm::Attribute::NoReturn);
+		panic->addFnAttr(llvm::Attribute::Cold);
+		panic->addFnAttr(llvm::Attribute::NoUnwind);
+	}
 }
 
 llvm::Value *coerceNullToTarget(CodeGenContext &ctx, llvm::Value *value, Type sourceType,
@@ -78,7 +110,8 @@ llvm::Value *coerceNullToTarget(CodeGenContext &ctx, llvm::Value *value, Type so
 
 llvm::Value *CodeGenContext::copyValue(llvm::Value *value, Type type) {
 	if (type->isTypeKind(TypeKind::Unit) || type->isTypeKind(TypeKind::Primitive) ||
-		type->isTypeKind(TypeKind::Null) || type->isTypeKind(TypeKind::Function)) {
+		type->isTypeKind(TypeKind::Null) || type->isTypeKind(TypeKind::Function) ||
+		type->isTypeKind(TypeKind::Reference)) {
 		return value;
 	}
 
@@ -90,9 +123,10 @@ llvm::Value *CodeGenContext::copyValue(llvm::Value *value, Type type) {
 
 		for (u32 i = 0; i < structType->orderedFields.size(); ++i) {
 			const auto &[_, fieldType] = structType->orderedFields[i];
-			auto *fieldValue = irBuilder.CreateExtractValue(value, {i});
+			const auto index = typeConverter.getFieldIndex(structType->name, i);
+			auto *fieldValue = irBuilder.CreateExtractValue(value, {index});
 			auto *copiedField = copyValue(fieldValue, fieldType);
-			result = irBuilder.CreateInsertValue(result, copiedField, {i});
+			result = irBuilder.CreateInsertValue(result, copiedField, {index});
 		}
 
 		return result;
@@ -132,14 +166,14 @@ llvm::Value *CodeGenContext::copyValue(llvm::Value *value, Type type) {
 void CodeGenContext::dropValue(llvm::Value *value, Type type) {
 	if (type->isTypeKind(TypeKind::Unit) || type->isTypeKind(TypeKind::Primitive) ||
 		type->isTypeKind(TypeKind::Null) || type->isTypeKind(TypeKind::Error) ||
-		type->isTypeKind(TypeKind::Function)) {
+		type->isTypeKind(TypeKind::Function) || type->isTypeKind(TypeKind::Reference)) {
 		return;
 	}
 
 	if (type->isTypeKind(TypeKind::Pointer)) {
 		auto *drop = llvmModule.getFunction(sharedPtrDrop);
 		VERIFY(drop);
-		irBuilder.CreateCall(drop, {value});
+		markDirectDrop(*irBuilder.CreateCall(drop, {value}), type);
 		return;
 	}
 
@@ -148,7 +182,7 @@ void CodeGenContext::dropValue(llvm::Value *value, Type type) {
 		auto *dataPtr = irBuilder.CreateExtractValue(value, 0U);
 		auto *dropArrFunc = llvmModule.getFunction(arrayDrop);
 		VERIFY(dropArrFunc);
-		irBuilder.CreateCall(dropArrFunc, {dataPtr});
+		markDirectDrop(*irBuilder.CreateCall(dropArrFunc, {dataPtr}), type);
 		return;
 	}
 
@@ -158,98 +192,231 @@ void CodeGenContext::dropValue(llvm::Value *value, Type type) {
 
 		// Materialize the rvalue in a stack slot so the generated struct destructor
 		// can recursively drop members through a stable address.
-		llvm::IRBuilder<> entryBuilder(&func->getEntryBlock(), func->getEntryBlock().begin());
-		auto *llvmStructType = typeConverter.convert(type);
-		auto *tmpAlloca = entryBuilder.CreateAlloca(llvmStructType, nullptr, "tmp.struct.drop");
+		auto *tmpAlloca = getDropSlot(*func, typeConverter.convert(type));
+		irBuilder.CreateLifetimeStart(tmpAlloca);
 		irBuilder.CreateStore(value, tmpAlloca);
 
 		auto dtor = getDestructor(type);
 		VERIFY(dtor.has_value());
 		auto *payload = irBuilder.CreateBitCast(tmpAlloca, irBuilder.getPtrTy());
 		irBuilder.CreateCall(getDestructorType(), dtor.value(), {payload});
+		irBuilder.CreateLifetimeEnd(tmpAlloca);
 		return;
 	}
 
 	UNREACHABLE();
 }
 
-Opt<llvm::Value *> CodeGenContext::getDestructor(Type type) {
-	if (type->isTypeKind(TypeKind::Unit) || type->isTypeKind(TypeKind::Primitive) ||
-		type->isTypeKind(TypeKind::Null) || type->isTypeKind(TypeKind::Error) ||
-		type->isTypeKind(TypeKind::Function)) {
-		return {};
+void CodeGenContext::markDirectDrop(llvm::CallInst &drop, Type type) {
+	const auto elementType = type->isTypeKind(TypeKind::Array)
+									 ? static_cast<ArrayType *>(type)->elementType
+									 : static_cast<PointerType *>(type)->pointeeType;
+
+	// Without a destructor the runtime does not call anything it could call directly.
+	const auto dtor = getDestructor(elementType);
+	if (!dtor.has_value()) {
+		return;
 	}
 
-	if (type->isTypeKind(TypeKind::Struct)) {
-		auto *structType = static_cast<StructType *>(type);
-		auto dtorName = getStructDtorName(structType->name);
-		auto *dtor = llvmModule.getFunction(dtorName.asAscii());
-		VERIFY(dtor);
-		return dtor;
+	auto *directDrop = getDirectDrop(type, *llvm::cast<llvm::Function>(dtor.value()));
+	auto *target = llvm::ConstantAsMetadata::get(directDrop);
+	drop.setMetadata(directDropKind, llvm::MDNode::get(llvmContext, {target}));
+}
+
+llvm::Function *CodeGenContext::getDirectDrop(Type type, llvm::Function &dtor) {
+	const auto isArray = type->isTypeKind(TypeKind::Array);
+	const auto *runtimeDrop = isArray ? arrayDrop : sharedPtrDrop;
+	const auto name = std::string(runtimeDrop) + "." + dtor.getName().str();
+
+	if (auto *directDrop = llvmModule.getFunction(name)) {
+		return directDrop;
 	}
 
-	if (type->isTypeKind(TypeKind::Array)) {
-		constexpr auto arrayDtorName = "__dtor_array";
-		auto *dtor = llvmModule.getFunction(arrayDtorName);
+	const auto oldIP = irBuilder.saveIP();
+	auto *directDrop = llvm::Function::Create(getDestructorType(), llvm::Function::InternalLinkage,
+											  name, llvmModule);
+	directDrop->addFnAttr(llvm::Attribute::NoUnwind);
 
-		if (!dtor) {
-			auto oldIP = irBuilder.saveIP();
-			auto *fnType = getDestructorType(); // void(void*)
-			dtor = llvm::Function::Create(fnType, llvm::Function::ExternalLinkage, arrayDtorName,
-										  llvmModule);
+	auto *entry = llvm::BasicBlock::Create(llvmContext, "entry", directDrop);
+	auto *release = llvm::BasicBlock::Create(llvmContext, "release", directDrop);
+	auto *destroy = llvm::BasicBlock::Create(llvmContext, "destroy", directDrop);
+	auto *done = llvm::BasicBlock::Create(llvmContext, "done", directDrop);
 
-			auto *entry = llvm::BasicBlock::Create(llvmContext, "entry", dtor);
-			irBuilder.SetInsertPoint(entry);
+	auto *value = directDrop->arg_begin();
+	value->setName("ptr");
 
-			// 'payload' is a pointer to the fat pointer: [T* data, size_t len]*
-			auto *payload = dtor->arg_begin();
+	irBuilder.SetInsertPoint(entry);
+	irBuilder.CreateCondBr(irBuilder.CreateIsNull(value), done, release);
 
-			// 1. Cast payload to the actual LLVM array struct type pointer
-			auto *llvmArrayType = typeConverter.convert(type);
-			auto *arrayStructPtr =
-					irBuilder.CreateBitCast(payload, llvm::PointerType::getUnqual(llvmArrayType));
+	// The control block is allocated in front of the value and starts with the reference count,
+	// its layout mirrors the ControlBlock and ArrayControlBlock of the runtime.
+	const auto &dataLayout = llvmModule.getDataLayout();
+	auto *sizeTy = irBuilder.getIntPtrTy(dataLayout);
+	auto *dtorTy = irBuilder.getPtrTy();
+	auto *controlBlockTy = isArray ? llvm::StructType::get(sizeTy, sizeTy, sizeTy, dtorTy)
+								   : llvm::StructType::get(sizeTy, dtorTy);
+	const auto controlBlockSize = dataLayout.getTypeAllocSize(controlBlockTy).getFixedValue();
+
+	irBuilder.SetInsertPoint(release);
+	auto *offset = llvm::ConstantInt::getSigned(sizeTy, -static_cast<i64>(controlBlockSize));
+	auto *controlBlock = irBuilder.CreateInBoundsGEP(irBuilder.getInt8Ty(), value, offset);
+	auto *refCountPtr = irBuilder.CreateStructGEP(controlBlockTy, controlBlock, 0U);
+	auto *refCount = irBuilder.CreateLoad(sizeTy, refCountPtr);
+	auto *decremented = irBuilder.CreateSub(refCount, llvm::ConstantInt::get(sizeTy, 1));
+	irBuilder.CreateStore(decremented, refCountPtr);
+	irBuilder.CreateCondBr(irBuilder.CreateICmpEQ(decremented, llvm::ConstantInt::get(sizeTy, 0)),
+						   destroy, done);
+
+	irBuilder.SetInsertPoint(destroy);
+	if (isArray) {
+		// Destroy the elements in order, like the runtime does.
+		auto *elementTy = typeConverter.convert(static_cast<ArrayType *>(type)->elementType);
+		auto *sizePtr = irBuilder.CreateStructGEP(controlBlockTy, controlBlock, 1U);
+		auto *size = irBuilder.CreateLoad(sizeTy, sizePtr);
+
+		auto *loop = llvm::BasicBlock::Create(llvmContext, "elements", directDrop, done);
+		auto *body = llvm::BasicBlock::Create(llvmContext, "element", directDrop, done);
+		auto *free = llvm::BasicBlock::Create(llvmContext, "free", directDrop, done);
+		irBuilder.CreateBr(loop);
+
+		irBuilder.SetInsertPoint(loop);
+		auto *index = irBuilder.CreatePHI(sizeTy, 2);
+		index->addIncoming(llvm::ConstantInt::get(sizeTy, 0), destroy);
+		irBuilder.CreateCondBr(irBuilder.CreateICmpULT(index, size), body, free);
+
+		irBuilder.SetInsertPoint(body);
+		auto *element = irBuilder.CreateInBoundsGEP(elementTy, value, index);
+		irBuilder.CreateCall(getDestructorType(), &dtor, {element});
+		index->addIncoming(irBuilder.CreateNUWAdd(index, llvm::ConstantInt::get(sizeTy, 1)), body);
+		irBuilder.CreateBr(loop);
+
+		irBuilder.SetInsertPoint(free);
+	} else {
+		irBuilder.CreateCall(getDestructorType(), &dtor, {value});
+	}
 
-			// 2. Extract the data pointer (field 0 of the fat pointer)
-			// We GEP to the first field and load it.
-			auto *dataPtrAddress = irBuilder.CreateStructGEP(llvmArrayType, arrayStructPtr, 0U);
-			auto *sharedPtrToData = irBuilder.CreateLoad(irBuilder.getPtrTy(), dataPtrAddress);
+	auto *runtimeFreeFunc = llvmModule.getFunction(runtimeFree);
+	VERIFY(runtimeFreeFunc);
+	irBuilder.CreateCall(runtimeFreeFunc, {controlBlock});
+	irBuilder.CreateBr(done);
 
-			// 3. Call the array-aware drop function
-			auto *dropArr = llvmModule.getFunction(arrayDrop);
-			VERIFY(dropArr);
-			irBuilder.CreateCall(dropArr, {sharedPtrToData});
+	irBuilder.SetInsertPoint(done);
+	irBuilder.CreateRetVoid();
+	irBuilder.restoreIP(oldIP);
+	return directDrop;
+}
 
-			irBuilder.CreateRetVoid();
-			irBuilder.restoreIP(oldIP);
+llvm::AllocaInst *CodeGenContext::getDropSlot(llvm::Function &func, llvm::Type *structType) {
+	if (m_DropSlotFunction != &func) {
+		m_DropSlotFunction = &func;
+		m_DropSlots.clear();
+	}
+
+	auto &slot = m_DropSlots[structType];
+
+	if (!slot) {
+		llvm::IRBuilder<> entryBuilder(&func.getEntryBlock(), func.getEntryBlock().begin());
+		slot = entryBuilder.CreateAlloca(structType, nullptr, "tmp.struct.drop");
+	}
+
+	return slot;
+}
+
+void CodeGenContext::promoteDrops() {
+	const auto kind = llvmContext.getMDKindID(directDropKind);
+
+	for (auto &func : llvmModule) {
+		for (auto &block : func) {
+			for (auto &inst : block) {
+				auto *call = llvm::dyn_cast<llvm::CallInst>(&inst);
+				auto *target = call ? call->getMetadata(kind) : nullptr;
+				if (!target) {
+					continue;
+				}
+
+				auto *directDrop = llvm::mdconst::extract<llvm::Function>(target->getOperand(0));
+				call->setCalledFunction(directDrop);
+				call->setMetadata(kind, nullptr);
+			}
 		}
+	}
+}
+
+void CodeGenContext::emitCheck(llvm::Value *failed, const char *panic) {
+	auto *func = irBuilder.GetInsertBlock()->getParent();
+	VERIFY(func);
+
+	if (m_TrapFunction != func) {
+		m_TrapFunction = func;
+		m_TrapBlocks.clear();
+	}
+
+	auto &trapBlock = m_TrapBlocks[panic];
+	if (!trapBlock) {
+		const auto oldIP = irBuilder.saveIP();
+		trapBlock = llvm::BasicBlock::Create(llvmContext, "panic", func);
+		irBuilder.SetInsertPoint(trapBlock);
+
+		auto *panicFunc = llvmModule.getFunction(panic);
+		VERIFY(panicFunc);
+		irBuilder.CreateCall(panicFunc, {});
+		irBuilder.CreateUnreachable();
+		irBuilder.restoreIP(oldIP);
+	}
+
+	// Same weights as clang uses for __builtin_expect.
+	auto *contBlock = llvm::BasicBlock::Create(llvmContext, "check.cont", func);
+	auto *weights = llvm::MDBuilder(llvmContext).createBranchWeights(1, 2000);
+	irBuilder.CreateCondBr(failed, trapBlock, contBlock, weights);
+	irBuilder.SetInsertPoint(contBlock);
+}
+
+Opt<llvm::Value *> CodeGenContext::getDestructor(Type type) {
+	if (type->isTypeKind(TypeKind::Unit) || type->isTypeKind(TypeKind::Primitive) ||
+		type->isTypeKind(TypeKind::Null) || type->isTypeKind(TypeKind::Error) ||
+		type->isTypeKind(TypeKind::Function) || type->isTypeKind(TypeKind::Reference)) {
+		return {};
+	}
 
+	if (type->isTypeKind(TypeKind::Struct)) {
+		auto *structType = static_cast<StructType *>(type);
+		auto dtorName = getStructDtorName(structType->name);
+		auto *dtor = llvmModule.getFunction(dtorName.asAscii());
+		VERIFY(dtor);
 		return dtor;
 	}
 
-	if (type->isTypeKind(TypeKind::Pointer)) {
-		constexpr auto ptrDtorName = "__dtor_ptr";
-		auto *dtor = llvmModule.getFunction(ptrDtorName);
+	// Values holding shared pointers or arrays of elements with a destructor get destructors of
+	// their own, so that dropping them calls the destructor of the elements directly.
+	if (type->isTypeKind(TypeKind::Array) || type->isTypeKind(TypeKind::Pointer)) {
+		const auto isArray = type->isTypeKind(TypeKind::Array);
+		const auto elementType = isArray ? static_cast<ArrayType *>(type)->elementType
+										 : static_cast<PointerType *>(type)->pointeeType;
+		const auto elementDtor = getDestructor(elementType);
+
+		auto dtorName = std::string(isArray ? "__dtor_array" : "__dtor_ptr");
+		if (elementDtor.has_value()) {
+			dtorName += "." + elementDtor.value()->getName().str();
+		}
+
+		auto *dtor = llvmModule.getFunction(dtorName);
 
 		if (!dtor) {
 			auto oldIP = irBuilder.saveIP();
-			auto *fnType = getDestructorType();
-			dtor = llvm::Function::Create(fnType, llvm::Function::ExternalLinkage, ptrDtorName,
+			auto *fnType = getDestructorType(); // void(void*)
+			dtor = llvm::Function::Create(fnType, llvm::Function::InternalLinkage, dtorName,
 										  llvmModule);
 
 			auto *entry = llvm::BasicBlock::Create(llvmContext, "entry", dtor);
 			irBuilder.SetInsertPoint(entry);
 
+			// 'payload' points to the shared pointer or the fat pointer: [T* data, size_t len]*
 			auto *payload = dtor->arg_begin();
 			payload->setName("payload");
 
-			auto *payloadAsPtrPtr =
-					irBuilder.CreateBitCast(payload,
-											llvm::PointerType::getUnqual(irBuilder.getPtrTy()));
-			auto *sharedPtrValue = irBuilder.CreateLoad(irBuilder.getPtrTy(), payloadAsPtrPtr);
+			auto *value = irBuilder.CreateLoad(typeConverter.convert(type), payload);
+			dropValue(value, type);
 
-			auto *drop = llvmModule.getFunction(sharedPtrDrop);
-			VERIFY(drop);
-			irBuilder.CreateCall(drop, {sharedPtrValue});
 			irBuilder.CreateRetVoid();
 			irBuilder.restoreIP(oldIP);
 		}
@@ -281,4 +448,99 @@ llvm::Value *CodeGenContext::getNullDestructor() {
 
 	return llvm::ConstantInt::get(sizeType, size);
 }
+
+bool CodeGenContext::isCallTo(const llvm::Instruction &inst, const char *name) {
+	const auto *call = llvm::dyn_cast<llvm::CallInst>(&inst);
+	const auto *callee = call ? call->getCalledFunction() : nullptr;
+
+	return callee && callee->getName() == name;
+}
+
+bool CodeGenContext::isCopy(const llvm::Instruction &inst) {
+	return isCallTo(inst, sharedPtrCopy) || isCallTo(inst, arrayCopy);
+}
+
+bool CodeGenContext::isDrop(const llvm::Instruction &inst) {
+	return isCallTo(inst, sharedPtrDrop) || isCallTo(inst, arrayDrop);
+}
+
+bool CodeGenContext::isBitArray(Type elementType) {
+	return elementType == TypeFactory::getBool();
+}
+
+llvm::Value *CodeGenContext::getBitArrayWords(llvm::Value *size) {
+	// Negative sizes are left to the runtime, like for other arrays.
+	auto *rounded = irBuilder.CreateAdd(size, irBuilder.getInt64(bitsPerWord - 1));
+	return irBuilder.CreateAShr(rounded, std::countr_zero(bitsPerWord));
+}
+
+void CodeGenContext::emitPopcount(llvm::Function &func) {
+	VERIFY(func.empty());
+
+	const auto oldIP = irBuilder.saveIP();
+	func.setLinkage(llvm::Function::InternalLinkage);
+
+	auto *entry = llvm::BasicBlock::Create(llvmContext, "entry", &func);
+	auto *loop = llvm::BasicBlock::Create(llvmContext, "words", &func);
+	auto *body = llvm::BasicBlock::Create(llvmContext, "word", &func);
+	auto *done = llvm::BasicBlock::Create(llvmContext, "done", &func);
+
+	// Bits past the size are never set, so whole words can be counted.
+	irBuilder.SetInsertPoint(entry);
+	auto *array = func.arg_begin();
+	auto *data = irBuilder.CreateExtractValue(array, 0U);
+	auto *words = getBitArrayWords(irBuilder.CreateExtractValue(array, 1U));
+	irBuilder.CreateBr(loop);
+
+	irBuilder.SetInsertPoint(loop);
+	auto *index = irBuilder.CreatePHI(irBuilder.getInt64Ty(), 2);
+	auto *count = irBuilder.CreatePHI(irBuilder.getInt64Ty(), 2);
+	index->addIncoming(irBuilder.getInt64(0), entry);
+	count->addIncoming(irBuilder.getInt64(0), entry);
+	irBuilder.CreateCondBr(irBuilder.CreateICmpSLT(index, words), body, done);
+
+	irBuilder.SetInsertPoint(body);
+	auto *wordPtr = irBuilder.CreateInBoundsGEP(irBuilder.getInt64Ty(), data, index);
+	auto *word = irBuilder.CreateLoad(irBuilder.getInt64Ty(), wordPtr);
+	auto *bits = irBuilder.CreateUnaryIntrinsic(llvm::Intrinsic::ctpop, word);
+	index->addIncoming(irBuilder.CreateNUWAdd(index, irBuilder.getInt64(1)), body);
+	count->addIncoming(irBuilder.CreateNUWAdd(count, bits), body);
+	irBuilder.CreateBr(loop);
+
+	irBuilder.SetInsertPoint(done);
+	irBuilder.CreateRet(irBuilder.CreateTrunc(count, irBuilder.getInt32Ty()));
+	irBuilder.restoreIP(oldIP);
+}
+
+std::string CodeGenContext::describeStructLayout(const U8String &name,
+												 const Vec<StructField> &fields) const {
+	auto *const llvmType = llvm::StructType::getTypeByName(llvmContext, name.asAscii());
+	VERIFY(llvmType && !llvmType->isOpaque());
+
+	const auto &dataLayout = llvmModule.getDataLayout();
+	const auto *const layout = dataLayout.getStructLayout(llvmType);
+
+	Vec<u32> fieldsBySlot(fields.size());
+	for (u32 i = 0; i < fields.size(); ++i) {
+		fieldsBySlot[typeConverter.getFieldIndex(name, i)] = i;
+	}
+
+	std::string lines;
+	u64 fieldsSize = 0;
+
+	for (u32 slot = 0; slot < fieldsBySlot.size(); ++slot) {
+		const auto &[fieldName, fieldType] = fields[fieldsBySlot[slot]];
+		const auto offset = layout->getElementOffset(slot);
+		auto *const slotType = llvmType->getElementType(slot);
+		const auto size = dataLayout.getTypeAllocSize(slotType).getFixedValue();
+
+		fieldsSize += size;
+		lines += std::format("\t{}: {} (offset {}, size {})\n", fieldName, fieldType, offset, size);
+	}
+
+	const auto size = layout->getSizeInBytes();
+	return std::format("struct {} (size {}, alignment {}, padding {})\n", name, size,
+					   layout->getAlignment().value(), size - fieldsSize) +
+		   lines;
+}
 }
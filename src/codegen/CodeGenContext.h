@@ -13,7 +13,38 @@ struct TrackedValue {
 	Type type;
 };
 
+/// Reference count operations that were not emitted because the value was only borrowed, or that
+/// were removed because they canceled each other out.
+struct RcStats {
+	u32 elidedCopies = 0;
+	u32 elidedDrops = 0;
+};
+
 struct CodeGenContext {
+private:
+	Box<llvm::LLVMContext> m_OwnedContext;
+	Box<llvm::Module> m_OwnedModule;
+	llvm::Function *m_TrapFunction = nullptr;
+	Map<std::string, llvm::BasicBlock *> m_TrapBlocks;
+	llvm::Function *m_DropSlotFunction = nullptr;
+	Map<llvm::Type *, llvm::AllocaInst *> m_DropSlots;
+
+	/// Metadata of a drop that names the function it is promoted to by promoteDrops.
+	constexpr static auto directDropKind = "ocn.direct_drop";
+
+	/// Marks a drop of a shared pointer or an array of the type for promotion, if its elements
+	/// have a destructor. The runtime calls the destructor stored in the control block indirectly,
+	/// but the type of the value already determines which destructor that is.
+	void markDirectDrop(llvm::CallInst &drop, Type type);
+
+	/// Returns the function that drops a shared pointer or an array of the type like the runtime,
+	/// but calls the destructor of its elements directly.
+	[[nodiscard]] llvm::Function *getDirectDrop(Type type, llvm::Function &dtor);
+
+	/// Returns the stack slot the function stores structs of the type in to drop them. A struct
+	/// is only in it until its destructor returns, so all drops of the function share one slot.
+	[[nodiscard]] llvm::AllocaInst *getDropSlot(llvm::Function &func, llvm::Type *structType);
+
 public:
 	constexpr static auto sharedPtrCreate = "__sp_create";
 	constexpr static auto sharedPtrCopy = "__sp_copy";
@@ -21,25 +52,85 @@ public:
 	constexpr static auto arrayCreate = "__arr_create";
 	constexpr static auto arrayCopy = "__arr_copy";
 	constexpr static auto arrayDrop = "__arr_drop";
+	constexpr static auto runtimeFree = "__ocn_free";
+	constexpr static auto panicNullDeref = "__panic_null_deref";
+	constexpr static auto panicOutOfBounds = "__panic_out_of_bounds";
+	constexpr static auto builtinPopcount = "popcount";
+
+	/// Whether the instruction directly calls the function with the name.
+	[[nodiscard]] static bool isCallTo(const llvm::Instruction &inst, const char *name);
+
+	/// Whether the instruction copies or drops a shared pointer or an array through the runtime.
+	[[nodiscard]] static bool isCopy(const llvm::Instruction &inst);
+	[[nodiscard]] static bool isDrop(const llvm::Instruction &inst);
+
+	/// Returns the value a chain of copies and bit casts starts from, copies return their
+	/// argument.
+	template <typename T>
+	[[nodiscard]] static T *stripCopies(T *value) {
+		while (const auto *inst = llvm::dyn_cast<llvm::Instruction>(value)) {
+			if (!isCopy(*inst) && !llvm::isa<llvm::BitCastInst>(inst)) {
+				break;
+			}
 
-	llvm::LLVMContext llvmContext;
+			value = inst->getOperand(0);
+		}
+
+		return value;
+	}
+
+	/// Arrays of bools store their elements as bits of 64 bit words, the first element in the
+	/// lowest bit of the first word. Their size stays the number of elements.
+	constexpr static u32 bitsPerWord = 64;
+
+	llvm::LLVMContext &llvmContext;
 	llvm::IRBuilder<> irBuilder;
-	llvm::Module llvmModule;
+	llvm::Module &llvmModule;
 	gen::TypeConverter typeConverter;
+	RcStats rcStats;
 
 	explicit CodeGenContext(const U8String &moduleName);
 
+	/// Hands over ownership of the generated module and its context, e.g. to a JIT. The
+	/// CodeGenContext must not be used to emit code afterwards.
+	[[nodiscard]] Pair<Box<llvm::LLVMContext>, Box<llvm::Module>> releaseModule();
+
 	void registerRuntimeFunctions();
 
 	llvm::Value *copyValue(llvm::Value *value, Type type);
 	void dropValue(llvm::Value *value, Type type);
 
+	/// Replaces the drops that were marked for promotion with calls of their direct drops. Runs
+	/// after the RcOptimizer, which only knows the drops of the runtime.
+	void promoteDrops();
+
+	/// Branches to a block that calls the panic if the condition holds, and continues in a new
+	/// block otherwise. The check is expected to pass, all checks of a function for the same
+	/// panic share a single block off the hot path.
+	void emitCheck(llvm::Value *failed, const char *panic);
+
 	[[nodiscard]] Opt<llvm::Value *> getDestructor(Type type);
 	[[nodiscard]] llvm::Value *getNullDestructor();
 	[[nodiscard]] llvm::FunctionType *getDestructorType();
 	[[nodiscard]] llvm::Value *sizeOf(Type type);
+
+	/// Whether the elements of arrays with the element type are packed into bits.
+	[[nodiscard]] static bool isBitArray(Type elementType);
+
+	/// Returns the number of words the bits of a bool array with the size take up.
+	[[nodiscard]] llvm::Value *getBitArrayWords(llvm::Value *size);
+
+	/// Emits the body of the popcount builtin, which counts the elements of a bool array that are
+	/// true. It is generated into every module instead of being part of the runtime, so that LLVM
+	/// can inline it and count a whole word at a time.
+	void emitPopcount(llvm::Function &func);
+
+	/// Describes where the fields of the struct are in memory, with the size, the alignment and
+	/// the padding of the struct, one line per field in the order of their offsets.
+	[[nodiscard]] std::string describeStructLayout(const U8String &name,
+												   const Vec<StructField> &fields) const;
 };
 
 llvm::Value *coerceNullToTarget(CodeGenContext &ctx, llvm::Value *value, Type sourceType,
 								Type targetType);
-}
\ No newline at end of file
+}
\ No newline at end of file
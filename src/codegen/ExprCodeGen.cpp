@@ -1,6 +1,7 @@
 #include "ExprCodeGen.h"
 
 #include <algorithm>
+#include <bit>
 
 #include "type/TypeFactory.h"
 
@@ -10,37 +11,134 @@ void emitNullDerefTrap(gen::CodeGenContext &ctx, llvm::Value *ptr) {
 	auto *ptrTy = llvm::dyn_cast<llvm::PointerType>(ptr->getType());
 	VERIFY(ptrTy);
 
-	auto *func = ctx.irBuilder.GetInsertBlock()->getParent();
-	VERIFY(func);
-
 	auto *isNull = ctx.irBuilder.CreateICmpEQ(ptr, llvm::ConstantPointerNull::get(ptrTy));
-	auto *panicBB = llvm::BasicBlock::Create(ctx.llvmContext, "deref.null.panic", func);
-	auto *contBB = llvm::BasicBlock::Create(ctx.llvmContext, "deref.cont", func);
+	ctx.emitCheck(isNull, CodeGenContext::panicNullDeref);
+}
+
+/// Checks the index against the bounds of the array and returns it as an i64.
+llvm::Value *emitBoundsCheck(gen::CodeGenContext &ctx, llvm::Value *arrayVal,
+							 llvm::Value *indexVal) {
+	// Fat pointer: { T* data, i64 size }
+	auto *sizeVal = ctx.irBuilder.CreateExtractValue(arrayVal, 1U);
+	auto *indexI64 = ctx.irBuilder.CreateSExt(indexVal, ctx.irBuilder.getInt64Ty());
+
+	// The size is never negative, so as unsigned numbers negative indices are out of bounds too.
+	auto *isOutOfBounds = ctx.irBuilder.CreateICmpUGE(indexI64, sizeVal);
+	ctx.emitCheck(isOutOfBounds, CodeGenContext::panicOutOfBounds);
+	return indexI64;
+}
 
-	ctx.irBuilder.CreateCondBr(isNull, panicBB, contBB);
+/// Checks the index against the bounds of the array and returns the address of the element.
+llvm::Value *emitElementAddress(gen::CodeGenContext &ctx, llvm::Value *arrayVal,
+								llvm::Value *indexVal, Type elementType) {
+	VERIFY(!CodeGenContext::isBitArray(elementType));
+	auto *indexI64 = emitBoundsCheck(ctx, arrayVal, indexVal);
+	auto *dataPtr = ctx.irBuilder.CreateExtractValue(arrayVal, 0U);
+
+	auto *elemType = ctx.typeConverter.convert(elementType);
+	return ctx.irBuilder.CreateInBoundsGEP(elemType, dataPtr, {indexI64});
+}
+
+/// The word of a bool array an element is stored in and the position of its bit in the word.
+struct BitAddress {
+	llvm::Value *word;
+	llvm::Value *bit;
+};
+
+/// Checks the index against the bounds of the bool array and returns where its bit is.
+BitAddress emitBitAddress(gen::CodeGenContext &ctx, llvm::Value *arrayVal, llvm::Value *indexVal) {
+	auto *indexI64 = emitBoundsCheck(ctx, arrayVal, indexVal);
+	auto *dataPtr = ctx.irBuilder.CreateExtractValue(arrayVal, 0U);
+
+	// The index is in bounds, so it is not negative.
+	constexpr auto bitsPerWord = CodeGenContext::bitsPerWord;
+	auto *wordIndex = ctx.irBuilder.CreateLShr(indexI64, std::countr_zero(bitsPerWord));
+	auto *word = ctx.irBuilder.CreateInBoundsGEP(ctx.irBuilder.getInt64Ty(), dataPtr, {wordIndex});
+	auto *bit = ctx.irBuilder.CreateAnd(indexI64, bitsPerWord - 1);
+	return {.word = word, .bit = bit};
+}
 
-	ctx.irBuilder.SetInsertPoint(panicBB);
-	auto *panicType = llvm::FunctionType::get(ctx.irBuilder.getVoidTy(), false);
-	auto panic = ctx.llvmModule.getOrInsertFunction("__panic_null_deref", panicType);
-	ctx.irBuilder.CreateCall(panic, {});
-	ctx.irBuilder.CreateUnreachable();
+/// Whether the expression is an element of a bool array, which has no address of its own.
+bool isBitArrayElement(const ast::Expr &n) {
+	if (n.kind != ast::NodeKind::IndexExpr) {
+		return false;
+	}
 
-	ctx.irBuilder.SetInsertPoint(contBB);
+	const auto &base = *static_cast<const ast::IndexExpr &>(n).base;
+	const auto *arrayType = static_cast<const ArrayType *>(base.inferredType.value());
+	return CodeGenContext::isBitArray(arrayType->elementType);
 }
 
 llvm::Value *extractArrayDataPtr(gen::CodeGenContext &ctx, llvm::Value *arrayVal) {
 	return ctx.irBuilder.CreateExtractValue(arrayVal, 0U);
 }
+
+llvm::Constant *getConstant(gen::CodeGenContext &ctx, const ast::ConstValue &value, Type type) {
+	auto *llvmType = ctx.typeConverter.convert(type);
+
+	if (!type->isTypeKind(TypeKind::Struct)) {
+		return llvm::ConstantInt::get(llvmType, static_cast<u64>(value.scalar));
+	}
+
+	const auto *structType = static_cast<StructType *>(type);
+	Vec<llvm::Constant *> fields(value.fields.size());
+
+	for (u32 i = 0; i < value.fields.size(); ++i) {
+		const auto index = ctx.typeConverter.getFieldIndex(structType->name, i);
+		fields[index] = getConstant(ctx, value.fields[i], structType->orderedFields[i].second);
+	}
+
+	return llvm::ConstantStruct::get(static_cast<llvm::StructType *>(llvmType), fields);
+}
 }
 
-ExprLowerer::ExprLowerer(CodeGenContext &ctx, AllocManager &allocManager)
+ExprLowerer::ExprLowerer(CodeGenContext &ctx, AllocManager &allocManager,
+						 const OwnershipAnalysis &ownership)
 	: m_Context(ctx)
-	, m_AllocManager(allocManager) {}
+	, m_AllocManager(allocManager)
+	, m_Ownership(ownership) {}
 
 ExprResult ExprLowerer::lowerExpr(const ast::Expr &n) {
+	// Constants own nothing that would have to be dropped.
+	if (n.constValue) {
+		const auto type = n.inferredType.value();
+		return {.value = getConstant(m_Context, n.constValue.value(), type),
+				.type = type,
+				.isTemp = true};
+	}
+
 	return dispatch(n);
 }
 
+void ExprLowerer::lowerInto(const ast::Expr &n, llvm::Value *dest, Type destType) {
+	if (n.kind == ast::NodeKind::StructInit && !n.constValue) {
+		const auto &structInit = static_cast<const ast::StructInit &>(n);
+		const auto *structType = static_cast<StructType *>(n.inferredType.value());
+		auto *const llvmStructType =
+				static_cast<llvm::StructType *>(m_Context.typeConverter.convert(structType));
+
+		// The arguments are evaluated in declaration order of the fields, like in visit.
+		for (u32 i = 0; i < structInit.args.size(); ++i) {
+			const auto index = m_Context.typeConverter.getFieldIndex(structType->name, i);
+			auto *const fieldPtr = m_Context.irBuilder.CreateStructGEP(llvmStructType, dest, index);
+			lowerInto(*structInit.args[i], fieldPtr, structType->orderedFields[i].second);
+		}
+
+		return;
+	}
+
+	const auto [value, type, isTemp] = lowerExpr(n);
+	auto *valueToStore = coerceNullToTarget(m_Context, value, type, destType);
+
+	if (isTemp) {
+		removeFromExprCleanup(value);
+	} else {
+		valueToStore = m_Context.copyValue(valueToStore, destType);
+	}
+
+	m_Context.irBuilder.CreateStore(valueToStore, dest);
+}
+
 void ExprLowerer::addToExprCleanup(llvm::Value *value, Type type) {
 	m_ExprCleanup.emplace_back(value, type);
 }
@@ -66,7 +164,8 @@ ExprResult ExprLowerer::lowerLValue(const ast::Expr &n) {
 
 			VERIFY(reg.has_value());
 
-			return {.value = reg.value().value, .type = reg.value().type, .isTemp = false};
+			// The inferred type of a borrowed parameter &T is the T stored in its slot.
+			return {.value = reg.value().value, .type = n.inferredType.value(), .isTemp = false};
 		}
 
 		case ast::NodeKind::UnaryExpr: {
@@ -83,9 +182,9 @@ ExprResult ExprLowerer::lowerLValue(const ast::Expr &n) {
 				const auto reg = m_AllocManager.getAlloca(varRef.ident);
 				VERIFY(reg.has_value());
 
-				auto *const llvmOperandType = m_Context.typeConverter.convert(reg.value().type);
+				operandType = varRef.inferredType.value();
+				auto *const llvmOperandType = m_Context.typeConverter.convert(operandType);
 				ptrValue = m_Context.irBuilder.CreateLoad(llvmOperandType, reg.value().value);
-				operandType = reg.value().type;
 			} else {
 				// For other operands (heap alloc, function returns pointer, complex expr),
 				// lowerExpr should produce the pointer value directly.
@@ -119,7 +218,7 @@ ExprResult ExprLowerer::lowerLValue(const ast::Expr &n) {
 			for (u32 i = 0; i < structType->orderedFields.size(); ++i) {
 				const auto &[fieldName, type] = structType->orderedFields[i];
 				if (fieldName == fieldAccess.field) {
-					fieldIndex = i;
+					fieldIndex = m_Context.typeConverter.getFieldIndex(structType->name, i);
 					fieldType = type;
 					found = true;
 					break;
@@ -143,50 +242,8 @@ ExprResult ExprLowerer::lowerLValue(const ast::Expr &n) {
 			VERIFY(arrayType->isTypeKind(TypeKind::Array));
 			auto *arrType = static_cast<ArrayType *>(arrayType);
 
-			// Fat pointer: { T* data, i64 size }
-			// Extract data pointer (field 0)
-			auto *dataPtrPtr = m_Context.irBuilder.CreateExtractValue(arrayVal, 0U);
-
-			// Extract size (field 1)
-			auto *sizeVal = m_Context.irBuilder.CreateExtractValue(arrayVal, 1U);
-
-			// Convert index to i64
-			auto *indexI64 =
-					m_Context.irBuilder.CreateSExt(indexVal,
-												   llvm::Type::getInt64Ty(
-														   m_Context.irBuilder.getContext()));
-
-			// Bounds check
-			auto *isNegative = m_Context.irBuilder.CreateICmpSLT(
-					indexI64,
-					llvm::ConstantInt::get(llvm::Type::getInt64Ty(m_Context.irBuilder.getContext()),
-										   0));
-			auto *isOutOfBounds = m_Context.irBuilder.CreateICmpSGE(indexI64, sizeVal);
-			auto *shouldTrap = m_Context.irBuilder.CreateOr(isNegative, isOutOfBounds);
-
-			// Emit bounds check trap
-			auto *trapFunc = m_Context.irBuilder.GetInsertBlock()->getParent();
-			VERIFY(trapFunc);
-
-			auto *trapBB =
-					llvm::BasicBlock::Create(m_Context.llvmContext, "bounds.check.trap", trapFunc);
-			auto *contBB =
-					llvm::BasicBlock::Create(m_Context.llvmContext, "bounds.check.cont", trapFunc);
-
-			m_Context.irBuilder.CreateCondBr(shouldTrap, trapBB, contBB);
-
-			m_Context.irBuilder.SetInsertPoint(trapBB);
-			auto *panicType = llvm::FunctionType::get(m_Context.irBuilder.getVoidTy(), false);
-			auto panic =
-					m_Context.llvmModule.getOrInsertFunction("__panic_out_of_bounds", panicType);
-			m_Context.irBuilder.CreateCall(panic, {});
-			m_Context.irBuilder.CreateUnreachable();
-
-			m_Context.irBuilder.SetInsertPoint(contBB);
-
-			// Compute GEP
-			auto *elemType = m_Context.typeConverter.convert(arrType->elementType);
-			auto *elemPtr = m_Context.irBuilder.CreateInBoundsGEP(elemType, dataPtrPtr, {indexI64});
+			auto *elemPtr =
+					emitElementAddress(m_Context, arrayVal, indexVal, arrType->elementType);
 
 			return {.value = elemPtr, .type = arrType->elementType, .isTemp = false};
 		}
@@ -236,41 +293,7 @@ ExprResult ExprLowerer::visit(const ast::NullLit &n) {
 
 ExprResult ExprLowerer::visit(const ast::HeapAlloc &n) {
 	const auto &ptrType = n.inferredType.value();
-
-	// Original non-array heap allocation logic
-	llvm::Value *value = nullptr;
-	Type type = nullptr;
-	bool isTemp = true;
-
-	// If allocation uses default initialization, synthesize a zero/null value
-	if (n.expr->kind == ast::NodeKind::DefaultInit) {
-		type = n.type;
-		auto *const llvmType = m_Context.typeConverter.convert(type);
-
-		if (type->isTypeKind(TypeKind::Pointer)) {
-			value = llvm::ConstantPointerNull::get(static_cast<llvm::PointerType *>(llvmType));
-		} else if (type->isTypeKind(TypeKind::Primitive) || type->isTypeKind(TypeKind::Unit)) {
-			value = llvm::ConstantInt::get(llvmType, 0);
-		} else {
-			value = llvm::ConstantAggregateZero::get(llvmType);
-		}
-
-		isTemp = true;
-	} else {
-		const auto [v, t, tmp] = lowerExpr(*n.expr);
-		value = v;
-		type = t;
-		isTemp = tmp;
-	}
-
-	// If the value is a temporary, we can just move it into the heap allocation.
-	// If it's not a temporary, we need to copy it first so that the heap allocation
-	// owns the data that was put inside it.
-	if (isTemp) {
-		removeFromExprCleanup(value);
-	} else {
-		m_Context.copyValue(value, type);
-	}
+	const auto &type = n.type;
 
 	// Create a new shared pointer via the runtime
 	auto *const func = m_Context.llvmModule.getFunction(CodeGenContext::sharedPtrCreate);
@@ -280,11 +303,27 @@ ExprResult ExprLowerer::visit(const ast::HeapAlloc &n) {
 	auto *const dtor = m_Context.getDestructor(type).value_or(nullDtor);
 	auto *const sharedPtr = m_Context.irBuilder.CreateCall(func, {size, dtor});
 
-	// Store the value into the shared pointer
 	auto *const elemType = m_Context.typeConverter.convert(type);
 	auto *const destPointerType = llvm::PointerType::getUnqual(elemType);
 	auto *const dest = m_Context.irBuilder.CreateBitCast(sharedPtr, destPointerType);
-	m_Context.irBuilder.CreateStore(value, dest);
+
+	// If allocation uses default initialization, store a zero/null value. Otherwise the value
+	// is constructed right in the heap cell, which then owns it.
+	if (n.expr->kind == ast::NodeKind::DefaultInit) {
+		llvm::Value *value = nullptr;
+
+		if (type->isTypeKind(TypeKind::Pointer)) {
+			value = llvm::ConstantPointerNull::get(static_cast<llvm::PointerType *>(elemType));
+		} else if (type->isTypeKind(TypeKind::Primitive) || type->isTypeKind(TypeKind::Unit)) {
+			value = llvm::ConstantInt::get(elemType, 0);
+		} else {
+			value = llvm::ConstantAggregateZero::get(elemType);
+		}
+
+		m_Context.irBuilder.CreateStore(value, dest);
+	} else {
+		lowerInto(*n.expr, dest, type);
+	}
 
 	// Now the pointer is owned by the current expression, so we need to clean it up after
 	// the expression is done. The pointer might still be moved by an outer node.
@@ -304,9 +343,17 @@ ExprResult ExprLowerer::visit(const ast::ArrayHeapAlloc &n) {
 	auto *elementSize = m_Context.sizeOf(n.elementType);
 	auto *elemDtor = m_Context.getDestructor(n.elementType).value_or(m_Context.getNullDestructor());
 
+	// The runtime only sees the words of a bool array, which it zeroes like any other array.
+	auto *allocCount = countI64;
+	if (CodeGenContext::isBitArray(n.elementType)) {
+		allocCount = m_Context.getBitArrayWords(countI64);
+		const auto wordSize = CodeGenContext::bitsPerWord / 8;
+		elementSize = llvm::ConstantInt::get(elementSize->getType(), wordSize);
+	}
+
 	auto *createArrFunc = m_Context.llvmModule.getFunction(CodeGenContext::arrayCreate);
 	auto *dataPtr =
-			m_Context.irBuilder.CreateCall(createArrFunc, {elementSize, countI64, elemDtor});
+			m_Context.irBuilder.CreateCall(createArrFunc, {elementSize, allocCount, elemDtor});
 
 	auto *fatPtrType = m_Context.typeConverter.convert(arrayType);
 	llvm::Value *fatPtr = llvm::UndefValue::get(fatPtrType);
@@ -324,6 +371,7 @@ ExprResult ExprLowerer::visit(const ast::StructInit &n) {
 			static_cast<llvm::StructType *>(m_Context.typeConverter.convert(resultType));
 	llvm::Value *aggregate = llvm::UndefValue::get(llvmResultType);
 
+	// The arguments are evaluated in declaration order of the fields, whatever slots they go to.
 	const auto *structType = static_cast<StructType *>(resultType);
 	for (u32 i = 0; i < n.args.size(); ++i) {
 		const auto &[resValue, resType, resIsTemp] = lowerExpr(*n.args[i]);
@@ -336,7 +384,8 @@ ExprResult ExprLowerer::visit(const ast::StructInit &n) {
 			removeFromExprCleanup(resValue);
 		}
 
-		aggregate = m_Context.irBuilder.CreateInsertValue(aggregate, valueToInsert, {i});
+		const auto index = m_Context.typeConverter.getFieldIndex(structType->name, i);
+		aggregate = m_Context.irBuilder.CreateInsertValue(aggregate, valueToInsert, {index});
 	}
 
 	addToExprCleanup(aggregate, resultType);
@@ -352,6 +401,15 @@ ExprResult ExprLowerer::visit(const ast::VarRef &n) {
 		auto *const ptrToValue = alloc.value().value;
 		auto *const value = m_Context.irBuilder.CreateLoad(llvmType, ptrToValue);
 
+		// The last use of an owned local hands its value over and leaves null behind, which
+		// makes a later drop of the local do nothing.
+		if (m_Ownership.isMove(n)) {
+			m_Context.irBuilder.CreateStore(llvm::Constant::getNullValue(llvmType), ptrToValue);
+			++m_Context.rcStats.elidedCopies;
+
+			return {.value = value, .type = type, .isTemp = true};
+		}
+
 		// Return local variable as a borrow
 		return {.value = value, .type = type, .isTemp = false};
 	}
@@ -379,47 +437,17 @@ ExprResult ExprLowerer::visit(const ast::IndexExpr &n) {
 	VERIFY(arrayType->isTypeKind(TypeKind::Array));
 	auto *arrType = static_cast<ArrayType *>(arrayType);
 
-	// Fat pointer structure: { T* data, i64 size }
-	// Extract data pointer (field 0)
-	auto *dataPtrPtr = m_Context.irBuilder.CreateExtractValue(arrayVal, 0U);
-
-	// Extract size (field 1)
-	auto *sizeVal = m_Context.irBuilder.CreateExtractValue(arrayVal, 1U);
-
-	// Convert index to i64 for comparison
-	auto *indexI64 =
-			m_Context.irBuilder.CreateSExt(indexVal, llvm::Type::getInt64Ty(
-															 m_Context.irBuilder.getContext()));
-
-	// Bounds check: if (index < 0 || index >= size) trap
-	auto *isNegative = m_Context.irBuilder.CreateICmpSLT(
-			indexI64,
-			llvm::ConstantInt::get(llvm::Type::getInt64Ty(m_Context.irBuilder.getContext()), 0));
-	auto *isOutOfBounds = m_Context.irBuilder.CreateICmpSGE(indexI64, sizeVal);
-	auto *shouldTrap = m_Context.irBuilder.CreateOr(isNegative, isOutOfBounds);
-
-	// Emit trap if bounds check fails
-	auto *func = m_Context.irBuilder.GetInsertBlock()->getParent();
-	VERIFY(func);
-
-	auto *trapBB = llvm::BasicBlock::Create(m_Context.llvmContext, "bounds.check.trap", func);
-	auto *contBB = llvm::BasicBlock::Create(m_Context.llvmContext, "bounds.check.cont", func);
+	if (CodeGenContext::isBitArray(arrType->elementType)) {
+		const auto [wordPtr, bit] = emitBitAddress(m_Context, arrayVal, indexVal);
+		auto *word = m_Context.irBuilder.CreateLoad(m_Context.irBuilder.getInt64Ty(), wordPtr);
+		auto *shifted = m_Context.irBuilder.CreateLShr(word, bit);
+		auto *value = m_Context.irBuilder.CreateTrunc(shifted, m_Context.irBuilder.getInt1Ty());
 
-	m_Context.irBuilder.CreateCondBr(shouldTrap, trapBB, contBB);
-
-	m_Context.irBuilder.SetInsertPoint(trapBB);
-	auto *panicType = llvm::FunctionType::get(m_Context.irBuilder.getVoidTy(), false);
-	auto panic = m_Context.llvmModule.getOrInsertFunction("__panic_out_of_bounds", panicType);
-	m_Context.irBuilder.CreateCall(panic, {});
-	m_Context.irBuilder.CreateUnreachable();
-
-	m_Context.irBuilder.SetInsertPoint(contBB);
+		return {.value = value, .type = arrType->elementType, .isTemp = true};
+	}
 
-	// Compute GEP: data[index]
+	auto *elemPtr = emitElementAddress(m_Context, arrayVal, indexVal, arrType->elementType);
 	auto *elemType = m_Context.typeConverter.convert(arrType->elementType);
-	auto *elemPtr = m_Context.irBuilder.CreateInBoundsGEP(elemType, dataPtrPtr, {indexI64});
-
-	// Load element
 	auto *value = m_Context.irBuilder.CreateLoad(elemType, elemPtr);
 
 	return {.value = value, .type = arrType->elementType, .isTemp = false};
@@ -482,6 +510,10 @@ ExprResult ExprLowerer::visit(const ast::UnaryExpr &n) {
 }
 
 ExprResult ExprLowerer::visit(const ast::BinaryExpr &n) {
+	if (n.op == BinaryOpKind::LogicalAnd || n.op == BinaryOpKind::LogicalOr) {
+		return lowerShortCircuit(n);
+	}
+
 	auto [left, leftType, isLeftTemp] = lowerExpr(*n.left);
 	auto [right, rightType, isRightTemp] = lowerExpr(*n.right);
 
@@ -646,20 +678,6 @@ ExprResult ExprLowerer::visit(const ast::BinaryExpr &n) {
 			}
 			UNREACHABLE();
 
-		case LogicalAnd:
-			if (leftType == TypeFactory::getBool()) {
-				auto *const val = m_Context.irBuilder.CreateAnd(left, right);
-				return {.value = val, .type = leftType, .isTemp = true};
-			}
-			UNREACHABLE();
-
-		case LogicalOr:
-			if (leftType == TypeFactory::getBool()) {
-				auto *const val = m_Context.irBuilder.CreateOr(left, right);
-				return {.value = val, .type = leftType, .isTemp = true};
-			}
-			UNREACHABLE();
-
 		case BitwiseAnd:
 			if (leftType == TypeFactory::getI32()) {
 				auto *const val = m_Context.irBuilder.CreateAnd(left, right);
@@ -699,24 +717,112 @@ ExprResult ExprLowerer::visit(const ast::BinaryExpr &n) {
 	}
 }
 
+ExprResult ExprLowerer::lowerShortCircuit(const ast::BinaryExpr &n) {
+	const auto isAnd = n.op == BinaryOpKind::LogicalAnd;
+	const auto [left, leftType, _] = lowerExpr(*n.left);
+	VERIFY(leftType == TypeFactory::getBool());
+
+	auto *func = m_Context.irBuilder.GetInsertBlock()->getParent();
+	auto *leftBlock = m_Context.irBuilder.GetInsertBlock();
+	auto *rightBlock = llvm::BasicBlock::Create(m_Context.llvmContext, isAnd ? "and.rhs" : "or.rhs",
+												func);
+	auto *mergeBlock = llvm::BasicBlock::Create(m_Context.llvmContext,
+												isAnd ? "and.merge" : "or.merge", func);
+
+	// && is false if the left operand is, || is true if the left operand is.
+	if (isAnd) {
+		m_Context.irBuilder.CreateCondBr(left, rightBlock, mergeBlock);
+	} else {
+		m_Context.irBuilder.CreateCondBr(left, mergeBlock, rightBlock);
+	}
+
+	// The temporaries of the right operand only exist on its branch, so they are dropped there.
+	m_Context.irBuilder.SetInsertPoint(rightBlock);
+	auto outerCleanup = std::move(m_ExprCleanup);
+	m_ExprCleanup.clear();
+
+	const auto right = lowerExpr(*n.right);
+	emitExprCleanup();
+	m_ExprCleanup = std::move(outerCleanup);
+
+	auto *rightEnd = m_Context.irBuilder.GetInsertBlock();
+	m_Context.irBuilder.CreateBr(mergeBlock);
+
+	m_Context.irBuilder.SetInsertPoint(mergeBlock);
+	auto *result = m_Context.irBuilder.CreatePHI(m_Context.irBuilder.getInt1Ty(), 2);
+	result->addIncoming(m_Context.irBuilder.getInt1(!isAnd), leftBlock);
+	result->addIncoming(right.value, rightEnd);
+
+	return {.value = result, .type = leftType, .isTemp = true};
+}
+
 ExprResult ExprLowerer::visit(const ast::FuncCall &n) {
-	const auto &[callee, type, isTemp] = lowerExpr(*n.expr);
+	const auto [type, callee, args] = lowerCallOperands(n, false);
+	const auto &call = m_Context.irBuilder.CreateCall(type, callee, args);
+
+	const auto funcType = static_cast<FunctionType *>(n.expr->inferredType.value());
+	addToExprCleanup(call, funcType->returnType);
+
+	return {.value = call, .type = n.inferredType.value(), .isTemp = true};
+}
+
+CallOperands ExprLowerer::lowerCallOperands(const ast::FuncCall &n, const bool isTailCall) {
+	auto [callee, type, isTemp] = lowerExpr(*n.expr);
 	VERIFY(type->isTypeKind(TypeKind::Function));
 	const auto funcType = static_cast<FunctionType *>(type);
 
+	// Direct calls of functions with borrowed parameters go to their borrowing variant.
+	const Vec<bool> *borrowedParams = nullptr;
+	if (n.expr->kind == ast::NodeKind::VarRef) {
+		const auto &ident = static_cast<const ast::VarRef &>(*n.expr).ident;
+
+		if (!m_AllocManager.getAlloca(ident)) {
+			borrowedParams = m_Ownership.getBorrowedParams(ident);
+		}
+
+		if (borrowedParams) {
+			const auto borrowingName = OwnershipAnalysis::getBorrowingName(ident);
+			callee = m_Context.llvmModule.getFunction(borrowingName.asAscii());
+			VERIFY(callee);
+		}
+	}
+
 	Vec<llvm::Value *> args;
 	args.reserve(n.args.size());
 
 	for (u32 i = 0; i < n.args.size(); ++i) {
 		const auto &arg = n.args[i];
 		const auto &[resValue, resType, resIsTemp] = lowerExpr(*arg);
-		auto *argValue = coerceNullToTarget(m_Context, resValue, resType, funcType->paramTypes[i]);
 
-		if (resIsTemp) {
+		auto paramType = funcType->paramTypes[i];
+		const auto isReference = paramType->isTypeKind(TypeKind::Reference);
+		if (isReference) {
+			paramType = static_cast<ReferenceType *>(paramType)->referencedType;
+		}
+
+		auto *argValue = coerceNullToTarget(m_Context, resValue, resType, paramType);
+
+		// A borrowed argument stays owned by the caller: temporaries are dropped with the rest
+		// of the expression and values that nothing keeps alive during the call are copied.
+		if (isReference || (borrowedParams && (*borrowedParams)[i])) {
+			if (resIsTemp) {
+				args.push_back(argValue);
+			} else if (isTailCall || m_Ownership.isBorrowedArg(*arg)) {
+				args.push_back(argValue);
+
+				if (isRefCounted(paramType)) {
+					++m_Context.rcStats.elidedCopies;
+				}
+			} else {
+				auto *copy = m_Context.copyValue(argValue, paramType);
+				addToExprCleanup(copy, paramType);
+				args.push_back(copy);
+			}
+		} else if (resIsTemp) {
 			removeFromExprCleanup(resValue);
 			args.push_back(argValue);
 		} else {
-			args.push_back(m_Context.copyValue(argValue, funcType->paramTypes[i]));
+			args.push_back(m_Context.copyValue(argValue, paramType));
 		}
 	}
 	Vec<llvm::Type *> llvmParamTypes;
@@ -727,29 +833,38 @@ ExprResult ExprLowerer::visit(const ast::FuncCall &n) {
 	auto *llvmReturnType = m_Context.typeConverter.convert(funcType->returnType);
 	auto *llvmFuncType = llvm::FunctionType::get(llvmReturnType, llvmParamTypes, false);
 
-	const auto &call = m_Context.irBuilder.CreateCall(llvmFuncType, callee, args);
-
-	addToExprCleanup(call, funcType->returnType);
-
-	return {.value = call, .type = n.inferredType.value(), .isTemp = true};
+	return {.type = llvmFuncType, .callee = callee, .args = std::move(args)};
 }
 
 ExprResult ExprLowerer::visit(const ast::Assignment &n) {
+	if (isBitArrayElement(*n.left)) {
+		return lowerBitAssignment(n);
+	}
+
 	const auto &[leftLValue, leftType, isLeftTemp] = lowerLValue(*n.left);
 	const auto &[right, rightType, isRightTemp] = lowerExpr(*n.right);
 	auto *adjustedRight = coerceNullToTarget(m_Context, right, rightType, leftType);
 	const auto &llvmLeftType = m_Context.typeConverter.convert(n.left->inferredType.value());
 	const auto &left = m_Context.irBuilder.CreateLoad(llvmLeftType, leftLValue);
 
+	// A borrowed local neither retains its new value nor releases the old one
+	const auto isLeftBorrowed =
+			n.left->kind == ast::NodeKind::VarRef &&
+			m_AllocManager.isBorrowed(static_cast<const ast::VarRef &>(*n.left).ident);
+
 	// First retain the right side
 	if (isRightTemp) {
 		removeFromExprCleanup(right);
+	} else if (isLeftBorrowed) {
+		++m_Context.rcStats.elidedCopies;
 	} else {
 		m_Context.copyValue(adjustedRight, leftType);
 	}
 
 	// If left is temp the expression cleanup will take care of it
-	if (!isLeftTemp) {
+	if (isLeftBorrowed) {
+		++m_Context.rcStats.elidedDrops;
+	} else if (!isLeftTemp) {
 		m_Context.dropValue(left, leftType);
 	}
 
@@ -843,4 +958,26 @@ ExprResult ExprLowerer::visit(const ast::Assignment &n) {
 			.type = leftType,
 			.isTemp = true};
 }
+
+ExprResult ExprLowerer::lowerBitAssignment(const ast::Assignment &n) {
+	// Bools have no compound assignments.
+	VERIFY(n.assignmentKind == AssignmentKind::Simple);
+
+	const auto &indexExpr = static_cast<const ast::IndexExpr &>(*n.left);
+	auto *arrayVal = lowerExpr(*indexExpr.base).value;
+	auto *indexVal = lowerExpr(*indexExpr.index).value;
+	const auto [wordPtr, bit] = emitBitAddress(m_Context, arrayVal, indexVal);
+	auto *right = lowerExpr(*n.right).value;
+
+	auto &builder = m_Context.irBuilder;
+	auto *word = builder.CreateLoad(builder.getInt64Ty(), wordPtr);
+	auto *mask = builder.CreateShl(builder.getInt64(1), bit);
+	auto *cleared = builder.CreateAnd(word, builder.CreateNot(mask));
+	auto *value = builder.CreateShl(builder.CreateZExt(right, builder.getInt64Ty()), bit);
+	builder.CreateStore(builder.CreateOr(cleared, value), wordPtr);
+
+	return {.value = llvm::ConstantInt::getNullValue(builder.getInt8Ty()),
+			.type = n.left->inferredType.value(),
+			.isTemp = true};
+}
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "AllocManager.h"
+#include "OwnershipAnalysis.h"
 #include "CodeGenContext.h"
 #include "ast/Visitor.h"
 
@@ -10,17 +11,35 @@ struct ExprResult {
 	bool isTemp;
 };
 
+/// The function a call goes to and the arguments it passes, before the call is emitted.
+struct CallOperands {
+	llvm::FunctionType *type;
+	llvm::Value *callee;
+	Vec<llvm::Value *> args;
+};
+
 struct ExprLowerer : ast::ConstVisitor<ExprResult> {
 private:
 	CodeGenContext &m_Context;
 	AllocManager &m_AllocManager;
+	const OwnershipAnalysis &m_Ownership;
 	Vec<TrackedValue> m_ExprCleanup;
 
 public:
-	ExprLowerer(CodeGenContext &ctx, AllocManager &allocManager);
+	ExprLowerer(CodeGenContext &ctx, AllocManager &allocManager,
+				const OwnershipAnalysis &ownership);
 
 	ExprResult lowerExpr(const ast::Expr &n);
 
+	/// Lowers the expression into the memory at the address, which then owns the value. Struct
+	/// initializers store their fields right into it instead of building the whole aggregate.
+	/// Locals get whole values instead, field stores would keep them from living in registers.
+	void lowerInto(const ast::Expr &n, llvm::Value *dest, Type destType);
+
+	/// Lowers the callee and the arguments of a call. A tail call passes the arguments for
+	/// borrowed parameters without copying them, the caller made sure that they outlive the call.
+	CallOperands lowerCallOperands(const ast::FuncCall &n, bool isTailCall);
+
 	void addToExprCleanup(llvm::Value *value, Type type);
 	void emitExprCleanup();
 	void removeFromExprCleanup(llvm::Value *value);
@@ -42,5 +61,13 @@ public:
 	ExprResult visit(const ast::BinaryExpr &n) override;
 	ExprResult visit(const ast::FuncCall &n) override;
 	ExprResult visit(const ast::Assignment &n) override;
+
+private:
+	/// Lowers && and ||, which only evaluate their right operand if the left one does not decide
+	/// the result.
+	ExprResult lowerShortCircuit(const ast::BinaryExpr &n);
+
+	/// Lowers the assignment of an element of a bool array, which sets or clears its bit.
+	ExprResult lowerBitAssignment(const ast::Assignment &n);
 };
 }
\ No newline at end of file
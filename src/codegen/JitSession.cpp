@@ -0,0 +1,121 @@
+#include "JitSession.h"
+
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include "core/PrintUtil.h"
+
+// Provided by ocn_stdlib.c, which is linked into the compiler.
+extern "C" {
+void print_i32(i32);
+void print_bool(i8);
+void print_char(i32);
+void print_newline();
+i32 read_i32();
+i8 read_bool();
+i32 read_char();
+void __panic_null_deref();
+void __panic_out_of_bounds();
+void *__sp_create(size_t, void (*)(void *));
+void *__sp_copy(void *);
+void __sp_drop(void *);
+void *__arr_create(size_t, size_t, void (*)(void *));
+void *__arr_copy(void *);
+void __arr_drop(void *);
+void __ocn_free(void *);
+}
+
+namespace gen {
+JitSession::JitSession(Box<llvm::orc::LLJIT> jit)
+	: m_Jit(std::move(jit)) {}
+
+llvm::Expected<Box<JitSession>> JitSession::create() {
+	llvm::InitializeNativeTarget();
+	llvm::InitializeNativeTargetAsmPrinter();
+
+	auto jit = llvm::orc::LLJITBuilder().create();
+	if (!jit) {
+		return jit.takeError();
+	}
+
+	auto session = Box<JitSession>(new JitSession(std::move(jit.get())));
+	if (auto err = session->defineRuntimeSymbols()) {
+		return std::move(err);
+	}
+
+	return session;
+}
+
+llvm::Error JitSession::defineRuntimeSymbols() {
+	llvm::orc::SymbolMap symbols;
+	const auto define = [&](const char *name, auto *fn) {
+		symbols[m_Jit->mangleAndIntern(name)] = llvm::orc::ExecutorSymbolDef(
+				llvm::orc::ExecutorAddr::fromPtr(fn),
+				llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+	};
+
+	define("print_i32", &print_i32);
+	define("print_bool", &print_bool);
+	define("print_char", &print_char);
+	define("print_newline", &print_newline);
+	define("read_i32", &read_i32);
+	define("read_bool", &read_bool);
+	define("read_char", &read_char);
+	define("__panic_null_deref", &__panic_null_deref);
+	define("__panic_out_of_bounds", &__panic_out_of_bounds);
+	define(CodeGenContext::sharedPtrCreate, &__sp_create);
+	define(CodeGenContext::sharedPtrCopy, &__sp_copy);
+	define(CodeGenContext::sharedPtrDrop, &__sp_drop);
+	define(CodeGenContext::arrayCreate, &__arr_create);
+	define(CodeGenContext::arrayCopy, &__arr_copy);
+	define(CodeGenContext::arrayDrop, &__arr_drop);
+	define(CodeGenContext::runtimeFree, &__ocn_free);
+
+	auto &dylib = m_Jit->getMainJITDylib();
+	if (auto err = dylib.define(llvm::orc::absoluteSymbols(std::move(symbols)))) {
+		return err;
+	}
+
+	// Anything else the generated code needs (e.g. memcpy) comes from the C library.
+	auto processSymbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+			m_Jit->getDataLayout().getGlobalPrefix());
+	if (!processSymbols) {
+		return processSymbols.takeError();
+	}
+
+	dylib.addGenerator(std::move(processSymbols.get()));
+	return llvm::Error::success();
+}
+
+llvm::Error JitSession::addModule(CodeGenContext &ctx) {
+	auto [llvmContext, llvmModule] = ctx.releaseModule();
+	return m_Jit->addIRModule(
+			llvm::orc::ThreadSafeModule(std::move(llvmModule), std::move(llvmContext)));
+}
+
+llvm::Expected<void *> JitSession::lookup(const U8String &name) {
+	auto symbol = m_Jit->lookup(name.asAscii());
+	if (!symbol) {
+		return symbol.takeError();
+	}
+
+	return symbol->toPtr<void *>();
+}
+
+llvm::Expected<i32> JitSession::runMain(const std::string &programName,
+										const Vec<std::string> &args) {
+	auto mainAddress = lookup(u8"main");
+	if (!mainAddress) {
+		return mainAddress.takeError();
+	}
+
+	using MainFn = int (*)(int, char *[]);
+	const auto exitCode = llvm::orc::runAsMain(reinterpret_cast<MainFn>(*mainAddress), args,
+											   llvm::StringRef(programName));
+
+	util::flushProgramOutput();
+	return exitCode;
+}
+}
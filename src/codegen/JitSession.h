@@ -0,0 +1,31 @@
+#pragma once
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+
+#include "CodeGenContext.h"
+
+namespace gen {
+/// Compiles generated modules in memory with ORC LLJIT and runs them inside the compiler process.
+/// The runtime (ocn_stdlib.c) is linked into the compiler, so its functions are resolved to their
+/// addresses in this process instead of going through clang and a linker.
+struct JitSession {
+private:
+	Box<llvm::orc::LLJIT> m_Jit;
+
+	explicit JitSession(Box<llvm::orc::LLJIT> jit);
+
+	llvm::Error defineRuntimeSymbols();
+
+public:
+	static llvm::Expected<Box<JitSession>> create();
+
+	/// Takes ownership of the module generated into ctx and adds it to the JIT.
+	llvm::Error addModule(CodeGenContext &ctx);
+
+	/// Looks up a function of a previously added module and returns its address.
+	llvm::Expected<void *> lookup(const U8String &name);
+
+	/// Calls the 'main' function of the added modules with argc/argv built from programName and
+	/// args, and returns its exit code.
+	llvm::Expected<i32> runMain(const std::string &programName, const Vec<std::string> &args);
+};
+}
@@ -0,0 +1,966 @@
+#include "OwnershipAnalysis.h"
+
+#include <algorithm>
+
+#include "ast/Visitor.h"
+#include "core/DefaultDecls.h"
+
+namespace gen {
+namespace {
+/// Calls fn for every direct subexpression of n.
+template <typename Fn>
+void forEachOperand(const ast::Expr &n, Fn &&fn) {
+	switch (n.kind) {
+		case ast::NodeKind::HeapAlloc: {
+			const auto &heapAlloc = static_cast<const ast::HeapAlloc &>(n);
+			fn(*heapAlloc.expr);
+			break;
+		}
+
+		case ast::NodeKind::ArrayHeapAlloc: {
+			const auto &arrayHeapAlloc = static_cast<const ast::ArrayHeapAlloc &>(n);
+			fn(*arrayHeapAlloc.size);
+			break;
+		}
+
+		case ast::NodeKind::StructInit: {
+			for (const auto &arg : static_cast<const ast::StructInit &>(n).args)
+				fn(*arg);
+			break;
+		}
+
+		case ast::NodeKind::UnaryExpr: {
+			fn(*static_cast<const ast::UnaryExpr &>(n).operand);
+			break;
+		}
+
+		case ast::NodeKind::BinaryExpr: {
+			const auto &binaryExpr = static_cast<const ast::BinaryExpr &>(n);
+			fn(*binaryExpr.left);
+			fn(*binaryExpr.right);
+			break;
+		}
+
+		case ast::NodeKind::Assignment: {
+			const auto &assignment = static_cast<const ast::Assignment &>(n);
+			fn(*assignment.left);
+			fn(*assignment.right);
+			break;
+		}
+
+		case ast::NodeKind::FuncCall: {
+			const auto &funcCall = static_cast<const ast::FuncCall &>(n);
+			fn(*funcCall.expr);
+			for (const auto &arg : funcCall.args)
+				fn(*arg);
+			break;
+		}
+
+		case ast::NodeKind::FieldAccess: {
+			fn(*static_cast<const ast::FieldAccess &>(n).base);
+			break;
+		}
+
+		case ast::NodeKind::IndexExpr: {
+			const auto &indexExpr = static_cast<const ast::IndexExpr &>(n);
+			fn(*indexExpr.base);
+			fn(*indexExpr.index);
+			break;
+		}
+
+		case ast::NodeKind::LenExpr: {
+			fn(*static_cast<const ast::LenExpr &>(n).base);
+			break;
+		}
+
+		default: break;
+	}
+}
+
+bool containsKind(const ast::Expr &n, const ast::NodeKind kind) {
+	bool found = n.kind == kind;
+	forEachOperand(n, [&](const ast::Expr &operand) {
+		found = found || containsKind(operand, kind);
+	});
+	return found;
+}
+
+/// Whether the right operand is only evaluated if the left one does not decide the result.
+bool isShortCircuit(const ast::BinaryExpr &n) {
+	return n.op == BinaryOpKind::LogicalAnd || n.op == BinaryOpKind::LogicalOr;
+}
+
+/// Walks the statements and expressions of a function in evaluation order. The passes below
+/// override the nodes at which values change hands.
+struct FunctionWalker : ast::ConstVisitor<void> {
+	virtual void visitOperands(const ast::Expr &n) {
+		forEachOperand(n, [this](const ast::Expr &operand) { dispatch(operand); });
+	}
+
+	void visit(const ast::IntLit &) override {}
+	void visit(const ast::CharLit &) override {}
+	void visit(const ast::BoolLit &) override {}
+	void visit(const ast::NullLit &) override {}
+	void visit(const ast::UnitLit &) override {}
+	void visit(const ast::DefaultInit &) override {}
+	void visit(const ast::VarRef &) override {}
+
+	void visit(const ast::HeapAlloc &n) override {
+		visitOperands(n);
+	}
+
+	void visit(const ast::ArrayHeapAlloc &n) override {
+		visitOperands(n);
+	}
+
+	void visit(const ast::StructInit &n) override {
+		visitOperands(n);
+	}
+
+	void visit(const ast::UnaryExpr &n) override {
+		visitOperands(n);
+	}
+
+	void visit(const ast::BinaryExpr &n) override {
+		visitOperands(n);
+	}
+
+	void visit(const ast::Assignment &n) override {
+		visitOperands(n);
+	}
+
+	void visit(const ast::FuncCall &n) override {
+		visitOperands(n);
+	}
+
+	void visit(const ast::FieldAccess &n) override {
+		visitOperands(n);
+	}
+
+	void visit(const ast::IndexExpr &n) override {
+		visitOperands(n);
+	}
+
+	void visit(const ast::LenExpr &n) override {
+		visitOperands(n);
+	}
+
+	void visit(const ast::BlockStmt &n) override {
+		for (const auto &stmt : n.stmts)
+			dispatch(*stmt);
+	}
+
+	void visit(const ast::IfStmt &n) override {
+		dispatch(*n.cond);
+		dispatch(*n.then);
+		dispatch(*n.else_);
+	}
+
+	void visit(const ast::WhileStmt &n) override {
+		dispatch(*n.cond);
+		dispatch(*n.body);
+	}
+
+	void visit(const ast::ReturnStmt &n) override {
+		dispatch(*n.expr);
+	}
+
+	void visit(const ast::VarDef &n) override {
+		dispatch(*n.value);
+	}
+};
+
+struct Variable {
+	Type type;
+	LocalKey key;
+	const ast::VarDef *def;
+	bool isAssigned = false;
+	/// Every value the variable is initialized with or assigned, nullptr for compound assignments.
+	Vec<const ast::Expr *> values;
+};
+
+/// A use of a variable whose value gets a new owner, which copies it unless the use is a move.
+struct Consumer {
+	/// The variable the value is stored in, if any.
+	Opt<u32> target;
+	/// The call the value is passed to as argument argIndex, if any.
+	const ast::FuncCall *call = nullptr;
+	u32 argIndex = 0;
+};
+
+/// Resolves the variables of a function in the same way as the AllocManager scopes them during
+/// code generation and records how they are assigned and consumed.
+struct VariableCollector : FunctionWalker {
+private:
+	Vec<Map<U8String, u32>> m_Scopes;
+	Vec<const ast::BlockStmt *> m_Blocks;
+
+	void consume(const ast::Expr &value, const Consumer &consumer) {
+		if (value.kind == ast::NodeKind::VarRef && resolve(value))
+			consumers[&static_cast<const ast::VarRef &>(value)] = consumer;
+	}
+
+public:
+	Vec<Variable> vars;
+	Map<const ast::VarRef *, u32> refs;
+	Map<const ast::VarDef *, u32> defs;
+	Map<const ast::BlockStmt *, Vec<u32>> blockVars;
+	Map<const ast::VarRef *, Consumer> consumers;
+	Vec<const ast::FuncCall *> calls;
+
+	explicit VariableCollector(const ast::FuncDecl &func) {
+		m_Scopes.emplace_back();
+
+		for (const auto &param : func.params) {
+			m_Scopes.back()[param.first] = static_cast<u32>(vars.size());
+			vars.push_back({.type = param.second, .key = &param, .def = nullptr});
+		}
+
+		dispatch(*func.body);
+	}
+
+	[[nodiscard]] Opt<u32> resolve(const ast::Expr &n) const {
+		if (n.kind != ast::NodeKind::VarRef)
+			return {};
+
+		const auto it = refs.find(&static_cast<const ast::VarRef &>(n));
+		if (it == refs.end())
+			return {};
+
+		return it->second;
+	}
+
+	void visit(const ast::HeapAlloc &n) override {
+		visitOperands(n);
+		consume(*n.expr, {});
+	}
+
+	void visit(const ast::StructInit &n) override {
+		visitOperands(n);
+
+		for (const auto &arg : n.args)
+			consume(*arg, {});
+	}
+
+	void visit(const ast::FuncCall &n) override {
+		visitOperands(n);
+		calls.push_back(&n);
+
+		for (u32 i = 0; i < n.args.size(); ++i)
+			consume(*n.args[i], {.call = &n, .argIndex = i});
+	}
+
+	void visit(const ast::Assignment &n) override {
+		visitOperands(n);
+
+		const auto id = resolve(*n.left);
+		if (id) {
+			auto &var = vars[*id];
+			var.isAssigned = true;
+			var.values.push_back(n.assignmentKind == AssignmentKind::Simple ? n.right.get()
+																			  : nullptr);
+		}
+
+		if (n.assignmentKind == AssignmentKind::Simple)
+			consume(*n.right, {.target = id});
+	}
+
+	void visit(const ast::VarRef &n) override {
+		for (auto it = m_Scopes.rbegin(); it != m_Scopes.rend(); ++it) {
+			if (const auto var = it->find(n.ident); var != it->end()) {
+				refs[&n] = var->second;
+				return;
+			}
+		}
+	}
+
+	void visit(const ast::BlockStmt &n) override {
+		m_Scopes.emplace_back();
+		m_Blocks.push_back(&n);
+
+		for (const auto &stmt : n.stmts)
+			dispatch(*stmt);
+
+		m_Blocks.pop_back();
+		m_Scopes.pop_back();
+	}
+
+	void visit(const ast::ReturnStmt &n) override {
+		dispatch(*n.expr);
+		consume(*n.expr, {});
+	}
+
+	void visit(const ast::VarDef &n) override {
+		dispatch(*n.value);
+
+		const auto id = static_cast<u32>(vars.size());
+		vars.push_back({.type = n.type, .key = &n, .def = &n, .values = {n.value.get()}});
+		m_Scopes.back()[n.ident] = id;
+		defs[&n] = id;
+		blockVars[m_Blocks.back()].push_back(id);
+		consume(*n.value, {.target = id});
+	}
+};
+
+/// The locals whose borrowed value may have been freed since they were last assigned.
+struct FlowState {
+	Vec<bool> stale;
+	bool isReachable = true;
+
+	void join(const FlowState &other) {
+		if (!other.isReachable)
+			return;
+
+		if (!isReachable) {
+			*this = other;
+			return;
+		}
+
+		for (size_t i = 0; i < stale.size(); ++i)
+			stale[i] = stale[i] || other.stale[i];
+	}
+
+	bool operator==(const FlowState &) const = default;
+};
+
+/// Walks a function in evaluation order and marks every borrowing candidate that is used while
+/// its value may already have been freed.
+struct FlowChecker : FunctionWalker {
+private:
+	const VariableCollector &m_Collector;
+	const Vec<bool> &m_Candidates;
+	const Map<const ast::VarRef *, Consumer> &m_HandOvers;
+	FlowState m_State;
+
+	void clobber() {
+		m_State.stale = m_Candidates;
+	}
+
+	void define(const u32 id) {
+		if (m_Candidates[id])
+			m_State.stale[id] = false;
+	}
+
+public:
+	Vec<bool> failed;
+
+	FlowChecker(const VariableCollector &collector, const Vec<bool> &candidates,
+				const Map<const ast::VarRef *, Consumer> &handOvers, const ast::FuncDecl &func)
+		: m_Collector(collector)
+		, m_Candidates(candidates)
+		, m_HandOvers(handOvers)
+		, m_State{.stale = Vec<bool>(candidates.size(), false)}
+		, failed(candidates.size(), false) {
+		dispatch(*func.body);
+	}
+
+	void visit(const ast::IndexExpr &n) override {
+		// The element is loaded through the base after the index is evaluated.
+		dispatch(*n.index);
+		dispatch(*n.base);
+	}
+
+	void visit(const ast::FuncCall &n) override {
+		visitOperands(n);
+
+		// The runtime functions only print and read values.
+		const auto isBuiltin =
+				n.expr->kind == ast::NodeKind::VarRef && !m_Collector.resolve(*n.expr) &&
+				s_DefaultDecls.contains(static_cast<const ast::VarRef &>(*n.expr).ident);
+
+		if (!isBuiltin)
+			clobber();
+	}
+
+	void visit(const ast::Assignment &n) override {
+		const auto id = m_Collector.resolve(*n.left);
+
+		if (id && n.assignmentKind == AssignmentKind::Simple) {
+			dispatch(*n.right);
+
+			if (m_Candidates[*id]) {
+				define(*id);
+			} else if (isRefCounted(m_Collector.vars[*id].type)) {
+				clobber();
+			}
+
+			return;
+		}
+
+		// The address of the left side is computed first but only stored to after the right
+		// side is evaluated.
+		dispatch(*n.right);
+		dispatch(*n.left);
+
+		if (isRefCounted(n.left->inferredType.value()))
+			clobber();
+	}
+
+	void visit(const ast::VarRef &n) override {
+		const auto id = m_Collector.resolve(n);
+		if (!id)
+			return;
+
+		if (m_Candidates[*id] && m_State.stale[*id])
+			failed[*id] = true;
+
+		// An owned value handed over to a temporary may be moved into it and freed with it.
+		const auto it = m_HandOvers.find(&n);
+		if (it != m_HandOvers.end() && !m_Candidates[*id] &&
+			!(it->second.target && m_Candidates[*it->second.target])) {
+			clobber();
+		}
+	}
+
+	void visit(const ast::BlockStmt &n) override {
+		for (const auto &stmt : n.stmts) {
+			if (!m_State.isReachable)
+				break;
+
+			dispatch(*stmt);
+		}
+
+		if (!m_State.isReachable)
+			return;
+
+		// Owned locals are dropped at the end of their block.
+		if (const auto it = m_Collector.blockVars.find(&n); it != m_Collector.blockVars.end()) {
+			for (const auto id : it->second) {
+				if (!m_Candidates[id] && isRefCounted(m_Collector.vars[id].type)) {
+					clobber();
+					break;
+				}
+			}
+		}
+	}
+
+	void visit(const ast::BinaryExpr &n) override {
+		if (!isShortCircuit(n)) {
+			visitOperands(n);
+			return;
+		}
+
+		dispatch(*n.left);
+		const auto skipped = m_State;
+		dispatch(*n.right);
+		m_State.join(skipped);
+	}
+
+	void visit(const ast::IfStmt &n) override {
+		dispatch(*n.cond);
+
+		const auto entry = m_State;
+		dispatch(*n.then);
+
+		auto merged = m_State;
+		m_State = entry;
+		dispatch(*n.else_);
+
+		merged.join(m_State);
+		m_State = merged;
+	}
+
+	void visit(const ast::WhileStmt &n) override {
+		auto entry = m_State;
+
+		while (true) {
+			m_State = entry;
+			dispatch(*n.cond);
+			dispatch(*n.body);
+
+			auto next = entry;
+			next.join(m_State);
+
+			if (next == entry)
+				break;
+
+			entry = next;
+		}
+
+		m_State = entry;
+		dispatch(*n.cond);
+	}
+
+	void visit(const ast::ReturnStmt &n) override {
+		dispatch(*n.expr);
+		m_State.isReachable = false;
+	}
+
+	void visit(const ast::VarDef &n) override {
+		dispatch(*n.value);
+		define(m_Collector.defs.at(&n));
+	}
+};
+
+/// Walks a function backwards and tracks which variables are read again later. A candidate use
+/// is a move only if its variable is dead after it every time the use is reached.
+struct LivenessChecker : FunctionWalker {
+private:
+	const VariableCollector &m_Collector;
+	const std::unordered_set<const ast::VarRef *> &m_Candidates;
+	Vec<bool> m_Live;
+
+	void visitOperands(const ast::Expr &n) override {
+		Vec<const ast::Expr *> operands;
+		forEachOperand(n, [&](const ast::Expr &operand) { operands.push_back(&operand); });
+
+		for (auto it = operands.rbegin(); it != operands.rend(); ++it)
+			dispatch(**it);
+	}
+
+	void join(const Vec<bool> &other) {
+		for (size_t i = 0; i < m_Live.size(); ++i)
+			m_Live[i] = m_Live[i] || other[i];
+	}
+
+public:
+	std::unordered_set<const ast::VarRef *> lastUses;
+	std::unordered_set<const ast::VarRef *> liveUses;
+
+	LivenessChecker(const VariableCollector &collector,
+					const std::unordered_set<const ast::VarRef *> &candidates,
+					const ast::FuncDecl &func)
+		: m_Collector(collector)
+		, m_Candidates(candidates)
+		, m_Live(collector.vars.size(), false) {
+		dispatch(*func.body);
+	}
+
+	void visit(const ast::IndexExpr &n) override {
+		dispatch(*n.base);
+		dispatch(*n.index);
+	}
+
+	void visit(const ast::BinaryExpr &n) override {
+		if (!isShortCircuit(n)) {
+			visitOperands(n);
+			return;
+		}
+
+		const auto skipped = m_Live;
+		dispatch(*n.right);
+		join(skipped);
+		dispatch(*n.left);
+	}
+
+	void visit(const ast::Assignment &n) override {
+		const auto id = m_Collector.resolve(*n.left);
+
+		if (!id) {
+			dispatch(*n.left);
+			dispatch(*n.right);
+			return;
+		}
+
+		// A compound assignment reads the variable after evaluating the right side.
+		m_Live[*id] = n.assignmentKind != AssignmentKind::Simple;
+		dispatch(*n.right);
+	}
+
+	void visit(const ast::VarRef &n) override {
+		const auto id = m_Collector.resolve(n);
+		if (!id)
+			return;
+
+		if (m_Candidates.contains(&n))
+			(m_Live[*id] ? liveUses : lastUses).insert(&n);
+
+		m_Live[*id] = true;
+	}
+
+	void visit(const ast::BlockStmt &n) override {
+		for (auto it = n.stmts.rbegin(); it != n.stmts.rend(); ++it)
+			dispatch(**it);
+	}
+
+	void visit(const ast::IfStmt &n) override {
+		const auto exit = m_Live;
+		dispatch(*n.then);
+
+		const auto then = m_Live;
+		m_Live = exit;
+		dispatch(*n.else_);
+
+		join(then);
+		dispatch(*n.cond);
+	}
+
+	void visit(const ast::WhileStmt &n) override {
+		const auto exit = m_Live;
+		dispatch(*n.cond);
+		auto head = m_Live;
+
+		while (true) {
+			dispatch(*n.body);
+			join(exit);
+			dispatch(*n.cond);
+
+			if (m_Live == head)
+				break;
+
+			head = m_Live;
+		}
+	}
+
+	void visit(const ast::ReturnStmt &n) override {
+		std::fill(m_Live.begin(), m_Live.end(), false);
+		dispatch(*n.expr);
+	}
+
+	void visit(const ast::VarDef &n) override {
+		m_Live[m_Collector.defs.at(&n)] = false;
+		dispatch(*n.value);
+	}
+};
+
+/// Walks a function in evaluation order and records which variables are moved out on every path
+/// that reaches a cleanup.
+struct MoveChecker : FunctionWalker {
+private:
+	const VariableCollector &m_Collector;
+	const std::unordered_set<const ast::VarRef *> &m_Moves;
+	Vec<bool> m_Moved;
+	bool m_IsReachable = true;
+
+	void record(const ast::Node &cleanup) {
+		auto [it, isNew] = movedAt.try_emplace(&cleanup, m_Moved);
+		if (isNew)
+			return;
+
+		// Cleanups within loops are reached once per iteration.
+		for (size_t i = 0; i < m_Moved.size(); ++i)
+			it->second[i] = it->second[i] && m_Moved[i];
+	}
+
+	void meet(const Vec<bool> &other) {
+		for (size_t i = 0; i < m_Moved.size(); ++i)
+			m_Moved[i] = m_Moved[i] && other[i];
+	}
+
+public:
+	Map<const ast::Node *, Vec<bool>> movedAt;
+
+	MoveChecker(const VariableCollector &collector,
+				const std::unordered_set<const ast::VarRef *> &moves, const ast::FuncDecl &func)
+		: m_Collector(collector)
+		, m_Moves(moves)
+		, m_Moved(collector.vars.size(), false) {
+		dispatch(*func.body);
+
+		if (m_IsReachable)
+			record(func);
+	}
+
+	void visit(const ast::Assignment &n) override {
+		visitOperands(n);
+
+		if (const auto id = m_Collector.resolve(*n.left))
+			m_Moved[*id] = false;
+	}
+
+	void visit(const ast::VarRef &n) override {
+		if (m_Moves.contains(&n))
+			m_Moved[m_Collector.refs.at(&n)] = true;
+	}
+
+	void visit(const ast::BinaryExpr &n) override {
+		if (!isShortCircuit(n)) {
+			visitOperands(n);
+			return;
+		}
+
+		// A move in the right operand does not happen if the left one decides the result.
+		dispatch(*n.left);
+		const auto skipped = m_Moved;
+		dispatch(*n.right);
+		meet(skipped);
+	}
+
+	void visit(const ast::BlockStmt &n) override {
+		for (const auto &stmt : n.stmts) {
+			if (!m_IsReachable)
+				return;
+
+			dispatch(*stmt);
+		}
+
+		if (m_IsReachable)
+			record(n);
+	}
+
+	void visit(const ast::IfStmt &n) override {
+		dispatch(*n.cond);
+
+		const auto entry = m_Moved;
+		dispatch(*n.then);
+
+		const auto then = m_Moved;
+		const auto isThenReachable = m_IsReachable;
+		m_Moved = entry;
+		m_IsReachable = true;
+		dispatch(*n.else_);
+
+		if (!m_IsReachable) {
+			m_Moved = then;
+			m_IsReachable = isThenReachable;
+		} else if (isThenReachable) {
+			meet(then);
+		}
+	}
+
+	void visit(const ast::WhileStmt &n) override {
+		auto head = m_Moved;
+
+		while (true) {
+			m_Moved = head;
+			dispatch(*n.cond);
+			dispatch(*n.body);
+
+			if (m_IsReachable)
+				meet(head);
+			else
+				m_Moved = head;
+
+			m_IsReachable = true;
+			if (m_Moved == head)
+				break;
+
+			head = m_Moved;
+		}
+
+		dispatch(*n.cond);
+	}
+
+	void visit(const ast::ReturnStmt &n) override {
+		dispatch(*n.expr);
+		record(n);
+		m_IsReachable = false;
+	}
+
+	void visit(const ast::VarDef &n) override {
+		dispatch(*n.value);
+		m_Moved[m_Collector.defs.at(&n)] = false;
+	}
+};
+}
+
+OwnershipAnalysis OwnershipAnalysis::analyze(const ast::Module &module) {
+	OwnershipAnalysis result;
+	Vec<Box<VariableCollector>> collectors;
+
+	for (const auto &func : module.funcs) {
+		auto &collector = *collectors.emplace_back(std::make_unique<VariableCollector>(*func));
+
+		Vec<bool> borrowedParams;
+		bool hasBorrowedParam = false;
+
+		for (u32 i = 0; i < func->params.size(); ++i) {
+			const auto &var = collector.vars[i];
+			borrowedParams.push_back(isRefCounted(var.type) && !var.isAssigned);
+			hasBorrowedParam = hasBorrowedParam || borrowedParams.back();
+		}
+
+		if (hasBorrowedParam)
+			result.m_BorrowedParams[func->ident] = std::move(borrowedParams);
+	}
+
+	for (size_t f = 0; f < module.funcs.size(); ++f) {
+		const auto &func = module.funcs[f];
+		const auto &collector = collectors[f];
+		const auto &vars = collector->vars;
+
+		// Parameters declared as &T are borrowed by every call, the ones inferred above only by
+		// direct calls, which go to the borrowing variant.
+		const auto isBorrowedPosition = [&](const ast::FuncCall &call, const u32 i) {
+			const auto *funcType = static_cast<FunctionType *>(call.expr->inferredType.value());
+			if (funcType->paramTypes[i]->isTypeKind(TypeKind::Reference))
+				return true;
+
+			if (call.expr->kind != ast::NodeKind::VarRef || collector->resolve(*call.expr))
+				return false;
+
+			const auto &callee = static_cast<const ast::VarRef &>(*call.expr).ident;
+			const auto *borrowedParams = result.getBorrowedParams(callee);
+			return borrowedParams && (*borrowedParams)[i];
+		};
+
+		const auto *ownParams = result.getBorrowedParams(func->ident);
+		Vec<bool> isBorrowedParam(vars.size(), false);
+		for (u32 i = 0; ownParams && i < func->params.size(); ++i)
+			isBorrowedParam[i] = (*ownParams)[i];
+
+		// Uses that give a reference counted value a new owner, except for the arguments the
+		// callee borrows.
+		Map<const ast::VarRef *, Consumer> handOvers;
+		for (const auto &[use, consumer] : collector->consumers) {
+			if (!isRefCounted(vars[collector->refs.at(use)].type))
+				continue;
+
+			if (consumer.call && isBorrowedPosition(*consumer.call, consumer.argIndex))
+				continue;
+
+			handOvers[use] = consumer;
+		}
+
+		// A value loaded from a variable, possibly through fields, pointers and elements, is kept
+		// alive by that variable until something frees memory.
+		std::function<bool(const ast::Expr &)> isLoaded = [&](const ast::Expr &n) {
+			switch (n.kind) {
+				case ast::NodeKind::VarRef: return collector->resolve(n).has_value();
+				case ast::NodeKind::FieldAccess:
+					return isLoaded(*static_cast<const ast::FieldAccess &>(n).base);
+				case ast::NodeKind::UnaryExpr: {
+					const auto &unaryExpr = static_cast<const ast::UnaryExpr &>(n);
+					return unaryExpr.op == UnaryOpKind::Dereference && isLoaded(*unaryExpr.operand);
+				}
+				case ast::NodeKind::IndexExpr: {
+					const auto &indexExpr = static_cast<const ast::IndexExpr &>(n);
+					return isLoaded(*indexExpr.base) &&
+						   !containsKind(*indexExpr.index, ast::NodeKind::FuncCall) &&
+						   !containsKind(*indexExpr.index, ast::NodeKind::Assignment);
+				}
+				default: return false;
+			}
+		};
+
+		Vec<bool> candidates(vars.size(), false);
+		for (size_t id = 0; id < vars.size(); ++id) {
+			const auto &var = vars[id];
+			if (!var.def || !(var.type->isTypeKind(TypeKind::Pointer) ||
+							  var.type->isTypeKind(TypeKind::Array))) {
+				continue;
+			}
+
+			candidates[id] = std::ranges::all_of(var.values, [&](const ast::Expr *value) {
+				return value && (value->kind == ast::NodeKind::NullLit ||
+								 value->kind == ast::NodeKind::DefaultInit || isLoaded(*value));
+			});
+		}
+
+		// Locals that turn out to be owned drop their value when assigned, which may free the
+		// values other candidates borrow, so the check is repeated until nothing changes.
+		while (true) {
+			const FlowChecker checker(*collector, candidates, handOvers, *func);
+
+			if (std::ranges::none_of(checker.failed, std::identity{}))
+				break;
+
+			for (size_t i = 0; i < candidates.size(); ++i)
+				candidates[i] = candidates[i] && !checker.failed[i];
+		}
+
+		for (size_t id = 0; id < vars.size(); ++id) {
+			if (candidates[id])
+				result.m_BorrowedLocals.insert(vars[id].def);
+		}
+
+		// A hand over of an owned variable can move the value unless it is stored in a local that
+		// only borrows, which would then borrow from nothing.
+		std::unordered_set<const ast::VarRef *> moveCandidates;
+		for (const auto &[use, consumer] : handOvers) {
+			const auto id = collector->refs.at(use);
+
+			if (candidates[id] || isBorrowedParam[id])
+				continue;
+
+			if (!(consumer.target && candidates[*consumer.target]))
+				moveCandidates.insert(use);
+		}
+
+		std::unordered_set<const ast::VarRef *> moves;
+		if (!moveCandidates.empty()) {
+			const LivenessChecker liveness(*collector, moveCandidates, *func);
+
+			for (const auto *use : liveness.lastUses) {
+				if (!liveness.liveUses.contains(use))
+					moves.insert(use);
+			}
+		}
+
+		std::function<bool(const ast::Expr &, u32)> movesVar = [&](const ast::Expr &n, u32 id) {
+			if (n.kind == ast::NodeKind::VarRef) {
+				return moves.contains(&static_cast<const ast::VarRef &>(n)) &&
+					   collector->resolve(n) == id;
+			}
+
+			bool found = false;
+			forEachOperand(n, [&](const ast::Expr &operand) {
+				found = found || movesVar(operand, id);
+			});
+			return found;
+		};
+
+		for (const auto *call : collector->calls) {
+			// An argument assigning a local might change it before the callee returns.
+			const auto assignsLocal = std::ranges::any_of(call->args, [](const auto &arg) {
+				return containsKind(*arg, ast::NodeKind::Assignment);
+			});
+
+			if (assignsLocal)
+				continue;
+
+			for (u32 i = 0; i < call->args.size(); ++i) {
+				const auto id = collector->resolve(*call->args[i]);
+				if (!isBorrowedPosition(*call, i) || !id || candidates[*id])
+					continue;
+
+				// Another argument moving the local out no longer keeps the value alive.
+				const auto isMovedOut = std::ranges::any_of(call->args, [&](const auto &arg) {
+					return movesVar(*arg, *id);
+				});
+
+				if (!isMovedOut)
+					result.m_BorrowedArgs.insert(call->args[i].get());
+			}
+		}
+
+		if (moves.empty())
+			continue;
+
+		const MoveChecker moveChecker(*collector, moves, *func);
+
+		for (const auto &[cleanup, moved] : moveChecker.movedAt) {
+			LocalSet locals;
+			for (size_t id = 0; id < vars.size(); ++id) {
+				if (moved[id])
+					locals.insert(vars[id].key);
+			}
+
+			if (!locals.empty())
+				result.m_MovedLocals[cleanup] = std::move(locals);
+		}
+
+		result.m_Moves.merge(moves);
+	}
+
+	return result;
+}
+
+U8String OwnershipAnalysis::getBorrowingName(const U8String &func) {
+	return func + u8".borrowed";
+}
+
+const Vec<bool> *OwnershipAnalysis::getBorrowedParams(const U8String &func) const {
+	const auto it = m_BorrowedParams.find(func);
+	return it != m_BorrowedParams.end() ? &it->second : nullptr;
+}
+
+bool OwnershipAnalysis::isBorrowed(const ast::VarDef &local) const {
+	return m_BorrowedLocals.contains(&local);
+}
+
+bool OwnershipAnalysis::isBorrowedArg(const ast::Expr &arg) const {
+	return m_BorrowedArgs.contains(&arg);
+}
+
+bool OwnershipAnalysis::isMove(const ast::VarRef &use) const {
+	return m_Moves.contains(&use);
+}
+
+const LocalSet &OwnershipAnalysis::getMovedLocals(const ast::Node &cleanup) const {
+	static const LocalSet s_None;
+
+	const auto it = m_MovedLocals.find(&cleanup);
+	return it != m_MovedLocals.end() ? it->second : s_None;
+}
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <unordered_set>
+
+#include "ast/AST.h"
+
+namespace gen {
+/// Identifies a local variable by its VarDef, or a parameter by its Param in the FuncDecl.
+using LocalKey = const void *;
+using LocalSet = std::unordered_set<LocalKey>;
+
+///
+/// Finds out who owns the reference counted values of a module, so that code generation can
+/// leave out reference count operations whose effect is already guaranteed:
+///
+/// - A parameter declared as &T is borrowed from the caller by every call. Locals of the caller are
+///   passed to it without copying them.
+/// - A parameter that is never assigned is borrowed from the caller. Calls within the module go
+///   to a borrowing variant of the function, which does not drop the parameter, and pass locals
+///   of the caller without copying them. The function itself stays an owning wrapper around the
+///   variant, so function values and other modules see the usual calling convention.
+/// - A pointer or array local that is only ever assigned values loaded from other variables,
+///   like a cursor walking a list, borrows from the heap it was loaded from. This holds as long
+///   as nothing that may free memory (a store of a reference counted value, a call, a drop or a
+///   move of an owned local) happens between an assignment of the local and a use of it.
+/// - The last use of an owned local that hands its value over, e.g. returns it, passes it to an
+///   owned parameter or stores it, moves the value instead of copying it. The local is set to
+///   null when it is moved out, so dropping it again does nothing, and cleanups that are only
+///   reached after the move leave it out.
+///
+struct OwnershipAnalysis {
+private:
+	Map<U8String, Vec<bool>> m_BorrowedParams;
+	std::unordered_set<const ast::VarDef *> m_BorrowedLocals;
+	std::unordered_set<const ast::Expr *> m_BorrowedArgs;
+	std::unordered_set<const ast::VarRef *> m_Moves;
+	Map<const ast::Node *, LocalSet> m_MovedLocals;
+
+public:
+	static OwnershipAnalysis analyze(const ast::Module &module);
+
+	/// Name of the variant of a function that borrows its parameters.
+	static U8String getBorrowingName(const U8String &func);
+
+	/// Returns which parameters of a function of the module are borrowed, nullptr if the
+	/// function owns all of them and has no borrowing variant.
+	[[nodiscard]] const Vec<bool> *getBorrowedParams(const U8String &func) const;
+
+	/// Whether the local only borrows its value and must neither copy nor drop it.
+	[[nodiscard]] bool isBorrowed(const ast::VarDef &local) const;
+
+	/// Whether the argument for a borrowed parameter is passed without copying it, because a
+	/// local or parameter of the caller keeps it alive during the call.
+	[[nodiscard]] bool isBorrowedArg(const ast::Expr &arg) const;
+
+	/// Whether the use is the last one of an owned local and moves its value out.
+	[[nodiscard]] bool isMove(const ast::VarRef &use) const;
+
+	/// Returns the locals that are always moved out when the cleanup at the end of a block, at a
+	/// return statement or at the end of a function is reached.
+	[[nodiscard]] const LocalSet &getMovedLocals(const ast::Node &cleanup) const;
+};
+}
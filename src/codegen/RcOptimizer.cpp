@@ -0,0 +1,192 @@
+#include "RcOptimizer.h"
+
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Transforms/Utils/Local.h>
+#include <llvm/Transforms/Utils/PromoteMemToReg.h>
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "core/DefaultDecls.h"
+
+namespace gen {
+namespace {
+/// Returns the value whose reference count an operation on the value changes. Copies return their
+/// argument, and arrays are copied and dropped through the data pointer of their fat pointer.
+const llvm::Value *getRoot(const llvm::Value *value) {
+	while (true) {
+		value = CodeGenContext::stripCopies(value);
+
+		const auto *extract = llvm::dyn_cast<llvm::ExtractValueInst>(value);
+		if (!extract || extract->getIndices() != llvm::ArrayRef<u32>{0}) {
+			return value;
+		}
+
+		// Look through the fat pointer or struct the value was inserted into. If it was not built
+		// here, the aggregate itself identifies its first field.
+		value = extract->getAggregateOperand();
+		while (const auto *insert = llvm::dyn_cast<llvm::InsertValueInst>(value)) {
+			if (insert->getIndices() == extract->getIndices()) {
+				value = insert->getInsertedValueOperand();
+				break;
+			}
+
+			value = insert->getAggregateOperand();
+		}
+	}
+}
+}
+
+RcOptimizer::RcOptimizer(CodeGenContext &ctx)
+	: m_Context(ctx) {}
+
+void RcOptimizer::optimize(CodeGenContext &ctx) {
+	RcOptimizer optimizer(ctx);
+
+	for (auto &func : ctx.llvmModule) {
+		if (func.isDeclaration()) {
+			continue;
+		}
+
+		optimizer.promoteLocals(func);
+		optimizer.cancelCopyDropPairs(func);
+	}
+}
+
+void RcOptimizer::promoteLocals(llvm::Function &func) {
+	Vec<llvm::AllocaInst *> allocas;
+
+	for (auto &inst : func.getEntryBlock()) {
+		auto *alloca = llvm::dyn_cast<llvm::AllocaInst>(&inst);
+		if (alloca && llvm::isAllocaPromotable(alloca)) {
+			allocas.push_back(alloca);
+		}
+	}
+
+	if (!allocas.empty()) {
+		llvm::DominatorTree domTree(func);
+		llvm::PromoteMemToReg(allocas, domTree);
+	}
+}
+
+bool RcOptimizer::mayRelease(const llvm::Instruction &inst) const {
+	const auto *call = llvm::dyn_cast<llvm::CallBase>(&inst);
+	if (!call || llvm::isa<llvm::IntrinsicInst>(call)) {
+		return false;
+	}
+
+	const auto *callee = call->getCalledFunction();
+	if (!callee) {
+		return true;
+	}
+
+	const auto name = callee->getName();
+	if (name == CodeGenContext::sharedPtrCreate || name == CodeGenContext::sharedPtrCopy ||
+		name == CodeGenContext::arrayCreate || name == CodeGenContext::arrayCopy ||
+		name == CodeGenContext::panicNullDeref || name == CodeGenContext::panicOutOfBounds) {
+		return false;
+	}
+
+	// The builtins only take and return values without reference counts.
+	return std::ranges::none_of(s_DefaultDecls, [&name](const auto &decl) {
+		return decl.first.asAscii() == name;
+	});
+}
+
+bool RcOptimizer::cancels(const llvm::CallInst &copy, const llvm::CallInst &drop,
+						  const llvm::DominatorTree &domTree, const llvm::LoopInfo &loops) const {
+	const auto *copyBlock = copy.getParent();
+	const auto *dropBlock = drop.getParent();
+
+	const auto mayReleaseIn = [this](auto begin, auto end) {
+		return std::any_of(begin, end, [this](const auto &inst) { return mayRelease(inst); });
+	};
+
+	if (copyBlock == dropBlock && copy.comesBefore(&drop)) {
+		return !mayReleaseIn(std::next(copy.getIterator()), drop.getIterator());
+	}
+
+	if (!domTree.dominates(&copy, &drop) ||
+		loops.getLoopFor(copyBlock) != loops.getLoopFor(dropBlock)) {
+		return false;
+	}
+
+	if (llvm::isa<llvm::ReturnInst>(copyBlock->getTerminator()) ||
+		mayReleaseIn(std::next(copy.getIterator()), copyBlock->end()) ||
+		mayReleaseIn(dropBlock->begin(), drop.getIterator())) {
+		return false;
+	}
+
+	// Every path from the copy must reach the drop without returning or running the copy again.
+	// Paths into a panic never return, what they leave alive does not matter.
+	Vec<const llvm::BasicBlock *> worklist(llvm::succ_begin(copyBlock), llvm::succ_end(copyBlock));
+	std::unordered_set<const llvm::BasicBlock *> visited;
+
+	while (!worklist.empty()) {
+		const auto *block = worklist.back();
+		worklist.pop_back();
+
+		if (block == dropBlock || !visited.insert(block).second) {
+			continue;
+		}
+
+		if (block == copyBlock || llvm::isa<llvm::ReturnInst>(block->getTerminator()) ||
+			mayReleaseIn(block->begin(), block->end())) {
+			return false;
+		}
+
+		worklist.insert(worklist.end(), llvm::succ_begin(block), llvm::succ_end(block));
+	}
+
+	return true;
+}
+
+void RcOptimizer::cancelCopyDropPairs(llvm::Function &func) {
+	// Canceling a pair removes a drop, which may make the paths of other pairs free of releases.
+	for (bool changed = true; changed;) {
+		changed = false;
+
+		const llvm::DominatorTree domTree(func);
+		const llvm::LoopInfo loops(domTree);
+
+		Vec<llvm::CallInst *> copies;
+		Vec<llvm::CallInst *> drops;
+
+		for (auto &block : func) {
+			for (auto &inst : block) {
+				if (CodeGenContext::isCopy(inst)) {
+					copies.push_back(llvm::cast<llvm::CallInst>(&inst));
+				} else if (CodeGenContext::isDrop(inst)) {
+					drops.push_back(llvm::cast<llvm::CallInst>(&inst));
+				}
+			}
+		}
+
+		for (auto *copy : copies) {
+			const auto *root = getRoot(copy->getArgOperand(0));
+			const auto match = std::ranges::find_if(drops, [&](const llvm::CallInst *drop) {
+				return drop && getRoot(drop->getArgOperand(0)) == root &&
+					   cancels(*copy, *drop, domTree, loops);
+			});
+
+			if (match == drops.end()) {
+				continue;
+			}
+
+			auto *drop = *match;
+			auto *dropped = drop->getArgOperand(0);
+			*match = nullptr;
+
+			// The copy returns its argument, its users get the value the drop would have released.
+			copy->replaceAllUsesWith(copy->getArgOperand(0));
+			copy->eraseFromParent();
+			drop->eraseFromParent();
+			llvm::RecursivelyDeleteTriviallyDeadInstructions(dropped);
+
+			++m_Context.rcStats.elidedCopies;
+			++m_Context.rcStats.elidedDrops;
+			changed = true;
+		}
+	}
+}
+}
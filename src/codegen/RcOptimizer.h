@@ -0,0 +1,50 @@
+#pragma once
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Instructions.h>
+
+#include "CodeGenContext.h"
+
+namespace gen {
+///
+/// Optimizes the reference count operations of a lowered module across statements. Copies and
+/// drops are explicit calls of the runtime in the generated code (__sp_copy and __sp_drop for
+/// pointers, __arr_copy and __arr_drop for arrays), and moves and borrows are already lowered to
+/// plain values. The optimizer first promotes the locals of every function to SSA values, so that
+/// a value keeps its identity from the statement that copies it to the cleanup that drops it.
+///
+/// A copy and a later drop of the same value cancel out, if
+///
+/// - the copy dominates the drop and both are in the same loop, so the drop runs at most once
+///   for every time the copy runs,
+/// - every path from the copy reaches the drop, except paths that end in a panic, and
+/// - nothing on these paths may release a reference, as that could free the value while it is
+///   still used, because it was only kept alive by the copy.
+///
+/// The value stays alive as long as before, its owner just changes: whoever received the copy
+/// takes over the reference the drop would have released.
+///
+struct RcOptimizer {
+private:
+	CodeGenContext &m_Context;
+
+	explicit RcOptimizer(CodeGenContext &ctx);
+
+	void promoteLocals(llvm::Function &func);
+	void cancelCopyDropPairs(llvm::Function &func);
+
+	/// Whether the instruction may drop a reference count to zero, e.g. a call of a function of
+	/// the program.
+	[[nodiscard]] bool mayRelease(const llvm::Instruction &inst) const;
+
+	/// Whether the copy and the drop of the same value can be removed together.
+	[[nodiscard]] bool cancels(const llvm::CallInst &copy, const llvm::CallInst &drop,
+							   const llvm::DominatorTree &domTree,
+							   const llvm::LoopInfo &loops) const;
+
+public:
+	/// Optimizes every function defined in the module of the context and adds the removed
+	/// operations to its statistics.
+	static void optimize(CodeGenContext &ctx);
+};
+}
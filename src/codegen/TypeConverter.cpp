@@ -1,5 +1,9 @@
 #include "TypeConverter.h"
 
+#include <algorithm>
+#include <numeric>
+
+#include <llvm/IR/DataLayout.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 
@@ -23,11 +27,57 @@ llvm::Type *TypeConverter::convert(Type type) {
 		case TypeKind::Struct:	 return convertStruct(static_cast<const StructType &>(*type));
 		case TypeKind::Array:	 return convertArray(static_cast<const ArrayType &>(*type));
 		case TypeKind::Error:	 UNREACHABLE();
+		case TypeKind::Reference: {
+			// A borrowed reference is passed as the value itself, which is a plain pointer for
+			// pointers and arrays, just without the reference count operations.
+			return convert(static_cast<const ReferenceType &>(*type).referencedType);
+		}
 	}
 
 	UNREACHABLE();
 }
 
+void TypeConverter::setStructBody(llvm::StructType &llvmType, const U8String &name,
+								  const Vec<StructField> &fields, const llvm::DataLayout &layout) {
+	Vec<llvm::Type *> fieldTypes;
+	for (const auto &[_, fieldType] : fields) {
+		fieldTypes.push_back(convert(fieldType));
+	}
+
+	Vec<u32> order(fields.size());
+	std::iota(order.begin(), order.end(), 0U);
+
+	// A field is never followed by one with a larger alignment, so only the end of the struct
+	// needs padding. The sort is stable, which keeps the layout the same in every module.
+	if (reorderFields) {
+		std::ranges::stable_sort(order, [&](const u32 a, const u32 b) {
+			const auto alignA = layout.getABITypeAlign(fieldTypes[a]);
+			const auto alignB = layout.getABITypeAlign(fieldTypes[b]);
+			if (alignA != alignB) {
+				return alignA > alignB;
+			}
+
+			return layout.getTypeAllocSize(fieldTypes[a]) > layout.getTypeAllocSize(fieldTypes[b]);
+		});
+	}
+
+	Vec<llvm::Type *> slotTypes;
+	Vec<u32> indices(fields.size());
+	for (u32 slot = 0; slot < order.size(); ++slot) {
+		slotTypes.push_back(fieldTypes[order[slot]]);
+		indices[order[slot]] = slot;
+	}
+
+	llvmType.setBody(slotTypes);
+	m_FieldIndices.insert_or_assign(name, std::move(indices));
+}
+
+u32 TypeConverter::getFieldIndex(const U8String &structName, const u32 field) const {
+	const auto indices = m_FieldIndices.find(structName);
+	VERIFY(indices != m_FieldIndices.end() && field < indices->second.size());
+	return indices->second[field];
+}
+
 llvm::Type *TypeConverter::convertPrimitive(const PrimitiveType &t) {
 	switch (t.primitiveKind) {
 		case PrimitiveKind::I32:  return llvm::Type::getInt32Ty(m_Context);
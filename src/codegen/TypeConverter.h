@@ -4,18 +4,34 @@
 
 namespace llvm {
 class Type;
+class StructType;
 class LLVMContext;
+class DataLayout;
 }
 
 namespace gen {
 struct TypeConverter {
 public:
+	/// Whether setStructBody orders the fields of structs by alignment and size, largest first,
+	/// which removes most of the padding between them. Fields keep their declaration order in
+	/// the language, getFieldIndex maps them to the slots of the LLVM struct.
+	bool reorderFields = false;
+
 	explicit TypeConverter(llvm::LLVMContext &ctx);
 
 	llvm::Type *convert(Type type);
 
+	/// Sets the body of the LLVM struct of a struct with the fields in declaration order. The
+	/// bodies of the structs it contains by value must already be set.
+	void setStructBody(llvm::StructType &llvmType, const U8String &name,
+					   const Vec<StructField> &fields, const llvm::DataLayout &layout);
+
+	/// Returns the slot of the LLVM struct the field with the index in declaration order is in.
+	[[nodiscard]] u32 getFieldIndex(const U8String &structName, u32 field) const;
+
 private:
 	llvm::LLVMContext &m_Context;
+	Map<U8String, Vec<u32>> m_FieldIndices;
 
 	llvm::Type *convertPrimitive(const PrimitiveType &t);
 	llvm::Type *convertPointer(const PointerType &t);
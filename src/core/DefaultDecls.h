@@ -12,4 +12,8 @@ inline Map<U8String, FunctionType *> s_DefaultDecls = {
 		{u8"read_i32", TypeFactory::getFunction({}, TypeFactory::getI32())},
 		{u8"read_bool", TypeFactory::getFunction({}, TypeFactory::getBool())},
 		{u8"read_char", TypeFactory::getFunction({}, TypeFactory::getChar())},
+		{u8"popcount",
+		 TypeFactory::getFunction({TypeFactory::getReference(
+										  TypeFactory::getArray(TypeFactory::getBool()))},
+								  TypeFactory::getI32())},
 };
\ No newline at end of file
@@ -191,3 +191,8 @@ void ErrorHandler::clear() {
 	errors.clear();
 	hasErrors = false;
 }
+
+void ErrorHandler::reset(const U8String &newSourceCode) {
+	clear();
+	sourceCode = newSourceCode;
+}
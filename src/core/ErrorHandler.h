@@ -32,6 +32,11 @@ public:
 	void addError(U8String message, SourceLoc loc, ErrorLevel level = ErrorLevel::ERROR);
 	void printErrors() const;
 
+	// Alle gesammelten Fehler, z.B. um sie als Diagnosen an einen Editor zu senden
+	const std::vector<ErrorMessage> &getErrors() const {
+		return errors;
+	}
+
 	// Prüfen, ob Fehler vorhanden sind
 	bool hasError() const {
 		return hasErrors;
@@ -42,4 +47,7 @@ public:
 
 	// Alle Fehler löschen
 	void clear();
+
+	// Alle Fehler löschen und neuen Quelltext setzen (z.B. für jede Eingabe der REPL)
+	void reset(const U8String &newSourceCode);
 };
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdio>
 #include <format>
 #include <iostream>
 
@@ -28,4 +29,10 @@ namespace util {
 	void print(std::format_string<Args...> fmt, Args &&...args) {
 		std::cout << std::format(fmt, std::forward<Args>(args)...);
 	}
+
+	/// Flushes what a program that ran inside the compiler printed. Programs print through the C
+	/// stdio buffers of this process, which are not flushed together with std::cout.
+	inline void flushProgramOutput() {
+		std::fflush(stdout);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,677 @@
+#include "Document.h"
+
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+
+#include "ast/Visitor.h"
+#include "lexer/Lexer.h"
+#include "parser/Parser.h"
+#include "semantic/passes/ExplorationPass.h"
+#include "semantic/passes/TypeCheckingPass.h"
+#include "type/TypeFactory.h"
+
+namespace lsp {
+namespace {
+/// Struct types are interned for the whole process, so only one document at a time can have its
+/// structs declared. This is the document whose declarations were explored last.
+Document *s_Active = nullptr;
+
+size_t sequenceLength(const unsigned char lead) {
+	if (lead < 0x80)
+		return 1;
+
+	if ((lead >> 5) == 0x6)
+		return 2;
+
+	if ((lead >> 4) == 0xE)
+		return 3;
+
+	if ((lead >> 3) == 0x1E)
+		return 4;
+
+	return 1;
+}
+
+bool isIdentChar(const char c) {
+	return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool isKeywordAt(const std::string &text, const size_t i, const std::string_view keyword) {
+	if (text.compare(i, keyword.size(), keyword) != 0)
+		return false;
+
+	const bool startsWord = i == 0 || !isIdentChar(text[i - 1]);
+	const auto end = i + keyword.size();
+
+	return startsWord && (end == text.size() || !isIdentChar(text[end]));
+}
+
+/// Returns the byte offsets of the lines where top level declarations start, the first one is
+/// always 0. Comments and literals are skipped so their brackets are not counted.
+Vec<size_t> splitDeclarations(const std::string &text) {
+	Vec<size_t> starts = {0};
+	bool hasDecl = false;
+	i32 depth = 0;
+
+	for (size_t i = 0; i < text.size(); ++i) {
+		const char c = text[i];
+		const char next = i + 1 < text.size() ? text[i + 1] : '\0';
+
+		if (c == '/' && next == '/') {
+			i = std::min(text.find('\n', i), text.size()) - 1;
+			continue;
+		}
+
+		if (c == '/' && next == '*') {
+			i = std::min(text.find("*/", i + 2), text.size() - 2) + 1;
+			continue;
+		}
+
+		if (c == '\'' || c == '"') {
+			while (++i < text.size() && text[i] != c && text[i] != '\n') {
+				if (text[i] == '\\')
+					++i;
+			}
+
+			continue;
+		}
+
+		if (c == '{' || c == '(' || c == '[') {
+			++depth;
+			continue;
+		}
+
+		if (c == '}' || c == ')' || c == ']') {
+			depth = std::max(depth - 1, 0);
+			continue;
+		}
+
+		if ((c != 'f' || !isKeywordAt(text, i, "func")) &&
+			(c != 's' || !isKeywordAt(text, i, "struct")))
+			continue;
+
+		// A declaration at the very start of a line is taken as such even if brackets are open,
+		// so a block that is not closed yet while typing does not swallow the rest of the file.
+		const bool startsLine = i == 0 || text[i - 1] == '\n';
+		if (depth != 0 && !startsLine)
+			continue;
+
+		depth = 0;
+		const auto lineStart = i == 0 ? 0 : text.rfind('\n', i - 1) + 1;
+
+		if (hasDecl && lineStart > starts.back())
+			starts.push_back(lineStart);
+
+		hasDecl = true;
+	}
+
+	return starts;
+}
+
+/// Converts an index in code points relative to the declaration to a document position.
+Position positionOf(const Declaration &decl, size_t index) {
+	Position position = {.line = decl.firstLine, .character = 0};
+
+	for (size_t i = 0; i < decl.text.size() && index > 0; --index) {
+		const auto length = sequenceLength(decl.text[i]);
+
+		if (decl.text[i] == '\n') {
+			++position.line;
+			position.character = 0;
+		} else {
+			// Code points outside of the basic plane take two UTF-16 code units.
+			position.character += length == 4 ? 2 : 1;
+		}
+
+		i += length;
+	}
+
+	return position;
+}
+
+Range rangeOf(const Declaration &decl, const SourceLoc &loc) {
+	return {.start = positionOf(decl, loc.index),
+			.end = positionOf(decl, loc.index + std::max<size_t>(loc.length, 1))};
+}
+
+/// Converts a document position to an index in code points relative to the declaration.
+Opt<size_t> indexOf(const Declaration &decl, const Position &position) {
+	Position current = {.line = decl.firstLine, .character = 0};
+	size_t index = 0;
+
+	for (size_t i = 0; i < decl.text.size(); ++index) {
+		if (current.line == position.line && current.character >= position.character)
+			return index;
+
+		if (decl.text[i] == '\n') {
+			if (current.line == position.line)
+				return index;
+
+			++current.line;
+			current.character = 0;
+			++i;
+			continue;
+		}
+
+		const auto length = sequenceLength(decl.text[i]);
+		current.character += length == 4 ? 2 : 1;
+		i += length;
+	}
+
+	return {};
+}
+
+///
+/// Finds the innermost expression that contains an index of a declaration and, for variables,
+/// the local declaration the variable refers to. Locals are tracked while walking the tree, so
+/// shadowing resolves the same way as in the type checker.
+///
+struct ExprFinder : ast::ConstVisitor<void> {
+	const size_t target;
+	const ast::Expr *hit = nullptr;
+	Opt<SourceLoc> definition;
+
+private:
+	Vec<Vec<Pair<U8String, SourceLoc>>> m_Scopes;
+
+public:
+	explicit ExprFinder(const size_t target)
+		: target(target) {}
+
+private:
+	void visitChild(const ast::Node *n) {
+		if (n)
+			dispatch(*n);
+	}
+
+	void enter(const ast::Expr &n) {
+		if (n.loc.index <= target && target < n.loc.index + std::max<size_t>(n.loc.length, 1))
+			hit = &n;
+	}
+
+	void visit(const ast::IntLit &n) override {
+		enter(n);
+	}
+
+	void visit(const ast::CharLit &n) override {
+		enter(n);
+	}
+
+	void visit(const ast::BoolLit &n) override {
+		enter(n);
+	}
+
+	void visit(const ast::NullLit &n) override {
+		enter(n);
+	}
+
+	void visit(const ast::UnitLit &n) override {
+		enter(n);
+	}
+
+	void visit(const ast::DefaultInit &n) override {
+		enter(n);
+	}
+
+	void visit(const ast::HeapAlloc &n) override {
+		enter(n);
+		visitChild(n.expr.get());
+	}
+
+	void visit(const ast::ArrayHeapAlloc &n) override {
+		enter(n);
+		visitChild(n.size.get());
+	}
+
+	void visit(const ast::StructInit &n) override {
+		enter(n);
+
+		for (const auto &arg : n.args)
+			visitChild(arg.get());
+	}
+
+	void visit(const ast::UnaryExpr &n) override {
+		enter(n);
+		visitChild(n.operand.get());
+	}
+
+	void visit(const ast::BinaryExpr &n) override {
+		enter(n);
+		visitChild(n.left.get());
+		visitChild(n.right.get());
+	}
+
+	void visit(const ast::Assignment &n) override {
+		enter(n);
+		visitChild(n.left.get());
+		visitChild(n.right.get());
+	}
+
+	void visit(const ast::FuncCall &n) override {
+		enter(n);
+		visitChild(n.expr.get());
+
+		for (const auto &arg : n.args)
+			visitChild(arg.get());
+	}
+
+	void visit(const ast::VarRef &n) override {
+		enter(n);
+
+		if (hit != &n)
+			return;
+
+		for (auto scope = m_Scopes.rbegin(); scope != m_Scopes.rend(); ++scope) {
+			const auto it = std::ranges::find_if(scope->rbegin(), scope->rend(), [&](auto &local) {
+				return local.first == n.ident;
+			});
+
+			if (it != scope->rend()) {
+				definition = it->second;
+				return;
+			}
+		}
+	}
+
+	void visit(const ast::FieldAccess &n) override {
+		enter(n);
+		visitChild(n.base.get());
+	}
+
+	void visit(const ast::IndexExpr &n) override {
+		enter(n);
+		visitChild(n.base.get());
+		visitChild(n.index.get());
+	}
+
+	void visit(const ast::LenExpr &n) override {
+		enter(n);
+		visitChild(n.base.get());
+	}
+
+	void visit(const ast::BlockStmt &n) override {
+		m_Scopes.emplace_back();
+
+		for (const auto &stmt : n.stmts)
+			visitChild(stmt.get());
+
+		m_Scopes.pop_back();
+	}
+
+	void visit(const ast::IfStmt &n) override {
+		visitChild(n.cond.get());
+		visitChild(n.then.get());
+		visitChild(n.else_.get());
+	}
+
+	void visit(const ast::WhileStmt &n) override {
+		visitChild(n.cond.get());
+		visitChild(n.body.get());
+	}
+
+	void visit(const ast::ReturnStmt &n) override {
+		visitChild(n.expr.get());
+	}
+
+	void visit(const ast::VarDef &n) override {
+		// The variable is only visible after its initializer.
+		visitChild(n.value.get());
+		m_Scopes.back().emplace_back(n.ident, n.loc);
+	}
+
+	void visit(const ast::FuncDecl &n) override {
+		// Parameters have no location of their own, they resolve to the function.
+		auto &params = m_Scopes.emplace_back();
+		for (const auto &[name, _] : n.params)
+			params.emplace_back(name, n.loc);
+
+		visitChild(n.body.get());
+		m_Scopes.pop_back();
+	}
+
+	void visit(const ast::StructDecl &) override {}
+
+	void visit(const ast::Module &n) override {
+		for (const auto &func : n.funcs)
+			visitChild(func.get());
+	}
+};
+}
+
+Document::Document(std::string filename)
+	: m_Filename(std::move(filename)) {}
+
+Document::~Document() {
+	if (s_Active == this) {
+		forgetStructs();
+		s_Active = nullptr;
+	}
+}
+
+void Document::update(const std::string &text) {
+	const bool wasActive = s_Active == this;
+
+	if (s_Active && !wasActive) {
+		s_Active->forgetStructs();
+		s_Active = nullptr;
+	}
+
+	// Declarations whose text did not change are reused, wherever they moved to.
+	Map<std::string_view, Vec<Box<Declaration>>> previous;
+	for (auto &decl : m_Decls) {
+		const std::string_view key = decl->text;
+		previous[key].push_back(std::move(decl));
+	}
+
+	const auto starts = splitDeclarations(text);
+	Vec<Box<Declaration>> decls;
+	Vec<std::string> added, removed;
+	u32 line = 0;
+
+	for (size_t i = 0; i < starts.size(); ++i) {
+		const auto end = i + 1 < starts.size() ? starts[i + 1] : text.size();
+		const std::string_view declText(text.data() + starts[i], end - starts[i]);
+		Box<Declaration> decl;
+
+		if (const auto it = previous.find(declText); it != previous.end() && !it->second.empty()) {
+			decl = std::move(it->second.back());
+			it->second.pop_back();
+		} else {
+			decl = std::make_unique<Declaration>();
+			decl->text = declText;
+			parse(*decl);
+			added.push_back(decl->signature);
+		}
+
+		decl->firstLine = line;
+		line += static_cast<u32>(std::ranges::count(declText, '\n'));
+		decls.push_back(std::move(decl));
+	}
+
+	// Without errors from exploring, the previous declarations redefined nothing and referenced
+	// no undeclared type, so the same signatures in any order declare the same again.
+	bool hadExploreErrors = false;
+	for (const auto &decl : decls)
+		hadExploreErrors = hadExploreErrors || !decl->exploreErrors.empty();
+
+	for (const auto &[_, unused] : previous) {
+		for (const auto &decl : unused) {
+			removed.push_back(decl->signature);
+			hadExploreErrors = hadExploreErrors || !decl->exploreErrors.empty();
+		}
+	}
+
+	// A changed signature may change the meaning of any function body, e.g. the type of a call.
+	// Declarations that kept their text also kept their signature, so only the replaced ones
+	// are compared.
+	std::ranges::sort(added);
+	std::ranges::sort(removed);
+	const bool recheckAll = added != removed;
+
+	// The previous declarations were moved out of m_Decls, kept and removed ones both may have
+	// declared structs.
+	if (wasActive && (recheckAll || hadExploreErrors)) {
+		for (const auto &decl : decls)
+			forgetStructs(*decl);
+
+		for (const auto &[_, unused] : previous) {
+			for (const auto &decl : unused)
+				forgetStructs(*decl);
+		}
+	}
+
+	m_Decls = std::move(decls);
+
+	Vec<Declaration *> unchecked;
+	for (const auto &decl : m_Decls) {
+		if (decl->hasSyntaxErrors || (decl->isChecked && !recheckAll))
+			continue;
+
+		// The type checker annotates the tree in place, checking again needs a fresh one.
+		if (decl->isChecked)
+			parse(*decl);
+
+		unchecked.push_back(decl.get());
+	}
+
+	// Exploring walks every declaration, on a keystroke inside a body the types and functions
+	// declared by the previous update are still valid.
+	if (!wasActive || recheckAll || hadExploreErrors)
+		explore();
+
+	s_Active = this;
+	m_ErrorHandler->clear();
+
+	sem::TypeCheckingPass typeChecking(*m_TypeContext);
+	const auto &errors = m_ErrorHandler->getErrors();
+
+	for (auto *decl : unchecked) {
+		const auto first = errors.size();
+
+		for (const auto &func : decl->module->funcs)
+			typeChecking.dispatch(*func);
+
+		decl->typeErrors.assign(errors.begin() + static_cast<std::ptrdiff_t>(first), errors.end());
+		decl->isChecked = true;
+	}
+}
+
+void Document::parse(Declaration &decl) const {
+	const U8String source(decl.text);
+	ErrorHandler err(m_Filename, source);
+
+	// Tokens are kept, parsing a declaration again for another type check does not lex it.
+	if (decl.tokens.empty())
+		decl.tokens = lex::Lexer::tokenize(source, err);
+
+	decl.module = err.hasError() ? nullptr : prs::Parser::parse(decl.tokens, err, m_Filename);
+	decl.hasSyntaxErrors = err.hasError();
+	decl.syntaxErrors = err.getErrors();
+	decl.isChecked = false;
+	decl.typeErrors.clear();
+
+	if (decl.hasSyntaxErrors) {
+		decl.module = nullptr;
+		decl.signature.clear();
+		return;
+	}
+
+	// Types are interned, their addresses identify them independent of what is declared.
+	decl.signature.clear();
+
+	for (const auto &s : decl.module->structs) {
+		decl.signature += std::format("struct {}", s->ident);
+
+		for (const auto &[name, type] : s->fields)
+			decl.signature += std::format(" {}:{}", name, static_cast<const void *>(type));
+
+		decl.signature += '\n';
+	}
+
+	for (const auto &f : decl.module->funcs) {
+		decl.signature += std::format("func {}", f->ident);
+
+		for (const auto &[_, type] : f->params)
+			decl.signature += std::format(" {}", static_cast<const void *>(type));
+
+		decl.signature += std::format(" -> {}\n", static_cast<const void *>(f->returnType));
+	}
+}
+
+void Document::explore() {
+	m_TypeContext = nullptr;
+	m_ErrorHandler = std::make_unique<ErrorHandler>(m_Filename, u8"");
+	m_TypeContext = std::make_unique<sem::TypeCheckerContext>(*m_ErrorHandler);
+
+	sem::ExplorationPass exploration(*m_TypeContext);
+	const auto &errors = m_ErrorHandler->getErrors();
+
+	for (const auto &decl : m_Decls)
+		decl->exploreErrors.clear();
+
+	// Same steps as exploring a single module, every step runs over all declarations.
+	const auto runStep = [&](void (sem::ExplorationPass::*step)(const ast::Module &)) {
+		for (const auto &decl : m_Decls) {
+			if (decl->hasSyntaxErrors)
+				continue;
+
+			const auto first = errors.size();
+			(exploration.*step)(*decl->module);
+			decl->exploreErrors.insert(decl->exploreErrors.end(),
+									   errors.begin() + static_cast<std::ptrdiff_t>(first),
+									   errors.end());
+		}
+	};
+
+	runStep(&sem::ExplorationPass::declareStructs);
+	runStep(&sem::ExplorationPass::validateStructs);
+	runStep(&sem::ExplorationPass::declareFunctions);
+}
+
+void Document::forgetStructs() const {
+	for (const auto &decl : m_Decls)
+		forgetStructs(*decl);
+}
+
+void Document::forgetStructs(const Declaration &decl) {
+	if (!decl.module)
+		return;
+
+	for (const auto &s : decl.module->structs) {
+		auto *structType = TypeFactory::getStruct(s->ident);
+		structType->fields.clear();
+		structType->orderedFields.clear();
+		structType->isDeclared = false;
+	}
+}
+
+void Document::activate() {
+	if (s_Active == this)
+		return;
+
+	if (s_Active)
+		s_Active->forgetStructs();
+
+	explore();
+	s_Active = this;
+}
+
+Vec<Diagnostic> Document::getDiagnostics() const {
+	Vec<Diagnostic> diagnostics;
+
+	for (const auto &decl : m_Decls) {
+		for (const auto *errors : {&decl->syntaxErrors, &decl->exploreErrors, &decl->typeErrors}) {
+			for (const auto &error : *errors) {
+				diagnostics.push_back({.range = rangeOf(*decl, error.location),
+									   .level = error.level,
+									   .message = std::format("{}", error.message)});
+			}
+		}
+	}
+
+	return diagnostics;
+}
+
+Opt<Pair<const Declaration *, size_t>> Document::locate(const Position &position) const {
+	const auto it = std::ranges::upper_bound(m_Decls, position.line, {},
+											 [](const auto &decl) { return decl->firstLine; });
+
+	if (it == m_Decls.begin())
+		return {};
+
+	const auto &decl = *std::prev(it);
+	const auto index = indexOf(*decl, position);
+
+	if (!index || !decl->isChecked)
+		return {};
+
+	return Pair<const Declaration *, size_t>(decl.get(), *index);
+}
+
+Opt<Hover> Document::hover(const Position &position) {
+	// Struct types print their name only while they are declared.
+	activate();
+
+	const auto located = locate(position);
+	if (!located)
+		return {};
+
+	const auto [decl, index] = *located;
+	ExprFinder finder(index);
+	finder.dispatch(*decl->module);
+
+	if (!finder.hit || !finder.hit->inferredType)
+		return {};
+
+	const auto *hit = finder.hit;
+	const auto type = hit->inferredType.value();
+	auto text = std::format("{}", *type);
+
+	if (hit->kind == ast::NodeKind::VarRef)
+		text = std::format("{}: {}", static_cast<const ast::VarRef *>(hit)->ident, *type);
+
+	return Hover{.range = rangeOf(*decl, hit->loc), .text = std::move(text)};
+}
+
+Opt<Range> Document::findDefinition(const Position &position) {
+	const auto located = locate(position);
+	if (!located)
+		return {};
+
+	const auto [decl, index] = *located;
+	ExprFinder finder(index);
+	finder.dispatch(*decl->module);
+
+	if (!finder.hit)
+		return {};
+
+	if (finder.definition)
+		return rangeOf(*decl, *finder.definition);
+
+	const auto findDecl = [&](const auto &matches) -> Opt<Range> {
+		for (const auto &other : m_Decls) {
+			if (!other->module)
+				continue;
+
+			if (const auto loc = matches(*other->module))
+				return rangeOf(*other, *loc);
+		}
+
+		return {};
+	};
+
+	if (finder.hit->kind == ast::NodeKind::VarRef) {
+		const auto &ident = static_cast<const ast::VarRef *>(finder.hit)->ident;
+
+		return findDecl([&](const ast::Module &module) -> Opt<SourceLoc> {
+			for (const auto &func : module.funcs) {
+				if (func->ident == ident)
+					return func->loc;
+			}
+
+			return {};
+		});
+	}
+
+	if (finder.hit->kind == ast::NodeKind::FieldAccess) {
+		const auto &base = *static_cast<const ast::FieldAccess *>(finder.hit)->base;
+
+		if (!base.inferredType || !base.inferredType.value()->isTypeKind(TypeKind::Struct))
+			return {};
+
+		const auto *structType = static_cast<const StructType *>(base.inferredType.value());
+
+		return findDecl([&](const ast::Module &module) -> Opt<SourceLoc> {
+			for (const auto &s : module.structs) {
+				if (s->ident == structType->name)
+					return s->loc;
+			}
+
+			return {};
+		});
+	}
+
+	return {};
+}
+}
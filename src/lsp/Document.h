@@ -0,0 +1,87 @@
+#pragma once
+#include <string>
+
+#include "ast/AST.h"
+#include "core/ErrorHandler.h"
+#include "lexer/Token.h"
+#include "semantic/common/TypeCheckerContext.h"
+
+namespace lsp {
+/// A position in a document as the language server protocol counts it: zero based lines and
+/// UTF-16 code units within the line.
+struct Position {
+	u32 line = 0;
+	u32 character = 0;
+};
+
+struct Range {
+	Position start;
+	Position end;
+};
+
+struct Diagnostic {
+	Range range;
+	ErrorLevel level;
+	std::string message;
+};
+
+struct Hover {
+	Range range;
+	std::string text;
+};
+
+/// A top level declaration of a document together with everything derived from its text. All
+/// source locations inside are relative to the start of the declaration, so a declaration that
+/// only moved within the document is reused as it is.
+struct Declaration {
+	std::string text;
+	u32 firstLine = 0;
+	Vec<lex::Token> tokens;
+	Box<ast::Module> module;
+	std::string signature;
+	bool hasSyntaxErrors = false;
+	bool isChecked = false;
+	Vec<ErrorMessage> syntaxErrors;
+	Vec<ErrorMessage> exploreErrors;
+	Vec<ErrorMessage> typeErrors;
+};
+
+///
+/// An open document of the language server. On every update the text is split into its top
+/// level declarations. Only declarations whose text changed are lexed and parsed again, and only
+/// their function bodies are type checked again, unless a signature of a struct or function
+/// changed, which may affect every body.
+///
+struct Document {
+private:
+	std::string m_Filename;
+	Vec<Box<Declaration>> m_Decls;
+	Box<ErrorHandler> m_ErrorHandler;
+	Box<sem::TypeCheckerContext> m_TypeContext;
+
+	void parse(Declaration &decl) const;
+	void explore();
+	void forgetStructs() const;
+	static void forgetStructs(const Declaration &decl);
+	void activate();
+
+	[[nodiscard]] Opt<Pair<const Declaration *, size_t>> locate(const Position &position) const;
+
+public:
+	explicit Document(std::string filename);
+	~Document();
+
+	Document(const Document &) = delete;
+	Document &operator=(const Document &) = delete;
+
+	void update(const std::string &text);
+
+	[[nodiscard]] Vec<Diagnostic> getDiagnostics() const;
+
+	/// Returns the type of the innermost expression at position.
+	[[nodiscard]] Opt<Hover> hover(const Position &position);
+
+	/// Returns where the variable, function or struct field used at position is declared.
+	[[nodiscard]] Opt<Range> findDefinition(const Position &position);
+};
+}
@@ -0,0 +1,265 @@
+#include "LanguageServer.h"
+
+#include <string_view>
+
+namespace lsp {
+namespace {
+constexpr i64 s_MethodNotFound = -32601;
+constexpr i64 s_InvalidRequest = -32600;
+
+/// Reads one message framed by a 'Content-Length' header, returns an empty optional at the end
+/// of the input.
+Opt<std::string> readMessage(std::istream &in) {
+	constexpr std::string_view lengthHeader = "Content-Length: ";
+	size_t length = 0;
+	std::string line;
+
+	while (std::getline(in, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		if (line.empty())
+			break;
+
+		if (line.starts_with(lengthHeader))
+			length = std::stoul(line.substr(lengthHeader.size()));
+	}
+
+	if (!in)
+		return {};
+
+	std::string content(length, '\0');
+	in.read(content.data(), static_cast<std::streamsize>(length));
+
+	if (!in)
+		return {};
+
+	return content;
+}
+
+llvm::json::Value toJson(const Position &position) {
+	return llvm::json::Object{{"line", position.line}, {"character", position.character}};
+}
+
+llvm::json::Value toJson(const Range &range) {
+	return llvm::json::Object{{"start", toJson(range.start)}, {"end", toJson(range.end)}};
+}
+
+i64 getSeverity(const ErrorLevel level) {
+	switch (level) {
+		case ErrorLevel::ERROR:	  return 1;
+		case ErrorLevel::WARNING: return 2;
+		case ErrorLevel::NOTE:	  return 3;
+		default:				  UNREACHABLE();
+	}
+}
+
+/// Documents are only used for diagnostics, the path is derived from the URI as it is.
+std::string getFilename(const std::string &uri) {
+	constexpr std::string_view scheme = "file://";
+	return uri.starts_with(scheme) ? uri.substr(scheme.size()) : uri;
+}
+
+std::string getUri(const llvm::json::Object &params) {
+	if (const auto *document = params.getObject("textDocument")) {
+		if (const auto uri = document->getString("uri"))
+			return uri->str();
+	}
+
+	return {};
+}
+
+Opt<Position> getPosition(const llvm::json::Object &params) {
+	const auto *position = params.getObject("position");
+	if (!position)
+		return {};
+
+	const auto line = position->getInteger("line");
+	const auto character = position->getInteger("character");
+	if (!line || !character)
+		return {};
+
+	return Position{.line = static_cast<u32>(*line), .character = static_cast<u32>(*character)};
+}
+}
+
+LanguageServer::LanguageServer(std::ostream &out)
+	: m_Out(out) {}
+
+int LanguageServer::run(std::istream &in, std::ostream &out) {
+	LanguageServer server(out);
+
+	while (const auto content = readMessage(in)) {
+		auto message = llvm::json::parse(*content);
+
+		if (!message) {
+			llvm::consumeError(message.takeError());
+			continue;
+		}
+
+		const auto *object = message->getAsObject();
+		if (object && !server.handle(*object))
+			return server.m_IsShutdown ? 0 : 1;
+	}
+
+	return 1;
+}
+
+bool LanguageServer::handle(const llvm::json::Object &message) {
+	const auto method = message.getString("method");
+	const auto *id = message.get("id");
+
+	// Responses to requests of the server, it does not send any.
+	if (!method)
+		return true;
+
+	static const llvm::json::Object s_NoParams;
+	const auto *params = message.getObject("params");
+	if (!params)
+		params = &s_NoParams;
+
+	if (!id) {
+		if (*method == "exit")
+			return false;
+
+		handleNotification(method->str(), *params);
+		return true;
+	}
+
+	llvm::json::Object response{{"jsonrpc", "2.0"}, {"id", *id}};
+
+	if (m_IsShutdown) {
+		response["error"] = llvm::json::Object{{"code", s_InvalidRequest},
+											   {"message", "The server was shut down."}};
+	} else if (auto result = handleRequest(method->str(), *params)) {
+		response["result"] = std::move(*result);
+	} else {
+		response["error"] = llvm::json::Object{
+				{"code", s_MethodNotFound},
+				{"message", std::format("Unsupported method '{}'.", method->str())}};
+	}
+
+	send(std::move(response));
+	return true;
+}
+
+Opt<llvm::json::Value> LanguageServer::handleRequest(const std::string &method,
+													 const llvm::json::Object &params) {
+	if (method == "initialize") {
+		// Documents are sent as a whole (sync kind 1), the server finds the changed
+		// declarations itself.
+		return llvm::json::Object{
+				{"capabilities",
+				 llvm::json::Object{
+						 {"textDocumentSync", llvm::json::Object{{"openClose", true}, {"change", 1}}},
+						 {"hoverProvider", true},
+						 {"definitionProvider", true}}},
+				{"serverInfo", llvm::json::Object{{"name", "ocn"}}}};
+	}
+
+	if (method == "shutdown") {
+		m_IsShutdown = true;
+		return llvm::json::Value(nullptr);
+	}
+
+	if (method != "textDocument/hover" && method != "textDocument/definition")
+		return {};
+
+	const auto uri = getUri(params);
+	const auto position = getPosition(params);
+	const auto it = m_Documents.find(uri);
+
+	if (!position || it == m_Documents.end())
+		return llvm::json::Value(nullptr);
+
+	if (method == "textDocument/hover") {
+		const auto hover = it->second->hover(*position);
+		if (!hover)
+			return llvm::json::Value(nullptr);
+
+		return llvm::json::Object{
+				{"contents",
+				 llvm::json::Object{{"kind", "markdown"},
+									{"value", std::format("```ocn\n{}\n```", hover->text)}}},
+				{"range", toJson(hover->range)}};
+	}
+
+	const auto definition = it->second->findDefinition(*position);
+	if (!definition)
+		return llvm::json::Value(nullptr);
+
+	return llvm::json::Object{{"uri", uri}, {"range", toJson(*definition)}};
+}
+
+void LanguageServer::handleNotification(const std::string &method,
+										const llvm::json::Object &params) {
+	const auto uri = getUri(params);
+
+	if (method == "textDocument/didOpen") {
+		std::string text;
+		if (const auto *textDocument = params.getObject("textDocument")) {
+			if (const auto value = textDocument->getString("text"))
+				text = value->str();
+		}
+
+		auto &document = m_Documents[uri];
+		document = std::make_unique<Document>(getFilename(uri));
+		document->update(text);
+		publishDiagnostics(uri, document->getDiagnostics());
+		return;
+	}
+
+	if (method == "textDocument/didChange") {
+		const auto it = m_Documents.find(uri);
+		const auto *changes = params.getArray("contentChanges");
+
+		if (it == m_Documents.end() || !changes || changes->empty())
+			return;
+
+		// With full synchronization the last change holds the whole text.
+		const auto *change = changes->back().getAsObject();
+		if (!change)
+			return;
+
+		const auto text = change->getString("text");
+		if (!text)
+			return;
+
+		it->second->update(text->str());
+		publishDiagnostics(uri, it->second->getDiagnostics());
+		return;
+	}
+
+	if (method == "textDocument/didClose") {
+		m_Documents.erase(uri);
+		publishDiagnostics(uri, {});
+	}
+}
+
+void LanguageServer::publishDiagnostics(const std::string &uri,
+										const Vec<Diagnostic> &diagnostics) {
+	llvm::json::Array items;
+
+	for (const auto &diagnostic : diagnostics) {
+		items.push_back(llvm::json::Object{{"range", toJson(diagnostic.range)},
+										   {"severity", getSeverity(diagnostic.level)},
+										   {"source", "ocn"},
+										   {"message", diagnostic.message}});
+	}
+
+	send(llvm::json::Object{
+			{"jsonrpc", "2.0"},
+			{"method", "textDocument/publishDiagnostics"},
+			{"params", llvm::json::Object{{"uri", uri}, {"diagnostics", std::move(items)}}}});
+}
+
+void LanguageServer::send(llvm::json::Object message) {
+	std::string content;
+	llvm::raw_string_ostream os(content);
+	os << llvm::json::Value(std::move(message));
+	os.flush();
+
+	m_Out << "Content-Length: " << content.size() << "\r\n\r\n" << content;
+	m_Out.flush();
+}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <llvm/Support/JSON.h>
+
+#include <iostream>
+
+#include "Document.h"
+
+namespace lsp {
+///
+/// Language server speaking JSON-RPC over stdin and stdout. Documents are synchronized as a
+/// whole on every change and diagnostics are published after each change, hover shows the
+/// inferred type of the expression under the cursor and go-to-definition resolves variables,
+/// functions and struct fields.
+///
+struct LanguageServer {
+private:
+	std::ostream &m_Out;
+	Map<std::string, Box<Document>> m_Documents;
+	bool m_IsShutdown = false;
+
+	explicit LanguageServer(std::ostream &out);
+
+	/// Handles one message, returns false once the client asked the server to exit.
+	bool handle(const llvm::json::Object &message);
+	Opt<llvm::json::Value> handleRequest(const std::string &method,
+										 const llvm::json::Object &params);
+	void handleNotification(const std::string &method, const llvm::json::Object &params);
+
+	void publishDiagnostics(const std::string &uri, const Vec<Diagnostic> &diagnostics);
+	void send(llvm::json::Object message);
+
+public:
+	/// Serves requests until the client sends 'exit', returns 0 if it shut the server down first.
+	static int run(std::istream &in, std::ostream &out);
+};
+}
@@ -8,12 +8,20 @@
 #include "ast/AST.h"
 #include "ast/Printer.h"
 #include "codegen/CodeGen.h"
+#include "codegen/JitSession.h"
 #include "core/ErrorHandler.h"
 #include "core/PrintUtil.h"
 #include "lexer/Lexer.h"
+#include "lsp/LanguageServer.h"
 #include "parser/Parser.h"
+#include "repl/Repl.h"
+#include "semantic/passes/ConstantEvaluationPass.h"
+#include "semantic/passes/EffectAnalysisPass.h"
 #include "semantic/passes/ExplorationPass.h"
 #include "semantic/passes/TypeCheckingPass.h"
+#include "server/CompileServer.h"
+#include "vm/BytecodeCompiler.h"
+#include "vm/Interpreter.h"
 
 using namespace lex;
 using namespace prs;
@@ -21,45 +29,42 @@ using namespace ast;
 using namespace sem;
 using namespace gen;
 
-int main(const int argc, const char *argv[]) {
-	if (argc < 2) {
-		util::print("Usage: \"{}\" <input-filename> [options]\n", argv[0]);
-		util::print("Options:\n");
-		util::print("\t-o, --output <filename> Name of the generated output file\n");
-		util::print("\t-d, --debug             Print debug information for AST and Tokens\n");
-		util::print("\t-i, --keep-intermediate Keeps the generated intermediate files\n");
-		return 1;
-	}
-
-	std::string filename = argv[1];
-	std::string outputFilename = "out";
-	bool debug = false, keepIntermediate = false;
-
-	for (int i = 2; i < argc; ++i) {
-		std::string opt = argv[i];
-
-		if (opt == "-d" || opt == "--debug") {
-			debug = true;
-		} else if (opt == "-o" || opt == "--output") {
-			if (i > argc - 2) {
-				util::print("Expected filename after option '{}'.\n", opt);
-				return 1;
-			}
-
-			outputFilename = argv[++i];
-		} else if (opt == "-i" || opt == "--keep-intermediate") {
-			keepIntermediate = true;
-		} else {
-			util::print("Unknown option: '{}'.", opt);
-			return 1;
-		}
-	}
+namespace {
+void printUsage(const char *program) {
+	util::print("Usage: \"{}\" <input-filename> [options]\n", program);
+	util::print("       \"{}\" --run [--backend=jit|vm] <input-filename> [args...]\n", program);
+	util::print("       \"{}\" --repl\n", program);
+	util::print("       \"{}\" --lsp\n", program);
+	util::print("       \"{}\" --server <socket-path>\n", program);
+	util::print("       \"{}\" --client <socket-path> <input-filename> [-o <filename>] [-r]\n",
+				program);
+	util::print("       \"{}\" --client <socket-path> --shutdown\n", program);
+	util::print("Options:\n");
+	util::print("\t-o, --output <filename> Name of the generated output file\n");
+	util::print("\t-d, --debug             Print debug information for AST and Tokens\n");
+	util::print("\t-i, --keep-intermediate Keeps the generated intermediate files\n");
+	util::print("\t-s, --stats             Print how many refcount operations were elided\n");
+	util::print("\t-r, --reorder-fields    Order struct fields by alignment to remove padding\n");
+	util::print("\t--print-layouts         Print the size, alignment and padding of every struct\n");
+	util::print("\t--run                   Compile in memory and run the program, passing args\n");
+	util::print("\t--backend=vm            Run on the bytecode interpreter instead of the JIT\n");
+	util::print("\t--repl                  Start an interactive session\n");
+	util::print("\t--lsp                   Run a language server on stdin and stdout\n");
+	util::print("\t--server                Keep a warm compiler listening on a Unix socket\n");
+	util::print("\t--client                Compile through the server listening on the socket\n");
+}
 
+/// Reads, lexes, parses and type checks a source file. On failure the diagnostics are printed,
+/// exitCode is set and nullptr is returned. The error handler is kept for the warnings of the
+/// code generation.
+Box<Module> runFrontend(const std::string &filename, const bool debug, int &exitCode,
+						Opt<ErrorHandler> &err) {
 	std::ifstream file(filename, std::ios::in | std::ios::binary);
 
 	if (!file) {
 		util::print("Could not open file: '{}'.\n", filename);
-		return 3;
+		exitCode = 3;
+		return nullptr;
 	}
 
 	std::stringstream buffer;
@@ -67,31 +72,33 @@ int main(const int argc, const char *argv[]) {
 	U8String source(buffer.str());
 	file.close();
 
-	ErrorHandler err(filename, source);
+	err.emplace(filename, source);
 
-	auto tokens = Lexer::tokenize(source, err);
+	auto tokens = Lexer::tokenize(source, *err);
 
 	if (debug) {
 		for (auto tok : tokens)
 			util::print("{:?}\n", tok);
 	}
 
-	if (err.hasError()) {
-		err.printErrors();
-		return 1;
+	if (err->hasError()) {
+		err->printErrors();
+		exitCode = 1;
+		return nullptr;
 	}
 
-	auto module = Parser::parse(tokens, err, filename);
+	auto module = Parser::parse(tokens, *err, filename);
 
-	if (err.hasError()) {
-		err.printErrors();
-		return 2;
+	if (err->hasError()) {
+		err->printErrors();
+		exitCode = 2;
+		return nullptr;
 	}
 
 	if (debug)
 		util::print("{}\n", *module);
 
-	TypeCheckerContext ctx(err);
+	TypeCheckerContext ctx(*err);
 
 	ExplorationPass pass1(ctx);
 	pass1.dispatch(*module);
@@ -99,18 +106,202 @@ int main(const int argc, const char *argv[]) {
 	TypeCheckingPass pass2(ctx);
 	pass2.dispatch(*module);
 
-	err.printErrors();
+	err->printErrors();
 
-	if (err.hasError())
-		return 3;
+	if (err->hasError()) {
+		exitCode = 3;
+		return nullptr;
+	}
+
+	// Everything reported so far was printed, later stages only print their own warnings.
+	err->clear();
+
+	ConstantEvaluationPass pass3;
+	pass3.dispatch(*module);
+	EffectAnalysisPass pass4;
+	pass4.dispatch(*module);
+
+	return module;
+}
+
+/// Compiles the program in memory with the JIT and runs its main function.
+int runJit(const std::string &filename, const Vec<std::string> &args) {
+	int exitCode = 0;
+	Opt<ErrorHandler> err;
+	const auto module = runFrontend(filename, false, exitCode, err);
+
+	if (!module)
+		return exitCode;
+
+	auto session = JitSession::create();
+	if (!session) {
+		util::print("Could not create JIT: {}\n", llvm::toString(session.takeError()));
+		return 4;
+	}
+
+	auto ctx = CodeGen::lower(*module, {}, &*err);
+	err->printErrors();
+
+	if (auto addErr = session.get()->addModule(*ctx)) {
+		util::print("Could not compile module: {}\n", llvm::toString(std::move(addErr)));
+		return 4;
+	}
+
+	auto result = session.get()->runMain(filename, args);
+	if (!result) {
+		util::print("Could not run program: {}\n", llvm::toString(result.takeError()));
+		return 4;
+	}
+
+	return result.get();
+}
+
+/// Compiles the program to bytecode and runs it on the interpreter, which skips all LLVM work.
+int runVm(const std::string &filename) {
+	int exitCode = 0;
+	Opt<ErrorHandler> err;
+	const auto module = runFrontend(filename, false, exitCode, err);
+
+	if (!module)
+		return exitCode;
+
+	const auto program = vm::BytecodeCompiler::compile(*module);
+	return vm::Interpreter::run(*program);
+}
+}
+
+int main(const int argc, const char *argv[]) {
+	if (argc < 2) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	if (std::string(argv[1]) == "--run") {
+		int next = 2;
+		std::string backend = "jit";
+
+		if (argc > next && std::string(argv[next]).starts_with("--backend=")) {
+			backend = std::string(argv[next++]).substr(std::string("--backend=").size());
+		}
+
+		if (argc <= next || (backend != "jit" && backend != "vm")) {
+			printUsage(argv[0]);
+			return 1;
+		}
+
+		if (backend == "vm")
+			return runVm(argv[next]);
+
+		return runJit(argv[next], Vec<std::string>(argv + next + 1, argv + argc));
+	}
+
+	if (std::string(argv[1]) == "--repl") {
+		return repl::Repl::run(std::cin);
+	}
+
+	if (std::string(argv[1]) == "--lsp") {
+		return lsp::LanguageServer::run(std::cin, std::cout);
+	}
+
+	if (std::string(argv[1]) == "--server") {
+		if (argc != 3) {
+			printUsage(argv[0]);
+			return 1;
+		}
+
+		return server::CompileServer::serve(argv[2]);
+	}
+
+	if (std::string(argv[1]) == "--client") {
+		if (argc == 4 && std::string(argv[3]) == "--shutdown")
+			return server::CompileServer::shutdown(argv[2]);
+
+		if (argc < 4) {
+			printUsage(argv[0]);
+			return 1;
+		}
+
+		std::string outputFilename = "out";
+		CodeGenOptions options;
+
+		for (int i = 4; i < argc; ++i) {
+			std::string opt = argv[i];
+
+			if ((opt == "-o" || opt == "--output") && i < argc - 1) {
+				outputFilename = argv[++i];
+			} else if (opt == "-r" || opt == "--reorder-fields") {
+				options.reorderFields = true;
+			} else {
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+
+		return server::CompileServer::submit(argv[2], argv[3], outputFilename, options);
+	}
+
+	std::string filename = argv[1];
+	std::string outputFilename = "out";
+	bool debug = false, keepIntermediate = false, stats = false, printLayouts = false;
+	CodeGenOptions options;
+
+	for (int i = 2; i < argc; ++i) {
+		std::string opt = argv[i];
+
+		if (opt == "-d" || opt == "--debug") {
+			debug = true;
+		} else if (opt == "-o" || opt == "--output") {
+			if (i > argc - 2) {
+				util::print("Expected filename after option '{}'.\n", opt);
+				return 1;
+			}
+
+			outputFilename = argv[++i];
+		} else if (opt == "-i" || opt == "--keep-intermediate") {
+			keepIntermediate = true;
+		} else if (opt == "-s" || opt == "--stats") {
+			stats = true;
+		} else if (opt == "-r" || opt == "--reorder-fields") {
+			options.reorderFields = true;
+		} else if (opt == "--print-layouts") {
+			printLayouts = true;
+		} else {
+			util::print("Unknown option: '{}'.", opt);
+			return 1;
+		}
+	}
+
+	int exitCode = 0;
+	Opt<ErrorHandler> err;
+	const auto module = runFrontend(filename, debug, exitCode, err);
+
+	if (!module)
+		return exitCode;
 
 	std::string llFilename = outputFilename + ".ll";
 	std::ofstream output(llFilename);
 
-	CodeGen::generate(output, *module);
+	const auto ctx = CodeGen::lower(*module, {}, &*err, options);
+	err->printErrors();
+
+	{
+		llvm::raw_os_ostream llvmOS(output);
+		ctx->llvmModule.print(llvmOS, nullptr);
+	}
 
 	output.close();
 
+	if (printLayouts) {
+		for (const auto &decl : module->structs) {
+			util::print("{}", ctx->describeStructLayout(decl->ident, decl->fields));
+		}
+	}
+
+	if (stats) {
+		util::print("Elided {} reference count increments and {} decrements.\n",
+					ctx->rcStats.elidedCopies, ctx->rcStats.elidedDrops);
+	}
+
 	pid_t pid = fork();
 
 	if (pid == 0) {
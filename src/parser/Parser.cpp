@@ -27,6 +27,12 @@ Box<Module> Parser::parse(const Vec<Token> &tokens, ErrorHandler &err, U8String
 	return parser.parseModule();
 }
 
+Box<BlockStmt> Parser::parseStatements(const Vec<Token> &tokens, ErrorHandler &err) {
+	Parser parser(tokens, err, u8"");
+
+	return parser.parseStmtList();
+}
+
 Parser::Parser(const Vec<Token> &tokens, ErrorHandler &err, U8String moduleName)
 	: m_Tokens(std::move(tokens))
 	, m_ModuleName(std::move(moduleName))
@@ -106,6 +112,23 @@ Box<Module> Parser::parseModule() {
 	return module;
 }
 
+Box<BlockStmt> Parser::parseStmtList() {
+	const auto startLoc = m_Current->loc;
+	Vec<Box<Stmt>> stmts;
+
+	try {
+		while (!m_Current->matches(TokenType::EndOfFile)) {
+			stmts.push_back(parseStmt());
+		}
+	} catch (ParsingError &e) {
+		reportError(e);
+	}
+
+	auto block = std::make_unique<BlockStmt>(std::move(stmts));
+	block->setLoc(makeSpanLoc(startLoc, m_Current->loc));
+	return block;
+}
+
 Box<FuncDecl> Parser::parseFuncDecl() {
 	const auto &funcToken = consume(TokenType::Keyword, u8"func");
 	auto name = consume(TokenType::Identifier).lexeme;
@@ -168,7 +191,15 @@ Vec<Param> Parser::parseParamList() {
 	while (m_Current->matches(TokenType::Identifier)) {
 		auto ident = consume(TokenType::Identifier).lexeme;
 		consume(TokenType::Separator, u8":");
-		auto type = parseType();
+
+		// Borrowed parameters are only allowed in parameter lists: &T
+		Type type;
+		if (m_Current->matches(TokenType::Operator, u8"&")) {
+			consume(TokenType::Operator, u8"&");
+			type = TypeFactory::getReference(parseType());
+		} else {
+			type = parseType();
+		}
 
 		params.emplace_back(std::move(ident), std::move(type));
 
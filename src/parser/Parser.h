@@ -19,6 +19,7 @@ struct ParsingError : std::exception {
 struct Parser {
 	static Box<ast::Module> parse(const Vec<lex::Token> &tokens, ErrorHandler &err,
 								  U8String moduleName);
+	static Box<ast::BlockStmt> parseStatements(const Vec<lex::Token> &tokens, ErrorHandler &err);
 
 	using TokenIter = Vec<lex::Token>::const_iterator;
 
@@ -36,6 +37,7 @@ struct Parser {
 	void reportError(ParsingError &e) const;
 
 	Box<ast::Module> parseModule();
+	Box<ast::BlockStmt> parseStmtList();
 	Box<ast::FuncDecl> parseFuncDecl();
 	Box<ast::StructDecl> parseStructDecl();
 	Vec<ast::Param> parseParamList();
@@ -0,0 +1,225 @@
+#include "Repl.h"
+
+#include "core/PrintUtil.h"
+#include "lexer/Lexer.h"
+#include "parser/Parser.h"
+#include "semantic/passes/ConstantEvaluationPass.h"
+#include "semantic/passes/EffectAnalysisPass.h"
+#include "semantic/passes/ExplorationPass.h"
+#include "semantic/passes/TypeCheckingPass.h"
+#include "type/TypeFactory.h"
+
+namespace repl {
+namespace {
+/// Returns how many brackets the line opens minus how many it closes. Brackets inside character
+/// literals and line comments are ignored, this only decides whether an input is complete.
+i32 bracketBalance(const std::string &line) {
+	i32 balance = 0;
+
+	for (size_t i = 0; i < line.size(); ++i) {
+		const char c = line[i];
+
+		if (c == '/' && i + 1 < line.size() && line[i + 1] == '/')
+			break;
+
+		if (c == '\'') {
+			while (++i < line.size() && line[i] != '\'') {
+				if (line[i] == '\\')
+					++i;
+			}
+
+			continue;
+		}
+
+		if (c == '{' || c == '(' || c == '[')
+			++balance;
+		else if (c == '}' || c == ')' || c == ']')
+			--balance;
+	}
+
+	return balance;
+}
+
+bool isBlank(const std::string &input) {
+	return input.find_first_not_of(" \t\r\n") == std::string::npos;
+}
+}
+
+Repl::Repl(Box<gen::JitSession> jit)
+	: m_ErrorHandler(u8"<repl>", u8"")
+	, m_TypeContext(m_ErrorHandler)
+	, m_Jit(std::move(jit)) {}
+
+llvm::Expected<Box<Repl>> Repl::create() {
+	auto jit = gen::JitSession::create();
+	if (!jit) {
+		return jit.takeError();
+	}
+
+	return Box<Repl>(new Repl(std::move(jit.get())));
+}
+
+int Repl::run(std::istream &in) {
+	auto created = create();
+	if (!created) {
+		util::print("Could not create JIT: {}\n", llvm::toString(created.takeError()));
+		return 4;
+	}
+
+	auto &repl = *created.get();
+
+	util::print("Enter 'struct' or 'func' declarations and statements, ':quit' to exit.\n");
+
+	std::string input;
+	std::string line;
+	i32 balance = 0;
+
+	while (true) {
+		util::print("{}", input.empty() ? "ocn> " : "...> ");
+		std::cout.flush();
+
+		if (!std::getline(in, line))
+			break;
+
+		if (input.empty() && (line == ":quit" || line == ":q"))
+			break;
+
+		input += line;
+		input += '\n';
+		balance += bracketBalance(line);
+
+		// Keep reading until all opened blocks are closed again.
+		if (balance > 0)
+			continue;
+
+		if (!isBlank(input))
+			repl.evaluate(U8String(input));
+
+		input.clear();
+		balance = 0;
+	}
+
+	util::print("\n");
+	return 0;
+}
+
+bool Repl::evaluate(const U8String &source) {
+	m_ErrorHandler.reset(source);
+
+	const auto tokens = lex::Lexer::tokenize(source, m_ErrorHandler);
+
+	if (m_ErrorHandler.hasError()) {
+		m_ErrorHandler.printErrors();
+		return false;
+	}
+
+	const U8String name = std::format("__repl_{}", m_InputCount++);
+	const auto &first = tokens.front();
+	const bool isDeclaration = first.matches(lex::TokenType::Keyword, u8"func") ||
+							   first.matches(lex::TokenType::Keyword, u8"struct");
+
+	Box<ast::Module> module;
+
+	if (isDeclaration) {
+		module = prs::Parser::parse(tokens, m_ErrorHandler, name);
+	} else {
+		Vec<Box<ast::FuncDecl>> funcs;
+		funcs.push_back(std::make_unique<ast::FuncDecl>(
+				name, Vec<ast::Param>{}, TypeFactory::getUnit(),
+				prs::Parser::parseStatements(tokens, m_ErrorHandler)));
+		module = std::make_unique<ast::Module>(name, std::move(funcs),
+											   Vec<Box<ast::StructDecl>>{});
+	}
+
+	if (m_ErrorHandler.hasError()) {
+		m_ErrorHandler.printErrors();
+		return false;
+	}
+
+	// Remember what this input declares, so it can be taken back if it does not type check.
+	auto &global = m_TypeContext.getGlobalNamespace();
+	Vec<U8String> newFuncs;
+	Vec<StructType *> newStructs;
+
+	for (const auto &decl : module->funcs) {
+		if (!global.getFunction(decl->ident))
+			newFuncs.push_back(decl->ident);
+	}
+
+	for (const auto &decl : module->structs) {
+		auto *structType = TypeFactory::getStruct(decl->ident);
+		if (!structType->isDeclared)
+			newStructs.push_back(structType);
+	}
+
+	const bool typeChecks = typeCheck(*module);
+	m_ErrorHandler.printErrors();
+
+	if (!typeChecks) {
+		rollback(newFuncs, newStructs);
+		return false;
+	}
+
+	// Functions of earlier inputs are not part of the module and are never evaluated.
+	sem::ConstantEvaluationPass constantEvaluation;
+	constantEvaluation.dispatch(*module);
+	sem::EffectAnalysisPass effectAnalysis;
+	effectAnalysis.dispatch(*module);
+
+	auto ctx = gen::CodeGen::lower(*module, m_Externals);
+	if (auto err = m_Jit->addModule(*ctx)) {
+		util::print("Could not compile input: {}\n", llvm::toString(std::move(err)));
+		rollback(newFuncs, newStructs);
+		return false;
+	}
+
+	if (isDeclaration) {
+		for (const auto &decl : module->structs)
+			m_Externals.structs.push_back(TypeFactory::getStruct(decl->ident));
+
+		for (const auto &decl : module->funcs)
+			m_Externals.funcs.emplace_back(decl->ident, global.getFunction(decl->ident).value());
+
+		return true;
+	}
+
+	auto address = m_Jit->lookup(name);
+	if (!address) {
+		util::print("Could not run input: {}\n", llvm::toString(address.takeError()));
+		return false;
+	}
+
+	using StatementsFn = void (*)();
+	reinterpret_cast<StatementsFn>(*address)();
+
+	util::flushProgramOutput();
+	return true;
+}
+
+bool Repl::typeCheck(ast::Module &module) {
+	sem::ExplorationPass exploration(m_TypeContext);
+	exploration.dispatch(module);
+
+	// Inputs are checked function by function, they do not need an entry point.
+	sem::TypeCheckingPass typeChecking(m_TypeContext);
+	for (const auto &decl : module.funcs)
+		typeChecking.dispatch(*decl);
+
+	return !m_ErrorHandler.hasError();
+}
+
+void Repl::rollback(const Vec<U8String> &newFuncs, const Vec<StructType *> &newStructs) {
+	auto &global = m_TypeContext.getGlobalNamespace();
+
+	for (const auto &name : newFuncs) {
+		if (global.getFunction(name))
+			global.removeFunction(name);
+	}
+
+	for (auto *structType : newStructs) {
+		structType->fields.clear();
+		structType->orderedFields.clear();
+		structType->isDeclared = false;
+	}
+}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <iostream>
+
+#include "codegen/CodeGen.h"
+#include "codegen/JitSession.h"
+#include "core/ErrorHandler.h"
+#include "semantic/common/TypeCheckerContext.h"
+
+namespace repl {
+///
+/// Interactive session that reads 'struct', 'func' and statement inputs one at a time. Every
+/// input is type checked against the declarations accumulated so far, lowered into its own
+/// module and added to a persistent JIT session, so earlier inputs are never recompiled.
+/// Statements are wrapped into a function returning unit, which is called right away.
+///
+struct Repl {
+private:
+	ErrorHandler m_ErrorHandler;
+	sem::TypeCheckerContext m_TypeContext;
+	Box<gen::JitSession> m_Jit;
+	gen::ExternalDecls m_Externals{.exportAll = true};
+	u32 m_InputCount = 0;
+
+	explicit Repl(Box<gen::JitSession> jit);
+
+	bool typeCheck(ast::Module &module);
+	void rollback(const Vec<U8String> &newFuncs, const Vec<StructType *> &newStructs);
+
+public:
+	/// Creates a session without any declarations.
+	static llvm::Expected<Box<Repl>> create();
+
+	/// Runs the read-eval-print loop until the end of the input or ':quit'.
+	static int run(std::istream &in);
+
+	/// Evaluates one complete input and prints its diagnostics. Returns whether the input was
+	/// accepted, rejected inputs leave the declarations of the session as they were.
+	bool evaluate(const U8String &source);
+};
+}
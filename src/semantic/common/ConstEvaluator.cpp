@@ -0,0 +1,458 @@
+#include "ConstEvaluator.h"
+
+#include <limits>
+
+namespace sem {
+using namespace ast;
+
+namespace {
+Opt<BinaryOpKind> getBinaryOp(const AssignmentKind kind) {
+	switch (kind) {
+		case AssignmentKind::Addition:		 return BinaryOpKind::Addition;
+		case AssignmentKind::Subtraction:	 return BinaryOpKind::Subtraction;
+		case AssignmentKind::Multiplication: return BinaryOpKind::Multiplication;
+		case AssignmentKind::Division:		 return BinaryOpKind::Division;
+		case AssignmentKind::Modulo:		 return BinaryOpKind::Modulo;
+		case AssignmentKind::BitwiseAnd:	 return BinaryOpKind::BitwiseAnd;
+		case AssignmentKind::BitwiseOr:		 return BinaryOpKind::BitwiseOr;
+		case AssignmentKind::BitwiseXor:	 return BinaryOpKind::BitwiseXor;
+		case AssignmentKind::LeftShift:		 return BinaryOpKind::LeftShift;
+		case AssignmentKind::RightShift:	 return BinaryOpKind::RightShift;
+		default:							 return std::nullopt;
+	}
+}
+}
+
+ConstEvaluator::ConstEvaluator(const Module &module) {
+	for (const auto &func : module.funcs) {
+		m_FuncIndices.emplace(func->ident, static_cast<i32>(m_Funcs.size()));
+		m_Funcs.push_back(func.get());
+	}
+}
+
+Opt<ConstValue> ConstEvaluator::evaluate(const Expr &n) {
+	VERIFY(isConstType(n.inferredType.value()));
+
+	m_Heap.clear();
+	m_HeapSize = 0;
+	m_Steps = 0;
+	m_CallDepth = 0;
+	m_Frame = nullptr;
+
+	try {
+		return evaluateExpr(n);
+	} catch (EvaluationError &) {
+		return std::nullopt;
+	}
+}
+
+bool ConstEvaluator::isFunction(const U8String &name) const {
+	return m_FuncIndices.contains(name);
+}
+
+bool ConstEvaluator::isConstType(Type type) {
+	if (type->isTypeKind(TypeKind::Primitive) || type->isTypeKind(TypeKind::Unit)) {
+		return true;
+	}
+
+	if (!type->isTypeKind(TypeKind::Struct)) {
+		return false;
+	}
+
+	const auto *structType = static_cast<StructType *>(type);
+	for (const auto &[_, fieldType] : structType->orderedFields) {
+		if (!isConstType(fieldType)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+ConstValue ConstEvaluator::visit(const IntLit &n) {
+	return {.scalar = n.value};
+}
+
+ConstValue ConstEvaluator::visit(const CharLit &n) {
+	return {.scalar = static_cast<i32>(n.value)};
+}
+
+ConstValue ConstEvaluator::visit(const BoolLit &n) {
+	return {.scalar = n.value ? 1 : 0};
+}
+
+ConstValue ConstEvaluator::visit(const NullLit &) {
+	return {};
+}
+
+ConstValue ConstEvaluator::visit(const UnitLit &) {
+	return {};
+}
+
+ConstValue ConstEvaluator::visit(const DefaultInit &) {
+	fail();
+}
+
+ConstValue ConstEvaluator::visit(const HeapAlloc &n) {
+	auto value = n.expr->kind == NodeKind::DefaultInit ? getDefault(n.type)
+													   : evaluateExpr(*n.expr);
+	return {.scalar = allocate({std::move(value)})};
+}
+
+ConstValue ConstEvaluator::visit(const ArrayHeapAlloc &n) {
+	const auto count = evaluateExpr(*n.size).scalar;
+	if (count < 0 || static_cast<u64>(count) > s_HeapBudget) {
+		fail();
+	}
+
+	return {.scalar = allocate(Vec<ConstValue>(count, getDefault(n.elementType)))};
+}
+
+ConstValue ConstEvaluator::visit(const StructInit &n) {
+	ConstValue result;
+	for (const auto &arg : n.args) {
+		result.fields.push_back(evaluateExpr(*arg));
+	}
+
+	return result;
+}
+
+ConstValue ConstEvaluator::visit(const UnaryExpr &n) {
+	auto operand = evaluateExpr(*n.operand);
+
+	switch (n.op) {
+		case UnaryOpKind::Positive:	   return operand;
+		case UnaryOpKind::LogicalNot:  return {.scalar = operand.scalar ? 0 : 1};
+		case UnaryOpKind::BitwiseNot:  return {.scalar = ~operand.scalar};
+		case UnaryOpKind::Dereference: return getObject(operand.scalar).front();
+		case UnaryOpKind::Negative:
+			return {.scalar = apply(BinaryOpKind::Subtraction, 0, operand.scalar)};
+		default: UNREACHABLE();
+	}
+}
+
+ConstValue ConstEvaluator::visit(const BinaryExpr &n) {
+	const auto left = evaluateExpr(*n.left).scalar;
+
+	// The right operand of && and || is only evaluated if the left one does not decide.
+	if (n.op == BinaryOpKind::LogicalAnd || n.op == BinaryOpKind::LogicalOr) {
+		if (left == (n.op == BinaryOpKind::LogicalOr)) {
+			return {.scalar = left};
+		}
+
+		return {.scalar = evaluateExpr(*n.right).scalar};
+	}
+
+	const auto right = evaluateExpr(*n.right).scalar;
+
+	// Pointers and arrays are compared by their objects, like the pointers they are at run time.
+	switch (n.op) {
+		case BinaryOpKind::Equality:		   return {.scalar = left == right};
+		case BinaryOpKind::Inequality:		   return {.scalar = left != right};
+		case BinaryOpKind::LessThan:		   return {.scalar = left < right};
+		case BinaryOpKind::LessThanOrEqual:	   return {.scalar = left <= right};
+		case BinaryOpKind::GreaterThan:		   return {.scalar = left > right};
+		case BinaryOpKind::GreaterThanOrEqual: return {.scalar = left >= right};
+		default:							   return {.scalar = apply(n.op, left, right)};
+	}
+}
+
+ConstValue ConstEvaluator::visit(const Assignment &n) {
+	auto &target = locate(*n.left);
+	auto value = evaluateExpr(*n.right);
+
+	if (const auto op = getBinaryOp(n.assignmentKind)) {
+		target.scalar = apply(op.value(), target.scalar, value.scalar);
+	} else {
+		target = std::move(value);
+	}
+
+	return {};
+}
+
+ConstValue ConstEvaluator::visit(const VarRef &n) {
+	if (const auto *local = findLocal(n.ident)) {
+		return *local;
+	}
+
+	// Builtins are not functions of the module, calling them would have an effect at run time.
+	const auto func = m_FuncIndices.find(n.ident);
+	if (func == m_FuncIndices.end()) {
+		fail();
+	}
+
+	return {.scalar = func->second};
+}
+
+ConstValue ConstEvaluator::visit(const FieldAccess &n) {
+	auto base = evaluateExpr(*n.base);
+	return std::move(base.fields[getFieldIndex(n)]);
+}
+
+ConstValue ConstEvaluator::visit(const IndexExpr &n) {
+	const auto array = evaluateExpr(*n.base).scalar;
+	const auto index = evaluateExpr(*n.index).scalar;
+	auto &elements = getObject(array);
+
+	if (index < 0 || static_cast<u64>(index) >= elements.size()) {
+		fail();
+	}
+
+	return elements[index];
+}
+
+ConstValue ConstEvaluator::visit(const LenExpr &n) {
+	// A null array has no elements.
+	const auto array = evaluateExpr(*n.base).scalar;
+	return {.scalar = array ? static_cast<i32>(getObject(array).size()) : 0};
+}
+
+ConstValue ConstEvaluator::visit(const FuncCall &n) {
+	const auto func = evaluateExpr(*n.expr).scalar;
+
+	Vec<ConstValue> args;
+	args.reserve(n.args.size());
+	for (const auto &arg : n.args) {
+		args.push_back(evaluateExpr(*arg));
+	}
+
+	return call(func, std::move(args));
+}
+
+ConstValue ConstEvaluator::evaluateExpr(const Expr &n) {
+	if (n.constValue) {
+		return n.constValue.value();
+	}
+
+	return dispatch(n);
+}
+
+bool ConstEvaluator::execute(const Stmt &n) {
+	step();
+
+	switch (n.kind) {
+		case NodeKind::BlockStmt: {
+			m_Frame->scopes.emplace_back();
+
+			for (const auto &stmt : static_cast<const BlockStmt &>(n).stmts) {
+				if (execute(*stmt)) {
+					return true;
+				}
+			}
+
+			m_Frame->scopes.pop_back();
+			return false;
+		}
+
+		case NodeKind::IfStmt: {
+			const auto &ifStmt = static_cast<const IfStmt &>(n);
+			return execute(evaluateExpr(*ifStmt.cond).scalar ? *ifStmt.then : *ifStmt.else_);
+		}
+
+		case NodeKind::WhileStmt: {
+			const auto &whileStmt = static_cast<const WhileStmt &>(n);
+
+			while (evaluateExpr(*whileStmt.cond).scalar) {
+				if (execute(*whileStmt.body)) {
+					return true;
+				}
+
+				step();
+			}
+
+			return false;
+		}
+
+		case NodeKind::ReturnStmt: {
+			m_ReturnValue = evaluateExpr(*static_cast<const ReturnStmt &>(n).expr);
+			return true;
+		}
+
+		case NodeKind::VarDef: {
+			const auto &varDef = static_cast<const VarDef &>(n);
+			auto value = varDef.value->kind == NodeKind::DefaultInit ? getDefault(varDef.type)
+																	  : evaluateExpr(*varDef.value);
+
+			m_Frame->scopes.back().insert_or_assign(varDef.ident, std::move(value));
+			return false;
+		}
+
+		default: {
+			evaluateExpr(static_cast<const Expr &>(n));
+			return false;
+		}
+	}
+}
+
+ConstValue ConstEvaluator::call(const i32 funcIndex, Vec<ConstValue> args) {
+	if (m_CallDepth == s_MaxCallDepth) {
+		fail();
+	}
+
+	const auto &func = *m_Funcs[funcIndex];
+	Frame frame;
+	auto &params = frame.scopes.emplace_back();
+
+	for (u32 i = 0; i < args.size(); ++i) {
+		params.emplace(func.params[i].first, std::move(args[i]));
+	}
+
+	auto *caller = m_Frame;
+	m_Frame = &frame;
+	++m_CallDepth;
+
+	// A function that ends without returning returns the default value of its return type.
+	m_ReturnValue = std::nullopt;
+	execute(*func.body);
+	auto result = m_ReturnValue ? std::move(m_ReturnValue.value()) : getDefault(func.returnType);
+
+	--m_CallDepth;
+	m_Frame = caller;
+
+	return result;
+}
+
+ConstValue &ConstEvaluator::locate(const Expr &n) {
+	switch (n.kind) {
+		case NodeKind::VarRef: {
+			auto *local = findLocal(static_cast<const VarRef &>(n).ident);
+			if (!local) {
+				fail();
+			}
+
+			return *local;
+		}
+
+		case NodeKind::UnaryExpr: {
+			const auto &unaryExpr = static_cast<const UnaryExpr &>(n);
+			VERIFY(unaryExpr.op == UnaryOpKind::Dereference);
+
+			return getObject(evaluateExpr(*unaryExpr.operand).scalar).front();
+		}
+
+		case NodeKind::FieldAccess: {
+			const auto &fieldAccess = static_cast<const FieldAccess &>(n);
+			return locate(*fieldAccess.base).fields[getFieldIndex(fieldAccess)];
+		}
+
+		case NodeKind::IndexExpr: {
+			const auto &indexExpr = static_cast<const IndexExpr &>(n);
+			const auto array = evaluateExpr(*indexExpr.base).scalar;
+			const auto index = evaluateExpr(*indexExpr.index).scalar;
+			auto &elements = getObject(array);
+
+			if (index < 0 || static_cast<u64>(index) >= elements.size()) {
+				fail();
+			}
+
+			return elements[index];
+		}
+
+		default: fail();
+	}
+}
+
+ConstValue *ConstEvaluator::findLocal(const U8String &name) const {
+	if (!m_Frame) {
+		return nullptr;
+	}
+
+	for (auto scope = m_Frame->scopes.rbegin(); scope != m_Frame->scopes.rend(); ++scope) {
+		if (const auto local = scope->find(name); local != scope->end()) {
+			return &local->second;
+		}
+	}
+
+	return nullptr;
+}
+
+Vec<ConstValue> &ConstEvaluator::getObject(const i32 ref) {
+	// Dereferencing null panics at run time.
+	if (ref == 0) {
+		fail();
+	}
+
+	return m_Heap[ref - 1];
+}
+
+i32 ConstEvaluator::allocate(Vec<ConstValue> elements) {
+	m_HeapSize += elements.size() + 1;
+	if (m_HeapSize > s_HeapBudget) {
+		fail();
+	}
+
+	m_Heap.push_back(std::move(elements));
+	return static_cast<i32>(m_Heap.size());
+}
+
+void ConstEvaluator::step() {
+	if (++m_Steps > s_StepBudget) {
+		fail();
+	}
+}
+
+void ConstEvaluator::fail() {
+	throw EvaluationError();
+}
+
+ConstValue ConstEvaluator::getDefault(Type type) {
+	ConstValue result;
+
+	if (type->isTypeKind(TypeKind::Struct)) {
+		for (const auto &[_, fieldType] : static_cast<StructType *>(type)->orderedFields) {
+			result.fields.push_back(getDefault(fieldType));
+		}
+	}
+
+	return result;
+}
+
+u32 ConstEvaluator::getFieldIndex(const FieldAccess &n) {
+	const auto *structType = static_cast<StructType *>(n.base->inferredType.value());
+	VERIFY(structType->isTypeKind(TypeKind::Struct));
+
+	for (u32 i = 0; i < structType->orderedFields.size(); ++i) {
+		if (structType->orderedFields[i].first == n.field) {
+			return i;
+		}
+	}
+
+	UNREACHABLE();
+}
+
+i32 ConstEvaluator::apply(const BinaryOpKind op, const i32 left, const i32 right) {
+	// Integers wrap around like the instructions they are lowered to. The cases the
+	// instructions leave undefined are left to run time.
+	const auto l = static_cast<u32>(left);
+	const auto r = static_cast<u32>(right);
+
+	switch (op) {
+		case BinaryOpKind::Addition:	   return static_cast<i32>(l + r);
+		case BinaryOpKind::Subtraction:	   return static_cast<i32>(l - r);
+		case BinaryOpKind::Multiplication: return static_cast<i32>(l * r);
+		case BinaryOpKind::BitwiseAnd:	   return left & right;
+		case BinaryOpKind::BitwiseOr:	   return left | right;
+		case BinaryOpKind::BitwiseXor:	   return left ^ right;
+
+		case BinaryOpKind::Division:
+		case BinaryOpKind::Modulo: {
+			if (right == 0 || (left == std::numeric_limits<i32>::min() && right == -1)) {
+				fail();
+			}
+
+			return op == BinaryOpKind::Division ? left / right : left % right;
+		}
+
+		case BinaryOpKind::LeftShift:
+		case BinaryOpKind::RightShift: {
+			if (right < 0 || right > 31) {
+				fail();
+			}
+
+			return op == BinaryOpKind::LeftShift ? static_cast<i32>(l << right) : left >> right;
+		}
+
+		default: UNREACHABLE();
+	}
+}
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <exception>
+
+#include "ast/Visitor.h"
+
+namespace sem {
+///
+/// Evaluates expressions at compile time by interpreting them, including the calls to functions
+/// of the module they make. Only expressions that do not refer to locals can be evaluated, and
+/// only the results of types that isConstType accepts can be used as constants.
+///
+/// During the evaluation, values are ast::ConstValues as well. Pointers and arrays are the index
+/// of their object on a heap of the evaluator plus one, so that null is 0, and functions are
+/// their index in the module. The evaluation gives up if the program would panic, if it calls a
+/// builtin like print_i32, whose effect has to happen at run time, or if it takes too many steps,
+/// so that an endless loop does not hang the compiler.
+///
+struct ConstEvaluator : ast::ConstVisitor<ast::ConstValue> {
+private:
+	/// Thrown to abandon an evaluation that cannot be done at compile time.
+	struct EvaluationError : std::exception {};
+
+	/// The locals of a function that is being evaluated, one map for every open block.
+	struct Frame {
+		Vec<Map<U8String, ast::ConstValue>> scopes;
+	};
+
+	static constexpr u64 s_StepBudget = 100'000;
+	static constexpr u64 s_HeapBudget = 1 << 20;
+	static constexpr u32 s_MaxCallDepth = 200;
+
+	Vec<const ast::FuncDecl *> m_Funcs;
+	Map<U8String, i32> m_FuncIndices;
+	Vec<Vec<ast::ConstValue>> m_Heap;
+	u64 m_HeapSize = 0;
+	u64 m_Steps = 0;
+	u32 m_CallDepth = 0;
+	Frame *m_Frame = nullptr;
+	Opt<ast::ConstValue> m_ReturnValue;
+
+public:
+	explicit ConstEvaluator(const ast::Module &module);
+
+	/// Evaluates an expression that does not refer to locals. Returns nothing if it cannot be
+	/// evaluated at compile time.
+	[[nodiscard]] Opt<ast::ConstValue> evaluate(const ast::Expr &n);
+
+	/// Whether the name refers to a function of the module.
+	[[nodiscard]] bool isFunction(const U8String &name) const;
+
+	/// Whether values of the type can be constants: integers, characters, booleans, unit and
+	/// structs made of them.
+	[[nodiscard]] static bool isConstType(Type type);
+
+private:
+	ast::ConstValue visit(const ast::IntLit &n) override;
+	ast::ConstValue visit(const ast::CharLit &n) override;
+	ast::ConstValue visit(const ast::BoolLit &n) override;
+	ast::ConstValue visit(const ast::NullLit &n) override;
+	ast::ConstValue visit(const ast::UnitLit &n) override;
+	ast::ConstValue visit(const ast::DefaultInit &n) override;
+	ast::ConstValue visit(const ast::HeapAlloc &n) override;
+	ast::ConstValue visit(const ast::ArrayHeapAlloc &n) override;
+	ast::ConstValue visit(const ast::StructInit &n) override;
+	ast::ConstValue visit(const ast::UnaryExpr &n) override;
+	ast::ConstValue visit(const ast::BinaryExpr &n) override;
+	ast::ConstValue visit(const ast::Assignment &n) override;
+	ast::ConstValue visit(const ast::VarRef &n) override;
+	ast::ConstValue visit(const ast::FieldAccess &n) override;
+	ast::ConstValue visit(const ast::IndexExpr &n) override;
+	ast::ConstValue visit(const ast::LenExpr &n) override;
+	ast::ConstValue visit(const ast::FuncCall &n) override;
+
+	/// Evaluates an expression, subexpressions that are already known to be constant are not
+	/// evaluated again.
+	ast::ConstValue evaluateExpr(const ast::Expr &n);
+
+	/// Runs a statement, returns whether it returned from the function.
+	bool execute(const ast::Stmt &n);
+
+	ast::ConstValue call(i32 funcIndex, Vec<ast::ConstValue> args);
+
+	/// Returns the storage an assignment to the expression writes to.
+	ast::ConstValue &locate(const ast::Expr &n);
+
+	ast::ConstValue *findLocal(const U8String &name) const;
+	Vec<ast::ConstValue> &getObject(i32 ref);
+	i32 allocate(Vec<ast::ConstValue> elements);
+	void step();
+
+	[[noreturn]] static void fail();
+	[[nodiscard]] static ast::ConstValue getDefault(Type type);
+	[[nodiscard]] static u32 getFieldIndex(const ast::FieldAccess &n);
+
+	/// Applies an arithmetic or bitwise operator to two integers.
+	[[nodiscard]] static i32 apply(BinaryOpKind op, i32 left, i32 right);
+};
+}
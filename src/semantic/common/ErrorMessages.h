@@ -15,7 +15,9 @@ enum struct ErrorMessageKind {
 	StructInfiniteSize,
 	NonReturningPaths,
 	UndefinedReference,
-	AssignToRValue
+	AssignToRValue,
+	AssignToBorrowedParam,
+	BorrowedParamEscapes
 };
 
 template <ErrorMessageKind E>
@@ -115,4 +117,18 @@ struct ErrorMessage<ErrorMessageKind::AssignToRValue> {
 		return std::format("Left side of an assignment needs to be an l-value.");
 	}
 };
+
+template <>
+struct ErrorMessage<ErrorMessageKind::AssignToBorrowedParam> {
+	[[nodiscard]] static U8String str(const U8String &ident) {
+		return std::format("Cannot assign to borrowed parameter '{}'.", ident);
+	}
+};
+
+template <>
+struct ErrorMessage<ErrorMessageKind::BorrowedParamEscapes> {
+	[[nodiscard]] static U8String str(const U8String &ident) {
+		return std::format("Borrowed parameter '{}' cannot escape the function.", ident);
+	}
+};
 }
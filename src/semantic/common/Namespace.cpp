@@ -10,6 +10,12 @@ void Namespace::addFunction(U8String name, FunctionType *func) {
 	m_Functions.emplace(std::move(name), func);
 }
 
+void Namespace::removeFunction(const U8String &name) {
+	VERIFY(m_Functions.contains(name));
+
+	m_Functions.erase(name);
+}
+
 Opt<FunctionType *> Namespace::getFunction(const U8String &name) const {
 	const auto func = m_Functions.find(name);
 
@@ -17,6 +17,7 @@ public:
 	Namespace &operator=(Namespace &&) = delete;
 
 	void addFunction(U8String name, FunctionType *func);
+	void removeFunction(const U8String &name);
 	Opt<FunctionType *> getFunction(const U8String &name) const;
 	size_t getSize() const;
 };
@@ -0,0 +1,167 @@
+#include "ConstantEvaluationPass.h"
+
+namespace sem {
+using namespace ast;
+
+bool ConstantEvaluationPass::visit(Module &n) {
+	m_Evaluator = std::make_unique<ConstEvaluator>(n);
+
+	for (const auto &func : n.funcs) {
+		dispatch(*func);
+	}
+
+	return false;
+}
+
+bool ConstantEvaluationPass::visit(IntLit &n) {
+	n.constValue = ConstValue{.scalar = n.value};
+	return true;
+}
+
+bool ConstantEvaluationPass::visit(CharLit &n) {
+	n.constValue = ConstValue{.scalar = static_cast<i32>(n.value)};
+	return true;
+}
+
+bool ConstantEvaluationPass::visit(BoolLit &n) {
+	n.constValue = ConstValue{.scalar = n.value ? 1 : 0};
+	return true;
+}
+
+bool ConstantEvaluationPass::visit(NullLit &) {
+	return true;
+}
+
+bool ConstantEvaluationPass::visit(UnitLit &n) {
+	n.constValue = ConstValue{};
+	return true;
+}
+
+bool ConstantEvaluationPass::visit(DefaultInit &) {
+	return true;
+}
+
+bool ConstantEvaluationPass::visit(HeapAlloc &n) {
+	return fold(n, dispatch(*n.expr));
+}
+
+bool ConstantEvaluationPass::visit(ArrayHeapAlloc &n) {
+	return fold(n, dispatch(*n.size));
+}
+
+bool ConstantEvaluationPass::visit(StructInit &n) {
+	bool canEvaluate = true;
+	for (const auto &arg : n.args) {
+		canEvaluate = dispatch(*arg) && canEvaluate;
+	}
+
+	return fold(n, canEvaluate);
+}
+
+bool ConstantEvaluationPass::visit(UnaryExpr &n) {
+	return fold(n, dispatch(*n.operand));
+}
+
+bool ConstantEvaluationPass::visit(BinaryExpr &n) {
+	const auto canEvaluateLeft = dispatch(*n.left);
+	const auto canEvaluateRight = dispatch(*n.right);
+
+	// If the left operand of && or || decides the result, the right one is never evaluated.
+	const auto isLogical = n.op == BinaryOpKind::LogicalAnd || n.op == BinaryOpKind::LogicalOr;
+	const auto &left = n.left->constValue;
+	const auto decides = isLogical && left && left->scalar == (n.op == BinaryOpKind::LogicalOr);
+
+	return fold(n, canEvaluateLeft && (canEvaluateRight || decides));
+}
+
+bool ConstantEvaluationPass::visit(Assignment &n) {
+	dispatch(*n.left);
+	dispatch(*n.right);
+	return false;
+}
+
+bool ConstantEvaluationPass::visit(FuncCall &n) {
+	bool canEvaluate = dispatch(*n.expr);
+	for (const auto &arg : n.args) {
+		canEvaluate = dispatch(*arg) && canEvaluate;
+	}
+
+	return fold(n, canEvaluate);
+}
+
+bool ConstantEvaluationPass::visit(VarRef &n) {
+	// Only functions of the module can be called at compile time, locals are not known.
+	return !m_Locals.contains(n.ident) && m_Evaluator->isFunction(n.ident);
+}
+
+bool ConstantEvaluationPass::visit(FieldAccess &n) {
+	return fold(n, dispatch(*n.base));
+}
+
+bool ConstantEvaluationPass::visit(IndexExpr &n) {
+	const auto canEvaluateBase = dispatch(*n.base);
+	return fold(n, dispatch(*n.index) && canEvaluateBase);
+}
+
+bool ConstantEvaluationPass::visit(LenExpr &n) {
+	return fold(n, dispatch(*n.base));
+}
+
+bool ConstantEvaluationPass::visit(BlockStmt &n) {
+	for (const auto &stmt : n.stmts) {
+		dispatch(*stmt);
+	}
+
+	return false;
+}
+
+bool ConstantEvaluationPass::visit(IfStmt &n) {
+	dispatch(*n.cond);
+	dispatch(*n.then);
+	dispatch(*n.else_);
+	return false;
+}
+
+bool ConstantEvaluationPass::visit(WhileStmt &n) {
+	dispatch(*n.cond);
+	dispatch(*n.body);
+	return false;
+}
+
+bool ConstantEvaluationPass::visit(ReturnStmt &n) {
+	dispatch(*n.expr);
+	return false;
+}
+
+bool ConstantEvaluationPass::visit(VarDef &n) {
+	dispatch(*n.value);
+	m_Locals.insert(n.ident);
+	return false;
+}
+
+bool ConstantEvaluationPass::visit(FuncDecl &n) {
+	// Locals shadow functions of the same name anywhere in the function, which is conservative
+	// for the blocks they are not declared in.
+	m_Locals.clear();
+	for (const auto &[name, _] : n.params) {
+		m_Locals.insert(name);
+	}
+
+	dispatch(*n.body);
+	return false;
+}
+
+bool ConstantEvaluationPass::fold(Expr &n, const bool canEvaluate) {
+	if (!canEvaluate) {
+		return false;
+	}
+
+	// Values of other types are evaluated as part of the enclosing expression.
+	if (!ConstEvaluator::isConstType(n.inferredType.value())) {
+		return true;
+	}
+
+	n.constValue = m_Evaluator->evaluate(n);
+	return n.constValue.has_value();
+}
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <unordered_set>
+
+#include "ast/Visitor.h"
+#include "semantic/common/ConstEvaluator.h"
+
+namespace sem {
+///
+/// Computes the values of all expressions of a type checked module that are known at compile
+/// time and stores them in their constValue, so that the backends can use the value instead of
+/// computing it at run time. Besides operators applied to literals and structs initialized with
+/// constant fields, this includes calls to functions with constant arguments that have no effects
+/// at run time, for example a function that builds a lookup table and reads an entry from it.
+///
+/// An expression can be evaluated if it does not refer to locals, which includes the parameters.
+/// Its value is only stored if its type can be a constant, but expressions of other types like
+/// `new i32(3)` or `table(8)` may still be part of a constant like `*new i32(3)` or `table(8)[3]`.
+///
+struct ConstantEvaluationPass : ast::Visitor<bool> {
+private:
+	Box<ConstEvaluator> m_Evaluator;
+	std::unordered_set<U8String> m_Locals;
+
+public:
+	ConstantEvaluationPass() = default;
+
+private:
+	bool visit(ast::Module &n) override;
+	bool visit(ast::IntLit &n) override;
+	bool visit(ast::CharLit &n) override;
+	bool visit(ast::BoolLit &n) override;
+	bool visit(ast::NullLit &n) override;
+	bool visit(ast::UnitLit &n) override;
+	bool visit(ast::DefaultInit &n) override;
+	bool visit(ast::HeapAlloc &n) override;
+	bool visit(ast::ArrayHeapAlloc &n) override;
+	bool visit(ast::StructInit &n) override;
+	bool visit(ast::UnaryExpr &n) override;
+	bool visit(ast::BinaryExpr &n) override;
+	bool visit(ast::Assignment &n) override;
+	bool visit(ast::FuncCall &n) override;
+	bool visit(ast::VarRef &n) override;
+	bool visit(ast::FieldAccess &n) override;
+	bool visit(ast::IndexExpr &n) override;
+	bool visit(ast::LenExpr &n) override;
+	bool visit(ast::BlockStmt &n) override;
+	bool visit(ast::IfStmt &n) override;
+	bool visit(ast::WhileStmt &n) override;
+	bool visit(ast::ReturnStmt &n) override;
+	bool visit(ast::VarDef &n) override;
+	bool visit(ast::FuncDecl &n) override;
+
+	/// Evaluates the expression if it can be evaluated and stores its value if it is a constant.
+	/// Returns whether an enclosing expression can still be evaluated.
+	bool fold(ast::Expr &n, bool canEvaluate);
+};
+}
@@ -0,0 +1,350 @@
+#include "EffectAnalysisPass.h"
+
+#include "core/DefaultDecls.h"
+
+namespace sem {
+using namespace ast;
+
+void EffectAnalysisPass::visit(Module &n) {
+	// Start from functions without effects and add the effects of their callees until nothing
+	// changes. The first round also finds out which functions call each other.
+	for (const auto &func : n.funcs) {
+		m_Funcs.emplace(func->ident, func.get());
+		func->effects = FuncEffects{.readsMemory = false,
+									.writesMemory = false,
+									.touchesHeap = false,
+									.mayPanic = false,
+									.mayDiverge = false,
+									.returnsFresh = true,
+									.capturedParams = Vec<bool>(func->params.size(), false)};
+	}
+
+	for (const auto &func : n.funcs) {
+		dispatch(*func);
+	}
+
+	findRecursiveFuncs();
+
+	for (bool changed = true; changed;) {
+		changed = false;
+
+		for (const auto &func : n.funcs) {
+			const auto previous = func->effects;
+			dispatch(*func);
+			changed = changed || func->effects != previous;
+		}
+	}
+}
+
+void EffectAnalysisPass::visit(IntLit &) {}
+
+void EffectAnalysisPass::visit(CharLit &) {}
+
+void EffectAnalysisPass::visit(BoolLit &) {}
+
+void EffectAnalysisPass::visit(NullLit &) {}
+
+void EffectAnalysisPass::visit(UnitLit &) {}
+
+void EffectAnalysisPass::visit(DefaultInit &) {}
+
+void EffectAnalysisPass::visit(HeapAlloc &n) {
+	m_Effects.touchesHeap = true;
+	use(*n.expr, false);
+}
+
+void EffectAnalysisPass::visit(ArrayHeapAlloc &n) {
+	m_Effects.touchesHeap = true;
+	use(*n.size, true);
+}
+
+void EffectAnalysisPass::visit(StructInit &n) {
+	for (const auto &arg : n.args) {
+		use(*arg, false);
+	}
+}
+
+void EffectAnalysisPass::visit(UnaryExpr &n) {
+	if (n.op == UnaryOpKind::Dereference) {
+		m_Effects.readsMemory = true;
+		m_Effects.mayPanic = true;
+	}
+
+	use(*n.operand, true);
+}
+
+void EffectAnalysisPass::visit(BinaryExpr &n) {
+	use(*n.left, true);
+	use(*n.right, true);
+}
+
+void EffectAnalysisPass::visit(Assignment &n) {
+	const Expr *target = n.left.get();
+	while (target->kind == NodeKind::FieldAccess) {
+		target = static_cast<const FieldAccess &>(*target).base.get();
+	}
+
+	// Stores through a pointer or into an array change memory the caller may see, stores into a
+	// parameter make the function own it.
+	if (target->kind == NodeKind::UnaryExpr || target->kind == NodeKind::IndexExpr) {
+		m_Effects.writesMemory = true;
+	} else if (target->kind == NodeKind::VarRef) {
+		const auto param = m_Params.find(static_cast<const VarRef &>(*target).ident);
+		if (param != m_Params.end()) {
+			m_Effects.capturedParams[param->second] = true;
+		}
+	}
+
+	if (isRefCounted(n.left->inferredType.value())) {
+		m_Effects.touchesHeap = true;
+	}
+
+	use(*n.left, true);
+	use(*n.right, false);
+}
+
+void EffectAnalysisPass::visit(FuncCall &n) {
+	if (auto *callee = getCallee(n)) {
+		m_Calls[m_Func].insert(callee);
+
+		// A callee that does not capture a parameter borrows the local passed for it.
+		const auto &effects = callee->effects;
+		for (u32 i = 0; i < n.args.size(); ++i) {
+			const auto isBorrowed = n.args[i]->kind == NodeKind::VarRef &&
+									i < effects.capturedParams.size() &&
+									!effects.capturedParams[i];
+			use(*n.args[i], isBorrowed);
+		}
+
+		m_Effects.readsMemory |= effects.readsMemory;
+		m_Effects.writesMemory |= effects.writesMemory;
+		m_Effects.touchesHeap |= effects.touchesHeap;
+		m_Effects.mayPanic |= effects.mayPanic;
+		m_Effects.mayDiverge |= effects.mayDiverge;
+
+		if (effects.neverReturns) {
+			m_Reachable = false;
+		}
+
+		return;
+	}
+
+	// Builtins only perform input or output, calls of function values may do anything.
+	const auto *ref = n.expr->kind == NodeKind::VarRef ? static_cast<const VarRef *>(n.expr.get())
+													   : nullptr;
+	const auto isBuiltin = ref && !m_Locals.contains(ref->ident) &&
+						   s_DefaultDecls.contains(ref->ident);
+
+	use(*n.expr, true);
+	for (const auto &arg : n.args) {
+		use(*arg, isBuiltin);
+	}
+
+	m_Effects.writesMemory = true;
+
+	// Reads wait for input that may never come, and the runtime keeps retrying them once the
+	// input has ended.
+	if (isBuiltin && (ref->ident == u8"read_i32" || ref->ident == u8"read_bool" ||
+					  ref->ident == u8"read_char")) {
+		m_Effects.mayDiverge = true;
+	}
+
+	if (!isBuiltin) {
+		m_Effects.readsMemory = true;
+		m_Effects.touchesHeap = true;
+		m_Effects.mayPanic = true;
+		m_Effects.mayDiverge = true;
+	}
+}
+
+void EffectAnalysisPass::visit(VarRef &n) {
+	if (m_IsInspected) {
+		return;
+	}
+
+	const auto param = m_Params.find(n.ident);
+	if (param != m_Params.end()) {
+		m_Effects.capturedParams[param->second] = true;
+	}
+}
+
+void EffectAnalysisPass::visit(FieldAccess &n) {
+	use(*n.base, true);
+}
+
+void EffectAnalysisPass::visit(IndexExpr &n) {
+	m_Effects.readsMemory = true;
+	m_Effects.mayPanic = true;
+
+	use(*n.base, true);
+	use(*n.index, true);
+}
+
+void EffectAnalysisPass::visit(LenExpr &n) {
+	m_Effects.readsMemory = true;
+	use(*n.base, true);
+}
+
+void EffectAnalysisPass::visit(BlockStmt &n) {
+	for (const auto &stmt : n.stmts) {
+		if (auto *expr = dynamic_cast<Expr *>(stmt.get())) {
+			use(*expr, true);
+		} else {
+			dispatch(*stmt);
+		}
+	}
+}
+
+void EffectAnalysisPass::visit(IfStmt &n) {
+	use(*n.cond, true);
+
+	// A branch that a constant condition never takes cannot return.
+	const auto &cond = n.cond->constValue;
+	const auto reachable = m_Reachable;
+
+	m_Reachable = reachable && (!cond || cond->scalar == 1);
+	dispatch(*n.then);
+	const auto reachableAfterThen = m_Reachable;
+
+	m_Reachable = reachable && (!cond || cond->scalar == 0);
+	dispatch(*n.else_);
+	m_Reachable = m_Reachable || reachableAfterThen;
+}
+
+void EffectAnalysisPass::visit(WhileStmt &n) {
+	use(*n.cond, true);
+
+	const auto &cond = n.cond->constValue;
+	const auto reachable = m_Reachable;
+
+	if (!cond || cond->scalar == 1) {
+		m_Effects.mayDiverge = true;
+	}
+
+	m_Reachable = reachable && (!cond || cond->scalar == 1);
+	dispatch(*n.body);
+
+	// There is no break, so a loop whose condition is always true is never left.
+	m_Reachable = reachable && (!cond || cond->scalar == 0);
+}
+
+void EffectAnalysisPass::visit(ReturnStmt &n) {
+	use(*n.expr, false);
+
+	const auto isAllocation = n.expr->kind == NodeKind::HeapAlloc ||
+							  n.expr->kind == NodeKind::ArrayHeapAlloc;
+	const auto *callee = n.expr->kind == NodeKind::FuncCall
+								 ? getCallee(static_cast<const FuncCall &>(*n.expr))
+								 : nullptr;
+
+	if (!isAllocation && !(callee && callee->effects.returnsFresh)) {
+		m_Effects.returnsFresh = false;
+	}
+
+	m_MayReturn = m_MayReturn || m_Reachable;
+	m_Reachable = false;
+}
+
+void EffectAnalysisPass::visit(VarDef &n) {
+	use(*n.value, false);
+
+	// The local is dropped at the end of its scope.
+	if (isRefCounted(n.type)) {
+		m_Effects.touchesHeap = true;
+	}
+
+	m_Locals.insert(n.ident);
+}
+
+void EffectAnalysisPass::visit(FuncDecl &n) {
+	m_Func = &n;
+	m_Locals.clear();
+	m_Params.clear();
+
+	for (u32 i = 0; i < n.params.size(); ++i) {
+		m_Locals.insert(n.params[i].first);
+		m_Params.emplace(n.params[i].first, i);
+	}
+
+	const auto returnsRef = n.returnType->isTypeKind(TypeKind::Pointer) ||
+							n.returnType->isTypeKind(TypeKind::Array);
+
+	m_Effects = FuncEffects{.readsMemory = false,
+							.writesMemory = false,
+							.touchesHeap = false,
+							.mayPanic = false,
+							.mayDiverge = false,
+							.returnsFresh = returnsRef,
+							.capturedParams = Vec<bool>(n.params.size(), false)};
+	m_Reachable = true;
+	m_MayReturn = false;
+
+	dispatch(*n.body);
+
+	m_Effects.neverReturns = !m_MayReturn && !m_Reachable;
+	m_Effects.mayDiverge |= m_RecursiveFuncs.contains(&n);
+
+	// A captured parameter may be owned by the function, which drops it at the end.
+	for (u32 i = 0; i < n.params.size(); ++i) {
+		if (m_Effects.capturedParams[i] && isRefCounted(n.params[i].second)) {
+			m_Effects.touchesHeap = true;
+		}
+	}
+
+	n.effects = std::move(m_Effects);
+}
+
+void EffectAnalysisPass::use(Expr &n, const bool isInspected) {
+	// Folded expressions and default values are constants, none of them is evaluated at run
+	// time. Default values have no type of their own either.
+	if (n.constValue || n.kind == NodeKind::DefaultInit) {
+		return;
+	}
+
+	// A temporary is dropped after it was inspected, a value handed over is copied or moved.
+	const auto isTemp = n.valueCategory == ValueCategory::RValue;
+	if (isRefCounted(n.inferredType.value()) && (!isInspected || isTemp)) {
+		m_Effects.touchesHeap = true;
+	}
+
+	m_IsInspected = isInspected;
+	dispatch(n);
+}
+
+FuncDecl *EffectAnalysisPass::getCallee(const FuncCall &n) const {
+	if (n.expr->kind != NodeKind::VarRef) {
+		return nullptr;
+	}
+
+	const auto &ident = static_cast<const VarRef &>(*n.expr).ident;
+	const auto func = m_Funcs.find(ident);
+	return func != m_Funcs.end() && !m_Locals.contains(ident) ? func->second : nullptr;
+}
+
+void EffectAnalysisPass::findRecursiveFuncs() {
+	for (const auto &[_, func] : m_Funcs) {
+		std::unordered_set<const FuncDecl *> visited;
+		Vec<const FuncDecl *> worklist = {func};
+
+		while (!worklist.empty()) {
+			const auto *current = worklist.back();
+			worklist.pop_back();
+
+			const auto calls = m_Calls.find(current);
+			if (calls == m_Calls.end()) {
+				continue;
+			}
+
+			for (const auto *callee : calls->second) {
+				if (callee == func) {
+					m_RecursiveFuncs.insert(func);
+				}
+
+				if (visited.insert(callee).second) {
+					worklist.push_back(callee);
+				}
+			}
+		}
+	}
+}
+}
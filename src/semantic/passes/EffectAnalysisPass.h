@@ -0,0 +1,74 @@
+#pragma once
+#include <unordered_set>
+
+#include "ast/Visitor.h"
+
+namespace sem {
+///
+/// Infers the effects of every function of a type checked module and stores them in its
+/// FuncDecl, so that the code generation can tell LLVM which calls it may remove, merge or move.
+/// A function that neither touches memory of its caller nor panics computes its result from its
+/// arguments only, and a function without loops or recursion that cannot panic always returns.
+///
+/// Calls of other functions of the module add the effects of the callee, which are computed by
+/// repeating the analysis of all functions until nothing changes. Calls of function values may
+/// do anything. Expressions folded by the ConstantEvaluationPass are not evaluated at run time,
+/// so they have no effects.
+///
+/// A parameter is captured if its value may outlive the call: if it is assigned, copied, returned
+/// or passed to a function that captures it. Only looking at it, e.g. dereferencing it, indexing
+/// it or comparing it, leaves it with the caller.
+///
+struct EffectAnalysisPass : ast::Visitor<void> {
+private:
+	Map<U8String, ast::FuncDecl *> m_Funcs;
+	Map<const ast::FuncDecl *, std::unordered_set<const ast::FuncDecl *>> m_Calls;
+	std::unordered_set<const ast::FuncDecl *> m_RecursiveFuncs;
+	const ast::FuncDecl *m_Func = nullptr;
+	std::unordered_set<U8String> m_Locals;
+	Map<U8String, u32> m_Params;
+	ast::FuncEffects m_Effects;
+	bool m_Reachable = true;
+	bool m_MayReturn = false;
+	bool m_IsInspected = false;
+
+public:
+	EffectAnalysisPass() = default;
+
+private:
+	void visit(ast::Module &n) override;
+	void visit(ast::IntLit &n) override;
+	void visit(ast::CharLit &n) override;
+	void visit(ast::BoolLit &n) override;
+	void visit(ast::NullLit &n) override;
+	void visit(ast::UnitLit &n) override;
+	void visit(ast::DefaultInit &n) override;
+	void visit(ast::HeapAlloc &n) override;
+	void visit(ast::ArrayHeapAlloc &n) override;
+	void visit(ast::StructInit &n) override;
+	void visit(ast::UnaryExpr &n) override;
+	void visit(ast::BinaryExpr &n) override;
+	void visit(ast::Assignment &n) override;
+	void visit(ast::FuncCall &n) override;
+	void visit(ast::VarRef &n) override;
+	void visit(ast::FieldAccess &n) override;
+	void visit(ast::IndexExpr &n) override;
+	void visit(ast::LenExpr &n) override;
+	void visit(ast::BlockStmt &n) override;
+	void visit(ast::IfStmt &n) override;
+	void visit(ast::WhileStmt &n) override;
+	void visit(ast::ReturnStmt &n) override;
+	void visit(ast::VarDef &n) override;
+	void visit(ast::FuncDecl &n) override;
+
+	/// Visits an expression whose value is either only inspected, or handed over to a new owner,
+	/// which copies or moves it.
+	void use(ast::Expr &n, bool isInspected);
+
+	/// Returns the function of the module a call goes to directly, nullptr for function values.
+	[[nodiscard]] ast::FuncDecl *getCallee(const ast::FuncCall &n) const;
+
+	/// Finds the functions that may call themselves, directly or through other functions.
+	void findRecursiveFuncs();
+};
+}
@@ -61,10 +61,18 @@ ExplorationPass::ExplorationPass(TypeCheckerContext &ctx)
 	: m_Context(ctx) {}
 
 void ExplorationPass::visit(const Module &n) {
+	declareStructs(n);
+	validateStructs(n);
+	declareFunctions(n);
+}
+
+void ExplorationPass::declareStructs(const Module &n) {
 	for (auto &s : n.structs) {
 		dispatch(*s);
 	}
+}
 
+void ExplorationPass::validateStructs(const Module &n) {
 	// Validate that all struct field types are declared, including nested references.
 	for (auto &s : n.structs) {
 		for (const auto &[fieldName, fieldType] : s->fields) {
@@ -80,7 +88,9 @@ void ExplorationPass::visit(const Module &n) {
 
 		validateNoCycles(root, s->loc);
 	}
+}
 
+void ExplorationPass::declareFunctions(const Module &n) {
 	for (auto &d : n.funcs) {
 		dispatch(*d);
 	}
@@ -104,6 +114,8 @@ bool ExplorationPass::validateDeclaredTypes(Type type, const SourceLoc &loc) {
 			return validateDeclaredTypes(static_cast<ArrayType *>(type)->elementType, loc);
 		case TypeKind::Pointer:
 			return validateDeclaredTypes(static_cast<PointerType *>(type)->pointeeType, loc);
+		case TypeKind::Reference:
+			return validateDeclaredTypes(static_cast<ReferenceType *>(type)->referencedType, loc);
 		case TypeKind::Function: {
 			auto *fnType = static_cast<FunctionType *>(type);
 			bool ok = validateDeclaredTypes(fnType->returnType, loc);
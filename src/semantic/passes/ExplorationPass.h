@@ -21,6 +21,13 @@ private:
 public:
 	explicit ExplorationPass(TypeCheckerContext &ctx);
 
+	// The steps of exploring a module. They are public so that declarations spread over
+	// multiple modules (e.g. the top level declarations of a document in the language server)
+	// can be explored together: first all structs, then their fields, then all functions.
+	void declareStructs(const ast::Module &n);
+	void validateStructs(const ast::Module &n);
+	void declareFunctions(const ast::Module &n);
+
 private:
 	void visit(const ast::Module &n) override;
 	void visit(const ast::StructDecl &n) override;
@@ -27,6 +27,10 @@ bool validateDeclaredTypes(Type type, TypeCheckerContext &ctx, const SourceLoc &
 			return validateDeclaredTypes(static_cast<ArrayType *>(type)->elementType, ctx, loc);
 		case TypeKind::Pointer:
 			return validateDeclaredTypes(static_cast<PointerType *>(type)->pointeeType, ctx, loc);
+		case TypeKind::Reference: {
+			const auto referencedType = static_cast<ReferenceType *>(type)->referencedType;
+			return validateDeclaredTypes(referencedType, ctx, loc);
+		}
 		case TypeKind::Function: {
 			auto *fnType = static_cast<FunctionType *>(type);
 			bool ok = validateDeclaredTypes(fnType->returnType, ctx, loc);
@@ -83,6 +87,7 @@ bool TypeCheckingPass::visit(HeapAlloc &n) {
 		actualType = n.type;
 	} else {
 		actualType = checkExpression(*n.expr);
+		checkNoEscape(*n.expr);
 	}
 	const auto expectedType = n.type;
 
@@ -138,6 +143,7 @@ bool TypeCheckingPass::visit(StructInit &n) {
 	for (u32 i = 0; i < n.args.size(); ++i) {
 		auto argType = checkExpression(*n.args[i]);
 		auto fieldType = structType->orderedFields[i].second;
+		checkNoEscape(*n.args[i]);
 
 		if (!argType->isTypeKind(TypeKind::Error) && !typesMatch(argType, fieldType)) {
 			const auto msg =
@@ -225,6 +231,19 @@ bool TypeCheckingPass::visit(Assignment &n) {
 	if (left->isTypeKind(TypeKind::Error) || right->isTypeKind(TypeKind::Error))
 		return false;
 
+	// Neither a borrowed parameter nor the fields it holds by value belong to the callee.
+	const Expr *target = n.left.get();
+	while (target->kind == NodeKind::FieldAccess)
+		target = static_cast<const FieldAccess *>(target)->base.get();
+
+	if (isBorrowedParam(*target)) {
+		const auto &ident = static_cast<const VarRef &>(*target).ident;
+		const auto msg = ErrorMessage<AssignToBorrowedParam>::str(ident);
+		m_Context.submitError(msg, n.loc);
+
+		return false;
+	}
+
 	if (n.left->valueCategory != ValueCategory::LValue) {
 		const auto msg = ErrorMessage<AssignToRValue>::str();
 		m_Context.submitError(msg, n.loc);
@@ -237,6 +256,10 @@ bool TypeCheckingPass::visit(Assignment &n) {
 
 	// Normal assignment '='
 	if (!compoundOp.has_value()) {
+		// Locals hold their own count, but the heap may outlive the caller.
+		if (n.left->kind != NodeKind::VarRef)
+			checkNoEscape(*n.right);
+
 		if (!typesMatch(left, right)) {
 			const auto msg = ErrorMessage<TypeMissmatch>::str(left, right);
 			m_Context.submitError(msg, n.loc);
@@ -296,12 +319,25 @@ bool TypeCheckingPass::visit(FuncCall &n) {
 
 	checkIfArgsCanCallFunction(argTypes, funcType, n.loc);
 
+	// Only borrowed parameters may receive a borrowed parameter of the caller.
+	for (size_t i = 0; i < n.args.size() && i < funcType->paramTypes.size(); ++i) {
+		if (!funcType->paramTypes[i]->isTypeKind(TypeKind::Reference))
+			checkNoEscape(*n.args[i]);
+	}
+
 	n.infer(funcType->returnType, ValueCategory::RValue);
 	return false;
 }
 
 bool TypeCheckingPass::visit(VarRef &n) {
 	if (const auto symbol = m_SymbolTable.getSymbol(n.ident)) {
+		// A borrowed parameter reads like the value it borrows, but cannot be assigned.
+		if (symbol.value()->isTypeKind(TypeKind::Reference)) {
+			const auto referencedType = static_cast<ReferenceType *>(symbol.value())->referencedType;
+			n.infer(referencedType, ValueCategory::RValue);
+			return false;
+		}
+
 		n.infer(symbol.value(), ValueCategory::LValue);
 		return false;
 	}
@@ -455,6 +491,7 @@ bool TypeCheckingPass::visit(ReturnStmt &n) {
 	VERIFY(m_CurrentFunctionReturnType.has_value());
 	const auto currentFuncRetType = m_CurrentFunctionReturnType.value();
 	const auto type = checkExpression(*n.expr);
+	checkNoEscape(*n.expr);
 
 	// If the type is <error-type> or if the return type matches
 	// the function declaration, it's okay and a valid return.
@@ -594,6 +631,10 @@ void TypeCheckingPass::checkIfArgsCanCallFunction(const TypeList &args, const Fu
 		auto &argType = args[i];
 		auto paramType = params[i];
 
+		// A borrowed parameter &T is passed a T.
+		if (paramType->isTypeKind(TypeKind::Reference))
+			paramType = static_cast<ReferenceType *>(paramType)->referencedType;
+
 		if (typesMatch(argType, paramType))
 			continue;
 
@@ -604,6 +645,22 @@ void TypeCheckingPass::checkIfArgsCanCallFunction(const TypeList &args, const Fu
 	}
 }
 
+bool TypeCheckingPass::isBorrowedParam(const Expr &n) const {
+	if (n.kind != NodeKind::VarRef)
+		return false;
+
+	const auto symbol = m_SymbolTable.getSymbol(static_cast<const VarRef &>(n).ident);
+	return symbol && symbol.value()->isTypeKind(TypeKind::Reference);
+}
+
+void TypeCheckingPass::checkNoEscape(const Expr &n) const {
+	if (!isBorrowedParam(n))
+		return;
+
+	const auto msg = ErrorMessage<BorrowedParamEscapes>::str(static_cast<const VarRef &>(n).ident);
+	m_Context.submitError(msg, n.loc);
+}
+
 Opt<BinaryOpKind> TypeCheckingPass::getBinaryOpFromAssignment(const AssignmentKind kind) {
 	using enum AssignmentKind;
 	switch (kind) {
@@ -51,5 +51,11 @@ private:
 	void checkIfArgsCanCallFunction(const TypeList &args, const FunctionType *func,
 									const SourceLoc &callLoc) const;
 	[[nodiscard]] static Opt<BinaryOpKind> getBinaryOpFromAssignment(AssignmentKind kind);
+
+	/// Whether the expression names a borrowed parameter &T.
+	[[nodiscard]] bool isBorrowedParam(const ast::Expr &n) const;
+	/// Reports an error if a borrowed parameter is returned or stored outside of the locals of
+	/// the function, where it could outlive the call.
+	void checkNoEscape(const ast::Expr &n) const;
 };
 }
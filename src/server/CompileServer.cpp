@@ -0,0 +1,474 @@
+#include "CompileServer.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/TargetParser/Host.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "codegen/CodeGen.h"
+#include "core/ErrorHandler.h"
+#include "core/PrintUtil.h"
+#include "lexer/Lexer.h"
+#include "parser/Parser.h"
+#include "semantic/passes/ConstantEvaluationPass.h"
+#include "semantic/passes/EffectAnalysisPass.h"
+#include "semantic/passes/ExplorationPass.h"
+#include "semantic/passes/TypeCheckingPass.h"
+#include "type/TypeFactory.h"
+
+namespace server {
+namespace {
+/// Redirects everything the compiler prints to std::cout and std::cerr into strings, so the
+/// diagnostics of a request can be sent back to the client.
+struct OutputCapture {
+	std::ostringstream out;
+	std::ostringstream err;
+	std::streambuf *const prevOut;
+	std::streambuf *const prevErr;
+
+	OutputCapture()
+		: prevOut(std::cout.rdbuf(out.rdbuf()))
+		, prevErr(std::cerr.rdbuf(err.rdbuf())) {}
+
+	~OutputCapture() {
+		std::cout.rdbuf(prevOut);
+		std::cerr.rdbuf(prevErr);
+	}
+};
+
+/// Runs a program and waits for it, returns its exit code or -1 if it could not be run.
+int runProcess(const Vec<std::string> &args) {
+	Vec<char *> argv;
+	for (const auto &arg : args)
+		argv.push_back(const_cast<char *>(arg.c_str()));
+	argv.push_back(nullptr);
+
+	const pid_t pid = fork();
+
+	if (pid == 0) {
+		execvp(argv[0], argv.data());
+		perror("execvp failed");
+		_exit(127);
+	}
+
+	if (pid < 0) {
+		perror("fork failed");
+		return -1;
+	}
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/// Struct types are interned for the whole process. Forgets the declarations of a module once it
+/// is compiled, so the next file may declare structs with the same names.
+void forgetStructs(const ast::Module &module) {
+	for (const auto &decl : module.structs) {
+		auto *structType = TypeFactory::getStruct(decl->ident);
+		structType->fields.clear();
+		structType->orderedFields.clear();
+		structType->isDeclared = false;
+	}
+}
+
+bool readAll(const int fd, std::string &data) {
+	char buffer[4096];
+
+	while (true) {
+		const auto count = read(fd, buffer, sizeof(buffer));
+
+		if (count == 0)
+			return true;
+
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		data.append(buffer, count);
+	}
+}
+
+bool writeAll(const int fd, const std::string &data) {
+	size_t written = 0;
+
+	while (written < data.size()) {
+		// A client that went away must not take the server down with SIGPIPE.
+		const auto count = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		written += count;
+	}
+
+	return true;
+}
+
+bool makeAddress(const std::string &socketPath, sockaddr_un &addr) {
+	if (socketPath.size() >= sizeof(addr.sun_path)) {
+		util::print("Socket path is too long: '{}'.\n", socketPath);
+		return false;
+	}
+
+	addr = {};
+	addr.sun_family = AF_UNIX;
+	std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+	return true;
+}
+
+/// Connects to the server at socketPath, returns the socket or -1.
+int connectTo(const std::string &socketPath) {
+	sockaddr_un addr;
+	if (!makeAddress(socketPath, addr))
+		return -1;
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/// Sends a request and reads the response, the server answers once the request is complete.
+bool exchange(const std::string &socketPath, const std::string &request, std::string &response) {
+	const int fd = connectTo(socketPath);
+
+	if (fd < 0) {
+		util::print("Could not connect to compile server at '{}'.\n", socketPath);
+		return false;
+	}
+
+	const bool ok = writeAll(fd, request) && shutdown(fd, SHUT_WR) == 0 && readAll(fd, response);
+	close(fd);
+
+	if (!ok)
+		util::print("Lost connection to compile server at '{}'.\n", socketPath);
+
+	return ok;
+}
+
+/// Responses start with the line "<exit-code> <stdout-size> <stderr-size>", followed by the
+/// output the compile printed to stdout and to stderr.
+std::string makeResponse(const int exitCode, const std::string &out, const std::string &err) {
+	return std::format("{} {} {}\n{}{}", exitCode, out.size(), err.size(), out, err);
+}
+
+/// Options follow the filenames of a compile request, one per line, spelled like on the command
+/// line. Returns false for an option the server does not know.
+bool parseOption(const std::string &option, gen::CodeGenOptions &options) {
+	if (option == "-r") {
+		options.reorderFields = true;
+		return true;
+	}
+
+	return false;
+}
+}
+
+CompileServer::CompileServer(Box<llvm::TargetMachine> targetMachine, std::string workDir)
+	: m_TargetMachine(std::move(targetMachine))
+	, m_WorkDir(std::move(workDir)) {}
+
+CompileServer::~CompileServer() {
+	std::filesystem::remove_all(m_WorkDir);
+}
+
+Box<CompileServer> CompileServer::create(const std::string &runtimeSource) {
+	llvm::InitializeNativeTarget();
+	llvm::InitializeNativeTargetAsmPrinter();
+
+	const auto triple = llvm::sys::getDefaultTargetTriple();
+	std::string error;
+	const auto *target = llvm::TargetRegistry::lookupTarget(triple, error);
+
+	if (!target) {
+		util::print("Could not find target '{}': {}\n", triple, error);
+		return nullptr;
+	}
+
+	Box<llvm::TargetMachine> targetMachine(target->createTargetMachine(
+			triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_));
+
+	char workDir[] = "/tmp/ocn-server-XXXXXX";
+	if (!mkdtemp(workDir)) {
+		perror("mkdtemp failed");
+		return nullptr;
+	}
+
+	Box<CompileServer> server(new CompileServer(std::move(targetMachine), workDir));
+
+	if (!server->buildRuntime(runtimeSource))
+		return nullptr;
+
+	return server;
+}
+
+int CompileServer::serve(const std::string &socketPath) {
+	sockaddr_un addr;
+	if (!makeAddress(socketPath, addr))
+		return 1;
+
+	// A socket file nobody listens on is left over from a server that was killed.
+	if (const int fd = connectTo(socketPath); fd >= 0) {
+		close(fd);
+		util::print("A compile server is already listening on '{}'.\n", socketPath);
+		return 1;
+	}
+
+	unlink(socketPath.c_str());
+
+	const auto server = create("ocn_stdlib.c");
+
+	if (!server)
+		return 5;
+
+	const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (listenFd < 0 || bind(listenFd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0 ||
+		listen(listenFd, SOMAXCONN) < 0) {
+		perror("Could not listen on socket");
+		return 5;
+	}
+
+	util::print("Listening on '{}'.\n", socketPath);
+	std::cout.flush();
+
+	bool stop = false;
+
+	while (!stop) {
+		const int clientFd = accept(listenFd, nullptr, nullptr);
+
+		if (clientFd < 0) {
+			if (errno == EINTR)
+				continue;
+
+			perror("accept failed");
+			break;
+		}
+
+		std::string request;
+		if (readAll(clientFd, request))
+			writeAll(clientFd, server->handle(request, stop));
+
+		close(clientFd);
+	}
+
+	close(listenFd);
+	unlink(socketPath.c_str());
+
+	return 0;
+}
+
+bool CompileServer::buildRuntime(const std::string &runtimeSource) {
+	m_RuntimeObject = m_WorkDir + "/ocn_stdlib.o";
+
+	if (runProcess({"clang", "-c", runtimeSource, "-o", m_RuntimeObject}) != 0) {
+		util::print("Could not compile the runtime '{}'.\n", runtimeSource);
+		return false;
+	}
+
+	return true;
+}
+
+std::string CompileServer::handle(const std::string &request, bool &shutdown) {
+	std::istringstream in(request);
+	std::string command, inputFilename, outputFilename;
+	std::getline(in, command);
+
+	if (command == "shutdown") {
+		shutdown = true;
+		return makeResponse(0, "", "");
+	}
+
+	std::getline(in, inputFilename);
+	std::getline(in, outputFilename);
+
+	gen::CodeGenOptions options;
+	bool knownOptions = true;
+
+	for (std::string option; std::getline(in, option);)
+		knownOptions = knownOptions && parseOption(option, options);
+
+	if (command != "compile" || inputFilename.empty() || outputFilename.empty() || !knownOptions)
+		return makeResponse(1, "Malformed request.\n", "");
+
+	std::ifstream file(inputFilename, std::ios::in | std::ios::binary);
+
+	if (!file)
+		return makeResponse(3, std::format("Could not open file: '{}'.\n", inputFilename), "");
+
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	auto source = buffer.str();
+
+	// Unchanged files skip lexing, parsing, type checking and code generation entirely, as long
+	// as they are compiled with the same options.
+	auto it = m_Cache.find(inputFilename);
+	if (it == m_Cache.end() || it->second.source != source || it->second.options != options) {
+		CachedUnit unit;
+		unit.source = std::move(source);
+		unit.options = options;
+		compileUnit(inputFilename, unit);
+
+		it = m_Cache.insert_or_assign(inputFilename, std::move(unit)).first;
+	}
+
+	const auto &unit = it->second;
+	const auto exitCode = unit.exitCode == 0 ? link(unit, outputFilename) : unit.exitCode;
+
+	return makeResponse(exitCode, unit.out, unit.err);
+}
+
+void CompileServer::compileUnit(const std::string &filename, CachedUnit &unit) {
+	OutputCapture capture;
+	++m_CompileCount;
+
+	unit.exitCode = [&] {
+		const U8String source(unit.source);
+		ErrorHandler err(filename, source);
+
+		const auto tokens = lex::Lexer::tokenize(source, err);
+
+		if (err.hasError()) {
+			err.printErrors();
+			return 1;
+		}
+
+		auto module = prs::Parser::parse(tokens, err, filename);
+
+		if (err.hasError()) {
+			err.printErrors();
+			return 2;
+		}
+
+		sem::TypeCheckerContext ctx(err);
+
+		sem::ExplorationPass pass1(ctx);
+		pass1.dispatch(*module);
+
+		sem::TypeCheckingPass pass2(ctx);
+		pass2.dispatch(*module);
+
+		err.printErrors();
+
+		auto exitCode = err.hasError() ? 3 : 0;
+
+		if (exitCode == 0) {
+			// Everything reported so far was printed, the code generation only adds warnings.
+			err.clear();
+
+			sem::ConstantEvaluationPass pass3;
+			pass3.dispatch(*module);
+			sem::EffectAnalysisPass pass4;
+			pass4.dispatch(*module);
+		}
+
+		if (exitCode == 0 && !emitObject(*module, err, unit.options, unit.object))
+			exitCode = 4;
+
+		forgetStructs(*module);
+		return exitCode;
+	}();
+
+	unit.out = capture.out.str();
+	unit.err = capture.err.str();
+}
+
+bool CompileServer::emitObject(const ast::Module &module, ErrorHandler &err,
+							   const gen::CodeGenOptions &options,
+							   llvm::SmallVector<char, 0> &object) {
+	const auto ctx = gen::CodeGen::lower(module, {}, &err, options);
+	err.printErrors();
+
+	auto &llvmModule = ctx->llvmModule;
+
+	llvmModule.setTargetTriple(m_TargetMachine->getTargetTriple().str());
+	llvmModule.setDataLayout(m_TargetMachine->createDataLayout());
+
+	llvm::raw_svector_ostream os(object);
+	llvm::legacy::PassManager passes;
+
+	if (m_TargetMachine->addPassesToEmitFile(passes, os, nullptr,
+											 llvm::CodeGenFileType::ObjectFile)) {
+		util::print("The target machine cannot emit object files.\n");
+		return false;
+	}
+
+	passes.run(llvmModule);
+	return true;
+}
+
+int CompileServer::link(const CachedUnit &unit, const std::string &outputFilename) {
+	const auto objectFilename = m_WorkDir + "/unit.o";
+
+	std::ofstream objectFile(objectFilename, std::ios::out | std::ios::binary);
+	objectFile.write(unit.object.data(), static_cast<std::streamsize>(unit.object.size()));
+	objectFile.close();
+
+	// Only the link step still runs clang, the runtime was compiled when the server started.
+	return runProcess({"clang", objectFilename, "-o", outputFilename, m_RuntimeObject}) == 0 ? 0
+																							: 5;
+}
+
+int CompileServer::submit(const std::string &socketPath, const std::string &inputFilename,
+						  const std::string &outputFilename, const gen::CodeGenOptions &options) {
+	// The server has its own working directory, so paths are sent as absolute paths.
+	auto request = std::format("compile\n{}\n{}\n",
+							   std::filesystem::absolute(inputFilename).string(),
+							   std::filesystem::absolute(outputFilename).string());
+
+	if (options.reorderFields)
+		request += "-r\n";
+
+	std::string response;
+	if (!exchange(socketPath, request, response))
+		return 5;
+
+	std::istringstream header(response.substr(0, response.find('\n')));
+	int exitCode = 0;
+	size_t outSize = 0, errSize = 0;
+
+	if (!(header >> exitCode >> outSize >> errSize)) {
+		util::print("Malformed response from compile server.\n");
+		return 5;
+	}
+
+	const auto bodyStart = response.find('\n') + 1;
+	std::cout << response.substr(bodyStart, outSize);
+	std::cerr << response.substr(bodyStart + outSize, errSize);
+
+	return exitCode;
+}
+
+int CompileServer::shutdown(const std::string &socketPath) {
+	std::string response;
+	return exchange(socketPath, "shutdown\n", response) ? 0 : 5;
+}
+}
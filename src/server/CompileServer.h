@@ -0,0 +1,70 @@
+#pragma once
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <string>
+
+#include "ast/AST.h"
+#include "codegen/CodeGen.h"
+
+namespace server {
+///
+/// Long running compiler process that listens on a Unix socket and keeps the expensive state
+/// warm between compiles: the LLVM target machine, the runtime prebuilt to an object file and
+/// the objects of files that were already checked and lowered. Requests are sent by a thin
+/// client (app --client) and handled one after another.
+///
+struct CompileServer {
+private:
+	/// Result of checking and lowering one source file, reused while the file does not change.
+	struct CachedUnit {
+		std::string source;
+		gen::CodeGenOptions options;
+		int exitCode = 0;
+		std::string out;
+		std::string err;
+		llvm::SmallVector<char, 0> object;
+	};
+
+	Box<llvm::TargetMachine> m_TargetMachine;
+	std::string m_WorkDir;
+	std::string m_RuntimeObject;
+	Map<std::string, CachedUnit> m_Cache;
+	u32 m_CompileCount = 0;
+
+	CompileServer(Box<llvm::TargetMachine> targetMachine, std::string workDir);
+
+	bool buildRuntime(const std::string &runtimeSource);
+	void compileUnit(const std::string &filename, CachedUnit &unit);
+	bool emitObject(const ast::Module &module, ErrorHandler &err, const gen::CodeGenOptions &options,
+					llvm::SmallVector<char, 0> &object);
+	int link(const CachedUnit &unit, const std::string &outputFilename);
+
+public:
+	CompileServer(const CompileServer &) = delete;
+	CompileServer &operator=(const CompileServer &) = delete;
+	~CompileServer();
+
+	/// Creates the target machine and a working directory and compiles the runtime into it.
+	/// Returns nullptr after printing the reason if any of it fails.
+	static Box<CompileServer> create(const std::string &runtimeSource);
+
+	/// Answers one request of a client. Sets shutdown if the client asks the server to stop.
+	std::string handle(const std::string &request, bool &shutdown);
+
+	/// Number of files that were checked and lowered, unchanged files are served from the cache.
+	u32 compileCount() const {
+		return m_CompileCount;
+	}
+
+	/// Serves compile requests on socketPath until a client asks the server to shut down.
+	static int serve(const std::string &socketPath);
+
+	/// Asks the server at socketPath to compile inputFilename into the executable outputFilename,
+	/// forwards the diagnostics and returns the exit code the compile would have had.
+	static int submit(const std::string &socketPath, const std::string &inputFilename,
+					  const std::string &outputFilename, const gen::CodeGenOptions &options);
+
+	static int shutdown(const std::string &socketPath);
+};
+}
@@ -168,4 +168,44 @@ bool ArrayType::equals(const TypeBase *other) const {
 
 Box<TypeBase> ArrayType::clone() const {
 	return std::make_unique<ArrayType>(elementType);
+}
+
+ReferenceType::ReferenceType(Type referencedType)
+	: TypeBase(TypeKind::Reference)
+	, referencedType(referencedType) {}
+
+U8String ReferenceType::str() const {
+	return std::format("&{}", referencedType);
+}
+
+bool ReferenceType::equals(const TypeBase *other) const {
+	if (!other || other->kind != TypeKind::Reference) {
+		return false;
+	}
+
+	auto *otherReference = static_cast<const ReferenceType *>(other);
+	return referencedType == otherReference->referencedType;
+}
+
+Box<TypeBase> ReferenceType::clone() const {
+	return std::make_unique<ReferenceType>(referencedType);
+}
+
+bool isRefCounted(Type type) {
+	if (type->isTypeKind(TypeKind::Pointer) || type->isTypeKind(TypeKind::Array)) {
+		return true;
+	}
+
+	if (!type->isTypeKind(TypeKind::Struct)) {
+		return false;
+	}
+
+	const auto *structType = static_cast<StructType *>(type);
+	for (const auto &[_, fieldType] : structType->orderedFields) {
+		if (isRefCounted(fieldType)) {
+			return true;
+		}
+	}
+
+	return false;
 }
\ No newline at end of file
@@ -6,7 +6,17 @@
 #include "core/Typedef.h"
 #include "core/U8String.h"
 
-enum struct TypeKind : u8 { Primitive, Unit, Error, Null, Pointer, Function, Struct, Array };
+enum struct TypeKind : u8 {
+	Primitive,
+	Unit,
+	Error,
+	Null,
+	Pointer,
+	Function,
+	Struct,
+	Array,
+	Reference
+};
 
 enum struct PrimitiveKind : u8 { I32, Char, Bool };
 
@@ -110,6 +120,21 @@ struct ArrayType : public TypeBase {
 	Box<TypeBase> clone() const override;
 };
 
+/// A borrowed parameter &T. It accepts a T from the caller, who keeps ownership, so the callee
+/// neither copies nor drops it and must not let it escape.
+struct ReferenceType : public TypeBase {
+	const Type referencedType;
+
+	explicit ReferenceType(Type referencedType);
+
+	U8String str() const override;
+	bool equals(const TypeBase *other) const override;
+	Box<TypeBase> clone() const override;
+};
+
+/// Whether copying or dropping a value of the type touches a reference count.
+bool isRefCounted(Type type);
+
 template <typename T>
 	requires std::derived_from<T, TypeBase>
 struct std::formatter<T> {
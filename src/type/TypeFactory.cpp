@@ -74,6 +74,11 @@ ArrayType *TypeFactory::getArray(Type elementType) {
 	return static_cast<ArrayType *>(type);
 }
 
+ReferenceType *TypeFactory::getReference(Type referencedType) {
+	auto type = intern(ReferenceType(referencedType));
+	return static_cast<ReferenceType *>(type);
+}
+
 Vec<Type> TypeFactory::allTypes() {
 	Vec<Type> result;
 
@@ -21,6 +21,7 @@ public:
 	static FunctionType *getFunction(TypeList paramTypes, Type returnType);
 	static StructType *getStruct(U8String name);
 	static ArrayType *getArray(Type elementType);
+	static ReferenceType *getReference(Type referencedType);
 
 	static void reset();
 	static Vec<Type> allTypes();
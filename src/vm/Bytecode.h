@@ -0,0 +1,118 @@
+#pragma once
+#include "core/Macros.h"
+#include "core/Typedef.h"
+#include "core/U8String.h"
+
+namespace vm {
+/// Index of a register in the frame of the executing function. Every register holds one 64-bit
+/// slot: i32, char and bool values are stored sign extended, pointers and arrays as the runtime
+/// payload pointer, structs as a pointer to a uniquely owned StructBox and functions as a
+/// pointer to their vm::Function.
+using Reg = u32;
+
+// X-macro list of all opcodes, the interpreter builds its dispatch table from the same list so
+// both always stay in the same order. Operands are named after the fields of Instr.
+#define OCN_VM_OPCODES(X)                                                                          \
+	X(LoadInt)		/* a = sign extended immediate b */                                            \
+	X(LoadFunc)		/* a = address of function b */                                                \
+	X(Move)			/* a = b */                                                                    \
+	X(Add)			/* a = b + c, all arithmetic wraps around at 32 bit */                         \
+	X(Sub)			/* a = b - c */                                                                \
+	X(Mul)			/* a = b * c */                                                                \
+	X(Div)			/* a = b / c */                                                                \
+	X(Mod)			/* a = b % c */                                                                \
+	X(And)			/* a = b & c */                                                                \
+	X(Or)			/* a = b | c */                                                                \
+	X(Xor)			/* a = b ^ c */                                                                \
+	X(Shl)			/* a = b << c */                                                               \
+	X(Shr)			/* a = b >> c (arithmetic) */                                                  \
+	X(Eq)			/* a = b == c, compares the whole slot */                                      \
+	X(Ne)			/* a = b != c */                                                               \
+	X(Lt)			/* a = b < c */                                                                \
+	X(Le)			/* a = b <= c */                                                               \
+	X(Gt)			/* a = b > c */                                                                \
+	X(Ge)			/* a = b >= c */                                                               \
+	X(Neg)			/* a = -b */                                                                   \
+	X(Not)			/* a = ~b */                                                                   \
+	X(LogicalNot)	/* a = !b */                                                                   \
+	X(Jump)			/* continue at instruction a */                                                \
+	X(JumpIfFalse)	/* continue at instruction b if a is false */                                  \
+	X(CallDirect)	/* a = function b called with the arguments in c, c + 1, ... */                \
+	X(Call)			/* a = function in register b called with the arguments in c, c + 1, ... */    \
+	X(Ret)			/* return a to the caller */                                                   \
+	X(CheckNull)	/* panic if the pointer a is null */                                           \
+	X(Load)			/* a = *b */                                                                   \
+	X(Store)		/* *a = b */                                                                   \
+	X(GetField)		/* a = field c of the struct b */                                              \
+	X(FieldAddr)	/* a = address of field c of the struct b */                                   \
+	X(IndexLoad)	/* a = element c of the array b, panics if out of bounds */                    \
+	X(IndexAddr)	/* a = address of element c of the array b, panics if out of bounds */         \
+	X(Len)			/* a = length of the array b */                                                \
+	X(NewPtr)		/* a = shared pointer holding b, pointee described by type c */                \
+	X(NewArray)		/* a = array of b default values, elements described by type c */             \
+	X(NewStruct)	/* a = struct of type c taking the fields from b, b + 1, ... */                \
+	X(NewDefault)	/* a = default value of the struct type c */                                   \
+	X(RcRetain)		/* increments the reference count of the shared pointer a */                   \
+	X(RcRelease)	/* decrements the reference count of the shared pointer a */                   \
+	X(ArrRetain)	/* increments the reference count of the array a */                            \
+	X(ArrRelease)	/* decrements the reference count of the array a */                            \
+	X(StructCopy)	/* a = deep copy of the struct b */                                            \
+	X(StructDrop)	/* drops all fields of the struct a and frees it */
+
+enum struct Opcode : u8 {
+#define OCN_VM_ENUM(name) name,
+	OCN_VM_OPCODES(OCN_VM_ENUM)
+#undef OCN_VM_ENUM
+};
+
+struct Instr {
+	Opcode op;
+	u32 a = 0;
+	u32 b = 0;
+	u32 c = 0;
+};
+
+/// How a value is copied and dropped, mirrors the cases of CodeGenContext::copyValue and
+/// CodeGenContext::dropValue.
+enum struct ValueKind : u8 { Trivial, Pointer, Array, Struct };
+
+struct TypeDesc {
+	ValueKind kind = ValueKind::Trivial;
+
+	/// Pointee of a pointer or element of an array.
+	const TypeDesc *inner = nullptr;
+
+	/// Field types of a struct, in declaration order.
+	Vec<const TypeDesc *> fields;
+};
+
+/// Header of the heap cell of a struct value, followed by one slot per field.
+struct StructBox {
+	const TypeDesc *desc;
+
+	u64 *slots() {
+		return reinterpret_cast<u64 *>(this + 1);
+	}
+
+	const u64 *slots() const {
+		return reinterpret_cast<const u64 *>(this + 1);
+	}
+};
+
+/// Builtin implemented by the host, receives the argument registers and returns the result.
+using NativeFn = u64 (*)(const u64 *args);
+
+struct Function {
+	U8String name;
+	u32 paramCount = 0;
+	u32 frameSize = 0;
+	Vec<Instr> code;
+	NativeFn native = nullptr;
+};
+
+struct Program {
+	Vec<Box<Function>> functions;
+	Vec<Box<TypeDesc>> types;
+	u32 entry = 0;
+};
+}
@@ -0,0 +1,206 @@
+#include "BytecodeCompiler.h"
+
+#include "Runtime.h"
+#include "core/DefaultDecls.h"
+
+namespace vm {
+BytecodeCompiler::BytecodeCompiler(CompilerContext &ctx)
+	: m_Context(ctx)
+	, m_LocalManager(ctx) {}
+
+Box<Program> BytecodeCompiler::compile(const ast::Module &module) {
+	CompilerContext ctx;
+	BytecodeCompiler compiler(ctx);
+
+	compiler.visitNode(module);
+
+	return ctx.releaseProgram();
+}
+
+void BytecodeCompiler::visitNode(const ast::Node &n) {
+	if (dynamic_cast<const ast::Expr *>(&n)) {
+		const auto mark = m_Context.beginStatement();
+
+		ExprCompiler exprCompiler(m_Context, m_LocalManager);
+		const auto result = exprCompiler.compileExpr(static_cast<const ast::Expr &>(n));
+		m_Context.discardConstant(result.reg);
+		exprCompiler.emitExprCleanup();
+
+		m_Context.endStatement(mark);
+		return;
+	}
+
+	dispatch(n);
+}
+
+void BytecodeCompiler::visit(const ast::Module &n) {
+	// Builtins are implemented by the host
+	for (const auto &[name, type] : s_DefaultDecls) {
+		const auto native = findNative(name);
+		VERIFY(native);
+
+		m_Context.declareFunction(name, static_cast<u32>(type->paramTypes.size()), native);
+	}
+
+	// Declare all functions first, so calls can refer to functions defined later
+	for (const auto &decl : n.funcs) {
+		m_Context.declareFunction(decl->ident, static_cast<u32>(decl->params.size()));
+	}
+
+	for (const auto &decl : n.funcs) {
+		visitNode(*decl);
+	}
+
+	const auto entry = m_Context.getFunctionIndex(u8"main");
+	VERIFY(entry.has_value());
+	m_Context.setEntry(entry.value());
+}
+
+void BytecodeCompiler::visit(const ast::FuncDecl &n) {
+	m_CurrentFunctionReturnType = n.returnType;
+	m_IsTerminated = false;
+
+	const auto index = m_Context.getFunctionIndex(n.ident);
+	VERIFY(index.has_value());
+
+	m_Context.beginFunction(index.value());
+	m_LocalManager.clearLocals();
+	m_LocalManager.openScope();
+
+	// The arguments arrive in the first registers
+	for (u32 i = 0; i < n.params.size(); ++i) {
+		const auto &[name, type] = n.params[i];
+		m_LocalManager.addLocal(i, type, name);
+	}
+
+	visitNode(*n.body);
+
+	if (!m_IsTerminated) {
+		m_LocalManager.emitFullScopeCleanup();
+
+		ExprCompiler exprCompiler(m_Context, m_LocalManager);
+		const auto result = exprCompiler.compileDefault(n.returnType);
+		m_Context.emit(Opcode::Ret, result.reg);
+	}
+
+	m_LocalManager.closeScope();
+	m_CurrentFunctionReturnType = std::nullopt;
+}
+
+void BytecodeCompiler::visit(const ast::BlockStmt &n) {
+	const auto mark = m_Context.beginStatement();
+	m_LocalManager.openScope();
+
+	for (auto &stmt : n.stmts) {
+		if (m_IsTerminated) {
+			break;
+		}
+
+		visitNode(*stmt);
+	}
+
+	if (!m_IsTerminated) {
+		m_LocalManager.emitCurrentScopeCleanup();
+	}
+
+	m_LocalManager.closeScope();
+	m_Context.endStatement(mark);
+}
+
+void BytecodeCompiler::visit(const ast::IfStmt &n) {
+	const auto mark = m_Context.beginStatement();
+
+	ExprCompiler exprCompiler(m_Context, m_LocalManager);
+	const auto cond = exprCompiler.compileExpr(*n.cond);
+	exprCompiler.emitExprCleanup();
+
+	const auto toElse = m_Context.emit(Opcode::JumpIfFalse, cond.reg);
+	m_Context.endStatement(mark);
+
+	visitNode(*n.then);
+
+	Opt<u32> toMerge;
+	if (!m_IsTerminated) {
+		toMerge = m_Context.emit(Opcode::Jump);
+	}
+
+	m_IsTerminated = false;
+	m_Context.patchJump(toElse, m_Context.label());
+
+	visitNode(*n.else_);
+
+	// Like the merge block of the LLVM backend, code after the if is always emitted.
+	m_IsTerminated = false;
+	if (toMerge.has_value()) {
+		m_Context.patchJump(toMerge.value(), m_Context.label());
+	} else {
+		m_Context.label();
+	}
+}
+
+void BytecodeCompiler::visit(const ast::WhileStmt &n) {
+	const auto condLabel = m_Context.label();
+	const auto mark = m_Context.beginStatement();
+
+	// Re-evaluate condition before every iteration
+	ExprCompiler exprCompiler(m_Context, m_LocalManager);
+	const auto cond = exprCompiler.compileExpr(*n.cond);
+	exprCompiler.emitExprCleanup();
+
+	const auto toAfter = m_Context.emit(Opcode::JumpIfFalse, cond.reg);
+	m_Context.endStatement(mark);
+
+	visitNode(*n.body);
+
+	if (!m_IsTerminated) {
+		m_Context.emit(Opcode::Jump, condLabel);
+	}
+
+	m_IsTerminated = false;
+	m_Context.patchJump(toAfter, m_Context.label());
+}
+
+void BytecodeCompiler::visit(const ast::ReturnStmt &n) {
+	const auto mark = m_Context.beginStatement();
+
+	ExprCompiler exprCompiler(m_Context, m_LocalManager);
+	const auto [value, type, isTemp] = exprCompiler.compileExpr(*n.expr);
+
+	auto owned = value;
+	if (isTemp) {
+		exprCompiler.removeFromExprCleanup(value);
+	} else {
+		owned = m_Context.copyValue(value, m_CurrentFunctionReturnType.value());
+	}
+
+	m_LocalManager.emitFullScopeCleanup();
+	m_Context.emit(Opcode::Ret, owned);
+
+	m_Context.endStatement(mark);
+	m_IsTerminated = true;
+}
+
+void BytecodeCompiler::visit(const ast::VarDef &n) {
+	// The local gets its register up front, but is only visible after its initializer.
+	const auto local = m_Context.allocReg();
+	const auto mark = m_Context.beginStatement();
+
+	ExprCompiler exprCompiler(m_Context, m_LocalManager);
+	const auto [value, valueType, isTemp] = n.value->kind == ast::NodeKind::DefaultInit
+													? exprCompiler.compileDefault(n.type)
+													: exprCompiler.compileExpr(*n.value);
+
+	auto owned = value;
+	if (isTemp) {
+		exprCompiler.removeFromExprCleanup(value);
+	} else {
+		owned = m_Context.copyValue(value, valueType);
+	}
+
+	m_Context.emitMove(local, owned);
+	exprCompiler.emitExprCleanup();
+
+	m_LocalManager.addLocal(local, n.type, n.ident);
+	m_Context.endStatement(mark);
+}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "ExprCompiler.h"
+
+namespace vm {
+/// Compiles a type checked module into a Program for the Interpreter. The structure follows
+/// gen::CodeGen statement by statement, so both backends agree on when values are copied and
+/// dropped.
+struct BytecodeCompiler : ast::ConstVisitor<void> {
+private:
+	CompilerContext &m_Context;
+	LocalManager m_LocalManager;
+	Opt<Type> m_CurrentFunctionReturnType;
+	bool m_IsTerminated = false;
+
+public:
+	explicit BytecodeCompiler(CompilerContext &ctx);
+
+	static Box<Program> compile(const ast::Module &module);
+	void visitNode(const ast::Node &n);
+
+	void visit(const ast::Module &n) override;
+	void visit(const ast::FuncDecl &n) override;
+	void visit(const ast::BlockStmt &n) override;
+	void visit(const ast::IfStmt &n) override;
+	void visit(const ast::WhileStmt &n) override;
+	void visit(const ast::ReturnStmt &n) override;
+	void visit(const ast::VarDef &n) override;
+};
+}
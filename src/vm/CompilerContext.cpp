@@ -0,0 +1,216 @@
+#include "CompilerContext.h"
+
+#include <algorithm>
+
+namespace vm {
+namespace {
+/// Whether the instruction writes its result into register a.
+bool writesRegA(const Opcode op) {
+	switch (op) {
+		case Opcode::Jump:
+		case Opcode::JumpIfFalse:
+		case Opcode::Ret:
+		case Opcode::CheckNull:
+		case Opcode::Store:
+		case Opcode::RcRetain:
+		case Opcode::RcRelease:
+		case Opcode::ArrRetain:
+		case Opcode::ArrRelease:
+		case Opcode::StructDrop: return false;
+		default:				 return true;
+	}
+}
+}
+
+ValueKind getValueKind(Type type) {
+	switch (type->kind) {
+		case TypeKind::Pointer: return ValueKind::Pointer;
+		case TypeKind::Array:	return ValueKind::Array;
+		case TypeKind::Struct:	return ValueKind::Struct;
+		default:				return ValueKind::Trivial;
+	}
+}
+
+CompilerContext::CompilerContext()
+	: m_Program(std::make_unique<Program>()) {}
+
+Box<Program> CompilerContext::releaseProgram() {
+	VERIFY(m_Program);
+	return std::move(m_Program);
+}
+
+u32 CompilerContext::declareFunction(const U8String &name, const u32 paramCount,
+									 const NativeFn native) {
+	auto function = std::make_unique<Function>();
+	function->name = name;
+	function->paramCount = paramCount;
+	function->native = native;
+
+	const auto index = static_cast<u32>(m_Program->functions.size());
+	m_Program->functions.push_back(std::move(function));
+	m_FunctionIndices[name] = index;
+
+	return index;
+}
+
+Opt<u32> CompilerContext::getFunctionIndex(const U8String &name) const {
+	if (const auto it = m_FunctionIndices.find(name); it != m_FunctionIndices.end()) {
+		return it->second;
+	}
+
+	return {};
+}
+
+void CompilerContext::beginFunction(const u32 index) {
+	m_Function = m_Program->functions[index].get();
+
+	// The arguments are passed in the first registers of the frame.
+	m_NextReg = m_Function->paramCount;
+	m_TempBase = m_NextReg;
+	m_LastLabel = 0;
+	m_Function->frameSize = m_NextReg;
+}
+
+void CompilerContext::setEntry(const u32 index) {
+	m_Program->entry = index;
+}
+
+u32 CompilerContext::getTypeIndex(Type type) {
+	if (const auto it = m_TypeIndices.find(type); it != m_TypeIndices.end()) {
+		return it->second;
+	}
+
+	auto desc = std::make_unique<TypeDesc>();
+	auto *result = desc.get();
+	result->kind = getValueKind(type);
+
+	// Register the descriptor before resolving the nested types, structs may point to themselves.
+	const auto index = static_cast<u32>(m_Program->types.size());
+	m_TypeIndices.emplace(type, index);
+	m_Program->types.push_back(std::move(desc));
+
+	const auto getTypeDesc = [this](Type nested) {
+		return m_Program->types[getTypeIndex(nested)].get();
+	};
+
+	switch (type->kind) {
+		case TypeKind::Pointer:
+			result->inner = getTypeDesc(static_cast<PointerType *>(type)->pointeeType);
+			break;
+
+		case TypeKind::Array:
+			result->inner = getTypeDesc(static_cast<ArrayType *>(type)->elementType);
+			break;
+
+		case TypeKind::Struct:
+			for (const auto &[_, fieldType] : static_cast<StructType *>(type)->orderedFields) {
+				result->fields.push_back(getTypeDesc(fieldType));
+			}
+			break;
+
+		default: break;
+	}
+
+	return index;
+}
+
+Reg CompilerContext::allocReg() {
+	return allocRegs(1);
+}
+
+Reg CompilerContext::allocRegs(const u32 count) {
+	const auto first = m_NextReg;
+	m_NextReg += count;
+	m_Function->frameSize = std::max(m_Function->frameSize, m_NextReg);
+
+	return first;
+}
+
+Reg CompilerContext::beginStatement() {
+	m_TempBase = m_NextReg;
+	return m_NextReg;
+}
+
+void CompilerContext::endStatement(const Reg mark) {
+	m_NextReg = mark;
+}
+
+u32 CompilerContext::emit(const Opcode op, const u32 a, const u32 b, const u32 c) {
+	const auto index = static_cast<u32>(m_Function->code.size());
+	m_Function->code.push_back({.op = op, .a = a, .b = b, .c = c});
+
+	return index;
+}
+
+u32 CompilerContext::label() {
+	m_LastLabel = static_cast<u32>(m_Function->code.size());
+	return m_LastLabel;
+}
+
+void CompilerContext::patchJump(const u32 jump, const u32 target) {
+	auto &instr = m_Function->code[jump];
+
+	if (instr.op == Opcode::Jump) {
+		instr.a = target;
+	} else {
+		VERIFY(instr.op == Opcode::JumpIfFalse);
+		instr.b = target;
+	}
+}
+
+void CompilerContext::emitMove(const Reg dst, const Reg src) {
+	if (dst == src) {
+		return;
+	}
+
+	// Locals live below the temporaries of the current statement and must not be retargeted.
+	// The instruction must also not be the target of a jump, that path would skip it.
+	auto &code = m_Function->code;
+	if (src >= m_TempBase && code.size() > m_LastLabel) {
+		auto &last = code.back();
+
+		if (writesRegA(last.op) && last.a == src) {
+			last.a = dst;
+			return;
+		}
+	}
+
+	emit(Opcode::Move, dst, src);
+}
+
+void CompilerContext::discardConstant(const Reg reg) {
+	auto &code = m_Function->code;
+	if (code.size() > m_LastLabel && code.back().op == Opcode::LoadInt && code.back().a == reg) {
+		code.pop_back();
+	}
+}
+
+Reg CompilerContext::copyValue(const Reg value, Type type) {
+	switch (getValueKind(type)) {
+		case ValueKind::Trivial: return value;
+
+		case ValueKind::Pointer: emit(Opcode::RcRetain, value); return value;
+
+		case ValueKind::Array: emit(Opcode::ArrRetain, value); return value;
+
+		case ValueKind::Struct: {
+			// Structs are values, copying them copies every field into a new box.
+			const auto copy = allocReg();
+			emit(Opcode::StructCopy, copy, value);
+			return copy;
+		}
+
+		default: UNREACHABLE();
+	}
+}
+
+void CompilerContext::dropValue(const Reg value, Type type) {
+	switch (getValueKind(type)) {
+		case ValueKind::Trivial: break;
+		case ValueKind::Pointer: emit(Opcode::RcRelease, value); break;
+		case ValueKind::Array:	 emit(Opcode::ArrRelease, value); break;
+		case ValueKind::Struct:	 emit(Opcode::StructDrop, value); break;
+		default:				 UNREACHABLE();
+	}
+}
+}
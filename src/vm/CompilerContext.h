@@ -0,0 +1,66 @@
+#pragma once
+#include "Bytecode.h"
+#include "type/Type.h"
+
+namespace vm {
+struct TrackedValue {
+	Reg reg;
+	Type type;
+};
+
+/// Shared state of the bytecode compiler: the program under construction and the function whose
+/// code is currently emitted. Plays the role of gen::CodeGenContext for the VM backend.
+struct CompilerContext {
+private:
+	Box<Program> m_Program;
+	Map<Type, u32> m_TypeIndices;
+	Map<U8String, u32> m_FunctionIndices;
+
+	Function *m_Function = nullptr;
+	Reg m_NextReg = 0;
+	Reg m_TempBase = 0;
+	u32 m_LastLabel = 0;
+
+public:
+	CompilerContext();
+
+	/// Hands over the compiled program, the context must not be used afterwards.
+	[[nodiscard]] Box<Program> releaseProgram();
+
+	u32 declareFunction(const U8String &name, u32 paramCount, NativeFn native = nullptr);
+	[[nodiscard]] Opt<u32> getFunctionIndex(const U8String &name) const;
+	void beginFunction(u32 index);
+	void setEntry(u32 index);
+
+	/// Returns the index of the descriptor of a type in Program::types, creating it on first use.
+	[[nodiscard]] u32 getTypeIndex(Type type);
+
+	Reg allocReg();
+	Reg allocRegs(u32 count);
+
+	/// Starts a statement, registers allocated from now on hold temporaries. Returns the mark
+	/// that endStatement uses to free them again.
+	Reg beginStatement();
+	void endStatement(Reg mark);
+
+	u32 emit(Opcode op, u32 a = 0, u32 b = 0, u32 c = 0);
+
+	/// Returns the position of the next instruction, which may be the target of a jump.
+	u32 label();
+	void patchJump(u32 jump, u32 target);
+
+	/// Emits 'dst = src'. If src is a temporary that was just computed, the instruction that
+	/// computed it writes to dst directly instead.
+	void emitMove(Reg dst, Reg src);
+
+	/// Removes the last instruction if it only loads a constant into reg. Used for the results of
+	/// expression statements, e.g. assignments, which are never read.
+	void discardConstant(Reg reg);
+
+	/// Returns a register holding an owned copy of the value, mirrors gen::CodeGenContext.
+	Reg copyValue(Reg value, Type type);
+	void dropValue(Reg value, Type type);
+};
+
+ValueKind getValueKind(Type type);
+}
@@ -0,0 +1,583 @@
+#include "ExprCompiler.h"
+
+#include <algorithm>
+
+#include "type/TypeFactory.h"
+
+namespace vm {
+namespace {
+/// Whether evaluating the expression may assign to a local variable, e.g. 'f(x = 1)'.
+bool containsAssignment(const ast::Expr &n) {
+	const auto any = [](const Vec<Box<ast::Expr>> &exprs) {
+		return std::ranges::any_of(exprs, [](const auto &e) { return containsAssignment(*e); });
+	};
+
+	switch (n.kind) {
+		case ast::NodeKind::Assignment: return true;
+
+		case ast::NodeKind::HeapAlloc:
+			return containsAssignment(*static_cast<const ast::HeapAlloc &>(n).expr);
+
+		case ast::NodeKind::ArrayHeapAlloc:
+			return containsAssignment(*static_cast<const ast::ArrayHeapAlloc &>(n).size);
+
+		case ast::NodeKind::StructInit: return any(static_cast<const ast::StructInit &>(n).args);
+
+		case ast::NodeKind::UnaryExpr:
+			return containsAssignment(*static_cast<const ast::UnaryExpr &>(n).operand);
+
+		case ast::NodeKind::BinaryExpr: {
+			const auto &binaryExpr = static_cast<const ast::BinaryExpr &>(n);
+			return containsAssignment(*binaryExpr.left) || containsAssignment(*binaryExpr.right);
+		}
+
+		case ast::NodeKind::FieldAccess:
+			return containsAssignment(*static_cast<const ast::FieldAccess &>(n).base);
+
+		case ast::NodeKind::IndexExpr: {
+			const auto &indexExpr = static_cast<const ast::IndexExpr &>(n);
+			return containsAssignment(*indexExpr.base) || containsAssignment(*indexExpr.index);
+		}
+
+		case ast::NodeKind::LenExpr:
+			return containsAssignment(*static_cast<const ast::LenExpr &>(n).base);
+
+		case ast::NodeKind::FuncCall: {
+			const auto &funcCall = static_cast<const ast::FuncCall &>(n);
+			return containsAssignment(*funcCall.expr) || any(funcCall.args);
+		}
+
+		default: return false;
+	}
+}
+
+Opcode getBinaryOpcode(const BinaryOpKind op) {
+	using enum BinaryOpKind;
+	switch (op) {
+		case Addition:			 return Opcode::Add;
+		case Subtraction:		 return Opcode::Sub;
+		case Multiplication:	 return Opcode::Mul;
+		case Division:			 return Opcode::Div;
+		case Modulo:			 return Opcode::Mod;
+		case Equality:			 return Opcode::Eq;
+		case Inequality:		 return Opcode::Ne;
+		case LessThan:			 return Opcode::Lt;
+		case LessThanOrEqual:	 return Opcode::Le;
+		case GreaterThan:		 return Opcode::Gt;
+		case GreaterThanOrEqual: return Opcode::Ge;
+		case BitwiseAnd:		 return Opcode::And;
+		case BitwiseOr:			 return Opcode::Or;
+		case BitwiseXor:		 return Opcode::Xor;
+		case LeftShift:			 return Opcode::Shl;
+		case RightShift:		 return Opcode::Shr;
+		default:				 UNREACHABLE();
+	}
+}
+
+Opcode getAssignmentOpcode(const AssignmentKind kind) {
+	using enum AssignmentKind;
+	switch (kind) {
+		case Addition:		 return Opcode::Add;
+		case Subtraction:	 return Opcode::Sub;
+		case Multiplication: return Opcode::Mul;
+		case Division:		 return Opcode::Div;
+		case Modulo:		 return Opcode::Mod;
+		case BitwiseAnd:	 return Opcode::And;
+		case BitwiseOr:		 return Opcode::Or;
+		case BitwiseXor:	 return Opcode::Xor;
+		case LeftShift:		 return Opcode::Shl;
+		case RightShift:	 return Opcode::Shr;
+		default:			 UNREACHABLE();
+	}
+}
+}
+
+ExprCompiler::ExprCompiler(CompilerContext &ctx, LocalManager &localManager)
+	: m_Context(ctx)
+	, m_LocalManager(localManager) {}
+
+ExprResult ExprCompiler::compileExpr(const ast::Expr &n) {
+	if (n.constValue) {
+		return compileConstant(n.constValue.value(), n.inferredType.value());
+	}
+
+	return dispatch(n);
+}
+
+void ExprCompiler::addToExprCleanup(const Reg reg, Type type) {
+	m_ExprCleanup.push_back({.reg = reg, .type = type});
+}
+
+void ExprCompiler::emitExprCleanup() {
+	for (const auto &[reg, type] : m_ExprCleanup) {
+		m_Context.dropValue(reg, type);
+	}
+	m_ExprCleanup.clear();
+}
+
+void ExprCompiler::removeFromExprCleanup(const Reg reg) {
+	const auto cond = [reg](const TrackedValue &tracked) { return tracked.reg == reg; };
+	const auto it = std::remove_if(m_ExprCleanup.begin(), m_ExprCleanup.end(), cond);
+	m_ExprCleanup.erase(it, m_ExprCleanup.end());
+}
+
+LValue ExprCompiler::compileLValue(const ast::Expr &n) {
+	switch (n.kind) {
+		case ast::NodeKind::VarRef: {
+			const auto &varRef = static_cast<const ast::VarRef &>(n);
+			const auto local = m_LocalManager.getLocal(varRef.ident);
+
+			VERIFY(local.has_value());
+
+			return {.reg = local.value().reg, .type = local.value().type, .isAddress = false};
+		}
+
+		case ast::NodeKind::UnaryExpr: {
+			const auto &unaryExpr = static_cast<const ast::UnaryExpr &>(n);
+			VERIFY(unaryExpr.op == UnaryOpKind::Dereference);
+
+			// The pointer itself is the address of the pointee, the payload of the shared pointer.
+			const auto [ptr, type, _] = compileExpr(*unaryExpr.operand);
+			const auto ptrType = static_cast<PointerType *>(type);
+			VERIFY(ptrType);
+
+			m_Context.emit(Opcode::CheckNull, ptr);
+			return {.reg = ptr, .type = ptrType->pointeeType, .isAddress = true};
+		}
+
+		case ast::NodeKind::FieldAccess: {
+			const auto &fieldAccess = static_cast<const ast::FieldAccess &>(n);
+			const auto base = compileStructBase(*fieldAccess.base);
+			const auto index = getFieldIndex(fieldAccess);
+			const auto *structType = static_cast<StructType *>(fieldAccess.base->inferredType.value());
+
+			const auto addr = m_Context.allocReg();
+			m_Context.emit(Opcode::FieldAddr, addr, base, index);
+
+			return {.reg = addr,
+					.type = structType->orderedFields[index].second,
+					.isAddress = true};
+		}
+
+		case ast::NodeKind::IndexExpr: {
+			const auto &indexExpr = static_cast<const ast::IndexExpr &>(n);
+			auto array = compileExpr(*indexExpr.base);
+			snapshotBefore(array, *indexExpr.index);
+			const auto index = compileExpr(*indexExpr.index);
+
+			VERIFY(array.type->isTypeKind(TypeKind::Array));
+			auto *arrayType = static_cast<ArrayType *>(array.type);
+
+			const auto addr = m_Context.allocReg();
+			m_Context.emit(Opcode::IndexAddr, addr, array.reg, index.reg);
+
+			return {.reg = addr, .type = arrayType->elementType, .isAddress = true};
+		}
+
+		default: UNREACHABLE();
+	}
+}
+
+ExprResult ExprCompiler::visit(const ast::IntLit &n) {
+	return constant(n.value, n.inferredType.value());
+}
+
+ExprResult ExprCompiler::visit(const ast::BoolLit &n) {
+	return constant(n.value ? 1 : 0, n.inferredType.value());
+}
+
+ExprResult ExprCompiler::visit(const ast::CharLit &n) {
+	return constant(static_cast<i32>(n.value), n.inferredType.value());
+}
+
+ExprResult ExprCompiler::visit(const ast::UnitLit &n) {
+	return constant(0, n.inferredType.value());
+}
+
+ExprResult ExprCompiler::visit(const ast::NullLit &n) {
+	return constant(0, n.inferredType.value());
+}
+
+ExprResult ExprCompiler::visit(const ast::HeapAlloc &n) {
+	const auto &ptrType = n.inferredType.value();
+	const auto [value, type, isTemp] = n.expr->kind == ast::NodeKind::DefaultInit
+											   ? compileDefault(n.type)
+											   : compileExpr(*n.expr);
+
+	// Temporaries are moved into the allocation, everything else is copied so that the
+	// allocation owns its value.
+	auto owned = value;
+	if (isTemp) {
+		removeFromExprCleanup(value);
+	} else {
+		owned = m_Context.copyValue(value, type);
+	}
+
+	const auto ptr = m_Context.allocReg();
+	m_Context.emit(Opcode::NewPtr, ptr, owned, m_Context.getTypeIndex(type));
+
+	addToExprCleanup(ptr, ptrType);
+
+	return {.reg = ptr, .type = ptrType, .isTemp = true};
+}
+
+ExprResult ExprCompiler::visit(const ast::ArrayHeapAlloc &n) {
+	const auto &arrayType = n.inferredType.value();
+	const auto [count, _, countIsTemp] = compileExpr(*n.size);
+	if (countIsTemp)
+		removeFromExprCleanup(count);
+
+	const auto array = m_Context.allocReg();
+	m_Context.emit(Opcode::NewArray, array, count, m_Context.getTypeIndex(n.elementType));
+
+	addToExprCleanup(array, arrayType);
+
+	return {.reg = array, .type = arrayType, .isTemp = true};
+}
+
+ExprResult ExprCompiler::visit(const ast::StructInit &n) {
+	const auto resultType = n.inferredType.value();
+	const auto *structType = static_cast<StructType *>(resultType);
+
+	// NewStruct takes the fields from consecutive registers.
+	const auto fields = m_Context.allocRegs(static_cast<u32>(n.args.size()));
+
+	for (u32 i = 0; i < n.args.size(); ++i) {
+		const auto [value, _, isTemp] = compileExpr(*n.args[i]);
+		const auto &fieldType = structType->orderedFields[i].second;
+
+		auto owned = value;
+		if (!isTemp) {
+			owned = m_Context.copyValue(value, fieldType);
+		} else {
+			removeFromExprCleanup(value);
+		}
+
+		m_Context.emitMove(fields + i, owned);
+	}
+
+	const auto result = m_Context.allocReg();
+	m_Context.emit(Opcode::NewStruct, result, fields, m_Context.getTypeIndex(resultType));
+
+	addToExprCleanup(result, resultType);
+
+	return {.reg = result, .type = resultType, .isTemp = true};
+}
+
+ExprResult ExprCompiler::visit(const ast::VarRef &n) {
+	const auto &type = n.inferredType.value();
+
+	if (const auto local = m_LocalManager.getLocal(n.ident)) {
+		// Return local variable as a borrow
+		return {.reg = local.value().reg, .type = type, .isTemp = false};
+	}
+
+	if (const auto index = m_Context.getFunctionIndex(n.ident)) {
+		const auto func = m_Context.allocReg();
+		m_Context.emit(Opcode::LoadFunc, func, index.value());
+
+		return {.reg = func, .type = type, .isTemp = false};
+	}
+
+	UNREACHABLE();
+}
+
+ExprResult ExprCompiler::visit(const ast::FieldAccess &n) {
+	const auto base = compileStructBase(*n.base);
+	const auto index = getFieldIndex(n);
+	const auto *structType = static_cast<StructType *>(n.base->inferredType.value());
+
+	const auto value = m_Context.allocReg();
+	m_Context.emit(Opcode::GetField, value, base, index);
+
+	return {.reg = value, .type = structType->orderedFields[index].second, .isTemp = false};
+}
+
+ExprResult ExprCompiler::visit(const ast::IndexExpr &n) {
+	auto array = compileExpr(*n.base);
+	snapshotBefore(array, *n.index);
+	const auto index = compileExpr(*n.index);
+
+	VERIFY(array.type->isTypeKind(TypeKind::Array));
+	auto *arrayType = static_cast<ArrayType *>(array.type);
+
+	const auto value = m_Context.allocReg();
+	m_Context.emit(Opcode::IndexLoad, value, array.reg, index.reg);
+
+	return {.reg = value, .type = arrayType->elementType, .isTemp = false};
+}
+
+ExprResult ExprCompiler::visit(const ast::LenExpr &n) {
+	const auto [array, arrayType, _] = compileExpr(*n.base);
+
+	VERIFY(arrayType->isTypeKind(TypeKind::Array));
+
+	const auto length = m_Context.allocReg();
+	m_Context.emit(Opcode::Len, length, array);
+
+	return {.reg = length, .type = TypeFactory::getI32(), .isTemp = true};
+}
+
+ExprResult ExprCompiler::visit(const ast::UnaryExpr &n) {
+	const auto [value, type, _] = compileExpr(*n.operand);
+
+	const auto unary = [&](const Opcode op) -> ExprResult {
+		const auto result = m_Context.allocReg();
+		m_Context.emit(op, result, value);
+
+		return {.reg = result, .type = type, .isTemp = true};
+	};
+
+	switch (n.op) {
+		case UnaryOpKind::Positive:	  return {.reg = value, .type = type, .isTemp = true};
+		case UnaryOpKind::Negative:	  return unary(Opcode::Neg);
+		case UnaryOpKind::LogicalNot: return unary(Opcode::LogicalNot);
+		case UnaryOpKind::BitwiseNot: return unary(Opcode::Not);
+
+		case UnaryOpKind::Dereference: {
+			const auto ptrType = static_cast<PointerType *>(type);
+			VERIFY(ptrType);
+			m_Context.emit(Opcode::CheckNull, value);
+
+			const auto result = m_Context.allocReg();
+			m_Context.emit(Opcode::Load, result, value);
+
+			return {.reg = result, .type = ptrType->pointeeType, .isTemp = false};
+		}
+
+		default: UNREACHABLE();
+	}
+}
+
+ExprResult ExprCompiler::visit(const ast::BinaryExpr &n) {
+	if (n.op == BinaryOpKind::LogicalAnd || n.op == BinaryOpKind::LogicalOr) {
+		return compileShortCircuit(n);
+	}
+
+	auto left = compileExpr(*n.left);
+	snapshotBefore(left, *n.right);
+	const auto right = compileExpr(*n.right);
+
+	// All values fit into one slot, so null compares equal to null pointers and null arrays.
+	const auto result = m_Context.allocReg();
+	m_Context.emit(getBinaryOpcode(n.op), result, left.reg, right.reg);
+
+	return {.reg = result, .type = n.inferredType.value(), .isTemp = true};
+}
+
+ExprResult ExprCompiler::compileShortCircuit(const ast::BinaryExpr &n) {
+	const auto left = compileExpr(*n.left);
+
+	// The result is the left operand, unless the right one has to be evaluated: && skips it if
+	// the left operand is false, || if it is true.
+	const auto result = m_Context.allocReg();
+	m_Context.emitMove(result, left.reg);
+
+	auto test = result;
+	if (n.op == BinaryOpKind::LogicalOr) {
+		test = m_Context.allocReg();
+		m_Context.emit(Opcode::LogicalNot, test, result);
+	}
+
+	const auto toEnd = m_Context.emit(Opcode::JumpIfFalse, test);
+
+	// The temporaries of the right operand only exist on its path, so they are dropped there.
+	auto outerCleanup = std::move(m_ExprCleanup);
+	m_ExprCleanup.clear();
+
+	const auto right = compileExpr(*n.right);
+	m_Context.emitMove(result, right.reg);
+	emitExprCleanup();
+	m_ExprCleanup = std::move(outerCleanup);
+
+	m_Context.patchJump(toEnd, m_Context.label());
+	return {.reg = result, .type = n.inferredType.value(), .isTemp = true};
+}
+
+ExprResult ExprCompiler::visit(const ast::FuncCall &n) {
+	const auto funcType = static_cast<FunctionType *>(n.expr->inferredType.value());
+	VERIFY(funcType->isTypeKind(TypeKind::Function));
+
+	// Calls of declared functions do not need to load the function first.
+	Opt<u32> direct;
+	ExprResult callee{};
+
+	if (n.expr->kind == ast::NodeKind::VarRef &&
+		!m_LocalManager.getLocal(static_cast<const ast::VarRef &>(*n.expr).ident)) {
+		direct = m_Context.getFunctionIndex(static_cast<const ast::VarRef &>(*n.expr).ident);
+		VERIFY(direct.has_value());
+	} else {
+		callee = compileExpr(*n.expr);
+	}
+
+	// The arguments are passed in consecutive registers.
+	const auto args = m_Context.allocRegs(static_cast<u32>(n.args.size()));
+
+	for (u32 i = 0; i < n.args.size(); ++i) {
+		const auto [value, _, isTemp] = compileExpr(*n.args[i]);
+		const auto paramType = funcType->paramTypes[i];
+
+		// A borrowed parameter &T leaves the argument to the caller, which drops it after the
+		// call. The callee copies the arguments into its own frame, so the argument register
+		// still holds the value then, even if the move was folded into the instruction before.
+		if (paramType->isTypeKind(TypeKind::Reference)) {
+			const auto referencedType = static_cast<ReferenceType *>(paramType)->referencedType;
+
+			auto borrowed = value;
+			if (isTemp) {
+				removeFromExprCleanup(value);
+			} else {
+				borrowed = m_Context.copyValue(value, referencedType);
+			}
+
+			m_Context.emitMove(args + i, borrowed);
+			addToExprCleanup(args + i, referencedType);
+			continue;
+		}
+
+		auto owned = value;
+		if (isTemp) {
+			removeFromExprCleanup(value);
+		} else {
+			owned = m_Context.copyValue(value, paramType);
+		}
+
+		m_Context.emitMove(args + i, owned);
+	}
+
+	const auto result = m_Context.allocReg();
+	if (direct.has_value()) {
+		m_Context.emit(Opcode::CallDirect, result, direct.value(), args);
+	} else {
+		m_Context.emit(Opcode::Call, result, callee.reg, args);
+	}
+
+	addToExprCleanup(result, funcType->returnType);
+
+	return {.reg = result, .type = n.inferredType.value(), .isTemp = true};
+}
+
+ExprResult ExprCompiler::visit(const ast::Assignment &n) {
+	const auto left = compileLValue(*n.left);
+	const auto [right, rightType, isRightTemp] = compileExpr(*n.right);
+	const auto isSimple = n.assignmentKind == AssignmentKind::Simple;
+
+	// The old value is only read after the right side, it might have assigned to it as well.
+	auto old = left.reg;
+	if (left.isAddress && (!isSimple || getValueKind(left.type) != ValueKind::Trivial)) {
+		old = m_Context.allocReg();
+		m_Context.emit(Opcode::Load, old, left.reg);
+	}
+
+	// First retain the right side
+	auto owned = right;
+	if (isRightTemp) {
+		removeFromExprCleanup(right);
+	} else {
+		owned = m_Context.copyValue(right, left.type);
+	}
+
+	m_Context.dropValue(old, left.type);
+
+	if (isSimple) {
+		if (left.isAddress) {
+			m_Context.emit(Opcode::Store, left.reg, owned);
+		} else {
+			m_Context.emitMove(left.reg, owned);
+		}
+
+		return constant(0, left.type);
+	}
+
+	const auto op = getAssignmentOpcode(n.assignmentKind);
+
+	if (left.isAddress) {
+		const auto result = m_Context.allocReg();
+		m_Context.emit(op, result, old, owned);
+		m_Context.emit(Opcode::Store, left.reg, result);
+	} else {
+		m_Context.emit(op, left.reg, left.reg, owned);
+	}
+
+	return constant(0, left.type);
+}
+
+ExprResult ExprCompiler::compileDefault(Type type) {
+	const auto result = m_Context.allocReg();
+
+	if (getValueKind(type) == ValueKind::Struct) {
+		m_Context.emit(Opcode::NewDefault, result, m_Context.getTypeIndex(type));
+	} else {
+		m_Context.emit(Opcode::LoadInt, result, 0);
+	}
+
+	return {.reg = result, .type = type, .isTemp = true};
+}
+
+ExprResult ExprCompiler::compileConstant(const ast::ConstValue &value, Type type) {
+	if (!type->isTypeKind(TypeKind::Struct)) {
+		return constant(value.scalar, type);
+	}
+
+	// Structs live in their own allocation, like the ones of a struct initializer.
+	const auto *structType = static_cast<StructType *>(type);
+	const auto fields = m_Context.allocRegs(static_cast<u32>(value.fields.size()));
+
+	for (u32 i = 0; i < value.fields.size(); ++i) {
+		const auto field = compileConstant(value.fields[i], structType->orderedFields[i].second);
+		removeFromExprCleanup(field.reg);
+		m_Context.emitMove(fields + i, field.reg);
+	}
+
+	const auto result = m_Context.allocReg();
+	m_Context.emit(Opcode::NewStruct, result, fields, m_Context.getTypeIndex(type));
+
+	addToExprCleanup(result, type);
+
+	return {.reg = result, .type = type, .isTemp = true};
+}
+
+ExprResult ExprCompiler::constant(const i32 value, Type type) {
+	const auto result = m_Context.allocReg();
+	m_Context.emit(Opcode::LoadInt, result, static_cast<u32>(value));
+
+	return {.reg = result, .type = type, .isTemp = true};
+}
+
+Reg ExprCompiler::compileStructBase(const ast::Expr &base) {
+	const auto lvalue = compileLValue(base);
+	if (!lvalue.isAddress) {
+		return lvalue.reg;
+	}
+
+	const auto box = m_Context.allocReg();
+	m_Context.emit(Opcode::Load, box, lvalue.reg);
+
+	return box;
+}
+
+u32 ExprCompiler::getFieldIndex(const ast::FieldAccess &n) const {
+	const auto *structType = static_cast<StructType *>(n.base->inferredType.value());
+	VERIFY(structType->isTypeKind(TypeKind::Struct));
+
+	for (u32 i = 0; i < structType->orderedFields.size(); ++i) {
+		if (structType->orderedFields[i].first == n.field) {
+			return i;
+		}
+	}
+
+	UNREACHABLE();
+}
+
+void ExprCompiler::snapshotBefore(ExprResult &result, const ast::Expr &later) {
+	// Borrowed locals are read straight from their register. If a later operand assigns to the
+	// local, the value has to be saved first, the LLVM backend loads it at this point as well.
+	if (result.isTemp || !containsAssignment(later)) {
+		return;
+	}
+
+	const auto snapshot = m_Context.allocReg();
+	m_Context.emit(Opcode::Move, snapshot, result.reg);
+	result.reg = snapshot;
+}
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "LocalManager.h"
+#include "ast/Visitor.h"
+
+namespace vm {
+struct ExprResult {
+	Reg reg;
+	Type type;
+	bool isTemp;
+};
+
+/// A location that can be assigned to, either a register or a register holding an address.
+struct LValue {
+	Reg reg;
+	Type type;
+	bool isAddress;
+};
+
+/// Compiles expressions into register bytecode. Ownership is handled exactly like in
+/// gen::ExprLowerer: temporaries are tracked until the end of the expression and every value
+/// that is stored somewhere is either moved out of a temporary or copied.
+struct ExprCompiler : ast::ConstVisitor<ExprResult> {
+private:
+	CompilerContext &m_Context;
+	LocalManager &m_LocalManager;
+	Vec<TrackedValue> m_ExprCleanup;
+
+public:
+	ExprCompiler(CompilerContext &ctx, LocalManager &localManager);
+
+	ExprResult compileExpr(const ast::Expr &n);
+
+	void addToExprCleanup(Reg reg, Type type);
+	void emitExprCleanup();
+	void removeFromExprCleanup(Reg reg);
+
+	LValue compileLValue(const ast::Expr &n);
+	ExprResult visit(const ast::IntLit &n) override;
+	ExprResult visit(const ast::BoolLit &n) override;
+	ExprResult visit(const ast::CharLit &n) override;
+	ExprResult visit(const ast::NullLit &n) override;
+	ExprResult visit(const ast::UnitLit &n) override;
+	ExprResult visit(const ast::HeapAlloc &n) override;
+	ExprResult visit(const ast::ArrayHeapAlloc &n) override;
+	ExprResult visit(const ast::StructInit &n) override;
+	ExprResult visit(const ast::VarRef &n) override;
+	ExprResult visit(const ast::FieldAccess &n) override;
+	ExprResult visit(const ast::IndexExpr &n) override;
+	ExprResult visit(const ast::LenExpr &n) override;
+	ExprResult visit(const ast::UnaryExpr &n) override;
+	ExprResult visit(const ast::BinaryExpr &n) override;
+	ExprResult visit(const ast::FuncCall &n) override;
+	ExprResult visit(const ast::Assignment &n) override;
+
+	/// Returns the default value of a type in a new temporary.
+	ExprResult compileDefault(Type type);
+
+private:
+	ExprResult constant(i32 value, Type type);
+	/// Compiles the value of an expression that is known at compile time.
+	ExprResult compileConstant(const ast::ConstValue &value, Type type);
+	/// Compiles && and ||, which only evaluate their right operand if the left one does not
+	/// decide the result.
+	ExprResult compileShortCircuit(const ast::BinaryExpr &n);
+	Reg compileStructBase(const ast::Expr &base);
+	u32 getFieldIndex(const ast::FieldAccess &n) const;
+	void snapshotBefore(ExprResult &result, const ast::Expr &later);
+};
+}
@@ -0,0 +1,372 @@
+#include "Interpreter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Runtime.h"
+#include "core/PrintUtil.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define OCN_VM_THREADED 1
+#else
+#define OCN_VM_THREADED 0
+#endif
+
+namespace vm {
+namespace {
+i32 asI32(const u64 value) {
+	return static_cast<i32>(value);
+}
+
+u64 fromI32(const i32 value) {
+	return static_cast<u64>(static_cast<i64>(value));
+}
+
+/// Converts the result of unsigned 32-bit arithmetic back into a slot, this is how the VM gets
+/// the wrap around behaviour of the LLVM backend without signed overflow.
+u64 wrap(const u32 value) {
+	return fromI32(static_cast<i32>(value));
+}
+
+void *asPtr(const u64 value) {
+	return reinterpret_cast<void *>(value);
+}
+
+u64 fromPtr(const void *ptr) {
+	return reinterpret_cast<u64>(ptr);
+}
+
+/// Returns the address of element index of an array, or panics like the LLVM backend if the
+/// index is out of bounds. Null arrays have no elements.
+u64 *elementAddress(const u64 array, const u64 index) {
+	const auto i = static_cast<i64>(asI32(index));
+
+	if (i < 0 || static_cast<u64>(i) >= arrayLength(asPtr(array))) {
+		__panic_out_of_bounds();
+	}
+
+	return static_cast<u64 *>(asPtr(array)) + i;
+}
+
+[[noreturn]] void panicStackOverflow() {
+	std::fputs("panic: stack overflow\n", stderr);
+	std::abort();
+}
+}
+
+Interpreter::Interpreter(const Program &program)
+	: m_Program(program)
+	, m_Registers(new u64[s_RegisterCount]) {}
+
+i32 Interpreter::run(const Program &program) {
+	Interpreter interpreter(program);
+	const auto result = interpreter.execute(*program.functions[program.entry]);
+
+	util::flushProgramOutput();
+	return asI32(result);
+}
+
+u64 Interpreter::execute(const Function &entry) {
+	Vec<Frame> frames;
+	const Function *function = &entry;
+	const Function *callee = nullptr;
+	const Instr *pc = entry.code.data();
+	const Instr *ip = nullptr;
+	u64 *regs = m_Registers.get();
+	const u64 *const regsEnd = regs + s_RegisterCount;
+
+	if (entry.frameSize > s_RegisterCount) {
+		panicStackOverflow();
+	}
+
+#if OCN_VM_THREADED
+#define OCN_VM_LABEL(name) &&op_##name,
+	static void *const s_Labels[] = {OCN_VM_OPCODES(OCN_VM_LABEL)};
+#undef OCN_VM_LABEL
+
+#define VM_CASE(name) op_##name:
+#define VM_NEXT()                                                                                  \
+	ip = pc++;                                                                                     \
+	goto *s_Labels[static_cast<u8>(ip->op)]
+
+	VM_NEXT();
+#else
+#define VM_CASE(name) case Opcode::name:
+#define VM_NEXT()	  continue
+
+	for (;;) {
+		ip = pc++;
+		switch (ip->op) {
+#endif
+
+	VM_CASE(LoadInt) {
+		regs[ip->a] = fromI32(static_cast<i32>(ip->b));
+		VM_NEXT();
+	}
+
+	VM_CASE(LoadFunc) {
+		regs[ip->a] = fromPtr(m_Program.functions[ip->b].get());
+		VM_NEXT();
+	}
+
+	VM_CASE(Move) {
+		regs[ip->a] = regs[ip->b];
+		VM_NEXT();
+	}
+
+	VM_CASE(Add) {
+		regs[ip->a] = wrap(static_cast<u32>(regs[ip->b]) + static_cast<u32>(regs[ip->c]));
+		VM_NEXT();
+	}
+
+	VM_CASE(Sub) {
+		regs[ip->a] = wrap(static_cast<u32>(regs[ip->b]) - static_cast<u32>(regs[ip->c]));
+		VM_NEXT();
+	}
+
+	VM_CASE(Mul) {
+		regs[ip->a] = wrap(static_cast<u32>(regs[ip->b]) * static_cast<u32>(regs[ip->c]));
+		VM_NEXT();
+	}
+
+	VM_CASE(Div) {
+		regs[ip->a] = fromI32(asI32(regs[ip->b]) / asI32(regs[ip->c]));
+		VM_NEXT();
+	}
+
+	VM_CASE(Mod) {
+		regs[ip->a] = fromI32(asI32(regs[ip->b]) % asI32(regs[ip->c]));
+		VM_NEXT();
+	}
+
+	VM_CASE(And) {
+		regs[ip->a] = regs[ip->b] & regs[ip->c];
+		VM_NEXT();
+	}
+
+	VM_CASE(Or) {
+		regs[ip->a] = regs[ip->b] | regs[ip->c];
+		VM_NEXT();
+	}
+
+	VM_CASE(Xor) {
+		regs[ip->a] = regs[ip->b] ^ regs[ip->c];
+		VM_NEXT();
+	}
+
+	VM_CASE(Shl) {
+		regs[ip->a] = wrap(static_cast<u32>(regs[ip->b]) << (regs[ip->c] & 31U));
+		VM_NEXT();
+	}
+
+	VM_CASE(Shr) {
+		regs[ip->a] = fromI32(asI32(regs[ip->b]) >> (regs[ip->c] & 31U));
+		VM_NEXT();
+	}
+
+	VM_CASE(Eq) {
+		regs[ip->a] = regs[ip->b] == regs[ip->c];
+		VM_NEXT();
+	}
+
+	VM_CASE(Ne) {
+		regs[ip->a] = regs[ip->b] != regs[ip->c];
+		VM_NEXT();
+	}
+
+	VM_CASE(Lt) {
+		regs[ip->a] = asI32(regs[ip->b]) < asI32(regs[ip->c]);
+		VM_NEXT();
+	}
+
+	VM_CASE(Le) {
+		regs[ip->a] = asI32(regs[ip->b]) <= asI32(regs[ip->c]);
+		VM_NEXT();
+	}
+
+	VM_CASE(Gt) {
+		regs[ip->a] = asI32(regs[ip->b]) > asI32(regs[ip->c]);
+		VM_NEXT();
+	}
+
+	VM_CASE(Ge) {
+		regs[ip->a] = asI32(regs[ip->b]) >= asI32(regs[ip->c]);
+		VM_NEXT();
+	}
+
+	VM_CASE(Neg) {
+		regs[ip->a] = wrap(0U - static_cast<u32>(regs[ip->b]));
+		VM_NEXT();
+	}
+
+	VM_CASE(Not) {
+		regs[ip->a] = ~regs[ip->b];
+		VM_NEXT();
+	}
+
+	VM_CASE(LogicalNot) {
+		regs[ip->a] = regs[ip->b] == 0;
+		VM_NEXT();
+	}
+
+	VM_CASE(Jump) {
+		pc = function->code.data() + ip->a;
+		VM_NEXT();
+	}
+
+	VM_CASE(JumpIfFalse) {
+		if (regs[ip->a] == 0) {
+			pc = function->code.data() + ip->b;
+		}
+		VM_NEXT();
+	}
+
+	VM_CASE(CallDirect) {
+		callee = m_Program.functions[ip->b].get();
+		goto call;
+	}
+
+	VM_CASE(Call) {
+		callee = static_cast<const Function *>(asPtr(regs[ip->b]));
+	}
+
+call: {
+	const u64 *args = regs + ip->c;
+
+	if (callee->native) {
+		regs[ip->a] = callee->native(args);
+		VM_NEXT();
+	}
+
+	auto *calleeRegs = regs + function->frameSize;
+	if (callee->frameSize > static_cast<size_t>(regsEnd - calleeRegs)) {
+		panicStackOverflow();
+	}
+
+	std::copy_n(args, callee->paramCount, calleeRegs);
+	frames.push_back({.function = function, .returnPc = pc, .regs = regs, .dest = ip->a});
+
+	function = callee;
+	regs = calleeRegs;
+	pc = callee->code.data();
+	VM_NEXT();
+}
+
+	VM_CASE(Ret) {
+		const auto result = regs[ip->a];
+
+		if (frames.empty()) {
+			return result;
+		}
+
+		const auto &frame = frames.back();
+		function = frame.function;
+		pc = frame.returnPc;
+		regs = frame.regs;
+		regs[frame.dest] = result;
+		frames.pop_back();
+		VM_NEXT();
+	}
+
+	VM_CASE(CheckNull) {
+		if (regs[ip->a] == 0) {
+			__panic_null_deref();
+		}
+		VM_NEXT();
+	}
+
+	VM_CASE(Load) {
+		regs[ip->a] = *static_cast<const u64 *>(asPtr(regs[ip->b]));
+		VM_NEXT();
+	}
+
+	VM_CASE(Store) {
+		*static_cast<u64 *>(asPtr(regs[ip->a])) = regs[ip->b];
+		VM_NEXT();
+	}
+
+	VM_CASE(GetField) {
+		regs[ip->a] = static_cast<const StructBox *>(asPtr(regs[ip->b]))->slots()[ip->c];
+		VM_NEXT();
+	}
+
+	VM_CASE(FieldAddr) {
+		regs[ip->a] = fromPtr(static_cast<StructBox *>(asPtr(regs[ip->b]))->slots() + ip->c);
+		VM_NEXT();
+	}
+
+	VM_CASE(IndexLoad) {
+		regs[ip->a] = *elementAddress(regs[ip->b], regs[ip->c]);
+		VM_NEXT();
+	}
+
+	VM_CASE(IndexAddr) {
+		regs[ip->a] = fromPtr(elementAddress(regs[ip->b], regs[ip->c]));
+		VM_NEXT();
+	}
+
+	VM_CASE(Len) {
+		regs[ip->a] = fromI32(static_cast<i32>(arrayLength(asPtr(regs[ip->b]))));
+		VM_NEXT();
+	}
+
+	VM_CASE(NewPtr) {
+		regs[ip->a] = fromPtr(newPointer(regs[ip->b], m_Program.types[ip->c].get()));
+		VM_NEXT();
+	}
+
+	VM_CASE(NewArray) {
+		regs[ip->a] = fromPtr(newArray(asI32(regs[ip->b]), m_Program.types[ip->c].get()));
+		VM_NEXT();
+	}
+
+	VM_CASE(NewStruct) {
+		regs[ip->a] = fromPtr(newStruct(m_Program.types[ip->c].get(), regs + ip->b));
+		VM_NEXT();
+	}
+
+	VM_CASE(NewDefault) {
+		regs[ip->a] = fromPtr(newDefaultStruct(m_Program.types[ip->b].get()));
+		VM_NEXT();
+	}
+
+	VM_CASE(RcRetain) {
+		__sp_copy(asPtr(regs[ip->a]));
+		VM_NEXT();
+	}
+
+	VM_CASE(RcRelease) {
+		__sp_drop(asPtr(regs[ip->a]));
+		VM_NEXT();
+	}
+
+	VM_CASE(ArrRetain) {
+		__arr_copy(asPtr(regs[ip->a]));
+		VM_NEXT();
+	}
+
+	VM_CASE(ArrRelease) {
+		__arr_drop(asPtr(regs[ip->a]));
+		VM_NEXT();
+	}
+
+	VM_CASE(StructCopy) {
+		regs[ip->a] = fromPtr(copyStruct(static_cast<const StructBox *>(asPtr(regs[ip->b]))));
+		VM_NEXT();
+	}
+
+	VM_CASE(StructDrop) {
+		dropStruct(static_cast<StructBox *>(asPtr(regs[ip->a])));
+		VM_NEXT();
+	}
+
+#if !OCN_VM_THREADED
+		}
+	}
+#endif
+
+#undef VM_CASE
+#undef VM_NEXT
+}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "Bytecode.h"
+
+namespace vm {
+/// Executes a Program. Instructions are dispatched with computed gotos where the compiler
+/// supports them (threaded code), otherwise with a switch. Calls do not recurse on the host
+/// stack, all frames live in one preallocated register stack.
+struct Interpreter {
+private:
+	struct Frame {
+		const Function *function;
+		const Instr *returnPc;
+		u64 *regs;
+		Reg dest;
+	};
+
+	const Program &m_Program;
+	Box<u64[]> m_Registers;
+
+	explicit Interpreter(const Program &program);
+
+	u64 execute(const Function &entry);
+
+public:
+	/// Number of registers available to all active frames together.
+	static constexpr size_t s_RegisterCount = size_t{1} << 22;
+
+	/// Runs the entry function of the program and returns its exit code.
+	static i32 run(const Program &program);
+};
+}
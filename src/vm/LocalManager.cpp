@@ -0,0 +1,53 @@
+#include "LocalManager.h"
+
+#include <ranges>
+
+namespace vm {
+LocalManager::LocalManager(CompilerContext &ctx)
+	: m_Context(ctx) {}
+
+Opt<TrackedValue> LocalManager::getLocal(const U8String &ident) const {
+	for (const auto &scope : std::ranges::reverse_view(m_Locals)) {
+		for (const auto &[name, tracked] : std::ranges::reverse_view(scope)) {
+			if (name == ident) {
+				return tracked;
+			}
+		}
+	}
+
+	return {};
+}
+
+void LocalManager::addLocal(const Reg reg, Type type, const U8String &ident) {
+	m_Locals.back().emplace_back(ident, TrackedValue{reg, type});
+}
+
+void LocalManager::clearLocals() {
+	m_Locals.clear();
+}
+
+void LocalManager::openScope() {
+	m_Locals.emplace_back();
+}
+
+void LocalManager::closeScope() {
+	m_Locals.pop_back();
+}
+
+void LocalManager::emitCurrentScopeCleanup() {
+	emitScopeCleanup(m_Locals.back());
+}
+
+void LocalManager::emitFullScopeCleanup() {
+	for (const auto &scope : std::ranges::reverse_view(m_Locals)) {
+		emitScopeCleanup(scope);
+	}
+}
+
+void LocalManager::emitScopeCleanup(const Scope &scope) {
+	// Locals live in registers, so unlike allocas they can be dropped directly.
+	for (const auto &[_, tracked] : std::ranges::reverse_view(scope)) {
+		m_Context.dropValue(tracked.reg, tracked.type);
+	}
+}
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "CompilerContext.h"
+
+namespace vm {
+using Scope = Vec<Pair<U8String, TrackedValue>>;
+
+/// Keeps track of the registers that hold local variables, mirrors gen::AllocManager.
+struct LocalManager {
+private:
+	CompilerContext &m_Context;
+	Vec<Scope> m_Locals;
+
+public:
+	explicit LocalManager(CompilerContext &ctx);
+
+public:
+	Opt<TrackedValue> getLocal(const U8String &ident) const;
+	void addLocal(Reg reg, Type type, const U8String &ident);
+	void clearLocals();
+	void openScope();
+	void closeScope();
+	void emitCurrentScopeCleanup();
+	void emitFullScopeCleanup();
+
+private:
+	void emitScopeCleanup(const Scope &scope);
+};
+}
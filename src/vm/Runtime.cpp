@@ -0,0 +1,207 @@
+#include "Runtime.h"
+
+#include <algorithm>
+
+extern "C" {
+void print_i32(i32);
+void print_bool(i8);
+void print_char(i32);
+void print_newline();
+i32 read_i32();
+i8 read_bool();
+i32 read_char();
+}
+
+namespace vm {
+namespace {
+/// Mirrors ArrayControlBlock of ocn_stdlib.c, which precedes the elements of every array.
+struct ArrayHeader {
+	size_t refCount;
+	size_t arraySize;
+	size_t elementSize;
+	void (*dtor)(void *);
+};
+
+u64 fromI32(const i32 value) {
+	return static_cast<u64>(static_cast<i64>(value));
+}
+
+void dropPointerSlot(void *slot) {
+	__sp_drop(*static_cast<void **>(slot));
+}
+
+void dropArraySlot(void *slot) {
+	__arr_drop(*static_cast<void **>(slot));
+}
+
+void dropStructSlot(void *slot) {
+	dropStruct(*static_cast<StructBox **>(slot));
+}
+
+/// Returns the destructor the runtime calls for a heap slot holding a value of the given type.
+void (*getSlotDestructor(const TypeDesc *desc))(void *) {
+	switch (desc->kind) {
+		case ValueKind::Trivial: return nullptr;
+		case ValueKind::Pointer: return &dropPointerSlot;
+		case ValueKind::Array:	 return &dropArraySlot;
+		case ValueKind::Struct:	 return &dropStructSlot;
+		default:				 UNREACHABLE();
+	}
+}
+
+u64 defaultValue(const TypeDesc *desc) {
+	if (desc->kind == ValueKind::Struct) {
+		return reinterpret_cast<u64>(newDefaultStruct(desc));
+	}
+
+	return 0;
+}
+
+StructBox *allocateStruct(const TypeDesc *desc) {
+	const auto size = sizeof(StructBox) + desc->fields.size() * sizeof(u64);
+	auto *box = static_cast<StructBox *>(__ocn_alloc(size));
+	VERIFY(box);
+
+	box->desc = desc;
+	return box;
+}
+
+u64 nativePrintI32(const u64 *args) {
+	print_i32(static_cast<i32>(args[0]));
+	return 0;
+}
+
+u64 nativePrintBool(const u64 *args) {
+	print_bool(static_cast<i8>(args[0]));
+	return 0;
+}
+
+u64 nativePrintChar(const u64 *args) {
+	print_char(static_cast<i32>(args[0]));
+	return 0;
+}
+
+u64 nativePrintNewline(const u64 *) {
+	print_newline();
+	return 0;
+}
+
+u64 nativeReadI32(const u64 *) {
+	return fromI32(read_i32());
+}
+
+u64 nativeReadBool(const u64 *) {
+	return read_bool() != 0 ? 1 : 0;
+}
+
+u64 nativeReadChar(const u64 *) {
+	return fromI32(read_char());
+}
+
+u64 nativePopcount(const u64 *args) {
+	const auto *data = reinterpret_cast<const u64 *>(args[0]);
+	const auto count = std::count_if(data, data + arrayLength(data), [](u64 v) { return v != 0; });
+	return fromI32(static_cast<i32>(count));
+}
+}
+
+NativeFn findNative(const U8String &name) {
+	static const Map<U8String, NativeFn> natives = {
+			{u8"print_i32", &nativePrintI32},	{u8"print_bool", &nativePrintBool},
+			{u8"print_char", &nativePrintChar}, {u8"print_newline", &nativePrintNewline},
+			{u8"read_i32", &nativeReadI32},		{u8"read_bool", &nativeReadBool},
+			{u8"read_char", &nativeReadChar},		{u8"popcount", &nativePopcount},
+	};
+
+	const auto it = natives.find(name);
+	return it != natives.end() ? it->second : nullptr;
+}
+
+StructBox *newDefaultStruct(const TypeDesc *desc) {
+	auto *box = allocateStruct(desc);
+
+	for (size_t i = 0; i < desc->fields.size(); ++i) {
+		box->slots()[i] = defaultValue(desc->fields[i]);
+	}
+
+	return box;
+}
+
+StructBox *newStruct(const TypeDesc *desc, const u64 *fields) {
+	auto *box = allocateStruct(desc);
+	std::copy_n(fields, desc->fields.size(), box->slots());
+
+	return box;
+}
+
+StructBox *copyStruct(const StructBox *box) {
+	const auto *desc = box->desc;
+	auto *copy = allocateStruct(desc);
+	const auto *from = box->slots();
+
+	for (size_t i = 0; i < desc->fields.size(); ++i) {
+		auto value = from[i];
+
+		switch (desc->fields[i]->kind) {
+			case ValueKind::Trivial: break;
+			case ValueKind::Pointer: __sp_copy(reinterpret_cast<void *>(value)); break;
+			case ValueKind::Array:	 __arr_copy(reinterpret_cast<void *>(value)); break;
+			case ValueKind::Struct:
+				value = reinterpret_cast<u64>(copyStruct(reinterpret_cast<StructBox *>(value)));
+				break;
+		}
+
+		copy->slots()[i] = value;
+	}
+
+	return copy;
+}
+
+void dropStruct(StructBox *box) {
+	const auto *desc = box->desc;
+
+	for (size_t i = 0; i < desc->fields.size(); ++i) {
+		auto *value = reinterpret_cast<void *>(box->slots()[i]);
+
+		switch (desc->fields[i]->kind) {
+			case ValueKind::Trivial: break;
+			case ValueKind::Pointer: __sp_drop(value); break;
+			case ValueKind::Array:	 __arr_drop(value); break;
+			case ValueKind::Struct:	 dropStruct(static_cast<StructBox *>(value)); break;
+		}
+	}
+
+	__ocn_free(box);
+}
+
+void *newPointer(const u64 value, const TypeDesc *pointee) {
+	auto *payload = __sp_create(sizeof(u64), getSlotDestructor(pointee));
+	*static_cast<u64 *>(payload) = value;
+
+	return payload;
+}
+
+void *newArray(const i32 count, const TypeDesc *element) {
+	const auto size = static_cast<size_t>(static_cast<i64>(count));
+	auto *data = __arr_create(sizeof(u64), size, getSlotDestructor(element));
+
+	// The runtime zeroes the elements, which is the default value of everything but structs.
+	if (data && element->kind == ValueKind::Struct) {
+		auto *slots = static_cast<u64 *>(data);
+
+		for (size_t i = 0; i < size; ++i) {
+			slots[i] = defaultValue(element);
+		}
+	}
+
+	return data;
+}
+
+u64 arrayLength(const void *data) {
+	if (!data) {
+		return 0;
+	}
+
+	return (static_cast<const ArrayHeader *>(data) - 1)->arraySize;
+}
+}
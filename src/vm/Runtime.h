@@ -0,0 +1,40 @@
+#pragma once
+#include "Bytecode.h"
+
+// Provided by ocn_stdlib.c, which is linked into the compiler. The VM shares the reference
+// counting, the allocator and the panics with compiled programs.
+extern "C" {
+void *__ocn_alloc(size_t size);
+void __ocn_free(void *ptr);
+void __panic_null_deref();
+void __panic_out_of_bounds();
+void *__sp_create(size_t, void (*)(void *));
+void *__sp_copy(void *);
+void __sp_drop(void *);
+void *__arr_create(size_t, size_t, void (*)(void *));
+void *__arr_copy(void *);
+void __arr_drop(void *);
+}
+
+namespace vm {
+/// Returns the host implementation of the builtin function with the given name, if any.
+NativeFn findNative(const U8String &name);
+
+/// Creates a struct whose fields hold their default value, nested structs are created as well.
+StructBox *newDefaultStruct(const TypeDesc *desc);
+
+/// Creates a struct that takes over the given field values.
+StructBox *newStruct(const TypeDesc *desc, const u64 *fields);
+
+StructBox *copyStruct(const StructBox *box);
+void dropStruct(StructBox *box);
+
+/// Creates a shared pointer owning value, the runtime drops the value with the pointer.
+void *newPointer(u64 value, const TypeDesc *pointee);
+
+/// Creates an array of count default values, every element occupies one slot.
+void *newArray(i32 count, const TypeDesc *element);
+
+/// Returns the number of elements of an array created by newArray, null arrays are empty.
+u64 arrayLength(const void *data);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+
+#include "Doctest.h"
+#include "lexer/Lexer.h"
+#include "parser/Parser.h"
+#include "semantic/passes/ConstantEvaluationPass.h"
+#include "semantic/passes/EffectAnalysisPass.h"
+#include "semantic/passes/ExplorationPass.h"
+#include "semantic/passes/TypeCheckingPass.h"
+
+namespace test {
+/// Passes that run after type checking, in the order the compiler runs them.
+struct ExtraPasses {
+	bool constantEvaluation = false;
+	bool effectAnalysis = false;
+};
+
+/// Lexes, parses and type checks source. Whatever went wrong is left in err.
+inline Box<ast::Module> typeCheck(const U8String &source, ErrorHandler &err) {
+	const auto tokens = lex::Lexer::tokenize(source, err);
+	auto module = prs::Parser::parse(tokens, err, u8"test.ocn");
+
+	sem::TypeCheckerContext ctx(err);
+	sem::ExplorationPass pass1(ctx);
+	pass1.dispatch(*module);
+	sem::TypeCheckingPass pass2(ctx);
+	pass2.dispatch(*module);
+
+	return module;
+}
+
+/// Type checks source, which must not have errors, and runs the requested passes on it. Later
+/// stages can report their warnings to err.
+inline Box<ast::Module> checkSource(const U8String &source, ErrorHandler &err,
+									const ExtraPasses &passes = {}) {
+	auto module = typeCheck(source, err);
+	REQUIRE_FALSE(err.hasError());
+
+	if (passes.constantEvaluation) {
+		sem::ConstantEvaluationPass pass;
+		pass.dispatch(*module);
+	}
+
+	if (passes.effectAnalysis) {
+		sem::EffectAnalysisPass pass;
+		pass.dispatch(*module);
+	}
+
+	return module;
+}
+
+inline Box<ast::Module> checkSource(const U8String &source, const ExtraPasses &passes = {}) {
+	ErrorHandler err(u8"test.ocn", source);
+	return checkSource(source, err, passes);
+}
+
+/// Returns the messages of everything err collected, in the order they were reported.
+inline Vec<U8String> getMessages(const ErrorHandler &err) {
+	Vec<U8String> messages;
+
+	for (const auto &error : err.getErrors()) {
+		messages.push_back(error.message);
+	}
+
+	return messages;
+}
+
+inline u32 countCalls(const llvm::Function &func, const char *callee) {
+	u32 count = 0;
+
+	for (const auto &block : func) {
+		for (const auto &inst : block) {
+			const auto *call = llvm::dyn_cast<llvm::CallInst>(&inst);
+			if (call && call->getCalledFunction() &&
+				call->getCalledFunction()->getName() == callee) {
+				++count;
+			}
+		}
+	}
+
+	return count;
+}
+}
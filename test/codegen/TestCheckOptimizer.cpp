@@ -0,0 +1,191 @@
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Verifier.h>
+
+#include "Doctest.h"
+#include "TestUtil.h"
+#include "codegen/CodeGen.h"
+
+using namespace gen;
+using namespace test;
+
+namespace {
+Box<CodeGenContext> lower(const U8String &source) {
+	return CodeGen::lower(*checkSource(source));
+}
+
+u32 countChecks(const llvm::Function &func, const char *panic, bool fast = false) {
+	u32 count = 0;
+
+	for (const auto &block : func) {
+		if (fast && !block.getName().endswith(".fast")) {
+			continue;
+		}
+
+		for (const auto *succ : llvm::successors(&block)) {
+			count += CodeGenContext::isCallTo(succ->front(), panic);
+		}
+	}
+
+	return count;
+}
+}
+
+TEST_CASE("CheckOptimizer: A dominating check proves the same index") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func main() -> i32 {\n"
+						   "\txs: []i32 = array[4]i32;\n"
+						   "\ti: i32 = read_i32();\n"
+						   "\txs[i] = xs[i] + 1;\n"
+						   "\tif (xs[i] > 0) {\n"
+						   "\t\treturn xs[3] + xs[0];\n"
+						   "\t}\n"
+						   "\treturn xs[i];\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	// xs[i] once, and xs[3] which also proves xs[0].
+	CHECK(countChecks(*main, CodeGenContext::panicOutOfBounds) == 2);
+}
+
+TEST_CASE("CheckOptimizer: A loop condition proves an index counting up from zero") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func main() -> i32 {\n"
+						   "\txs: []i32 = array[4]i32;\n"
+						   "\ti: i32 = 0;\n"
+						   "\twhile (i < len(xs)) {\n"
+						   "\t\txs[i] = i;\n"
+						   "\t\ti = i + 1;\n"
+						   "\t}\n"
+						   "\tj: i32 = 3;\n"
+						   "\twhile (j < len(xs)) {\n"
+						   "\t\txs[j] = j;\n"
+						   "\t\tj = j - 1;\n"
+						   "\t}\n"
+						   "\treturn 0;\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	// Only the second loop, as j may become negative.
+	CHECK(countChecks(*main, CodeGenContext::panicOutOfBounds) == 1);
+}
+
+TEST_CASE("CheckOptimizer: A check on only some paths proves nothing") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func main() -> i32 {\n"
+						   "\txs: []i32 = array[4]i32;\n"
+						   "\ti: i32 = read_i32();\n"
+						   "\tif (i > 2) {\n"
+						   "\t\txs[i] = 1;\n"
+						   "\t}\n"
+						   "\treturn xs[i];\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	CHECK(countChecks(*main, CodeGenContext::panicOutOfBounds) == 2);
+}
+
+TEST_CASE("CheckOptimizer: A counted loop gets a copy without bounds checks") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func axpy(a: []i32, b: []i32, n: i32) -> i32 {\n"
+						   "\ti: i32 = 0;\n"
+						   "\ts: i32 = 0;\n"
+						   "\twhile (i < n) {\n"
+						   "\t\ta[i] = a[i] + 2 * b[i];\n"
+						   "\t\ts = s + a[i];\n"
+						   "\t\ti = i + 1;\n"
+						   "\t}\n"
+						   "\treturn s;\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\txs: []i32 = array[4]i32;\n"
+						   "\treturn axpy(xs, array[4]i32, read_i32());\n"
+						   "}\n");
+
+	// Assert
+	const auto *axpy = ctx->llvmModule.getFunction("axpy.borrowed");
+	REQUIRE(axpy != nullptr);
+	CHECK_FALSE(llvm::verifyFunction(*axpy, &llvm::errs()));
+	CHECK(countChecks(*axpy, CodeGenContext::panicOutOfBounds) == 2);
+	CHECK(countChecks(*axpy, CodeGenContext::panicOutOfBounds, true) == 0);
+	CHECK(std::ranges::any_of(*axpy, [](const llvm::BasicBlock &block) {
+		return block.getName() == "while.body.fast";
+	}));
+}
+
+TEST_CASE("CheckOptimizer: A loop whose bound changes is not versioned") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func main() -> i32 {\n"
+						   "\txs: []i32 = array[4]i32;\n"
+						   "\ti: i32 = 0;\n"
+						   "\tn: i32 = 8;\n"
+						   "\twhile (i < n) {\n"
+						   "\t\txs[i] = i;\n"
+						   "\t\tn = n - 1;\n"
+						   "\t\ti = i + 1;\n"
+						   "\t}\n"
+						   "\treturn 0;\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	CHECK(countChecks(*main, CodeGenContext::panicOutOfBounds) == 1);
+	CHECK(std::ranges::none_of(*main, [](const llvm::BasicBlock &block) {
+		return block.getName().endswith(".fast");
+	}));
+}
+
+TEST_CASE("CheckOptimizer: Pointers that are created, compared or dereferenced are not null") {
+	// Arrange & Act
+	const auto ctx = lower(u8"struct Node { v: i32, next: *Node }\n"
+						   "func f(p: *i32, n: *Node) -> i32 {\n"
+						   "\tq: *i32 = new i32(3);\n"
+						   "\ts: i32 = *q + *q;\n"
+						   "\tif (p != null) {\n"
+						   "\t\ts = s + *p;\n"
+						   "\t}\n"
+						   "\ts = s + (*n).v + (*n).v;\n"
+						   "\tif ((*n).next != null) {\n"
+						   "\t\tm: *Node = (*n).next;\n"
+						   "\t\ts = s + (*m).v;\n"
+						   "\t}\n"
+						   "\treturn s;\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\treturn f(new i32(1), new Node { 1, null });\n"
+						   "}\n");
+
+	// Assert
+	const auto *f = ctx->llvmModule.getFunction("f.borrowed");
+	REQUIRE(f != nullptr);
+	// Only the first dereference of n.
+	CHECK(countChecks(*f, CodeGenContext::panicNullDeref) == 1);
+	CHECK(std::ranges::any_of(llvm::instructions(*f), [](const llvm::Instruction &inst) {
+		return inst.hasMetadata(llvm::LLVMContext::MD_nonnull);
+	}));
+}
+
+TEST_CASE("CheckOptimizer: A store in between keeps the check of a loaded pointer") {
+	// Arrange & Act
+	const auto ctx = lower(u8"struct Link { v: i32, next: *Link }\n"
+						   "func main() -> i32 {\n"
+						   "\tn: *Link = new Link { 1, new Link { 2, null } };\n"
+						   "\tif ((*n).next != null) {\n"
+						   "\t\t(*n).next = null;\n"
+						   "\t\tm: *Link = (*n).next;\n"
+						   "\t\treturn (*m).v;\n"
+						   "\t}\n"
+						   "\treturn 0;\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	CHECK(countChecks(*main, CodeGenContext::panicNullDeref) == 1);
+}
@@ -0,0 +1,512 @@
+#include "Doctest.h"
+#include "TestUtil.h"
+#include "codegen/CodeGen.h"
+
+using namespace gen;
+using namespace test;
+
+namespace {
+Box<CodeGenContext> lower(const U8String &source, Vec<ErrorMessage> *warnings = nullptr,
+						  const CodeGenOptions &options = {}) {
+	ErrorHandler err(u8"test.ocn", source);
+	const auto module = checkSource(source, err, {.effectAnalysis = true});
+	auto lowered = CodeGen::lower(*module, {}, &err, options);
+
+	if (warnings) {
+		*warnings = err.getErrors();
+	}
+
+	return lowered;
+}
+
+u32 countTailCalls(const llvm::Function &func) {
+	u32 count = 0;
+
+	for (const auto &block : func) {
+		for (const auto &inst : block) {
+			const auto *call = llvm::dyn_cast<llvm::CallInst>(&inst);
+			count += call && call->isMustTailCall();
+		}
+	}
+
+	return count;
+}
+
+u32 countReturns(const llvm::Function &func) {
+	u32 count = 0;
+
+	for (const auto &block : func) {
+		count += llvm::isa<llvm::ReturnInst>(block.getTerminator());
+	}
+
+	return count;
+}
+}
+
+TEST_CASE("CodeGen: Returns share the cleanup of the scopes they leave") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func pick(k: i32) -> i32 {\n"
+						   "\ta: *i32 = new i32(1);\n"
+						   "\tif (k == 0) {\n"
+						   "\t\treturn 0;\n"
+						   "\t}\n"
+						   "\tb: *i32 = new i32(2);\n"
+						   "\tif (k == 1) {\n"
+						   "\t\tc: *i32 = new i32(3);\n"
+						   "\t\tif (*c == k) {\n"
+						   "\t\t\treturn *c;\n"
+						   "\t\t}\n"
+						   "\t\treturn *b;\n"
+						   "\t}\n"
+						   "\tif (k == 2) {\n"
+						   "\t\treturn *b + 1;\n"
+						   "\t}\n"
+						   "\treturn *a;\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\treturn pick(1);\n"
+						   "}\n");
+
+	// Assert
+	const auto *pick = ctx->llvmModule.getFunction("pick");
+	REQUIRE(pick != nullptr);
+	CHECK(countReturns(*pick) == 1);
+	// a after the first return, c once and a and b once for the other four returns.
+	CHECK(countCalls(*pick, CodeGenContext::sharedPtrDrop) == 4);
+}
+
+TEST_CASE("CodeGen: Returns that move out different locals get their own cleanup") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func pick(k: i32) -> *i32 {\n"
+						   "\ta: *i32 = new i32(1);\n"
+						   "\tb: *i32 = new i32(2);\n"
+						   "\tif (k == 0) {\n"
+						   "\t\treturn a;\n"
+						   "\t}\n"
+						   "\treturn b;\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tp: *i32 = pick(1);\n"
+						   "\treturn *p;\n"
+						   "}\n");
+
+	// Assert
+	const auto *pick = ctx->llvmModule.getFunction("pick");
+	REQUIRE(pick != nullptr);
+	CHECK(countReturns(*pick) == 1);
+	CHECK(countCalls(*pick, CodeGenContext::sharedPtrDrop) == 2);
+}
+
+TEST_CASE("CodeGen: Safety checks of a function share one cold panic block per kind") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func sum(xs: []i32, p: *i32, q: *i32) -> i32 {\n"
+						   "\treturn xs[0] + xs[1] + xs[2] + *p + *q;\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\treturn sum(array[3]i32, new i32(1), new i32(2));\n"
+						   "}\n");
+
+	// Assert
+	const auto *sum = ctx->llvmModule.getFunction("sum.borrowed");
+	REQUIRE(sum != nullptr);
+	CHECK(countCalls(*sum, CodeGenContext::panicOutOfBounds) == 1);
+	CHECK(countCalls(*sum, CodeGenContext::panicNullDeref) == 1);
+
+	const auto *panic = ctx->llvmModule.getFunction(CodeGenContext::panicOutOfBounds);
+	REQUIRE(panic != nullptr);
+	CHECK(panic->hasFnAttribute(llvm::Attribute::NoReturn));
+	CHECK(panic->hasFnAttribute(llvm::Attribute::Cold));
+}
+
+TEST_CASE("CodeGen: The right operand of && and || only runs if it decides the result") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func check(p: *i32, q: *i32) -> bool {\n"
+						   "\treturn (p != null && *p > 0) || *q > 0;\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tcheck(null, new i32(1));\n"
+						   "\treturn 0;\n"
+						   "}\n");
+
+	// Assert
+	const auto *check = ctx->llvmModule.getFunction("check.borrowed");
+	REQUIRE(check != nullptr);
+	// p is tested before it is dereferenced, only the dereference of q is checked.
+	CHECK(countCalls(*check, CodeGenContext::panicNullDeref) == 1);
+
+	u32 phis = 0;
+	for (const auto &block : *check) {
+		phis += llvm::isa<llvm::PHINode>(block.front());
+	}
+	CHECK(phis == 2);
+}
+
+TEST_CASE("CodeGen: A whole program only keeps the functions main uses and makes them internal") {
+	// Arrange & Act
+	const auto ctx = lower(u8"struct UnusedThing {\n"
+						   "\tx: i32\n"
+						   "}\n"
+						   "struct UsedThing {\n"
+						   "\tx: i32\n"
+						   "}\n"
+						   "func unused(t: UnusedThing) -> i32 {\n"
+						   "\treturn t.x;\n"
+						   "}\n"
+						   "func used(n: i32) -> i32 {\n"
+						   "\tt: *UsedThing = new UsedThing { n };\n"
+						   "\treturn *t.x;\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\treturn used(read_i32());\n"
+						   "}\n");
+
+	// Assert
+	CHECK(ctx->llvmModule.getFunction("unused") == nullptr);
+	CHECK(ctx->llvmModule.getFunction(getStructDtorName(u8"UnusedThing").asAscii()) == nullptr);
+
+	const auto *used = ctx->llvmModule.getFunction("used");
+	REQUIRE(used != nullptr);
+	CHECK(used->hasInternalLinkage());
+
+	const auto *dtor = ctx->llvmModule.getFunction(getStructDtorName(u8"UsedThing").asAscii());
+	REQUIRE(dtor != nullptr);
+	CHECK(dtor->hasInternalLinkage());
+
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	CHECK(main->hasExternalLinkage());
+}
+
+TEST_CASE("CodeGen: Inferred effects of functions become attributes") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func square(x: i32) -> i32 {\n"
+						   "\treturn x * x;\n"
+						   "}\n"
+						   "func size(xs: []i32) -> i32 {\n"
+						   "\treturn len(xs);\n"
+						   "}\n"
+						   "func peek(p: *i32) -> i32 {\n"
+						   "\treturn *p;\n"
+						   "}\n"
+						   "func make(n: i32) -> *i32 {\n"
+						   "\treturn new i32(n);\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tp: *i32 = make(read_i32());\n"
+						   "\treturn square(*p) + size(array[2]i32) + peek(p);\n"
+						   "}\n");
+
+	// Assert
+	const auto *square = ctx->llvmModule.getFunction("square");
+	REQUIRE(square != nullptr);
+	CHECK(square->doesNotAccessMemory());
+	CHECK(square->hasFnAttribute(llvm::Attribute::WillReturn));
+	CHECK(square->doesNotThrow());
+
+	const auto *size = ctx->llvmModule.getFunction("size.borrowed");
+	REQUIRE(size != nullptr);
+	CHECK(size->onlyReadsMemory());
+	CHECK_FALSE(size->doesNotAccessMemory());
+
+	// A null pointer makes peek panic, so calls of it must stay.
+	const auto *peek = ctx->llvmModule.getFunction("peek.borrowed");
+	REQUIRE(peek != nullptr);
+	CHECK_FALSE(peek->onlyReadsMemory());
+	CHECK_FALSE(peek->hasFnAttribute(llvm::Attribute::WillReturn));
+	CHECK(peek->hasParamAttribute(0, llvm::Attribute::NoCapture));
+
+	const auto *make = ctx->llvmModule.getFunction("make");
+	REQUIRE(make != nullptr);
+	CHECK(make->returnDoesNotAlias());
+	CHECK_FALSE(make->onlyReadsMemory());
+}
+
+TEST_CASE("CodeGen: Drops of values with destructors call the destructor directly") {
+	// Arrange & Act
+	const auto ctx = lower(u8"struct DirectBox {\n"
+						   "\tn: i32,\n"
+						   "\tp: *i32\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tb: *DirectBox = new DirectBox { read_i32(), new i32(1) };\n"
+						   "\tbs: []*DirectBox = array[2]*DirectBox;\n"
+						   "\tbs[0] = b;\n"
+						   "\treturn *b.n;\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	CHECK(countCalls(*main, CodeGenContext::sharedPtrDrop) == 0);
+	CHECK(countCalls(*main, CodeGenContext::arrayDrop) == 0);
+	// The assignment drops the element it replaces, the end of main drops b.
+	CHECK(countCalls(*main, "__sp_drop.__dtor_DirectBox") == 2);
+	CHECK(countCalls(*main, "__arr_drop.__dtor_ptr.__dtor_DirectBox") == 1);
+
+	const auto *drop = ctx->llvmModule.getFunction("__sp_drop.__dtor_DirectBox");
+	REQUIRE(drop != nullptr);
+	CHECK(countCalls(*drop, "__dtor_DirectBox") == 1);
+
+	// Pointers to values without a destructor are left to the runtime, which calls nothing.
+	const auto *dtor = ctx->llvmModule.getFunction("__dtor_DirectBox");
+	REQUIRE(dtor != nullptr);
+	CHECK(countCalls(*dtor, "__dtor_ptr") == 1);
+
+	for (const auto &func : ctx->llvmModule) {
+		for (const auto &block : func) {
+			for (const auto &inst : block) {
+				const auto *call = llvm::dyn_cast<llvm::CallInst>(&inst);
+				CHECK_FALSE((call && call->isIndirectCall()));
+			}
+		}
+	}
+}
+
+TEST_CASE("CodeGen: Recursive calls in tail position become guaranteed tail calls") {
+	// Arrange & Act
+	Vec<ErrorMessage> warnings;
+	const auto ctx = lower(u8"struct TailNode {\n"
+						   "\tv: i32,\n"
+						   "\tnext: *TailNode\n"
+						   "}\n"
+						   "func nth(node: *TailNode, i: i32) -> i32 {\n"
+						   "\tif (i == 0) {\n"
+						   "\t\treturn *node.v;\n"
+						   "\t}\n"
+						   "\treturn nth(*node.next, i - 1);\n"
+						   "}\n"
+						   "func isEven(n: i32) -> bool {\n"
+						   "\tif (n == 0) {\n"
+						   "\t\treturn true;\n"
+						   "\t}\n"
+						   "\treturn isOdd(n - 1);\n"
+						   "}\n"
+						   "func isOdd(n: i32) -> bool {\n"
+						   "\tif (n == 0) {\n"
+						   "\t\treturn false;\n"
+						   "\t}\n"
+						   "\treturn isEven(n - 1);\n"
+						   "}\n"
+						   "func keep(n: i32, p: *TailNode) -> i32 {\n"
+						   "\tlocal: *TailNode = new TailNode { n, p };\n"
+						   "\tif (n == 0) {\n"
+						   "\t\treturn 0;\n"
+						   "\t}\n"
+						   "\treturn keep(n - 1, local);\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tp: *TailNode = new TailNode { 1, null };\n"
+						   "\tprint_bool(isEven(read_i32()));\n"
+						   "\treturn nth(p, 0) + keep(read_i32(), p);\n"
+						   "}\n",
+						   &warnings);
+
+	// Assert
+	const auto *nth = ctx->llvmModule.getFunction("nth.borrowed");
+	REQUIRE(nth != nullptr);
+	CHECK(countTailCalls(*nth) == 1);
+	CHECK(countCalls(*nth, "nth.borrowed") == 1);
+
+	for (const auto *name : {"isEven", "isOdd"}) {
+		const auto *func = ctx->llvmModule.getFunction(name);
+		REQUIRE(func != nullptr);
+		CHECK(countTailCalls(*func) == 1);
+	}
+
+	// The local has to outlive the call that borrows it, so it cannot be dropped before.
+	const auto *keep = ctx->llvmModule.getFunction("keep.borrowed");
+	REQUIRE(keep != nullptr);
+	CHECK(countTailCalls(*keep) == 0);
+
+	REQUIRE(warnings.size() == 1);
+	CHECK(warnings[0].level == ErrorLevel::WARNING);
+	CHECK(warnings[0].message.asAscii().find("'keep'") != std::string::npos);
+}
+
+TEST_CASE("CodeGen: Reordered struct fields keep their declaration order in the language") {
+	// Arrange & Act
+	const auto ctx = lower(u8"struct PackedNode {\n"
+						   "\tflag: bool,\n"
+						   "\tnext: *PackedNode,\n"
+						   "\tb: bool,\n"
+						   "\tx: i32\n"
+						   "}\n"
+						   "func make(x: i32) -> PackedNode {\n"
+						   "\treturn PackedNode { true, null, false, x };\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tn: PackedNode = make(read_i32());\n"
+						   "\treturn n.x;\n"
+						   "}\n",
+						   nullptr, {.reorderFields = true});
+
+	// Assert
+	auto *const structType = llvm::StructType::getTypeByName(ctx->llvmContext, "PackedNode");
+	REQUIRE(structType != nullptr);
+	REQUIRE(structType->getNumElements() == 4);
+	CHECK(structType->getElementType(0)->isPointerTy());
+	CHECK(structType->getElementType(1)->isIntegerTy(32));
+	CHECK(structType->getElementType(2)->isIntegerTy(1));
+	CHECK(structType->getElementType(3)->isIntegerTy(1));
+
+	CHECK(ctx->typeConverter.getFieldIndex(u8"PackedNode", 0) == 2);
+	CHECK(ctx->typeConverter.getFieldIndex(u8"PackedNode", 1) == 0);
+	CHECK(ctx->typeConverter.getFieldIndex(u8"PackedNode", 3) == 1);
+
+	// The argument for x goes into the slot of x.
+	const auto *make = ctx->llvmModule.getFunction("make");
+	REQUIRE(make != nullptr);
+	bool insertsX = false;
+	for (const auto &block : *make) {
+		for (const auto &inst : block) {
+			const auto *insert = llvm::dyn_cast<llvm::InsertValueInst>(&inst);
+			if (insert && insert->getInsertedValueOperand() == make->getArg(0)) {
+				insertsX = insert->getIndices()[0] == 1;
+			}
+		}
+	}
+	CHECK(insertsX);
+
+	// In declaration order, the pointer and the i32 would each follow a bool and need padding.
+	CHECK(ctx->llvmModule.getDataLayout().getTypeAllocSize(structType) == 16);
+}
+
+TEST_CASE("CodeGen: Bool arrays are packed into bits") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func main() -> i32 {\n"
+						   "\tflags: []bool = array[read_i32()]bool;\n"
+						   "\tflags[read_i32()] = read_bool();\n"
+						   "\tif (flags[read_i32()]) {\n"
+						   "\t\treturn len(flags);\n"
+						   "\t}\n"
+						   "\treturn popcount(flags);\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+
+	u32 bitLoads = 0;
+	u32 bitStores = 0;
+	for (const auto &block : *main) {
+		for (const auto &inst : block) {
+			const auto *call = llvm::dyn_cast<llvm::CallInst>(&inst);
+			if (call && call->getCalledFunction() &&
+				call->getCalledFunction()->getName() == CodeGenContext::arrayCreate) {
+				// The runtime allocates whole words of 8 bytes.
+				const auto *elementSize = llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(0));
+				REQUIRE(elementSize != nullptr);
+				CHECK(elementSize->getZExtValue() == 8);
+			}
+
+			if (const auto *load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+				bitLoads += load->getType()->isIntegerTy(64);
+				CHECK_FALSE(load->getType()->isIntegerTy(1));
+			}
+
+			if (const auto *store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+				bitStores += store->getValueOperand()->getType()->isIntegerTy(64);
+			}
+		}
+	}
+
+	// The assignment loads the word it changes, the condition loads the word it tests.
+	CHECK(bitLoads == 2);
+	CHECK(bitStores == 1);
+	CHECK(countCalls(*main, CodeGenContext::builtinPopcount) == 1);
+
+	const auto *popcount = ctx->llvmModule.getFunction(CodeGenContext::builtinPopcount);
+	REQUIRE(popcount != nullptr);
+	CHECK_FALSE(popcount->isDeclaration());
+	CHECK(popcount->hasInternalLinkage());
+	CHECK(countCalls(*popcount, "llvm.ctpop.i64") == 1);
+}
+
+TEST_CASE("CodeGen: Locals of nested scopes get lifetimes and struct drops share one slot") {
+	// Arrange & Act
+	const auto ctx = lower(u8"struct SlotBox {\n"
+						   "\tn: i32,\n"
+						   "\tp: *i32\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tif (read_bool()) {\n"
+						   "\t\ta: SlotBox = SlotBox { read_i32(), new i32(1) };\n"
+						   "\t\tx: i32 = a.n;\n"
+						   "\t\tprint_i32(x);\n"
+						   "\t}\n"
+						   "\tif (read_bool()) {\n"
+						   "\t\tb: SlotBox = SlotBox { read_i32(), new i32(2) };\n"
+						   "\t\ty: i32 = b.n;\n"
+						   "\t\tprint_i32(y);\n"
+						   "\t}\n"
+						   "\treturn 0;\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+
+	u32 dropSlots = 0;
+	u32 lifetimeStarts = 0;
+	u32 lifetimeEnds = 0;
+	for (const auto &block : *main) {
+		for (const auto &inst : block) {
+			if (const auto *alloca = llvm::dyn_cast<llvm::AllocaInst>(&inst)) {
+				dropSlots += std::string_view(alloca->getName()).starts_with("tmp.struct.drop");
+				// The i32 locals live in registers.
+				CHECK(alloca->getAllocatedType()->isStructTy());
+			}
+
+			const auto *call = llvm::dyn_cast<llvm::CallInst>(&inst);
+			if (call && call->getCalledFunction()) {
+				const std::string_view name = call->getCalledFunction()->getName();
+				lifetimeStarts += name.starts_with("llvm.lifetime.start");
+				lifetimeEnds += name.starts_with("llvm.lifetime.end");
+			}
+		}
+	}
+
+	// Both drops of a SlotBox store it in the same slot.
+	CHECK(dropSlots == 1);
+	// a, b and each use of the drop slot are enclosed in their own lifetime. The field accesses
+	// keep a and b in memory.
+	CHECK(lifetimeStarts == 4);
+	CHECK(lifetimeEnds == 4);
+}
+
+TEST_CASE("CodeGen: Struct initializers store their fields right into heap cells") {
+	// Arrange & Act
+	const auto ctx = lower(u8"struct InPlaceInner {\n"
+						   "\tn: i32,\n"
+						   "\tp: *i32\n"
+						   "}\n"
+						   "struct InPlaceOuter {\n"
+						   "\tinner: InPlaceInner,\n"
+						   "\tm: i32\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tboxed: *InPlaceOuter = new InPlaceOuter {\n"
+						   "\t\tInPlaceInner { read_i32(), new i32(2) }, read_i32() };\n"
+						   "\treturn 0;\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+
+	u32 fieldStores = 0;
+	for (const auto &block : *main) {
+		for (const auto &inst : block) {
+			CHECK_FALSE(llvm::isa<llvm::InsertValueInst>(&inst));
+
+			const auto *store = llvm::dyn_cast<llvm::StoreInst>(&inst);
+			if (store && llvm::isa<llvm::GetElementPtrInst>(store->getPointerOperand())) {
+				CHECK_FALSE(store->getValueOperand()->getType()->isStructTy());
+				++fieldStores;
+			}
+		}
+	}
+
+	// The initializer stores n, p and m, but never a whole struct.
+	CHECK(fieldStores == 3);
+}
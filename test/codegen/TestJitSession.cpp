@@ -0,0 +1,88 @@
+#include "Doctest.h"
+#include "TestUtil.h"
+#include "codegen/CodeGen.h"
+#include "codegen/JitSession.h"
+
+// Provided by ocn_stdlib.c, which is linked into the tests like into the compiler.
+extern "C" {
+void *__sp_create(size_t, void (*)(void *));
+void __ocn_free(void *);
+}
+
+using namespace gen;
+
+namespace {
+Box<CodeGenContext> lower(const U8String &source) {
+	ErrorHandler err(u8"test.ocn", source);
+	const auto module =
+			test::checkSource(source, err, {.constantEvaluation = true, .effectAnalysis = true});
+	return CodeGen::lower(*module, {}, &err);
+}
+
+void requireSuccess(llvm::Error err) {
+	if (err) {
+		FAIL(llvm::toString(std::move(err)));
+	}
+}
+
+template <typename T>
+T requireValue(llvm::Expected<T> value) {
+	if (!value) {
+		FAIL(llvm::toString(value.takeError()));
+	}
+
+	return std::move(value.get());
+}
+}
+
+TEST_CASE("JitSession: Runs main and returns its exit code") {
+	// Arrange
+	auto session = requireValue(JitSession::create());
+	const auto ctx = lower(u8"struct JitBox {\n"
+						   "\tn: i32,\n"
+						   "\tp: *i32\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tb: *JitBox = new JitBox { 2, new i32(40) };\n"
+						   "\treturn (*b).n + *((*b).p);\n"
+						   "}\n");
+
+	// Dropping b frees its cell directly instead of going through the runtime.
+	REQUIRE(ctx->llvmModule.getFunction(CodeGenContext::runtimeFree) != nullptr);
+
+	// Act
+	requireSuccess(session->addModule(*ctx));
+	const auto exitCode = requireValue(session->runMain("test", {}));
+
+	// Assert
+	CHECK(exitCode == 42);
+}
+
+TEST_CASE("JitSession: Runtime functions resolve to the runtime linked into the process") {
+	// Arrange
+	auto session = requireValue(JitSession::create());
+	const auto ctx = lower(u8"func main() -> i32 {\n"
+						   "\treturn 0;\n"
+						   "}\n");
+	requireSuccess(session->addModule(*ctx));
+
+	// Act
+	auto *createAddress = requireValue(session->lookup(U8String(CodeGenContext::sharedPtrCreate)));
+	auto *freeAddress = requireValue(session->lookup(U8String(CodeGenContext::runtimeFree)));
+
+	// Assert
+	CHECK(createAddress == reinterpret_cast<void *>(&__sp_create));
+	CHECK(freeAddress == reinterpret_cast<void *>(&__ocn_free));
+}
+
+TEST_CASE("JitSession: Looking up a function that no module defines fails") {
+	// Arrange
+	auto session = requireValue(JitSession::create());
+
+	// Act
+	auto missing = session->lookup(u8"missing");
+
+	// Assert
+	CHECK_FALSE(static_cast<bool>(missing));
+	llvm::consumeError(missing.takeError());
+}
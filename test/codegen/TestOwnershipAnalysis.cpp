@@ -0,0 +1,192 @@
+#include "Doctest.h"
+#include "TestUtil.h"
+#include "codegen/OwnershipAnalysis.h"
+
+using namespace gen;
+
+namespace {
+Box<ast::Module> check(const U8String &source) {
+	return test::checkSource(source);
+}
+
+const ast::VarDef &getLocal(const ast::Module &module, const u32 func, const u32 stmt) {
+	return static_cast<const ast::VarDef &>(*module.funcs[func]->body->stmts[stmt]);
+}
+}
+
+TEST_CASE("OwnershipAnalysis: Parameters that are never assigned are borrowed") {
+	// Arrange
+	const auto module = check(u8"func foo(a: *i32, b: *i32, c: i32) -> i32 {\n"
+							  "\tb = a;\n"
+							  "\treturn *a + c;\n"
+							  "}\n"
+							  "func bar(c: i32) -> i32 {\n"
+							  "\treturn c;\n"
+							  "}\n"
+							  "func main() -> i32 {\n"
+							  "\treturn 0;\n"
+							  "}\n");
+
+	// Act
+	const auto ownership = OwnershipAnalysis::analyze(*module);
+
+	// Assert
+	const auto *foo = ownership.getBorrowedParams(u8"foo");
+	REQUIRE(foo != nullptr);
+	CHECK(*foo == Vec<bool>{true, false, false});
+	CHECK(ownership.getBorrowedParams(u8"bar") == nullptr);
+}
+
+TEST_CASE("OwnershipAnalysis: A cursor walking a list borrows from the list") {
+	// Arrange
+	const auto module = check(u8"struct BorrowWalkNode {\n"
+							  "\tdata: i32,\n"
+							  "\tnext: *BorrowWalkNode\n"
+							  "}\n"
+							  "func sum(list: *BorrowWalkNode) -> i32 {\n"
+							  "\tcurrent: *BorrowWalkNode = list;\n"
+							  "\ts: i32 = 0;\n"
+							  "\twhile (current != null) {\n"
+							  "\t\ts += *current.data;\n"
+							  "\t\tcurrent = *current.next;\n"
+							  "\t}\n"
+							  "\treturn s;\n"
+							  "}\n"
+							  "func main() -> i32 {\n"
+							  "\treturn 0;\n"
+							  "}\n");
+
+	// Act
+	const auto ownership = OwnershipAnalysis::analyze(*module);
+
+	// Assert
+	CHECK(ownership.isBorrowed(getLocal(*module, 0, 0)));
+	CHECK_FALSE(ownership.isBorrowed(getLocal(*module, 0, 1)));
+}
+
+TEST_CASE("OwnershipAnalysis: A cursor used after a store owns its value") {
+	// Arrange
+	const auto module = check(u8"struct BorrowStoreNode {\n"
+							  "\tdata: i32,\n"
+							  "\tnext: *BorrowStoreNode\n"
+							  "}\n"
+							  "func cut(list: *BorrowStoreNode) -> i32 {\n"
+							  "\tsecond: *BorrowStoreNode = *list.next;\n"
+							  "\t*list.next = null;\n"
+							  "\treturn *second.data;\n"
+							  "}\n"
+							  "func last(list: *BorrowStoreNode) -> i32 {\n"
+							  "\tsecond: *BorrowStoreNode = *list.next;\n"
+							  "\t*list.next = null;\n"
+							  "\treturn *list.data;\n"
+							  "}\n"
+							  "func main() -> i32 {\n"
+							  "\treturn 0;\n"
+							  "}\n");
+
+	// Act
+	const auto ownership = OwnershipAnalysis::analyze(*module);
+
+	// Assert
+	CHECK_FALSE(ownership.isBorrowed(getLocal(*module, 0, 0)));
+	CHECK(ownership.isBorrowed(getLocal(*module, 1, 0)));
+}
+
+TEST_CASE("OwnershipAnalysis: Only locals of the caller are passed as borrowed arguments") {
+	// Arrange
+	const auto module = check(u8"struct BorrowArgNode {\n"
+							  "\tdata: i32,\n"
+							  "\tnext: *BorrowArgNode\n"
+							  "}\n"
+							  "func get(node: *BorrowArgNode) -> i32 {\n"
+							  "\treturn *node.data;\n"
+							  "}\n"
+							  "func main() -> i32 {\n"
+							  "\tnode: *BorrowArgNode = new BorrowArgNode { 1, null };\n"
+							  "\treturn get(node) + get(*node.next);\n"
+							  "}\n");
+
+	// Act
+	const auto ownership = OwnershipAnalysis::analyze(*module);
+
+	// Assert
+	const auto &ret = static_cast<const ast::ReturnStmt &>(*module->funcs[1]->body->stmts[1]);
+	const auto &sum = static_cast<const ast::BinaryExpr &>(*ret.expr);
+	CHECK(ownership.isBorrowedArg(*static_cast<const ast::FuncCall &>(*sum.left).args[0]));
+	CHECK_FALSE(ownership.isBorrowedArg(*static_cast<const ast::FuncCall &>(*sum.right).args[0]));
+}
+
+TEST_CASE("OwnershipAnalysis: Returning an owned local moves it") {
+	// Arrange
+	const auto module = check(u8"struct MoveNode {\n"
+							  "\tdata: i32\n"
+							  "}\n"
+							  "func make() -> *MoveNode {\n"
+							  "\tnode: *MoveNode = new MoveNode { 1 };\n"
+							  "\t*node.data = 2;\n"
+							  "\treturn node;\n"
+							  "}\n"
+							  "func main() -> i32 {\n"
+							  "\treturn 0;\n"
+							  "}\n");
+
+	// Act
+	const auto ownership = OwnershipAnalysis::analyze(*module);
+
+	// Assert
+	const auto &ret = static_cast<const ast::ReturnStmt &>(*module->funcs[0]->body->stmts[2]);
+	CHECK(ownership.isMove(static_cast<const ast::VarRef &>(*ret.expr)));
+	CHECK(ownership.getMovedLocals(ret).contains(&getLocal(*module, 0, 0)));
+}
+
+TEST_CASE("OwnershipAnalysis: Only the last use of an owned local moves it") {
+	// Arrange
+	const auto module = check(u8"struct MovePairNode {\n"
+							  "\tdata: i32\n"
+							  "}\n"
+							  "struct MovePair {\n"
+							  "\tfirst: *MovePairNode,\n"
+							  "\tsecond: *MovePairNode\n"
+							  "}\n"
+							  "func main() -> i32 {\n"
+							  "\tnode: *MovePairNode = new MovePairNode { 1 };\n"
+							  "\tpair: MovePair = MovePair { node, node };\n"
+							  "\treturn 0;\n"
+							  "}\n");
+
+	// Act
+	const auto ownership = OwnershipAnalysis::analyze(*module);
+
+	// Assert
+	const auto &init = static_cast<const ast::StructInit &>(*getLocal(*module, 0, 1).value);
+	CHECK_FALSE(ownership.isMove(static_cast<const ast::VarRef &>(*init.args[0])));
+	CHECK(ownership.isMove(static_cast<const ast::VarRef &>(*init.args[1])));
+}
+
+TEST_CASE("OwnershipAnalysis: A use within a loop does not move a local declared outside") {
+	// Arrange
+	const auto module = check(u8"struct MoveLoopNode {\n"
+							  "\tdata: i32\n"
+							  "}\n"
+							  "struct MoveLoopBox {\n"
+							  "\tnode: *MoveLoopNode\n"
+							  "}\n"
+							  "func main() -> i32 {\n"
+							  "\tnode: *MoveLoopNode = new MoveLoopNode { 1 };\n"
+							  "\ti: i32 = 0;\n"
+							  "\twhile (i < 2) {\n"
+							  "\t\tbox: MoveLoopBox = MoveLoopBox { node };\n"
+							  "\t\ti += 1;\n"
+							  "\t}\n"
+							  "\treturn 0;\n"
+							  "}\n");
+
+	// Act
+	const auto ownership = OwnershipAnalysis::analyze(*module);
+
+	// Assert
+	const auto &loop = static_cast<const ast::WhileStmt &>(*module->funcs[0]->body->stmts[2]);
+	const auto &box = static_cast<const ast::VarDef &>(*loop.body->stmts[0]);
+	const auto &init = static_cast<const ast::StructInit &>(*box.value);
+	CHECK_FALSE(ownership.isMove(static_cast<const ast::VarRef &>(*init.args[0])));
+}
@@ -0,0 +1,129 @@
+#include "Doctest.h"
+#include "TestUtil.h"
+#include "codegen/CodeGen.h"
+
+using namespace gen;
+using namespace test;
+
+namespace {
+Box<CodeGenContext> lower(const U8String &source) {
+	return CodeGen::lower(*checkSource(source));
+}
+
+u32 countAllocas(const llvm::Function &func) {
+	u32 count = 0;
+
+	for (const auto &inst : func.getEntryBlock()) {
+		count += llvm::isa<llvm::AllocaInst>(inst);
+	}
+
+	return count;
+}
+}
+
+TEST_CASE("RcOptimizer: Locals are promoted to values") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func main() -> i32 {\n"
+						   "\tp: *i32 = new i32(1);\n"
+						   "\txs: []i32 = array[2]i32;\n"
+						   "\ti: i32 = 1;\n"
+						   "\treturn *p + xs[i];\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	CHECK(countAllocas(*main) == 0);
+}
+
+TEST_CASE("RcOptimizer: A copy and a later drop of the same value cancel out") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func main() -> i32 {\n"
+						   "\tn: *i32 = new i32(1);\n"
+						   "\tm: *i32 = n;\n"
+						   "\tprint_i32(*m);\n"
+						   "\tm = new i32(2);\n"
+						   "\txs: []i32 = array[3]i32;\n"
+						   "\tys: []i32 = xs;\n"
+						   "\tys[0] = 4;\n"
+						   "\tys = array[2]i32;\n"
+						   "\treturn *m + *n + xs[0];\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	CHECK(countCalls(*main, CodeGenContext::sharedPtrCopy) == 0);
+	CHECK(countCalls(*main, CodeGenContext::sharedPtrDrop) == 2);
+	CHECK(countCalls(*main, CodeGenContext::arrayCopy) == 0);
+	CHECK(countCalls(*main, CodeGenContext::arrayDrop) == 2);
+	CHECK(ctx->rcStats.elidedCopies == 2);
+	CHECK(ctx->rcStats.elidedDrops == 2);
+}
+
+TEST_CASE("RcOptimizer: Struct locals defined by an initializer are promoted and cancel pairs") {
+	// Arrange & Act
+	const auto ctx = lower(u8"struct PromotedWrap {\n"
+						   "\tp: *i32\n"
+						   "}\n"
+						   "func keep(w: PromotedWrap) -> i32 {\n"
+						   "\treturn 0;\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tn: *i32 = new i32(1);\n"
+						   "\tw: PromotedWrap = PromotedWrap { n };\n"
+						   "\tprint_i32(*n);\n"
+						   "\tn = null;\n"
+						   "\treturn keep(w);\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	CHECK(countCalls(*main, CodeGenContext::sharedPtrCopy) == 0);
+	CHECK(ctx->rcStats.elidedCopies >= 1);
+
+	for (const auto &inst : main->getEntryBlock()) {
+		const auto *alloca = llvm::dyn_cast<llvm::AllocaInst>(&inst);
+		CHECK_FALSE((alloca && alloca->getName() == "w"));
+	}
+}
+
+TEST_CASE("RcOptimizer: A call in between keeps the copy and the drop") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func consume(p: *i32) -> i32 {\n"
+						   "\tp = null;\n"
+						   "\treturn 0;\n"
+						   "}\n"
+						   "func main() -> i32 {\n"
+						   "\tn: *i32 = new i32(1);\n"
+						   "\tm: *i32 = n;\n"
+						   "\tconsume(new i32(3));\n"
+						   "\tm = new i32(2);\n"
+						   "\treturn *m + *n;\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	CHECK(countCalls(*main, CodeGenContext::sharedPtrCopy) == 1);
+	CHECK(countCalls(*main, CodeGenContext::sharedPtrDrop) == 3);
+}
+
+TEST_CASE("RcOptimizer: A drop on only some paths keeps the copy") {
+	// Arrange & Act
+	const auto ctx = lower(u8"func main() -> i32 {\n"
+						   "\tn: *i32 = new i32(1);\n"
+						   "\tm: *i32 = n;\n"
+						   "\tif (*n > 0) {\n"
+						   "\t\tm = new i32(2);\n"
+						   "\t}\n"
+						   "\treturn *m + *n;\n"
+						   "}\n");
+
+	// Assert
+	const auto *main = ctx->llvmModule.getFunction("main");
+	REQUIRE(main != nullptr);
+	CHECK(countCalls(*main, CodeGenContext::sharedPtrCopy) == 1);
+	CHECK(countCalls(*main, CodeGenContext::sharedPtrDrop) == 3);
+}
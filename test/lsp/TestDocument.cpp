@@ -0,0 +1,97 @@
+#include "Doctest.h"
+#include "lsp/Document.h"
+
+using namespace lsp;
+
+TEST_CASE("Document: Diagnostics are reported relative to the document") {
+	// Arrange
+	Document doc("test.ocn");
+
+	// Act
+	doc.update("func main() -> i32 {\n"
+			   "\treturn 0;\n"
+			   "}\n"
+			   "\n"
+			   "func foo() {\n"
+			   "\tx: i32 = true;\n"
+			   "}\n");
+
+	// Assert
+	const auto diagnostics = doc.getDiagnostics();
+	REQUIRE(diagnostics.size() == 1);
+	CHECK(diagnostics[0].level == ErrorLevel::ERROR);
+	CHECK(diagnostics[0].range.start.line == 5);
+	CHECK(diagnostics[0].range.start.character == 1);
+}
+
+TEST_CASE("Document: Changing a signature checks the bodies that use it again") {
+	// Arrange
+	Document doc("test.ocn");
+	doc.update("func foo() -> i32 {\n"
+			   "\treturn 1;\n"
+			   "}\n"
+			   "func main() -> i32 {\n"
+			   "\treturn foo();\n"
+			   "}\n");
+	REQUIRE(doc.getDiagnostics().empty());
+
+	// Act
+	doc.update("func foo() -> bool {\n"
+			   "\treturn true;\n"
+			   "}\n"
+			   "func main() -> i32 {\n"
+			   "\treturn foo();\n"
+			   "}\n");
+
+	// Assert
+	const auto diagnostics = doc.getDiagnostics();
+	REQUIRE(diagnostics.size() == 1);
+	CHECK(diagnostics[0].range.start.line == 4);
+}
+
+TEST_CASE("Document: Hover shows the inferred type of the expression") {
+	// Arrange
+	Document doc("test.ocn");
+	doc.update("struct Foo {\n"
+			   "\ta: i32\n"
+			   "}\n"
+			   "func main() -> i32 {\n"
+			   "\tf: Foo = Foo { 1 };\n"
+			   "\treturn f.a;\n"
+			   "}\n");
+
+	// Act
+	const auto variable = doc.hover({.line = 5, .character = 8});
+	const auto field = doc.hover({.line = 5, .character = 10});
+
+	// Assert
+	REQUIRE(variable.has_value());
+	CHECK(variable->text == "f: Foo");
+	REQUIRE(field.has_value());
+	CHECK(field->text == "i32");
+}
+
+TEST_CASE("Document: Definitions resolve locals before functions") {
+	// Arrange
+	Document doc("test.ocn");
+	doc.update("func foo() -> i32 {\n"
+			   "\treturn 1;\n"
+			   "}\n"
+			   "func main() -> i32 {\n"
+			   "\tfoo: i32 = 2;\n"
+			   "\treturn foo;\n"
+			   "}\n"
+			   "func bar() -> i32 {\n"
+			   "\treturn foo();\n"
+			   "}\n");
+
+	// Act
+	const auto local = doc.findDefinition({.line = 5, .character = 8});
+	const auto function = doc.findDefinition({.line = 8, .character = 8});
+
+	// Assert
+	REQUIRE(local.has_value());
+	CHECK(local->start.line == 4);
+	REQUIRE(function.has_value());
+	CHECK(function->start.line == 0);
+}
@@ -861,6 +861,22 @@ TEST_CASE("Parser: parseParamList() - Multiple params") {
 	CHECK(params[2].first == u8"c");
 }
 
+TEST_CASE("Parser: parseParamList() - Borrowed param") {
+	// Arrange
+	U8String source = u8"(list: &*i32, items: &[]i32)";
+	ErrorHandler err(u8"", source);
+	auto tokens = Lexer::tokenize(source, err);
+	Parser parser(tokens, err, u8"test-module");
+
+	// Act
+	auto params = parser.parseParamList();
+
+	// Assert
+	REQUIRE(params.size() == 2);
+	CHECK(params[0].second->str() == u8"&*i32");
+	CHECK(params[1].second->str() == u8"&[]i32");
+}
+
 TEST_CASE("Parser: parseFuncDecl() - Simple function") {
 	// Arrange
 	U8String source = u8"func main() { return; }";
@@ -1000,4 +1016,34 @@ TEST_CASE("Parser: getAssignmentKindFromString() - All assignment types") {
 	CHECK(Parser::getAssignmentKindFromString(u8"*=") == AssignmentKind::Multiplication);
 	CHECK(Parser::getAssignmentKindFromString(u8"/=") == AssignmentKind::Division);
 	CHECK(Parser::getAssignmentKindFromString(u8"%=") == AssignmentKind::Modulo);
+}
+
+TEST_CASE("Parser: parseStatements() - Statements until end of file") {
+	// Arrange
+	U8String source = u8"x: i32 = 5; print_i32(x); while (x > 0) { x -= 1; }";
+	ErrorHandler err(u8"", source);
+	auto tokens = Lexer::tokenize(source, err);
+
+	// Act
+	auto block = Parser::parseStatements(tokens, err);
+
+	// Assert
+	CHECK_FALSE(err.hasError());
+	REQUIRE(block->stmts.size() == 3);
+	CHECK(block->stmts[0]->kind == ast::NodeKind::VarDef);
+	CHECK(block->stmts[1]->kind == ast::NodeKind::FuncCall);
+	CHECK(block->stmts[2]->kind == ast::NodeKind::WhileStmt);
+}
+
+TEST_CASE("Parser: parseStatements() - Reports error for incomplete statement") {
+	// Arrange
+	U8String source = u8"x: i32 = ";
+	ErrorHandler err(u8"", source);
+	auto tokens = Lexer::tokenize(source, err);
+
+	// Act
+	auto block = Parser::parseStatements(tokens, err);
+
+	// Assert
+	CHECK(err.hasError());
 }
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include <unistd.h>
+
+#include <cstdio>
+
+#include "Doctest.h"
+#include "repl/Repl.h"
+
+namespace {
+struct Evaluation {
+	bool accepted;
+	std::string output;
+};
+
+Box<repl::Repl> createRepl() {
+	auto repl = repl::Repl::create();
+	if (!repl) {
+		FAIL(llvm::toString(repl.takeError()));
+	}
+
+	return std::move(repl.get());
+}
+
+/// Evaluates the input and returns what it printed. Programs print through C stdio and
+/// diagnostics through std::cout, so stdout itself is redirected into a temporary file.
+Evaluation evaluate(repl::Repl &repl, const U8String &input) {
+	FILE *capture = std::tmpfile();
+	REQUIRE(capture != nullptr);
+
+	std::cout.flush();
+	std::fflush(stdout);
+	const int savedStdout = dup(STDOUT_FILENO);
+	dup2(fileno(capture), STDOUT_FILENO);
+
+	const auto accepted = repl.evaluate(input);
+
+	std::cout.flush();
+	std::fflush(stdout);
+	dup2(savedStdout, STDOUT_FILENO);
+	close(savedStdout);
+
+	std::string output;
+	std::rewind(capture);
+	for (int c = std::fgetc(capture); c != EOF; c = std::fgetc(capture)) {
+		output += static_cast<char>(c);
+	}
+
+	std::fclose(capture);
+	return {.accepted = accepted, .output = std::move(output)};
+}
+}
+
+TEST_CASE("Repl: Inputs use the declarations of earlier inputs") {
+	// Arrange
+	const auto repl = createRepl();
+	REQUIRE(evaluate(*repl, u8"struct ReplPoint {\n"
+							"\tx: i32,\n"
+							"\ty: i32\n"
+							"}\n")
+					.accepted);
+	REQUIRE(evaluate(*repl, u8"func replSum(p: ReplPoint) -> i32 {\n"
+							"\treturn p.x + p.y;\n"
+							"}\n")
+					.accepted);
+
+	// Act
+	const auto first = evaluate(*repl, u8"print_i32(replSum(ReplPoint { 2, 3 }));\n");
+	const auto second = evaluate(*repl, u8"p: ReplPoint = ReplPoint { 4, 5 };\n"
+										"print_i32(replSum(p) * 2);\n");
+
+	// Assert
+	CHECK(first.accepted);
+	CHECK(first.output == "5");
+	CHECK(second.accepted);
+	CHECK(second.output == "18");
+}
+
+TEST_CASE("Repl: A struct cannot be declared again") {
+	// Arrange
+	const auto repl = createRepl();
+	REQUIRE(evaluate(*repl, u8"struct ReplPair {\n"
+							"\ta: i32\n"
+							"}\n")
+					.accepted);
+
+	// Act
+	const auto redeclared = evaluate(*repl, u8"struct ReplPair {\n"
+											"\ta: i32,\n"
+											"\tb: i32\n"
+											"}\n");
+	const auto used = evaluate(*repl, u8"p: ReplPair = ReplPair { 7 };\n"
+									  "print_i32(p.a);\n");
+
+	// Assert
+	CHECK_FALSE(redeclared.accepted);
+	CHECK_FALSE(redeclared.output.empty());
+	CHECK(used.accepted);
+	CHECK(used.output == "7");
+}
+
+TEST_CASE("Repl: Rejected inputs are taken back and the session goes on") {
+	// Arrange
+	const auto repl = createRepl();
+
+	// Act
+	const auto syntaxError = evaluate(*repl, u8"x: i32 = ;\n");
+	const auto typeError = evaluate(*repl, u8"struct ReplCell {\n"
+										   "\tv: i32\n"
+										   "}\n"
+										   "func replAnswer() -> i32 {\n"
+										   "\treturn true;\n"
+										   "}\n");
+	const auto undefined = evaluate(*repl, u8"print_i32(replAnswer());\n");
+	const auto redeclared = evaluate(*repl, u8"struct ReplCell {\n"
+											"\tv: i32,\n"
+											"\tw: i32\n"
+											"}\n"
+											"func replAnswer() -> i32 {\n"
+											"\tc: ReplCell = ReplCell { 40, 2 };\n"
+											"\treturn c.v + c.w;\n"
+											"}\n");
+	const auto called = evaluate(*repl, u8"print_i32(replAnswer());\n");
+
+	// Assert
+	CHECK_FALSE(syntaxError.accepted);
+	CHECK_FALSE(typeError.accepted);
+	CHECK_FALSE(undefined.accepted);
+	CHECK(redeclared.accepted);
+	CHECK(called.accepted);
+	CHECK(called.output == "42");
+}
@@ -0,0 +1,171 @@
+#include "Doctest.h"
+#include "TestUtil.h"
+
+using namespace sem;
+using namespace ast;
+
+namespace {
+Box<Module> evaluate(const U8String &source) {
+	return test::checkSource(source, {.constantEvaluation = true});
+}
+
+/// Returns the values of the return statements directly in the body of main.
+Vec<Opt<ConstValue>> getReturnedValues(const Module &module) {
+	Vec<Opt<ConstValue>> values;
+
+	for (const auto &func : module.funcs) {
+		if (func->ident != u8"main") {
+			continue;
+		}
+
+		for (const auto &stmt : func->body->stmts) {
+			if (stmt->kind == NodeKind::ReturnStmt) {
+				values.push_back(static_cast<const ReturnStmt &>(*stmt).expr->constValue);
+			}
+		}
+	}
+
+	return values;
+}
+}
+
+TEST_CASE("ConstantEvaluationPass: Operators on literals are folded") {
+	// Arrange & Act
+	const auto module = evaluate(u8"func main() -> i32 {\n"
+								 "\tif ('a' == 'a' && !(3 > 4)) {\n"
+								 "\t\treturn (2 + 3) * 4 - -1;\n"
+								 "\t}\n"
+								 "\treturn ~5 ^ 3;\n"
+								 "}\n");
+
+	// Assert
+	const auto &main = *module->funcs[0];
+	const auto &ifStmt = static_cast<const IfStmt &>(*main.body->stmts[0]);
+	REQUIRE(ifStmt.cond->constValue.has_value());
+	CHECK(ifStmt.cond->constValue->scalar == 1);
+
+	const auto &then = static_cast<const ReturnStmt &>(*ifStmt.then->stmts[0]);
+	REQUIRE(then.expr->constValue.has_value());
+	CHECK(then.expr->constValue->scalar == 21);
+
+	const auto values = getReturnedValues(*module);
+	REQUIRE(values.size() == 1);
+	REQUIRE(values[0].has_value());
+	CHECK(values[0]->scalar == -7);
+}
+
+TEST_CASE("ConstantEvaluationPass: Calls of functions without effects are evaluated") {
+	// Arrange & Act
+	const auto module = evaluate(u8"func table(n: i32) -> []i32 {\n"
+								 "\tt: []i32 = array[n]i32;\n"
+								 "\ti: i32 = 0;\n"
+								 "\twhile (i < n) {\n"
+								 "\t\tt[i] = i * i;\n"
+								 "\t\ti += 1;\n"
+								 "\t}\n"
+								 "\treturn t;\n"
+								 "}\n"
+								 "func fib(n: i32) -> i32 {\n"
+								 "\tif (n < 2) {\n"
+								 "\t\treturn n;\n"
+								 "\t}\n"
+								 "\treturn fib(n - 1) + fib(n - 2);\n"
+								 "}\n"
+								 "func main() -> i32 {\n"
+								 "\treturn table(8)[5] + len(table(4)) + fib(10);\n"
+								 "}\n");
+
+	// Assert
+	const auto values = getReturnedValues(*module);
+	REQUIRE(values.size() == 1);
+	REQUIRE(values[0].has_value());
+	CHECK(values[0]->scalar == 25 + 4 + 55);
+}
+
+TEST_CASE("ConstantEvaluationPass: Structs with constant fields are folded") {
+	// Arrange & Act
+	const auto module = evaluate(u8"struct ConstPoint {\n"
+								 "\tx: i32,\n"
+								 "\ty: i32\n"
+								 "}\n"
+								 "struct ConstSegment {\n"
+								 "\ta: ConstPoint,\n"
+								 "\tb: ConstPoint\n"
+								 "}\n"
+								 "func segment(k: i32) -> ConstSegment {\n"
+								 "\ts: ConstSegment;\n"
+								 "\ts.a = ConstPoint { k, k + 1 };\n"
+								 "\tp: *ConstPoint = new ConstPoint { 3, 4 };\n"
+								 "\ts.b.x = *p.x + *p.y;\n"
+								 "\treturn s;\n"
+								 "}\n"
+								 "func main() -> i32 {\n"
+								 "\ts: ConstSegment = segment(5);\n"
+								 "\treturn segment(2).b.x;\n"
+								 "}\n");
+
+	// Assert
+	const auto &main = *module->funcs[1];
+	const auto &varDef = static_cast<const VarDef &>(*main.body->stmts[0]);
+	REQUIRE(varDef.value->constValue.has_value());
+
+	const auto &segment = varDef.value->constValue.value();
+	REQUIRE(segment.fields.size() == 2);
+	CHECK(segment.fields[0].fields[0].scalar == 5);
+	CHECK(segment.fields[0].fields[1].scalar == 6);
+	CHECK(segment.fields[1].fields[0].scalar == 7);
+	CHECK(segment.fields[1].fields[1].scalar == 0);
+
+	const auto values = getReturnedValues(*module);
+	REQUIRE(values.size() == 1);
+	REQUIRE(values[0].has_value());
+	CHECK(values[0]->scalar == 7);
+}
+
+TEST_CASE("ConstantEvaluationPass: Effects, locals, panics and endless loops stay at run time") {
+	// Arrange & Act
+	const auto module = evaluate(u8"func loud(x: i32) -> i32 {\n"
+								 "\tprint_i32(x);\n"
+								 "\treturn x;\n"
+								 "}\n"
+								 "func spin() -> i32 {\n"
+								 "\twhile (true) {\n"
+								 "\t}\n"
+								 "\treturn 0;\n"
+								 "}\n"
+								 "func outOfBounds() -> i32 {\n"
+								 "\txs: []i32 = array[2]i32;\n"
+								 "\treturn xs[2];\n"
+								 "}\n"
+								 "func main() -> i32 {\n"
+								 "\tk: i32 = 2;\n"
+								 "\tif (read_bool()) {\n"
+								 "\t\treturn loud(1);\n"
+								 "\t}\n"
+								 "\tif (read_bool()) {\n"
+								 "\t\treturn spin() + outOfBounds() + 1 / 0;\n"
+								 "\t}\n"
+								 "\tif (read_bool()) {\n"
+								 "\t\treturn k + 1;\n"
+								 "\t}\n"
+								 "\tif ((false && loud(2) > 0) || 1 + 1 == 2) {\n"
+								 "\t\treturn 0;\n"
+								 "\t}\n"
+								 "\treturn 1;\n"
+								 "}\n");
+
+	// Assert
+	const auto &main = *module->funcs[3];
+	for (u32 i = 1; i <= 3; ++i) {
+		const auto &ifStmt = static_cast<const IfStmt &>(*main.body->stmts[i]);
+		CHECK_FALSE(ifStmt.cond->constValue.has_value());
+
+		const auto &returnStmt = static_cast<const ReturnStmt &>(*ifStmt.then->stmts[0]);
+		CHECK_FALSE(returnStmt.expr->constValue.has_value());
+	}
+
+	// The right operand of && is never evaluated, so it does not keep the result from being known.
+	const auto &ifStmt = static_cast<const IfStmt &>(*main.body->stmts[4]);
+	REQUIRE(ifStmt.cond->constValue.has_value());
+	CHECK(ifStmt.cond->constValue->scalar == 1);
+}
@@ -0,0 +1,192 @@
+#include "Doctest.h"
+#include "TestUtil.h"
+
+using namespace sem;
+using namespace ast;
+
+namespace {
+Box<Module> analyze(const U8String &source) {
+	// Constant conditions tell which loops are never left.
+	return test::checkSource(source, {.constantEvaluation = true, .effectAnalysis = true});
+}
+}
+
+TEST_CASE("EffectAnalysisPass: Functions of their arguments only have no effects") {
+	// Arrange & Act
+	const auto module = analyze(u8"func square(x: i32) -> i32 {\n"
+								"\treturn x * x;\n"
+								"}\n"
+								"func sumTo(n: i32) -> i32 {\n"
+								"\ts: i32 = 0;\n"
+								"\ti: i32 = 0;\n"
+								"\twhile (i < n) {\n"
+								"\t\ts += square(i);\n"
+								"\t\ti += 1;\n"
+								"\t}\n"
+								"\treturn s;\n"
+								"}\n"
+								"func size(xs: []i32) -> i32 {\n"
+								"\treturn len(xs);\n"
+								"}\n"
+								"func main() -> i32 {\n"
+								"\treturn 0;\n"
+								"}\n");
+
+	// Assert
+	const auto &square = module->funcs[0]->effects;
+	CHECK_FALSE(square.readsMemory);
+	CHECK_FALSE(square.writesMemory);
+	CHECK_FALSE(square.touchesHeap);
+	CHECK_FALSE(square.mayPanic);
+	CHECK_FALSE(square.mayDiverge);
+
+	const auto &sumTo = module->funcs[1]->effects;
+	CHECK_FALSE(sumTo.readsMemory);
+	CHECK_FALSE(sumTo.writesMemory);
+	CHECK(sumTo.mayDiverge);
+
+	const auto &size = module->funcs[2]->effects;
+	CHECK(size.readsMemory);
+	CHECK_FALSE(size.writesMemory);
+	CHECK_FALSE(size.touchesHeap);
+	CHECK_FALSE(size.mayPanic);
+	CHECK_FALSE(size.capturedParams[0]);
+}
+
+TEST_CASE("EffectAnalysisPass: Reading input may not return") {
+	// Arrange & Act
+	const auto module = analyze(u8"func ask() -> i32 {\n"
+								"\treturn read_i32();\n"
+								"}\n"
+								"func twice() -> i32 {\n"
+								"\treturn 2 * ask();\n"
+								"}\n"
+								"func main() -> i32 {\n"
+								"\treturn twice();\n"
+								"}\n");
+
+	// Assert
+	const auto &ask = module->funcs[0]->effects;
+	CHECK(ask.mayDiverge);
+	CHECK_FALSE(ask.mayPanic);
+	CHECK(module->funcs[1]->effects.mayDiverge);
+}
+
+TEST_CASE("EffectAnalysisPass: Effects of callees are added to their callers") {
+	// Arrange & Act
+	const auto module = analyze(u8"func show(x: i32) {\n"
+								"\tprint_i32(x);\n"
+								"}\n"
+								"func peek(p: *i32) -> i32 {\n"
+								"\treturn *p;\n"
+								"}\n"
+								"func countDown(n: i32) -> i32 {\n"
+								"\tif (n == 0) {\n"
+								"\t\treturn 0;\n"
+								"\t}\n"
+								"\treturn countDown(n - 1);\n"
+								"}\n"
+								"func both(p: *i32) -> i32 {\n"
+								"\tshow(1);\n"
+								"\treturn peek(p) + countDown(*p);\n"
+								"}\n"
+								"func main() -> i32 {\n"
+								"\treturn 0;\n"
+								"}\n");
+
+	// Assert
+	const auto &show = module->funcs[0]->effects;
+	CHECK(show.writesMemory);
+	CHECK_FALSE(show.mayPanic);
+	CHECK_FALSE(show.mayDiverge);
+
+	const auto &peek = module->funcs[1]->effects;
+	CHECK(peek.readsMemory);
+	CHECK(peek.mayPanic);
+	CHECK_FALSE(peek.touchesHeap);
+
+	const auto &countDown = module->funcs[2]->effects;
+	CHECK(countDown.mayDiverge);
+	CHECK_FALSE(countDown.readsMemory);
+
+	const auto &both = module->funcs[3]->effects;
+	CHECK(both.readsMemory);
+	CHECK(both.writesMemory);
+	CHECK(both.mayPanic);
+	CHECK(both.mayDiverge);
+	CHECK_FALSE(both.touchesHeap);
+	CHECK_FALSE(both.capturedParams[0]);
+}
+
+TEST_CASE("EffectAnalysisPass: Parameters that are kept, returned or assigned are captured") {
+	// Arrange & Act
+	const auto module = analyze(u8"struct EffectBox {\n"
+								"\tp: *i32\n"
+								"}\n"
+								"func keep(p: *i32) -> *i32 {\n"
+								"\treturn p;\n"
+								"}\n"
+								"func wrap(p: *i32) -> EffectBox {\n"
+								"\treturn EffectBox { p };\n"
+								"}\n"
+								"func forward(p: *i32, q: *i32) -> *i32 {\n"
+								"\tif (q == null) {\n"
+								"\t\treturn keep(p);\n"
+								"\t}\n"
+								"\tq = null;\n"
+								"\treturn new i32(*q);\n"
+								"}\n"
+								"func fresh(n: i32) -> *i32 {\n"
+								"\tif (n > 0) {\n"
+								"\t\treturn fresh(n - 1);\n"
+								"\t}\n"
+								"\treturn new i32(n);\n"
+								"}\n"
+								"func main() -> i32 {\n"
+								"\treturn 0;\n"
+								"}\n");
+
+	// Assert
+	CHECK(module->funcs[0]->effects.capturedParams[0]);
+	CHECK_FALSE(module->funcs[0]->effects.returnsFresh);
+	CHECK(module->funcs[1]->effects.capturedParams[0]);
+
+	const auto &forward = module->funcs[2]->effects;
+	CHECK(forward.capturedParams[0]);
+	CHECK(forward.capturedParams[1]);
+	CHECK(forward.touchesHeap);
+	CHECK_FALSE(forward.returnsFresh);
+
+	CHECK(module->funcs[3]->effects.returnsFresh);
+}
+
+TEST_CASE("EffectAnalysisPass: Functions that only loop forever never return") {
+	// Arrange & Act
+	const auto module = analyze(u8"func spin() -> i32 {\n"
+								"\twhile (true) {\n"
+								"\t}\n"
+								"\treturn 0;\n"
+								"}\n"
+								"func halt(n: i32) -> i32 {\n"
+								"\tif (n > 0) {\n"
+								"\t\treturn spin();\n"
+								"\t}\n"
+								"\tspin();\n"
+								"\treturn 1;\n"
+								"}\n"
+								"func maybe(n: i32) -> i32 {\n"
+								"\tif (n > 0) {\n"
+								"\t\treturn spin();\n"
+								"\t}\n"
+								"\treturn n;\n"
+								"}\n"
+								"func main() -> i32 {\n"
+								"\treturn 0;\n"
+								"}\n");
+
+	// Assert
+	CHECK(module->funcs[0]->effects.neverReturns);
+	CHECK(module->funcs[1]->effects.neverReturns);
+	CHECK_FALSE(module->funcs[2]->effects.neverReturns);
+	CHECK(module->funcs[2]->effects.mayDiverge);
+}
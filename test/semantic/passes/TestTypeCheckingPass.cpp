@@ -1,4 +1,5 @@
 #include "Doctest.h"
+#include "TestUtil.h"
 #include "semantic/passes/ExplorationPass.h"
 #include "semantic/passes/TypeCheckingPass.h"
 
@@ -373,4 +374,65 @@ TEST_CASE("TypeCheckingPass: Simple Assignment with wrong type will add an error
 	CHECK(*type == UnitType());
 	CHECK(assignment->valueCategory == ValueCategory::RValue);
 }
-#endif
\ No newline at end of file
+#endif
+
+namespace {
+Vec<U8String> checkErrors(const U8String &source) {
+	ErrorHandler err(u8"test.ocn", source);
+	test::typeCheck(source, err);
+	return test::getMessages(err);
+}
+}
+
+TEST_CASE("TypeCheckingPass: Borrowed parameters can be read, copied to locals and passed on") {
+	// Arrange
+	const U8String source = u8"struct BorrowReadNode {\n"
+							"\tdata: i32,\n"
+							"\tnext: *BorrowReadNode\n"
+							"}\n"
+							"func get(node: &*BorrowReadNode) -> i32 {\n"
+							"\tcurrent: *BorrowReadNode = node;\n"
+							"\tcurrent = *current.next;\n"
+							"\treturn *node.data;\n"
+							"}\n"
+							"func sum(node: &*BorrowReadNode, items: &[]i32) -> i32 {\n"
+							"\treturn get(node) + items[0] + len(items);\n"
+							"}\n"
+							"func main() -> i32 {\n"
+							"\tnode: *BorrowReadNode = new BorrowReadNode { 1, null };\n"
+							"\treturn sum(node, array[2]i32);\n"
+							"}\n";
+
+	// Act
+	const auto errors = checkErrors(source);
+
+	// Assert
+	CHECK(errors.empty());
+}
+
+TEST_CASE("TypeCheckingPass: Borrowed parameters cannot escape or be assigned") {
+	// Arrange
+	const U8String source = u8"struct BorrowEscapeNode {\n"
+							"\tnext: *BorrowEscapeNode\n"
+							"}\n"
+							"func keep(node: *BorrowEscapeNode) {}\n"
+							"func leak(node: &*BorrowEscapeNode) -> *BorrowEscapeNode {\n"
+							"\t*node.next = node;\n"
+							"\tkeep(node);\n"
+							"\tnode = null;\n"
+							"\treturn node;\n"
+							"}\n"
+							"func main() -> i32 {\n"
+							"\treturn 0;\n"
+							"}\n";
+
+	// Act
+	const auto errors = checkErrors(source);
+
+	// Assert
+	REQUIRE(errors.size() == 4);
+	CHECK(errors[0] == u8"Borrowed parameter 'node' cannot escape the function.");
+	CHECK(errors[1] == u8"Borrowed parameter 'node' cannot escape the function.");
+	CHECK(errors[2] == u8"Cannot assign to borrowed parameter 'node'.");
+	CHECK(errors[3] == u8"Borrowed parameter 'node' cannot escape the function.");
+}
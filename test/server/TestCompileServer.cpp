@@ -0,0 +1,209 @@
+#include <sys/wait.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "Doctest.h"
+#include "server/CompileServer.h"
+
+using namespace server;
+
+namespace {
+struct Response {
+	int exitCode;
+	std::string body;
+};
+
+/// Directory of the test files, removed with everything in it at the end of a test.
+struct TempDir {
+	std::filesystem::path path;
+
+	TempDir() {
+		char dir[] = "/tmp/ocn-server-test-XXXXXX";
+		REQUIRE(mkdtemp(dir) != nullptr);
+		path = dir;
+	}
+
+	~TempDir() {
+		std::filesystem::remove_all(path);
+	}
+
+	std::string file(const std::string &name) const {
+		return (path / name).string();
+	}
+};
+
+Box<CompileServer> createServer() {
+	// CMake passes absolute source paths, the runtime lies two directories above this file.
+	const auto runtime = std::filesystem::path(__FILE__).parent_path() / "../../ocn_stdlib.c";
+	auto server = CompileServer::create(runtime.string());
+	REQUIRE(server != nullptr);
+	return server;
+}
+
+void writeFile(const std::string &filename, const std::string &content) {
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	file << content;
+}
+
+Response sendRequest(CompileServer &server, const std::string &request) {
+	bool shutdown = false;
+	const auto response = server.handle(request, shutdown);
+	CHECK_FALSE(shutdown);
+
+	std::istringstream in(response);
+	int exitCode = 0;
+	size_t outSize = 0, errSize = 0;
+	REQUIRE(in >> exitCode >> outSize >> errSize);
+
+	const auto body = response.substr(response.find('\n') + 1);
+	CHECK(body.size() == outSize + errSize);
+	return {exitCode, body};
+}
+
+Response compile(CompileServer &server, const std::string &input, const std::string &output,
+				 const std::string &options = "") {
+	return sendRequest(server, "compile\n" + input + "\n" + output + "\n" + options);
+}
+
+int runExecutable(const std::string &filename) {
+	const auto status = std::system(filename.c_str());
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+}
+
+TEST_CASE("CompileServer: Malformed requests are answered without compiling") {
+	// Arrange
+	const auto server = createServer();
+
+	// Act
+	const auto missingOutput = sendRequest(*server, "compile\n/tmp/input.ocn\n");
+	const auto unknownCommand = sendRequest(*server, "build\n/tmp/input.ocn\n/tmp/out\n");
+	const auto unknownOption = sendRequest(*server, "compile\n/tmp/input.ocn\n/tmp/out\n--fast\n");
+
+	bool shutdown = false;
+	server->handle("shutdown\n", shutdown);
+
+	// Assert
+	for (const auto &response : {missingOutput, unknownCommand, unknownOption}) {
+		CHECK(response.exitCode == 1);
+		CHECK(response.body == "Malformed request.\n");
+	}
+
+	CHECK(server->compileCount() == 0);
+	CHECK(shutdown);
+}
+
+TEST_CASE("CompileServer: Compiles a file into an executable") {
+	// Arrange
+	const auto server = createServer();
+	const TempDir dir;
+	writeFile(dir.file("main.ocn"), "struct ServerPair {\n"
+									"\ta: i32,\n"
+									"\tb: i32\n"
+									"}\n"
+									"func main() -> i32 {\n"
+									"\tp: *ServerPair = new ServerPair { 40, 2 };\n"
+									"\treturn *p.a + *p.b;\n"
+									"}\n");
+
+	// Act
+	const auto response = compile(*server, dir.file("main.ocn"), dir.file("main"));
+
+	// Assert
+	CHECK(response.exitCode == 0);
+	CHECK(response.body.empty());
+	CHECK(server->compileCount() == 1);
+	CHECK(runExecutable(dir.file("main")) == 42);
+}
+
+TEST_CASE("CompileServer: Unchanged files are served from the cache") {
+	// Arrange
+	const auto server = createServer();
+	const TempDir dir;
+	writeFile(dir.file("main.ocn"), "struct ServerFlags {\n"
+									"\ton: bool,\n"
+									"\tcount: i32,\n"
+									"\toff: bool\n"
+									"}\n"
+									"func main() -> i32 {\n"
+									"\tf: ServerFlags = ServerFlags { true, 7, false };\n"
+									"\treturn f.count;\n"
+									"}\n");
+	const auto first = compile(*server, dir.file("main.ocn"), dir.file("first"));
+
+	// Act
+	const auto repeated = compile(*server, dir.file("main.ocn"), dir.file("second"));
+	const auto countAfterRepeat = server->compileCount();
+	const auto reordered = compile(*server, dir.file("main.ocn"), dir.file("third"), "-r\n");
+
+	// Assert
+	CHECK(first.exitCode == 0);
+	CHECK(repeated.exitCode == 0);
+	CHECK(countAfterRepeat == 1);
+	CHECK(runExecutable(dir.file("second")) == 7);
+
+	// Different options need a different object.
+	CHECK(reordered.exitCode == 0);
+	CHECK(server->compileCount() == 2);
+	CHECK(runExecutable(dir.file("third")) == 7);
+}
+
+TEST_CASE("CompileServer: Changed files are compiled again") {
+	// Arrange
+	const auto server = createServer();
+	const TempDir dir;
+	writeFile(dir.file("main.ocn"), "func main() -> i32 {\n"
+									"\treturn 1;\n"
+									"}\n");
+	const auto first = compile(*server, dir.file("main.ocn"), dir.file("main"));
+
+	// Act
+	writeFile(dir.file("main.ocn"), "func main() -> i32 {\n"
+									"\treturn true;\n"
+									"}\n");
+	const auto broken = compile(*server, dir.file("main.ocn"), dir.file("main"));
+
+	writeFile(dir.file("main.ocn"), "func main() -> i32 {\n"
+									"\treturn 3;\n"
+									"}\n");
+	const auto fixed = compile(*server, dir.file("main.ocn"), dir.file("main"));
+
+	// Assert
+	CHECK(first.exitCode == 0);
+	CHECK(broken.exitCode == 3);
+	CHECK_FALSE(broken.body.empty());
+	CHECK(fixed.exitCode == 0);
+	CHECK(server->compileCount() == 3);
+	CHECK(runExecutable(dir.file("main")) == 3);
+}
+
+TEST_CASE("CompileServer: Warnings of the code generation are sent to the client") {
+	// Arrange
+	const auto server = createServer();
+	const TempDir dir;
+	writeFile(dir.file("main.ocn"), "struct ServerNode {\n"
+									"\tv: i32,\n"
+									"\tnext: *ServerNode\n"
+									"}\n"
+									"func keep(n: i32, p: *ServerNode) -> i32 {\n"
+									"\tlocal: *ServerNode = new ServerNode { n, p };\n"
+									"\tif (n == 0) {\n"
+									"\t\treturn 0;\n"
+									"\t}\n"
+									"\treturn keep(n - 1, local);\n"
+									"}\n"
+									"func main() -> i32 {\n"
+									"\treturn keep(read_i32(), null);\n"
+									"}\n");
+
+	// Act
+	const auto response = compile(*server, dir.file("main.ocn"), dir.file("main"));
+
+	// Assert
+	CHECK(response.exitCode == 0);
+	CHECK(response.body.find("'keep'") != std::string::npos);
+	CHECK(response.body.find("tail call") != std::string::npos);
+}
@@ -57,6 +57,18 @@ TEST_CASE("Struct interning (Nominal)") {
 	CHECK(s1 != s3);
 }
 
+TEST_CASE("Reference interning") {
+	TypeFactory::reset();
+
+	Type ptr = TypeFactory::getPointer(TypeFactory::getI32());
+	Type ref1 = TypeFactory::getReference(ptr);
+	Type ref2 = TypeFactory::getReference(ptr);
+
+	CHECK(ref1 == ref2);
+	CHECK(ref1 != ptr); // A borrowed reference is a type of its own
+	CHECK(ref1->str() == u8"&*i32");
+}
+
 TEST_CASE("Registry integrity") {
 	TypeFactory::reset();
 
@@ -0,0 +1,347 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Doctest.h"
+#include "TestUtil.h"
+#include "codegen/CodeGen.h"
+#include "codegen/JitSession.h"
+#include "vm/BytecodeCompiler.h"
+#include "vm/Interpreter.h"
+
+namespace {
+/// Number of cells taken from the runtime allocator that were not returned yet.
+i64 s_LiveCells = 0;
+}
+
+// Strong definitions replace the weak allocator of ocn_stdlib.c in the test binary, so the cells of
+// compiled programs and of the VM are counted alike.
+extern "C" {
+void *__ocn_alloc(size_t size) {
+	void *ptr = std::calloc(1, size);
+	s_LiveCells += ptr != nullptr;
+	return ptr;
+}
+
+void __ocn_free(void *ptr) {
+	s_LiveCells -= ptr != nullptr;
+	std::free(ptr);
+}
+}
+
+namespace {
+enum class Backend { Jit, Vm };
+
+struct Run {
+	bool panicked;
+	int exitCode;
+	std::string out;
+	std::string err;
+	i64 leakedCells;
+};
+
+/// Runs main on the backend and stores the cells it left alive. Only the run itself is counted,
+/// compiling the program may allocate on its own.
+int execute(Backend backend, const ast::Module &module, i64 &leakedCells) {
+	if (backend == Backend::Vm) {
+		const auto program = vm::BytecodeCompiler::compile(module);
+		const auto before = s_LiveCells;
+		const auto exitCode = vm::Interpreter::run(*program);
+		leakedCells = s_LiveCells - before;
+		return exitCode;
+	}
+
+	auto session = gen::JitSession::create();
+	if (!session) {
+		std::fputs(llvm::toString(session.takeError()).c_str(), stderr);
+		std::_Exit(EXIT_FAILURE);
+	}
+
+	auto ctx = gen::CodeGen::lower(module);
+	if (auto err = session.get()->addModule(*ctx)) {
+		std::fputs(llvm::toString(std::move(err)).c_str(), stderr);
+		std::_Exit(EXIT_FAILURE);
+	}
+
+	const auto before = s_LiveCells;
+	auto exitCode = session.get()->runMain("test", {});
+	if (!exitCode) {
+		std::fputs(llvm::toString(exitCode.takeError()).c_str(), stderr);
+		std::_Exit(EXIT_FAILURE);
+	}
+
+	leakedCells = s_LiveCells - before;
+	return exitCode.get();
+}
+
+std::string readAll(FILE *file) {
+	std::string content;
+	std::rewind(file);
+
+	for (int c = std::fgetc(file); c != EOF; c = std::fgetc(file)) {
+		content += static_cast<char>(c);
+	}
+
+	std::fclose(file);
+	return content;
+}
+
+/// Runs the program in a child process, panics abort the process that runs them.
+Run run(Backend backend, const ast::Module &module) {
+	FILE *out = std::tmpfile();
+	FILE *err = std::tmpfile();
+	int leaks[2];
+	REQUIRE(out != nullptr);
+	REQUIRE(err != nullptr);
+	REQUIRE(pipe(leaks) == 0);
+
+	std::fflush(stdout);
+	std::fflush(stderr);
+	const pid_t pid = fork();
+	REQUIRE(pid >= 0);
+
+	if (pid == 0) {
+		dup2(fileno(out), STDOUT_FILENO);
+		dup2(fileno(err), STDERR_FILENO);
+		close(leaks[0]);
+
+		i64 leakedCells = 0;
+		const auto exitCode = execute(backend, module, leakedCells);
+		std::fflush(stdout);
+
+		if (write(leaks[1], &leakedCells, sizeof(leakedCells)) != sizeof(leakedCells)) {
+			std::_Exit(EXIT_FAILURE);
+		}
+
+		std::_Exit(exitCode);
+	}
+
+	close(leaks[1]);
+	Run result{.panicked = false, .exitCode = 0, .out = {}, .err = {}, .leakedCells = 0};
+
+	// A panic aborts before the count is written.
+	if (read(leaks[0], &result.leakedCells, sizeof(result.leakedCells)) !=
+		sizeof(result.leakedCells)) {
+		result.leakedCells = -1;
+	}
+
+	close(leaks[0]);
+
+	int status = 0;
+	REQUIRE(waitpid(pid, &status, 0) == pid);
+	result.panicked = WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+	result.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	result.out = readAll(out);
+	result.err = readAll(err);
+	return result;
+}
+
+/// Runs the program on the JIT and on the VM, which have to agree on everything it does.
+Run runOnBoth(const U8String &source) {
+	const auto module =
+			test::checkSource(source, {.constantEvaluation = true, .effectAnalysis = true});
+	auto jit = run(Backend::Jit, *module);
+	const auto vm = run(Backend::Vm, *module);
+
+	CHECK(vm.panicked == jit.panicked);
+	CHECK(vm.exitCode == jit.exitCode);
+	CHECK(vm.out == jit.out);
+	CHECK(vm.err == jit.err);
+	CHECK(vm.leakedCells == jit.leakedCells);
+	return jit;
+}
+}
+
+TEST_CASE("Interpreter: && and || skip their right operand like compiled code") {
+	// Arrange & Act
+	const auto result = runOnBoth(u8"func loud(b: bool) -> bool {\n"
+								  "\tprint_bool(b);\n"
+								  "\tprint_char(' ');\n"
+								  "\treturn b;\n"
+								  "}\n"
+								  "func main() -> i32 {\n"
+								  "\tp: *i32 = null;\n"
+								  "\tif (p != null && *p > 0) {\n"
+								  "\t\tprint_i32(1);\n"
+								  "\t}\n"
+								  "\tif (loud(false) && loud(true)) {\n"
+								  "\t\tprint_i32(2);\n"
+								  "\t}\n"
+								  "\tif (loud(true) || loud(false)) {\n"
+								  "\t\tprint_i32(3);\n"
+								  "\t}\n"
+								  "\treturn 0;\n"
+								  "}\n");
+
+	// Assert
+	CHECK_FALSE(result.panicked);
+	CHECK(result.out == "false true 3");
+	CHECK(result.leakedCells == 0);
+}
+
+TEST_CASE("Interpreter: Borrowed parameters see the values of the caller") {
+	// Arrange & Act
+	const auto result = runOnBoth(u8"struct VmListNode {\n"
+								  "\tvalue: i32,\n"
+								  "\tnext: *VmListNode\n"
+								  "}\n"
+								  "func sumList(node: &*VmListNode) -> i32 {\n"
+								  "\tif (node == null) {\n"
+								  "\t\treturn 0;\n"
+								  "\t}\n"
+								  "\treturn *node.value + sumList(*node.next);\n"
+								  "}\n"
+								  "func total(xs: &[]i32) -> i32 {\n"
+								  "\ts: i32 = 0;\n"
+								  "\ti: i32 = 0;\n"
+								  "\twhile (i < len(xs)) {\n"
+								  "\t\ts += xs[i];\n"
+								  "\t\ti += 1;\n"
+								  "\t}\n"
+								  "\treturn s;\n"
+								  "}\n"
+								  "func main() -> i32 {\n"
+								  "\tlist: *VmListNode = new VmListNode { 1, new VmListNode { 2, null } };\n"
+								  "\txs: []i32 = array[3]i32;\n"
+								  "\txs[0] = 10;\n"
+								  "\txs[2] = 30;\n"
+								  "\tprint_i32(sumList(list));\n"
+								  "\tprint_char(' ');\n"
+								  "\tprint_i32(total(xs));\n"
+								  "\treturn len(xs);\n"
+								  "}\n");
+
+	// Assert
+	CHECK_FALSE(result.panicked);
+	CHECK(result.exitCode == 3);
+	CHECK(result.out == "3 40");
+	CHECK(result.leakedCells == 0);
+}
+
+TEST_CASE("Interpreter: popcount counts the set flags of a bool array") {
+	// Arrange & Act
+	const auto result = runOnBoth(u8"func main() -> i32 {\n"
+								  "\tflags: []bool = array[10]bool;\n"
+								  "\ti: i32 = 0;\n"
+								  "\twhile (i < len(flags)) {\n"
+								  "\t\tflags[i] = i < 3 || i == 7;\n"
+								  "\t\ti += 1;\n"
+								  "\t}\n"
+								  "\tflags[0] = false;\n"
+								  "\treturn popcount(flags);\n"
+								  "}\n");
+
+	// Assert
+	CHECK_FALSE(result.panicked);
+	CHECK(result.exitCode == 3);
+	CHECK(result.leakedCells == 0);
+}
+
+TEST_CASE("Interpreter: Indexing past the end panics like compiled code") {
+	// Arrange & Act
+	const auto result = runOnBoth(u8"func at(xs: []i32, i: i32) -> i32 {\n"
+								  "\treturn xs[i];\n"
+								  "}\n"
+								  "func main() -> i32 {\n"
+								  "\txs: []i32 = array[2]i32;\n"
+								  "\treturn at(xs, len(xs));\n"
+								  "}\n");
+
+	// Assert
+	CHECK(result.panicked);
+	CHECK(result.err == "panic: array out of bounds\n");
+}
+
+TEST_CASE("Interpreter: Dereferencing null panics like compiled code") {
+	// Arrange & Act
+	const auto result = runOnBoth(u8"func get(p: *i32) -> i32 {\n"
+								  "\treturn *p;\n"
+								  "}\n"
+								  "func main() -> i32 {\n"
+								  "\tp: *i32 = new i32(1);\n"
+								  "\tprint_i32(get(p));\n"
+								  "\tp = null;\n"
+								  "\treturn get(p);\n"
+								  "}\n");
+
+	// Assert
+	CHECK(result.panicked);
+	CHECK(result.err == "panic: null pointer dereference\n");
+}
+
+TEST_CASE("Interpreter: Dropping structs runs the destructors of their fields") {
+	// Arrange & Act
+	const auto result = runOnBoth(u8"struct VmInner {\n"
+								  "\tp: *i32\n"
+								  "}\n"
+								  "struct VmOuter {\n"
+								  "\tinner: VmInner,\n"
+								  "\titems: []*VmInner,\n"
+								  "\tnext: *VmOuter\n"
+								  "}\n"
+								  "func build(n: i32) -> *VmOuter {\n"
+								  "\tif (n == 0) {\n"
+								  "\t\treturn null;\n"
+								  "\t}\n"
+								  "\to: *VmOuter = new VmOuter { VmInner { new i32(n) }, array[2]*VmInner, "
+								  "build(n - 1) };\n"
+								  "\t*o.items[0] = new VmInner { new i32(n * 10) };\n"
+								  "\treturn o;\n"
+								  "}\n"
+								  "func main() -> i32 {\n"
+								  "\to: *VmOuter = build(3);\n"
+								  "\tfirst: *VmInner = *o.items[0];\n"
+								  "\tprint_i32(*(*o.inner.p) + *(*first.p));\n"
+								  "\tvalue: VmInner = *first;\n"
+								  "\to = null;\n"
+								  "\tfirst = null;\n"
+								  "\treturn *(value.p);\n"
+								  "}\n");
+
+	// Assert
+	CHECK_FALSE(result.panicked);
+	CHECK(result.exitCode == 30);
+	CHECK(result.out == "33");
+	CHECK(result.leakedCells == 0);
+}
+
+TEST_CASE("Interpreter: Bool arrays keep their flags across word boundaries like compiled code") {
+	// Arrange & Act
+	const auto result = runOnBoth(u8"func show(b: bool) {\n"
+								  "\tprint_bool(b);\n"
+								  "\tprint_char(' ');\n"
+								  "}\n"
+								  "func main() -> i32 {\n"
+								  "\tflags: []bool = array[130]bool;\n"
+								  "\tflags[63] = true;\n"
+								  "\tflags[64] = true;\n"
+								  "\tflags[127] = true;\n"
+								  "\tflags[128] = true;\n"
+								  "\tflags[129] = true;\n"
+								  "\tflags[64] = false;\n"
+								  "\tshow(flags[62]);\n"
+								  "\tshow(flags[63]);\n"
+								  "\tshow(flags[64]);\n"
+								  "\tshow(flags[65]);\n"
+								  "\tshow(flags[129]);\n"
+								  "\tprint_i32(len(flags));\n"
+								  "\tprint_char(' ');\n"
+								  "\tall: []bool = array[65]bool;\n"
+								  "\ti: i32 = 0;\n"
+								  "\twhile (i < len(all)) {\n"
+								  "\t\tall[i] = true;\n"
+								  "\t\ti += 1;\n"
+								  "\t}\n"
+								  "\tprint_i32(popcount(all));\n"
+								  "\treturn popcount(flags);\n"
+								  "}\n");
+
+	// Assert
+	CHECK_FALSE(result.panicked);
+	CHECK(result.exitCode == 4);
+	CHECK(result.out == "false true false false true 130 65");
+	CHECK(result.leakedCells == 0);
+}